@@ -87,6 +87,9 @@ Do the following when updating NewtonDynamics:
 #include <set>
 #include <map>
 #include <vector>
+#include <string>
+#include <new>
+#include <utility>
 
 // Comment out if SDL is not needed
 #define MSP_USE_SDL
@@ -94,6 +97,11 @@ Do the following when updating NewtonDynamics:
 #define MSP_NON_COL_CONTACTS_CAPACITY 16
 #define MSP_MAX_RAY_HITS              256
 
+// Use SSE in bulk queries when dFloat is single precision.
+#if !defined(_NEWTON_USE_DOUBLE) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+    #define MSP_USE_SSE
+#endif
+
 namespace MSP {
     // Classes
     class Newton;
@@ -127,6 +135,282 @@ namespace MSP {
 
     // Structures
 
+    // Maps handles, passed to Ruby as integers, to objects. The lower 24 bits
+    // of a handle store the slot index and the bits above store the slot
+    // generation, which is advanced whenever the slot is released. This way,
+    // handles of destroyed objects are rejected with a single array lookup.
+    // Handles stay Fixnums on 64-bit Ruby, and on 32-bit Ruby until a slot
+    // has been reused 63 times.
+    template<typename T>
+    class HandleTable {
+    public:
+        HandleTable() :
+            m_free_index(INVALID_INDEX),
+            m_count(0)
+        {
+        }
+
+        unsigned long long insert(T object) {
+            unsigned int index;
+            if (m_free_index != INVALID_INDEX) {
+                index = m_free_index;
+                m_free_index = m_slots[index].m_next_free;
+            }
+            else {
+                if (m_slots.size() > INDEX_MASK)
+                    rb_raise(rb_eRangeError, "Too many objects!");
+                index = static_cast<unsigned int>(m_slots.size());
+                m_slots.push_back(Slot());
+            }
+            Slot& slot = m_slots[index];
+            slot.m_object = object;
+            slot.m_next_free = INVALID_INDEX;
+            ++m_count;
+            return (static_cast<unsigned long long>(slot.m_generation) << INDEX_BITS) | index;
+        }
+
+        bool erase(unsigned long long handle) {
+            if (!is_valid(handle))
+                return false;
+            unsigned int index = static_cast<unsigned int>(handle & INDEX_MASK);
+            Slot& slot = m_slots[index];
+            slot.m_object = nullptr;
+            // Generation zero is skipped so that a zero handle is never valid.
+            if (++slot.m_generation == 0)
+                slot.m_generation = 1;
+            slot.m_next_free = m_free_index;
+            m_free_index = index;
+            --m_count;
+            return true;
+        }
+
+        bool is_valid(unsigned long long handle) const {
+            unsigned int index = static_cast<unsigned int>(handle & INDEX_MASK);
+            return index < m_slots.size() &&
+                m_slots[index].m_generation == handle >> INDEX_BITS &&
+                m_slots[index].m_object != nullptr;
+        }
+
+        // Returns the referenced object or null if the handle is stale.
+        T find(unsigned long long handle) const {
+            return is_valid(handle) ? m_slots[static_cast<unsigned int>(handle & INDEX_MASK)].m_object : nullptr;
+        }
+
+        // Slot access for iteration; released slots hold null.
+        T at(unsigned int index) const {
+            return m_slots[index].m_object;
+        }
+
+        // Reserves room for the given number of insertions.
+        void reserve(unsigned int count) {
+            m_slots.reserve(m_count + count);
+        }
+
+        unsigned int capacity() const {
+            return static_cast<unsigned int>(m_slots.size());
+        }
+
+        unsigned int size() const {
+            return m_count;
+        }
+
+        bool empty() const {
+            return m_count == 0;
+        }
+
+    private:
+        static const unsigned int INVALID_INDEX = 0xFFFFFFFF;
+        static const unsigned int INDEX_BITS = 24;
+        static const unsigned int INDEX_MASK = (1 << INDEX_BITS) - 1;
+
+        struct Slot {
+            T m_object;
+            unsigned int m_generation;
+            unsigned int m_next_free;
+            Slot() :
+                m_object(nullptr),
+                m_generation(1),
+                m_next_free(INVALID_INDEX)
+            {
+            }
+        };
+
+        std::vector<Slot> m_slots;
+        unsigned int m_free_index;
+        unsigned int m_count;
+    };
+
+    // Allocates objects from contiguous chunks, so that objects created
+    // together lie next to each other in memory. Addresses are stable and
+    // released slots are reused through a free list. Chunks are freed with
+    // the pool; all objects must be destroyed before that.
+    template<typename T, unsigned int CHUNK_SIZE = 64>
+    class ObjectPool {
+    public:
+        ObjectPool() :
+            m_free(nullptr),
+            m_count(0)
+        {
+        }
+
+        ~ObjectPool() {
+            for (typename std::vector<Node*>::iterator it = m_chunks.begin(); it != m_chunks.end(); ++it)
+                delete[] *it;
+        }
+
+        template<typename... Args>
+        T* create(Args&&... args) {
+            if (m_free == nullptr) {
+                Node* chunk = new Node[CHUNK_SIZE];
+                // Link in reverse, so that slots are handed out in address order.
+                for (unsigned int i = CHUNK_SIZE; i > 0; --i) {
+                    chunk[i - 1].m_next = m_free;
+                    m_free = &chunk[i - 1];
+                }
+                m_chunks.push_back(chunk);
+            }
+            Node* node = m_free;
+            m_free = node->m_next;
+            ++m_count;
+            return new (node->m_storage) T(std::forward<Args>(args)...);
+        }
+
+        void destroy(T* object) {
+            object->~T();
+            Node* node = reinterpret_cast<Node*>(object);
+            node->m_next = m_free;
+            m_free = node;
+            --m_count;
+        }
+
+        unsigned int size() const {
+            return m_count;
+        }
+
+    private:
+        union Node {
+            Node* m_next;
+            alignas(T) char m_storage[sizeof(T)];
+        };
+
+        std::vector<Node*> m_chunks;
+        Node* m_free;
+        unsigned int m_count;
+
+        // Non-copyable
+        ObjectPool(const ObjectPool&);
+        ObjectPool& operator=(const ObjectPool&);
+    };
+
+    // Links an object into an IntrusiveList. An object embeds one link for
+    // each list it can be on.
+    template<typename T>
+    struct ListLink {
+        T* m_prev;
+        T* m_next;
+        bool m_linked;
+        ListLink() :
+            m_prev(nullptr),
+            m_next(nullptr),
+            m_linked(false)
+        {
+        }
+    };
+
+    // Doubly linked list threaded through the objects themselves, so that
+    // insertion and removal are constant time and allocate nothing. Objects
+    // are kept in insertion order.
+    template<typename T, ListLink<T> T::*LINK>
+    class IntrusiveList {
+    public:
+        IntrusiveList() :
+            m_first(nullptr),
+            m_last(nullptr),
+            m_count(0)
+        {
+        }
+
+        ~IntrusiveList() {
+            clear();
+        }
+
+        void push_back(T* object) {
+            ListLink<T>& link = object->*LINK;
+            link.m_prev = m_last;
+            link.m_next = nullptr;
+            link.m_linked = true;
+            if (m_last != nullptr)
+                (m_last->*LINK).m_next = object;
+            else
+                m_first = object;
+            m_last = object;
+            ++m_count;
+        }
+
+        // Does nothing if the object is not linked.
+        void remove(T* object) {
+            ListLink<T>& link = object->*LINK;
+            if (!link.m_linked)
+                return;
+            if (link.m_prev != nullptr)
+                (link.m_prev->*LINK).m_next = link.m_next;
+            else
+                m_first = link.m_next;
+            if (link.m_next != nullptr)
+                (link.m_next->*LINK).m_prev = link.m_prev;
+            else
+                m_last = link.m_prev;
+            link.m_prev = nullptr;
+            link.m_next = nullptr;
+            link.m_linked = false;
+            --m_count;
+        }
+
+        // Unlinks all objects.
+        void clear() {
+            T* object = m_first;
+            while (object != nullptr) {
+                ListLink<T>& link = object->*LINK;
+                object = link.m_next;
+                link.m_prev = nullptr;
+                link.m_next = nullptr;
+                link.m_linked = false;
+            }
+            m_first = nullptr;
+            m_last = nullptr;
+            m_count = 0;
+        }
+
+        static bool is_linked(const T* object) {
+            return (object->*LINK).m_linked;
+        }
+
+        static T* next(const T* object) {
+            return (object->*LINK).m_next;
+        }
+
+        T* first() const {
+            return m_first;
+        }
+
+        unsigned int size() const {
+            return m_count;
+        }
+
+        bool empty() const {
+            return m_count == 0;
+        }
+
+    private:
+        T* m_first;
+        T* m_last;
+        unsigned int m_count;
+
+        // Non-copyable
+        IntrusiveList(const IntrusiveList&);
+        IntrusiveList& operator=(const IntrusiveList&);
+    };
+
     // Ruby Functions
     VALUE rbf_is_sdl_used(VALUE self);
 
@@ -37,6 +37,8 @@ const dFloat MSP::Body::MIN_VOLUME(1.0e-6f);
 const dFloat MSP::Body::MAX_VOLUME(1.0e14f);
 const dFloat MSP::Body::MIN_DENSITY(1.0e-6f);
 const dFloat MSP::Body::MAX_DENSITY(1.0e14f);
+const int MSP::Body::FORCE_DAMPED(1);
+const int MSP::Body::FORCE_PENDING(2);
 
 
 /*
@@ -45,7 +47,7 @@ const dFloat MSP::Body::MAX_DENSITY(1.0e14f);
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 */
 
-std::set<const NewtonBody*> MSP::Body::s_valid_bodies;
+MSP::HandleTable<const NewtonBody*> MSP::Body::s_valid_bodies;
 
 
 /*
@@ -59,17 +61,22 @@ void MSP::Body::destructor_callback(const NewtonBody* const body) {
     const NewtonWorld* world = NewtonBodyGetWorld(body);
     MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world));
     c_clear_non_collidable_bodies(body);
-    if (s_valid_bodies.find(body) != s_valid_bodies.end())
-        s_valid_bodies.erase(body);
-    if (body_data->m_group != Qnil && world_data->m_group_to_body_map.find(body_data->m_group) != world_data->m_group_to_body_map.end())
-        world_data->m_group_to_body_map.erase(body_data->m_group);
-    if (body_data->m_destructor_proc != Qnil)
-        rb_rescue2(RUBY_METHOD_FUNC(Util::call_proc), body_data->m_destructor_proc, RUBY_METHOD_FUNC(Util::rescue_proc), Qnil, rb_eException, (VALUE)0);
+    s_valid_bodies.erase(body_data->m_handle);
+    MSP::World::c_invalidate_body_snapshot(world);
+    // Detach joints; connected ones are disconnected by Newton after this callback.
+    for (MSP::Joint::JointData* joint_data = body_data->m_cold->m_contained_joints.first(); joint_data != nullptr; joint_data = MSP::Joint::ParentJointList::next(joint_data))
+        joint_data->m_parent = nullptr;
+    body_data->m_cold->m_contained_joints.clear();
+    body_data->m_cold->m_connected_joints.clear();
+    if (body_data->m_cold->m_group != Qnil && world_data->m_group_to_body_map.find(body_data->m_cold->m_group) != world_data->m_group_to_body_map.end())
+        world_data->m_group_to_body_map.erase(body_data->m_cold->m_group);
+    if (body_data->m_cold->m_destructor_proc != Qnil)
+        rb_rescue2(RUBY_METHOD_FUNC(Util::call_proc), body_data->m_cold->m_destructor_proc, RUBY_METHOD_FUNC(Util::rescue_proc), Qnil, rb_eException, (VALUE)0);
     VALUE v_body = c_body_to_value(body);
     rb_hash_delete(world_data->m_body_destructors, v_body);
     rb_hash_delete(world_data->m_body_user_datas, v_body);
     rb_hash_delete(world_data->m_body_groups, v_body);
-    delete body_data;
+    world_data->m_body_pool.destroy(body_data);
 }
 
 void MSP::Body::transform_callback(const NewtonBody* const body, const dFloat* const matrix, int thread_index) {
@@ -82,71 +89,46 @@ void MSP::Body::force_and_torque_callback(const NewtonBody* const body, dFloat t
     MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world));
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
 
-    dMatrix transformation_matrix;
-    dFloat mass;
-    dVector inertia;
-    NewtonBodyGetMass(body, &mass, &inertia.m_x, &inertia.m_y, &inertia.m_z);
-    NewtonBodyGetMatrix(body, &transformation_matrix[0][0]);
-
-    // Gravity
-    if (body_data->m_gravity_enabled) {
-        dVector force(world_data->m_gravity.Scale(mass));
-        NewtonBodyAddForce(body, &force[0]);
-    }
-    // Linear damping
-    if (body_data->m_linear_damping_enabled) {
+    // Gravity; the scale is zero when gravity is disabled.
+    dVector force(world_data->m_gravity.Scale(body_data->m_gravity_scale));
+    dVector torque(0.0f);
+    // Damping, applied along the local axes
+    if ((body_data->m_force_flags & FORCE_DAMPED) != 0) {
+        dMatrix matrix;
         dVector velocity;
-        NewtonBodyGetVelocity(body, &velocity[0]);
-        velocity = transformation_matrix.UnrotateVector(velocity);
-
-        dVector viscous_force(
-            -velocity.m_x * body_data->m_linear_damping.m_x * mass,
-            -velocity.m_y * body_data->m_linear_damping.m_y * mass,
-            -velocity.m_z * body_data->m_linear_damping.m_z * mass);
-        viscous_force = transformation_matrix.RotateVector(viscous_force);
-        NewtonBodyAddForce(body, &viscous_force[0]);
-    }
-    // Angular damping
-    if (body_data->m_angular_damping_enabled) {
         dVector omega;
+        NewtonBodyGetMatrix(body, &matrix[0][0]);
+        NewtonBodyGetVelocity(body, &velocity[0]);
         NewtonBodyGetOmega(body, &omega[0]);
-        omega = transformation_matrix.UnrotateVector(omega);
-        dVector viscous_torque(
-            -omega.m_x * body_data->m_angular_damping.m_x * inertia.m_x,
-            -omega.m_y * body_data->m_angular_damping.m_y * inertia.m_y,
-            -omega.m_z * body_data->m_angular_damping.m_z * inertia.m_z);
-        viscous_torque = transformation_matrix.RotateVector(viscous_torque);
-        NewtonBodyAddTorque(body, &viscous_torque[0]);
-    }
-    // Other forces
-    if (body_data->m_set_force_state) {
-        NewtonBodySetForce(body, &body_data->m_set_force[0]);
-        body_data->m_set_force_state = false;
-    }
-    if (body_data->m_add_force_state) {
-        NewtonBodyAddForce(body, &body_data->m_add_force[0]);
-        body_data->m_add_force_state = false;
-    }
-    if (body_data->m_set_torque_state) {
-        NewtonBodySetTorque(body, &body_data->m_set_torque[0]);
-        body_data->m_set_torque_state = false;
-    }
-    if (body_data->m_add_torque_state) {
-        NewtonBodyAddTorque(body, &body_data->m_add_torque[0]);
-        body_data->m_add_torque_state = false;
+        velocity = matrix.UnrotateVector(velocity);
+        omega = matrix.UnrotateVector(omega);
+        const dVector& linear_drag = body_data->m_linear_drag;
+        const dVector& angular_drag = body_data->m_angular_drag;
+        force -= matrix.RotateVector(dVector(velocity.m_x * linear_drag.m_x, velocity.m_y * linear_drag.m_y, velocity.m_z * linear_drag.m_z));
+        torque -= matrix.RotateVector(dVector(omega.m_x * angular_drag.m_x, omega.m_y * angular_drag.m_y, omega.m_z * angular_drag.m_z));
     }
+    // Fluid volumes of the world
+    if (!world_data->m_fluid_volumes.empty() && !body_data->m_bstatic)
+        c_apply_fluid_volumes(body, timestep, force, torque);
+    // Forces and torques set or added by the user
+    if ((body_data->m_force_flags & FORCE_PENDING) != 0)
+        c_apply_pending_forces(body_data, force, torque);
+
+    NewtonBodyAddForce(body, &force[0]);
+    NewtonBodyAddTorque(body, &torque[0]);
 }
 
 void MSP::Body::collision_iterator(void* const user_data, int vertex_count, const dFloat* const face_array, int face_id) {
+    if (vertex_count <= 0) return;
     CollisionIteratorData* data = reinterpret_cast<CollisionIteratorData*>(user_data);
-    VALUE v_face = rb_ary_new2(vertex_count);
-    unsigned int j = 0;
-    for (int i = 0; i < vertex_count; ++i) {
-        dVector vertex(face_array[j], face_array[j + 1], face_array[j + 2]);
-        rb_ary_store(v_face, i, Util::point_to_value(vertex));
-        j += 3;
-    }
-    rb_ary_push(data->m_faces, v_face);
+    std::vector<dVector>& vertices = data->m_vertices;
+    vertices.clear();
+    for (int i = 0; i < vertex_count * 3; i += 3)
+        vertices.push_back(dVector(face_array[i], face_array[i + 1], face_array[i + 2]));
+    if (data->m_packed)
+        rb_ary_push(data->m_faces, Util::points_to_packed(&vertices[0], vertex_count));
+    else
+        rb_ary_push(data->m_faces, Util::points_to_value(&vertices[0], vertex_count));
 }
 
 void MSP::Body::collision_iterator2(void* const user_data, int vertex_count, const dFloat* const face_array, int face_id) {
@@ -249,217 +231,104 @@ void MSP::Body::collision_iterator3(void* const user_data, int vertex_count, con
     delete[] vertices;
 }
 
-void MSP::Body::collision_iterator4(void* const user_data, int vertex_count, const dFloat* const face_array, int face_id) {
-    CollisionIteratorData2* ci_data = reinterpret_cast<CollisionIteratorData2*>(user_data);
-    // Convert face array into points
-    std::map<unsigned int, dVector> vertices;
-    unsigned int j = 0;
-    for (int i = 0; i < vertex_count; ++i) {
-        vertices[i] = dVector(face_array[j], face_array[j + 1], face_array[j + 2]);
-        j += 3;
+/*
+ ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+  Helper Functions
+ ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+unsigned int MSP::Body::TouchersTable::c_hash(const NewtonBody* body) {
+    unsigned long long address = reinterpret_cast<unsigned long long>(body);
+    return static_cast<unsigned int>(((address >> 4) ^ (address >> 20)) * 2654435761ULL);
+}
+
+char* MSP::Body::TouchersTable::find(const NewtonBody* body) {
+    if (m_count == 0) return nullptr;
+    unsigned int mask = capacity() - 1;
+    for (unsigned int i = c_hash(body) & mask; ; i = (i + 1) & mask) {
+        Entry& entry = m_entries[i];
+        if (entry.m_body == body) return &entry.m_state;
+        if (entry.m_body == nullptr) return nullptr;
     }
-    // Calculate face normal
-    dVector normal((vertices[1] - vertices[0]).CrossProduct(vertices[2] - vertices[0]));
-    dFloat normal_mag = Util::get_vector_magnitude(normal);
-    if (normal_mag < 1.0e-6f) return;
-    Util::scale_vector(normal, 1.0f / normal_mag);
-    // Face matrix from normal
-    dMatrix face_matrix;
-    Util::matrix_from_pin_dir(vertices[0], normal, face_matrix);
-    // Convert face array into points
-    std::map<unsigned int, dVector> local_vertices;
-    for (std::map<unsigned int, dVector>::const_iterator it = vertices.begin(); it != vertices.end(); ++it) {
-        local_vertices[it->first] = face_matrix.UntransformVector(it->second);
-    }
-    // Calculate relative velocity
-    dFloat lv = ci_data->m_velocity.DotProduct3(normal);
-    //dFloat lo = data->omega.DotProduct3(normal);
-    // For every triangle
-    for (int i = 1; i < vertex_count - 1; ++i) {
-        // Calculate face area and centroid
-        const dVector& p0 = local_vertices[0];
-        const dVector& p1 = local_vertices[i];
-        const dVector& p2 = local_vertices[i+1];
-        dFloat a = p0.m_x*p1.m_y - p1.m_x*p0.m_y;
-        dFloat b = p1.m_x*p2.m_y - p2.m_x*p1.m_y;
-        dFloat c = p2.m_x*p0.m_y - p0.m_x*p2.m_y;
-        dFloat signed_area = (a + b + c) * 0.5f;
-        dVector centroid((p0.m_x + p1.m_x)*a + (p1.m_x + p2.m_x)*b + (p2.m_x + p0.m_x)*c, (p0.m_y + p1.m_y)*a + (p1.m_y + p2.m_y)*b + (p2.m_y + p0.m_y)*c, vertices[0].m_z);
-        dFloat cscale = 1.0f / (6.0f * signed_area);
-        centroid.m_x *= cscale;
-        centroid.m_y *= cscale;
-        centroid = face_matrix.TransformVector(centroid);
-        // Apply force and torque from linear velocity
-        if (lv > 0.0f) {
-            // Calculate the necessary force on face
-            dVector point_force(normal.Scale(-dAbs(signed_area) * lv * lv * ci_data->m_drag));
-            // Add point force
-            ci_data->m_force += point_force;
-            dVector r(centroid - ci_data->m_centre);
-            ci_data->m_torque += r.CrossProduct(point_force);
+}
+
+void MSP::Body::TouchersTable::set(const NewtonBody* body, char state) {
+    // Keep the load factor at or below one half.
+    if ((m_count + 1) * 2 > capacity()) {
+        std::vector<Entry> entries;
+        entries.swap(m_entries);
+        Entry empty_entry = { nullptr, 0 };
+        m_entries.assign(entries.empty() ? 8 : entries.size() * 2, empty_entry);
+        m_count = 0;
+        for (std::vector<Entry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+            if (it->m_body != nullptr)
+                set(it->m_body, it->m_state);
         }
-        // Apply force and torque from angular velocity
-        /*if (dAbs(lo) < 0.9999995f) {
-            dFloat qmag = Util::get_vector_magnitude(data->omega);
-            if (qmag > 1.0e-6f) {
-                dVector dir(centroid - data->centre);
-                dFloat dir_mag = Util::get_vector_magnitude(dir);
-                dVector xaxis(data->omega);
-                Util::scale_vector(xaxis, 1.0f / qmag);
-                dVector yaxis;
-                dVector zaxis;
-                if (dir_mag < 1.0e-6f) {
-                    yaxis = normal;
-                    zaxis = xaxis.CrossProduct(yaxis);
-                    Util::normalize_vector(zaxis);
-                }
-                else {
-                    zaxis = dir.CrossProduct(xaxis);
-                    Util::normalize_vector(zaxis);
-                    yaxis = xaxis.CrossProduct(zaxis);
-                    Util::normalize_vector(yaxis);
-                }
-                dMatrix omega_matrix(xaxis, yaxis, zaxis, centroid);
-                dVector q1(omega_matrix.UntransformVector(vertices[0]));
-                dVector q2(omega_matrix.UntransformVector(vertices[i]));
-                dVector q3(omega_matrix.UntransformVector(vertices[i+1]));
-                dVector qnormal(omega_matrix.UnrotateVector(normal));
-                // Calculate the necessary force on face
-                dFloat point_force_mag = -qnormal.m_z * qmag * qmag / 6.0f *
-                (q1.m_x * (q3.m_y*q3.m_y + q1.m_y*q3.m_y - q1.m_y*q2.m_y - q2.m_y*q2.m_y) +
-                 q2.m_x * (q1.m_y*q1.m_y + q2.m_y*q1.m_y - q2.m_y*q3.m_y - q3.m_y*q3.m_y) +
-                 q3.m_x * (q2.m_y*q2.m_y + q3.m_y*q2.m_y - q3.m_y*q1.m_y - q1.m_y*q1.m_y));
-                dVector point_force(normal.Scale(point_force_mag));
-                // Add point force
-                data->force += point_force;
-                dVector r(centroid - data->centre);
-                data->torque += r.CrossProduct(point_force);
-            }
-        }*/
-    }
-    // Apply force and torque from linear velocity
-    /*if (lv > 0.0f) {
-        // Transform points with respect to face normal
-        std::map<unsigned int, dVector> vertices;
-        dMatrix face_matrix;
-        Util::matrix_from_pin_dir(Util::ORIGIN, normal, face_matrix);
-        for (int i = 0; i < vertex_count * 3; i += 3) {
-            dVector vertex(face_matrix.UntransformVector(dVector(face_array[i], face_array[i+1], face_array[i+2])));
-            vertices[i] = vertex;
+    }
+    unsigned int mask = capacity() - 1;
+    for (unsigned int i = c_hash(body) & mask; ; i = (i + 1) & mask) {
+        Entry& entry = m_entries[i];
+        if (entry.m_body == body) {
+            entry.m_state = state;
+            return;
         }
-        // Calculate face area and centroid
-        dVector centroid(0.0f, 0.0f, vertices[0].m_z);
-        dFloat signed_area = 0.0f;
-        for (unsigned int i = 0; i < vertex_count; ++i) {
-            const dFloat& x0 = vertices[i].m_x;
-            const dFloat& y0 = vertices[i].m_y;
-            const dFloat& x1 = vertices[(i+1) % vertex_count].m_x;
-            const dFloat& y1 = vertices[(i+1) % vertex_count].m_y;
-            dFloat a = x0*y1 - x1*y0;
-            signed_area += a;
-            centroid.m_x += (x0 + x1)*a;
-            centroid.m_y += (y0 + y1)*a;
+        if (entry.m_body == nullptr) {
+            entry.m_body = body;
+            entry.m_state = state;
+            ++m_count;
+            return;
         }
-        signed_area *= 0.5f;
-        dFloat scale = 1.0f / (6.0f * signed_area);
-        centroid.m_x *= scale;
-        centroid.m_y *= scale;
-        centroid = face_matrix.TransformVector(centroid);
-        // Calculate the necessary force on face
-        dVector point_force(normal.Scale(-signed_area * lv * lv * data->drag));
-        // Add point force
-        data->force += point_force;
-        dVector r(centroid - data->centre);
-        data->torque += r.CrossProduct(point_force);
-    }*/
-    // Calculate face normal
-    /*dVector p1(face_array[0], face_array[1], face_array[2]);
-    dVector p2(face_array[3], face_array[4], face_array[5]);
-    dVector p3(face_array[6], face_array[7], face_array[8]);
-    dVector normal((p2 - p1).CrossProduct(p3 - p1));
-    dFloat normal_mag = Util::get_vector_magnitude(normal);
-    if (normal_mag < M_EPSILON) return;
-    Util::normalize_vector(normal);
-    // Transform points with respect to face normal
-    std::vector<dVector> vertices;
-    dMatrix face_matrix;
-    Util::matrix_from_pin_dir(Util::ORIGIN, normal, face_matrix);
-    for (int i = 0; i < vertex_count; ++i) {
-        dVector vertex(face_matrix.UntransformVector(dVector(face_array[i*3+0], face_array[i*3+1], face_array[i*3+2])));
-        vertices.push_back(vertex);
-    }
-    // Calculate face area and centroid
-    dVector centroid(0.0f, 0.0f, vertices[0].m_z);
-    dFloat signed_area = 0.0f;
-    for (int i = 0; i < vertex_count; ++i) {
-        const dFloat& x0 = vertices[i].m_x;
-        const dFloat& y0 = vertices[i].m_y;
-        const dFloat& x1 = vertices[(i+1) % vertex_count].m_x;
-        const dFloat& y1 = vertices[(i+1) % vertex_count].m_y;
-        dFloat a = x0*y1 - x1*y0;
-        signed_area += a;
-        centroid.m_x += (x0 + x1)*a;
-        centroid.m_y += (y0 + y1)*a;
     }
-    signed_area *= 0.5f;
-    dFloat scale = 1.0f / (6.0f * signed_area);
-    centroid.m_x *= scale;
-    centroid.m_y *= scale;
-    centroid = face_matrix.TransformVector(centroid);
-    // Calculate point force
-    dVector point_veloc;
-    NewtonBodyGetPointVelocity(data->body, &centroid[0], &point_veloc[0]);
-    if (!Util::is_vector_valid(point_veloc)) return;
-    dFloat veloc_mag = Util::get_vector_magnitude(point_veloc);
-    if (veloc_mag < M_EPSILON) return;
-    dFloat cos_theta = normal.DotProduct3(point_veloc) / veloc_mag;
-    if (cos_theta < M_EPSILON) return;
-    Util::scale_vector(point_veloc, 1.0f / veloc_mag);
-    dMatrix veloc_matrix;
-    Util::matrix_from_pin_dir(Util::ORIGIN, point_veloc, veloc_matrix);
-    dVector loc_normal(veloc_matrix.UnrotateVector(normal));
-    //if (loc_normal.m_z < M_EPSILON) return;
-    dFloat quantity = -dAbs(signed_area) * veloc_mag * veloc_mag * data->drag;
-    dVector point_force(loc_normal.Scale(quantity));
-    point_force = veloc_matrix.RotateVector(point_force);
-    //dVector loc_point_force(0.0f, 0.0f, -loc_normal.m_z * dAbs(signed_area) * data->density * veloc_mag);
-    //dVector point_force(veloc_matrix.RotateVector(loc_point_force));
-    // Add force and torque
-    data->force += point_force;
-    dVector r(centroid - data->centre);
-    data->torque += r.CrossProduct(point_force);
-    // Add additional rotational force.
-    //if (1.0f - cos_theta < M_EPSILON) return;
-    //dVector side_force(normal.CrossProduct(point_veloc));
-    //data->torque += r.CrossProduct(side_force.Scale(dAbs(signed_area) * veloc_mag * data->density));*/
 }
 
+void MSP::Body::TouchersTable::erase(const NewtonBody* body) {
+    if (m_count == 0) return;
+    unsigned int mask = capacity() - 1;
+    unsigned int i = c_hash(body) & mask;
+    while (m_entries[i].m_body != body) {
+        if (m_entries[i].m_body == nullptr) return;
+        i = (i + 1) & mask;
+    }
+    // Shift back the following entries of the probe sequence to fill the gap.
+    for (unsigned int j = (i + 1) & mask; m_entries[j].m_body != nullptr; j = (j + 1) & mask) {
+        unsigned int k = c_hash(m_entries[j].m_body) & mask;
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+        m_entries[i] = m_entries[j];
+        i = j;
+    }
+    m_entries[i].m_body = nullptr;
+    --m_count;
+}
 
-/*
- ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-  Helper Functions
- ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-*/
+void MSP::Body::TouchersTable::clear() {
+    for (std::vector<Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+        it->m_body = nullptr;
+    m_count = 0;
+}
 
-bool MSP::Body::c_is_body_valid(const NewtonBody* address) {
-    return s_valid_bodies.find(address) != s_valid_bodies.end();
+bool MSP::Body::c_is_body_valid(unsigned long long handle) {
+    return s_valid_bodies.is_valid(handle);
 }
 
 VALUE MSP::Body::c_body_to_value(const NewtonBody* body) {
-    return rb_ull2inum(reinterpret_cast<unsigned long long>(body));
+    return rb_ull2inum(reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body))->m_handle);
 }
 
 const NewtonBody* MSP::Body::c_value_to_body(VALUE v_body) {
-    const NewtonBody* address = reinterpret_cast<NewtonBody*>(rb_num2ull(v_body));
-    if (Util::s_validate_objects && s_valid_bodies.find(address) == s_valid_bodies.end())
+    unsigned long long handle = rb_num2ull(v_body);
+    const NewtonBody* address = s_valid_bodies.find(handle);
+    if (address == nullptr)
         rb_raise(rb_eTypeError, "Given address doesn't reference a valid body!");
+    // Body state is owned by the solver while an update is pending.
+    MSP::World::c_wait_for_update(NewtonBodyGetWorld(address));
     return address;
 }
 
 bool MSP::Body::c_bodies_collidable(const NewtonBody* body0, const NewtonBody* body1) {
     BodyData* data0 = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body0));
     BodyData* data1 = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body1));
-    return (data0->m_collidable && data1->m_collidable && data0->m_non_collidable_bodies.find(body1) == data0->m_non_collidable_bodies.end());
+    return (data0->m_collidable && data1->m_collidable &&
+        (data0->m_non_collidable_count == 0 || data0->m_cold->m_non_collidable_bodies.find(body1) == data0->m_cold->m_non_collidable_bodies.end()));
 }
 
 bool MSP::Body::c_bodies_aabb_overlap(const NewtonBody* body0, const NewtonBody* body1) {
@@ -490,18 +359,18 @@ void MSP::Body::c_validate_two_bodies(const NewtonBody* body1, const NewtonBody*
 
 void MSP::Body::c_clear_non_collidable_bodies(const NewtonBody* body) {
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
-    for (std::map<const NewtonBody*, bool>::iterator it = body_data->m_non_collidable_bodies.begin(); it != body_data->m_non_collidable_bodies.end(); ++it) {
-        const NewtonBody* other_body = it->first;
-        if (s_valid_bodies.find(other_body) != s_valid_bodies.end()) {
-            BodyData* other_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(other_body));
-            if (other_data->m_non_collidable_bodies.find(body) != other_data->m_non_collidable_bodies.end())
-                other_data->m_non_collidable_bodies.erase(body);
-        }
+    // Non-collidable pairs are kept symmetric, so every listed body is alive.
+    for (std::map<const NewtonBody*, bool>::iterator it = body_data->m_cold->m_non_collidable_bodies.begin(); it != body_data->m_cold->m_non_collidable_bodies.end(); ++it) {
+        BodyData* other_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(it->first));
+        other_data->m_cold->m_non_collidable_bodies.erase(body);
+        other_data->m_non_collidable_count = static_cast<unsigned int>(other_data->m_cold->m_non_collidable_bodies.size());
     }
-    body_data->m_non_collidable_bodies.clear();
+    body_data->m_cold->m_non_collidable_bodies.clear();
+    body_data->m_non_collidable_count = 0;
 }
 
 void MSP::Body::c_body_add_force(BodyData* body_data, const dVector& force) {
+    body_data->m_force_flags |= FORCE_PENDING;
     if (body_data->m_add_force_state)
         body_data->m_add_force += force;
     else {
@@ -511,6 +380,7 @@ void MSP::Body::c_body_add_force(BodyData* body_data, const dVector& force) {
 }
 
 void MSP::Body::c_body_set_force(BodyData* body_data, const dVector& force) {
+    body_data->m_force_flags |= FORCE_PENDING;
     body_data->m_add_force_state = false;
     if (body_data->m_set_force_state)
         body_data->m_set_force += force;
@@ -521,6 +391,7 @@ void MSP::Body::c_body_set_force(BodyData* body_data, const dVector& force) {
 }
 
 void MSP::Body::c_body_add_torque(BodyData* body_data, const dVector& torque) {
+    body_data->m_force_flags |= FORCE_PENDING;
     if (body_data->m_add_torque_state)
         body_data->m_add_torque += torque;
     else {
@@ -530,6 +401,7 @@ void MSP::Body::c_body_add_torque(BodyData* body_data, const dVector& torque) {
 }
 
 void MSP::Body::c_body_set_torque(BodyData* body_data, const dVector& torque) {
+    body_data->m_force_flags |= FORCE_PENDING;
     body_data->m_add_torque_state = false;
     if (body_data->m_set_torque_state)
         body_data->m_set_torque += torque;
@@ -539,28 +411,75 @@ void MSP::Body::c_body_set_torque(BodyData* body_data, const dVector& torque) {
     }
 }
 
+void MSP::Body::c_update_force_model(const NewtonBody* body) {
+    BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
+    dFloat mass;
+    dVector inertia;
+    NewtonBodyGetMass(body, &mass, &inertia.m_x, &inertia.m_y, &inertia.m_z);
+    body_data->m_gravity_scale = body_data->m_gravity_enabled ? mass : 0.0f;
+    body_data->m_linear_drag = dVector(0.0f);
+    body_data->m_angular_drag = dVector(0.0f);
+    if (body_data->m_cold->m_linear_damping_enabled) {
+        const dVector& damping = body_data->m_cold->m_linear_damping;
+        body_data->m_linear_drag = dVector(damping.m_x * mass, damping.m_y * mass, damping.m_z * mass);
+    }
+    if (body_data->m_cold->m_angular_damping_enabled) {
+        const dVector& damping = body_data->m_cold->m_angular_damping;
+        body_data->m_angular_drag = dVector(damping.m_x * inertia.m_x, damping.m_y * inertia.m_y, damping.m_z * inertia.m_z);
+    }
+    body_data->m_force_flags &= ~FORCE_DAMPED;
+    if (mass > 0.0f && (body_data->m_cold->m_linear_damping_enabled || body_data->m_cold->m_angular_damping_enabled))
+        body_data->m_force_flags |= FORCE_DAMPED;
+}
 
-/*
- ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-  Ruby Functions
- ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-*/
+void MSP::Body::c_apply_pending_forces(BodyData* body_data, dVector& force, dVector& torque) {
+    // A set force replaces everything accumulated before it.
+    if (body_data->m_set_force_state) {
+        force = body_data->m_set_force;
+        body_data->m_set_force_state = false;
+    }
+    if (body_data->m_add_force_state) {
+        force += body_data->m_add_force;
+        body_data->m_add_force_state = false;
+    }
+    if (body_data->m_set_torque_state) {
+        torque = body_data->m_set_torque;
+        body_data->m_set_torque_state = false;
+    }
+    if (body_data->m_add_torque_state) {
+        torque += body_data->m_add_torque;
+        body_data->m_add_torque_state = false;
+    }
+    body_data->m_force_flags &= ~FORCE_PENDING;
+}
 
-VALUE MSP::Body::rbf_is_valid(VALUE self, VALUE v_body) {
-    return c_is_body_valid(reinterpret_cast<NewtonBody*>(Util::value_to_ull(v_body))) ? Qtrue : Qfalse;
+void MSP::Body::c_body_get_matrix(const NewtonBody* body, dMatrix& matrix_out) {
+    const NewtonCollision* collision = NewtonBodyGetCollision(body);
+    BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
+    NewtonBodyGetMatrix(body, &matrix_out[0][0]);
+    const dVector& dcs = body_data->m_cold->m_default_collision_scale;
+    const dVector& ms = body_data->m_cold->m_matrix_scale;
+    const dVector& cs = MSP::Collision::c_get_collision_data(collision)->m_scale;
+    dVector actual_matrix_scale(ms.m_x * cs.m_x / dcs.m_x, ms.m_y * cs.m_y / dcs.m_y, ms.m_z * cs.m_z / dcs.m_z);
+    Util::set_matrix_scale(matrix_out, actual_matrix_scale);
 }
 
-VALUE MSP::Body::rbf_create(VALUE self, VALUE v_world, VALUE v_collision, VALUE v_matrix, VALUE v_type, VALUE v_id, VALUE v_group) {
-    const NewtonWorld* world = MSP::World::c_value_to_world(v_world);
+dFloat MSP::Body::c_calculate_collision_volume(const NewtonCollision* collision) {
+    int collision_type = NewtonCollisionGetType(collision);
+    if (collision_type == SERIALIZE_ID_NULL)
+        return 1.0f;
+    else if (collision_type < SERIALIZE_ID_TREE)
+        return NewtonConvexCollisionCalculateVolume(collision);
+    else
+        return 0.0f;
+}
+
+const NewtonBody* MSP::Body::c_create(const NewtonWorld* world, const NewtonCollision* collision, dMatrix matrix, int type, int id, VALUE v_group, dFloat volume) {
     MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world));
-    const NewtonCollision* collision = MSP::Collision::c_value_to_collision(v_collision);
-    int type = Util::value_to_int(v_type);
-    int id = Util::value_to_int(v_id);
 
     dMatrix col_matrix;
     NewtonCollisionGetMatrix(collision, &col_matrix[0][0]);
 
-    dMatrix matrix(Util::value_to_matrix(v_matrix));
     dVector scale(Util::get_matrix_scale(matrix));
 
     if (Util::is_matrix_flipped(matrix)) {
@@ -577,28 +496,20 @@ VALUE MSP::Body::rbf_create(VALUE self, VALUE v_world, VALUE v_collision, VALUE
     else
         body = NewtonCreateDynamicBody(world, collision, &matrix[0][0]);
 
-    BodyData* body_data = new BodyData(scale, MSP::Collision::s_valid_collisions[collision]->m_scale, col_matrix.m_posit, id, v_group);
+    BodyData* body_data = world_data->m_body_pool.create(scale, MSP::Collision::c_get_collision_data(collision)->m_scale, col_matrix.m_posit, id, v_group);
 
-    int collision_type = NewtonCollisionGetType(collision);
-    if (collision_type == SERIALIZE_ID_NULL)
-        body_data->m_volume = 1.0f;
-    else if (collision_type < SERIALIZE_ID_TREE)
-        body_data->m_volume = NewtonConvexCollisionCalculateVolume(collision);
-    else
-        body_data->m_volume = 0.0f;
-
-    if (body_data->m_volume < MIN_VOLUME) {
+    if (volume < MIN_VOLUME) {
         body_data->m_dynamic = false;
         body_data->m_bstatic = true;
-        body_data->m_volume = 0.0f;
-        body_data->m_density = 0.0f;
+        body_data->m_cold->m_volume = 0.0f;
+        body_data->m_cold->m_density = 0.0f;
         body_data->m_mass = 0.0f;
     }
     else {
         body_data->m_dynamic = true;
         body_data->m_bstatic = false;
-        body_data->m_volume = Util::clamp_float(body_data->m_volume, MIN_VOLUME, MAX_VOLUME);
-        body_data->m_mass = Util::clamp_float(body_data->m_volume * body_data->m_density, MIN_MASS, MAX_MASS);
+        body_data->m_cold->m_volume = Util::clamp_float(volume, MIN_VOLUME, MAX_VOLUME);
+        body_data->m_mass = Util::clamp_float(body_data->m_cold->m_volume * body_data->m_cold->m_density, MIN_MASS, MAX_MASS);
     }
 
     NewtonBodySetMassProperties(body, body_data->m_mass, collision);
@@ -607,21 +518,186 @@ VALUE MSP::Body::rbf_create(VALUE self, VALUE v_world, VALUE v_collision, VALUE
     NewtonBodySetTransformCallback(body, transform_callback);
     NewtonBodySetMaterialGroupID(body, body_data->m_material_id);
     NewtonBodySetCollidable(body, body_data->m_collidable ? 1 : 0);
-    NewtonBodySetAutoSleep(body, body_data->m_auto_sleep_enabled ? 1 : 0);
+    NewtonBodySetAutoSleep(body, body_data->m_cold->m_auto_sleep_enabled ? 1 : 0);
     NewtonBodySetUserData(body, body_data);
+    c_update_force_model(body);
     NewtonBodySetLinearDamping(body, 0.0f);
     dVector damp(0.0f);
     NewtonBodySetAngularDamping(body, &damp[0]);
 
-    s_valid_bodies.insert(body);
-
-    VALUE v_body = c_body_to_value(body);
+    body_data->m_handle = s_valid_bodies.insert(body);
+    MSP::World::c_invalidate_body_snapshot(world);
 
     if (v_group != Qnil) {
         world_data->m_group_to_body_map[v_group] = body;
-        rb_hash_aset(world_data->m_body_groups, v_body, v_group);
+        rb_hash_aset(world_data->m_body_groups, c_body_to_value(body), v_group);
     }
-    return v_body;
+    return body;
+}
+
+bool MSP::Body::c_calculate_buoyancy(
+    const NewtonBody* body,
+    const dMatrix& matrix,
+    const dVector& plane,
+    const dVector& gravity,
+    dFloat density,
+    dFloat linear_viscosity,
+    dFloat angular_viscosity,
+    const dVector& linear_current,
+    const dVector& angular_current,
+    dFloat timestep,
+    dVector& force_out,
+    dVector& torque_out)
+{
+    const NewtonCollision* collision = NewtonBodyGetCollision(body);
+    dVector com;
+    NewtonBodyGetCentreOfMass(body, &com[0]);
+    com = matrix.TransformVector(com);
+
+    dVector force(0.0f);
+    dVector torque(0.0f);
+    NewtonConvexCollisionCalculateBuoyancyAcceleration(collision, &matrix[0][0], &com[0], &gravity[0], &plane[0], density, 0.0f, &force[0], &torque[0]);
+
+    dVector inertia;
+    dFloat mass;
+    NewtonBodyGetMass(body, &mass, &inertia.m_x, &inertia.m_y, &inertia.m_z);
+
+    force_out = dVector(0.0f);
+    torque_out = dVector(0.0f);
+    bool submerged = false;
+    if (dAbs(force.m_x) > M_EPSILON || dAbs(force.m_y) > M_EPSILON || dAbs(force.m_z) > M_EPSILON) {
+        force_out = force;
+        if (linear_viscosity > M_EPSILON) {
+            dVector veloc;
+            NewtonBodyGetVelocity(body, &veloc[0]);
+            force_out += (linear_current - veloc).Scale(mass * linear_viscosity / timestep);
+        }
+        submerged = true;
+    }
+    if (dAbs(torque.m_x) > M_EPSILON || dAbs(torque.m_y) > M_EPSILON || dAbs(torque.m_z) > M_EPSILON) {
+        torque_out = torque;
+        if (angular_viscosity > M_EPSILON) {
+            dVector omega;
+            NewtonBodyGetOmega(body, &omega[0]);
+            omega = matrix.UnrotateVector(angular_current - omega);
+            dFloat mag = angular_viscosity / timestep;
+            dVector viscous_torque(
+                omega.m_x * inertia.m_x * mag,
+                omega.m_y * inertia.m_y * mag,
+                omega.m_z * inertia.m_z * mag);
+            torque_out += matrix.RotateVector(viscous_torque);
+        }
+        submerged = true;
+    }
+    return submerged;
+}
+
+void MSP::Body::c_apply_fluid_volumes(const NewtonBody* body, dFloat timestep, dVector& force, dVector& torque) {
+    // Called from force callbacks, which run on the worker threads; volumes
+    // are only changed between updates.
+    const NewtonWorld* world = NewtonBodyGetWorld(body);
+    MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world));
+    dVector min_pt;
+    dVector max_pt;
+    NewtonBodyGetAABB(body, &min_pt[0], &max_pt[0]);
+    dMatrix matrix;
+    NewtonBodyGetMatrix(body, &matrix[0][0]);
+    for (std::vector<MSP::World::FluidVolume>::const_iterator it = world_data->m_fluid_volumes.begin(); it != world_data->m_fluid_volumes.end(); ++it) {
+        const MSP::World::FluidVolume& volume = *it;
+        // Skip bodies outside the box of the volume or fully above its surface,
+        // testing the corner of the broadphase box deepest along the normal.
+        if (volume.m_bounded && (
+            min_pt.m_x > volume.m_aabb_max.m_x || max_pt.m_x < volume.m_aabb_min.m_x ||
+            min_pt.m_y > volume.m_aabb_max.m_y || max_pt.m_y < volume.m_aabb_min.m_y ||
+            min_pt.m_z > volume.m_aabb_max.m_z || max_pt.m_z < volume.m_aabb_min.m_z))
+            continue;
+        dVector deepest(
+            volume.m_plane.m_x > 0.0f ? min_pt.m_x : max_pt.m_x,
+            volume.m_plane.m_y > 0.0f ? min_pt.m_y : max_pt.m_y,
+            volume.m_plane.m_z > 0.0f ? min_pt.m_z : max_pt.m_z);
+        if (volume.m_plane.DotProduct3(deepest) + volume.m_plane.m_w > 0.0f)
+            continue;
+        dVector fluid_force;
+        dVector fluid_torque;
+        if (c_calculate_buoyancy(body, matrix, volume.m_plane, world_data->m_gravity, volume.m_density, volume.m_linear_viscosity, volume.m_angular_viscosity, volume.m_linear_current, volume.m_angular_current, timestep, fluid_force, fluid_torque)) {
+            force += fluid_force;
+            torque += fluid_torque;
+        }
+    }
+}
+
+
+/*
+ ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+  Ruby Functions
+ ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+VALUE MSP::Body::rbf_is_valid(VALUE self, VALUE v_body) {
+    return c_is_body_valid(Util::value_to_ull(v_body)) ? Qtrue : Qfalse;
+}
+
+VALUE MSP::Body::rbf_create(VALUE self, VALUE v_world, VALUE v_collision, VALUE v_matrix, VALUE v_type, VALUE v_id, VALUE v_group) {
+    const NewtonWorld* world = MSP::World::c_value_to_world(v_world);
+    const NewtonCollision* collision = MSP::Collision::c_value_to_collision(v_collision);
+    int type = Util::value_to_int(v_type);
+    int id = Util::value_to_int(v_id);
+    dMatrix matrix(Util::value_to_matrix(v_matrix));
+    const NewtonBody* body = c_create(world, collision, matrix, type, id, v_group, c_calculate_collision_volume(collision));
+    return c_body_to_value(body);
+}
+
+VALUE MSP::Body::rbf_create_many(VALUE self, VALUE v_world, VALUE v_collision, VALUE v_matrices, VALUE v_type, VALUE v_ids, VALUE v_groups) {
+    const NewtonWorld* world = MSP::World::c_value_to_world(v_world);
+    const NewtonCollision* collision = MSP::Collision::c_value_to_collision(v_collision);
+    int type = Util::value_to_int(v_type);
+    // Matrices are either an array of transformations or a string of packed
+    // doubles, 16 per matrix.
+    bool packed = (TYPE(v_matrices) == T_STRING);
+    unsigned int count;
+    if (packed) {
+        long length = RSTRING_LEN(v_matrices);
+        if (length % (sizeof(double) * 16) != 0)
+            rb_raise(rb_eArgError, "Size of packed matrices must be a multiple of 16 doubles!");
+        count = static_cast<unsigned int>(length / (sizeof(double) * 16));
+    }
+    else {
+        Check_Type(v_matrices, T_ARRAY);
+        count = static_cast<unsigned int>(RARRAY_LEN(v_matrices));
+    }
+    bool ids_given = (TYPE(v_ids) == T_ARRAY);
+    if (ids_given && static_cast<unsigned int>(RARRAY_LEN(v_ids)) != count)
+        rb_raise(rb_eArgError, "Number of ids doesn't match the number of matrices!");
+    if (v_groups != Qnil) {
+        Check_Type(v_groups, T_ARRAY);
+        if (static_cast<unsigned int>(RARRAY_LEN(v_groups)) != count)
+            rb_raise(rb_eArgError, "Number of groups doesn't match the number of matrices!");
+    }
+    // Convert all arguments before creating any body, so that an invalid
+    // matrix or id doesn't leave earlier bodies behind without a handle.
+    std::vector<dMatrix> matrices(count);
+    std::vector<int> ids(count, ids_given ? 0 : Util::value_to_int(v_ids));
+    double values[16];
+    for (unsigned int i = 0; i < count; ++i) {
+        if (packed) {
+            memcpy(values, RSTRING_PTR(v_matrices) + i * sizeof(values), sizeof(values));
+            matrices[i] = Util::values_to_matrix(values);
+        }
+        else
+            matrices[i] = Util::value_to_matrix(rb_ary_entry(v_matrices, i));
+        if (ids_given)
+            ids[i] = Util::value_to_int(rb_ary_entry(v_ids, i));
+    }
+    // Volume only depends on the collision, so it's computed once for all bodies.
+    dFloat volume = c_calculate_collision_volume(collision);
+    s_valid_bodies.reserve(count);
+    VALUE v_bodies = rb_ary_new2(count);
+    for (unsigned int i = 0; i < count; ++i) {
+        VALUE v_group = (v_groups != Qnil) ? rb_ary_entry(v_groups, i) : Qnil;
+        const NewtonBody* body = c_create(world, collision, matrices[i], type, ids[i], v_group, volume);
+        rb_ary_store(v_bodies, i, c_body_to_value(body));
+    }
+    return v_bodies;
 }
 
 VALUE MSP::Body::rbf_destroy(VALUE self, VALUE v_body) {
@@ -669,15 +745,8 @@ VALUE MSP::Body::rbf_set_continuous_collision_state(VALUE self, VALUE v_body, VA
 
 VALUE MSP::Body::rbf_get_matrix(VALUE self, VALUE v_body) {
     const NewtonBody* body = c_value_to_body(v_body);
-    const NewtonCollision* collision = NewtonBodyGetCollision(body);
-    BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
     dMatrix matrix;
-    NewtonBodyGetMatrix(body, &matrix[0][0]);
-    const dVector& dcs = body_data->m_default_collision_scale;
-    const dVector& ms = body_data->m_matrix_scale;
-    const dVector& cs = MSP::Collision::s_valid_collisions[collision]->m_scale;
-    dVector actual_matrix_scale(ms.m_x * cs.m_x / dcs.m_x, ms.m_y * cs.m_y / dcs.m_y, ms.m_z * cs.m_z / dcs.m_z);
-    Util::set_matrix_scale(matrix, actual_matrix_scale);
+    c_body_get_matrix(body, matrix);
     return Util::matrix_to_value(matrix);
 }
 
@@ -686,7 +755,7 @@ VALUE MSP::Body::rbf_get_normal_matrix(VALUE self, VALUE v_body) {
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
     dMatrix matrix;
     NewtonBodyGetMatrix(body, &matrix[0][0]);
-    if (body_data->m_matrix_scale.m_x < 0) {
+    if (body_data->m_cold->m_matrix_scale.m_x < 0) {
         matrix.m_front.m_x = -matrix.m_front.m_x;
         matrix.m_front.m_y = -matrix.m_front.m_y;
         matrix.m_front.m_z = -matrix.m_front.m_z;
@@ -706,12 +775,13 @@ VALUE MSP::Body::rbf_set_matrix(VALUE self, VALUE v_body, VALUE v_matrix) {
     }
     Util::extract_matrix_scale(matrix);
     NewtonBodySetMatrix(body, &matrix[0][0]);
-    const dVector& dcs = body_data->m_default_collision_scale;
-    const dVector& ms = body_data->m_matrix_scale;
-    const dVector& cs = MSP::Collision::s_valid_collisions[collision]->m_scale;
+    const dVector& dcs = body_data->m_cold->m_default_collision_scale;
+    const dVector& ms = body_data->m_cold->m_matrix_scale;
+    const dVector& cs = MSP::Collision::c_get_collision_data(collision)->m_scale;
     dVector actual_matrix_scale(ms.m_x * cs.m_x / dcs.m_x, ms.m_y * cs.m_y / dcs.m_y, ms.m_z * cs.m_z / dcs.m_z);
     Util::set_matrix_scale(matrix, actual_matrix_scale);
     body_data->m_matrix_changed = true;
+    MSP::World::c_invalidate_body_snapshot(NewtonBodyGetWorld(body));
     return Qnil;
 }
 
@@ -743,6 +813,7 @@ VALUE MSP::Body::rbf_set_position(VALUE self, VALUE v_body, VALUE v_position, VA
     matrix[3] = position;
     NewtonBodySetMatrix(body, &matrix[0][0]);
     body_data->m_matrix_changed = true;
+    MSP::World::c_invalidate_body_snapshot(NewtonBodyGetWorld(body));
     return Qnil;
 }
 
@@ -775,6 +846,7 @@ VALUE MSP::Body::rbf_set_euler_angles(VALUE self, VALUE v_body, VALUE v_angles)
     NewtonSetEulerAngle(&angles[0], &matrix[0][0]);
     NewtonBodySetMatrix(body, &matrix[0][0]);
     body_data->m_matrix_changed = true;
+    MSP::World::c_invalidate_body_snapshot(NewtonBodyGetWorld(body));
     //dVector angles0;
     //dVector angles1;
     //NewtonGetEulerAngle(&matrix[0][0], &angles0[0], &angles1[0]);
@@ -796,6 +868,7 @@ VALUE MSP::Body::rbf_set_velocity(VALUE self, VALUE v_body, VALUE v_velocity) {
         dVector velocity(Util::value_to_vector(v_velocity).Scale(M_METER_TO_INCH));
         NewtonBodySetVelocity(body, &velocity[0]);
     //}
+    MSP::World::c_invalidate_body_snapshot(NewtonBodyGetWorld(body));
     return Qnil;
 }
 
@@ -820,6 +893,7 @@ VALUE MSP::Body::rbf_set_omega(VALUE self, VALUE v_body, VALUE v_omega) {
         dVector omega(Util::value_to_vector(v_omega));
         NewtonBodySetOmega(body, &omega[0]);
     //}
+    MSP::World::c_invalidate_body_snapshot(NewtonBodyGetWorld(body));
     return Qnil;
 }
 
@@ -828,9 +902,9 @@ VALUE MSP::Body::rbf_get_centre_of_mass(VALUE self, VALUE v_body) {
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
     dVector com;
     NewtonBodyGetCentreOfMass(body, &com[0]);
-    com.m_x /= body_data->m_matrix_scale.m_x;
-    com.m_y /= body_data->m_matrix_scale.m_y;
-    com.m_z /= body_data->m_matrix_scale.m_z;
+    com.m_x /= body_data->m_cold->m_matrix_scale.m_x;
+    com.m_y /= body_data->m_cold->m_matrix_scale.m_y;
+    com.m_z /= body_data->m_cold->m_matrix_scale.m_z;
     return Util::point_to_value(com);
 }
 
@@ -838,9 +912,9 @@ VALUE MSP::Body::rbf_set_centre_of_mass(VALUE self, VALUE v_body, VALUE v_com) {
     const NewtonBody* body = c_value_to_body(v_body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
     dVector com(Util::value_to_point(v_com));
-    com.m_x *= body_data->m_matrix_scale.m_x;
-    com.m_y *= body_data->m_matrix_scale.m_y;
-    com.m_z *= body_data->m_matrix_scale.m_z;
+    com.m_x *= body_data->m_cold->m_matrix_scale.m_x;
+    com.m_y *= body_data->m_cold->m_matrix_scale.m_y;
+    com.m_z *= body_data->m_cold->m_matrix_scale.m_z;
     NewtonBodySetCentreOfMass(body, &com[0]);
     return Qnil;
 }
@@ -865,10 +939,11 @@ VALUE MSP::Body::rbf_set_mass(VALUE self, VALUE v_body, VALUE v_mass) {
     if (!body_data->m_dynamic)
         return Qnil;
     body_data->m_mass = Util::clamp_float(Util::value_to_dFloat(v_mass), MIN_MASS, MAX_MASS);
-    body_data->m_density = Util::clamp_float(body_data->m_mass / body_data->m_volume, MIN_DENSITY, MAX_DENSITY);
+    body_data->m_cold->m_density = Util::clamp_float(body_data->m_mass / body_data->m_cold->m_volume, MIN_DENSITY, MAX_DENSITY);
     dVector com;
     NewtonBodyGetCentreOfMass(body, &com[0]);
     NewtonBodySetMassProperties(body, body_data->m_bstatic ? 0.0f : body_data->m_mass, NewtonBodyGetCollision(body));
+    c_update_force_model(body);
     NewtonBodySetCentreOfMass(body, &com[0]);
     return Qnil;
 }
@@ -876,7 +951,7 @@ VALUE MSP::Body::rbf_set_mass(VALUE self, VALUE v_body, VALUE v_mass) {
 VALUE MSP::Body::rbf_get_density(VALUE self, VALUE v_body) {
     const NewtonBody* body = c_value_to_body(v_body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
-    return Util::to_value(body_data->m_density);
+    return Util::to_value(body_data->m_cold->m_density);
 }
 
 VALUE MSP::Body::rbf_set_density(VALUE self, VALUE v_body, VALUE v_density) {
@@ -884,11 +959,12 @@ VALUE MSP::Body::rbf_set_density(VALUE self, VALUE v_body, VALUE v_density) {
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
     if (!body_data->m_dynamic)
         return Qnil;
-    body_data->m_density = Util::clamp_float(Util::value_to_dFloat(v_density), MIN_DENSITY, MAX_DENSITY);
-    body_data->m_mass = Util::clamp_float(body_data->m_density * body_data->m_volume, MIN_MASS, MAX_MASS);
+    body_data->m_cold->m_density = Util::clamp_float(Util::value_to_dFloat(v_density), MIN_DENSITY, MAX_DENSITY);
+    body_data->m_mass = Util::clamp_float(body_data->m_cold->m_density * body_data->m_cold->m_volume, MIN_MASS, MAX_MASS);
     dVector com;
     NewtonBodyGetCentreOfMass(body, &com[0]);
     NewtonBodySetMassProperties(body, body_data->m_bstatic ? 0.0f : body_data->m_mass, NewtonBodyGetCollision(body));
+    c_update_force_model(body);
     NewtonBodySetCentreOfMass(body, &com[0]);
     return Qnil;
 }
@@ -896,18 +972,19 @@ VALUE MSP::Body::rbf_set_density(VALUE self, VALUE v_body, VALUE v_density) {
 VALUE MSP::Body::rbf_get_volume(VALUE self, VALUE v_body) {
     const NewtonBody* body = c_value_to_body(v_body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
-    return Util::to_value(body_data->m_volume);
+    return Util::to_value(body_data->m_cold->m_volume);
 }
 
 VALUE MSP::Body::rbf_set_volume(VALUE self, VALUE v_body, VALUE v_volume) {
     const NewtonBody* body = c_value_to_body(v_body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
     if (!body_data->m_dynamic) return Qnil;
-    body_data->m_volume = Util::clamp_float(Util::value_to_dFloat(v_volume), MIN_VOLUME, MAX_VOLUME);
-    body_data->m_mass = Util::clamp_float(body_data->m_density * body_data->m_volume, MIN_MASS, MAX_MASS);
+    body_data->m_cold->m_volume = Util::clamp_float(Util::value_to_dFloat(v_volume), MIN_VOLUME, MAX_VOLUME);
+    body_data->m_mass = Util::clamp_float(body_data->m_cold->m_density * body_data->m_cold->m_volume, MIN_MASS, MAX_MASS);
     dVector com;
     NewtonBodyGetCentreOfMass(body, &com[0]);
     NewtonBodySetMassProperties(body, body_data->m_bstatic ? 0.0f : body_data->m_mass, NewtonBodyGetCollision(body));
+    c_update_force_model(body);
     NewtonBodySetCentreOfMass(body, &com[0]);
     return Qnil;
 }
@@ -918,10 +995,11 @@ VALUE MSP::Body::rbf_reset_mass_properties(VALUE self, VALUE v_body, VALUE v_den
     dFloat density = Util::clamp_float(Util::value_to_dFloat(v_density), MIN_DENSITY, MAX_DENSITY);
     if (!body_data->m_dynamic) return Qfalse;
     const NewtonCollision* collision = NewtonBodyGetCollision(body);
-    body_data->m_density = density;
-    body_data->m_volume = Util::clamp_float(NewtonConvexCollisionCalculateVolume(collision), MIN_VOLUME, MAX_VOLUME);
-    body_data->m_mass = Util::clamp_float(body_data->m_density * body_data->m_volume, MIN_MASS, MAX_MASS);
+    body_data->m_cold->m_density = density;
+    body_data->m_cold->m_volume = Util::clamp_float(NewtonConvexCollisionCalculateVolume(collision), MIN_VOLUME, MAX_VOLUME);
+    body_data->m_mass = Util::clamp_float(body_data->m_cold->m_density * body_data->m_cold->m_volume, MIN_MASS, MAX_MASS);
     NewtonBodySetMassProperties(body, body_data->m_bstatic ? 0.0f : body_data->m_mass, collision);
+    c_update_force_model(body);
     return Qtrue;
 }
 
@@ -938,9 +1016,11 @@ VALUE MSP::Body::rbf_set_static(VALUE self, VALUE v_body, VALUE v_state) {
     bool state = Util::value_to_bool(v_state);
     if (state == body_data->m_bstatic) return Qnil;
     body_data->m_bstatic = state;
+    MSP::World::c_invalidate_body_snapshot(NewtonBodyGetWorld(body));
     dVector com;
     NewtonBodyGetCentreOfMass(body, &com[0]);
     NewtonBodySetMassProperties(body, body_data->m_bstatic ? 0.0f : body_data->m_mass, NewtonBodyGetCollision(body));
+    c_update_force_model(body);
     NewtonBodySetCentreOfMass(body, &com[0]);
     NewtonBodySetSleepState(body, 0);
     if (body_data->m_bstatic) {
@@ -950,7 +1030,7 @@ VALUE MSP::Body::rbf_set_static(VALUE self, VALUE v_body, VALUE v_state) {
         body_data->m_matrix_changed = true;
     }
     else {
-        NewtonBodySetAutoSleep(body, body_data->m_auto_sleep_enabled ? 1 : 0);
+        NewtonBodySetAutoSleep(body, body_data->m_cold->m_auto_sleep_enabled ? 1 : 0);
     }
     return Qnil;
 }
@@ -977,6 +1057,7 @@ VALUE MSP::Body::rbf_is_frozen(VALUE self, VALUE v_body) {
 VALUE MSP::Body::rbf_set_frozen(VALUE self, VALUE v_body, VALUE v_state) {
     const NewtonBody* body = c_value_to_body(v_body);
     NewtonBodySetFreezeState(body, Util::value_to_bool(v_state) ? 1 : 0);
+    MSP::World::c_invalidate_body_snapshot(NewtonBodyGetWorld(body));
     return Qnil;
 }
 
@@ -988,6 +1069,7 @@ VALUE MSP::Body::rbf_is_sleeping(VALUE self, VALUE v_body) {
 VALUE MSP::Body::rbf_set_sleeping(VALUE self, VALUE v_body, VALUE v_state) {
     const NewtonBody* body = c_value_to_body(v_body);
     NewtonBodySetSleepState(body, Util::value_to_bool(v_state) ? 1 : 0);
+    MSP::World::c_invalidate_body_snapshot(NewtonBodyGetWorld(body));
     return Qnil;
 }
 
@@ -995,14 +1077,15 @@ VALUE MSP::Body::rbf_get_auto_sleep_state(VALUE self, VALUE v_body) {
     const NewtonBody* body = c_value_to_body(v_body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
     //return NewtonBodyGetAutoSleep(body) == 1 ? Qtrue : Qfalse;
-    return Util::to_value(body_data->m_auto_sleep_enabled);
+    return Util::to_value(body_data->m_cold->m_auto_sleep_enabled);
 }
 
 VALUE MSP::Body::rbf_set_auto_sleep_state(VALUE self, VALUE v_body, VALUE v_state) {
     const NewtonBody* body = c_value_to_body(v_body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
-    body_data->m_auto_sleep_enabled = Util::value_to_bool(v_state);
-    NewtonBodySetAutoSleep(body, body_data->m_auto_sleep_enabled ? 1 : 0);
+    body_data->m_cold->m_auto_sleep_enabled = Util::value_to_bool(v_state);
+    NewtonBodySetAutoSleep(body, body_data->m_cold->m_auto_sleep_enabled ? 1 : 0);
+    MSP::World::c_invalidate_body_snapshot(NewtonBodyGetWorld(body));
     return Qnil;
 }
 
@@ -1011,7 +1094,7 @@ VALUE MSP::Body::rbf_is_non_collidable_with(VALUE self, VALUE v_body, VALUE v_ot
     const NewtonBody* other_body = c_value_to_body(v_other_body);
     c_validate_two_bodies(body, other_body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
-    return body_data->m_non_collidable_bodies.find(other_body) != body_data->m_non_collidable_bodies.end() ? Qtrue : Qfalse;
+    return body_data->m_cold->m_non_collidable_bodies.find(other_body) != body_data->m_cold->m_non_collidable_bodies.end() ? Qtrue : Qfalse;
 }
 
 VALUE MSP::Body::rbf_set_non_collidable_with(VALUE self, VALUE v_body, VALUE v_other_body, VALUE v_state) {
@@ -1022,15 +1105,17 @@ VALUE MSP::Body::rbf_set_non_collidable_with(VALUE self, VALUE v_body, VALUE v_o
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
     BodyData* other_body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(other_body));
     if (state) {
-        body_data->m_non_collidable_bodies[other_body] = true;
-        other_body_data->m_non_collidable_bodies[body] = true;
+        body_data->m_cold->m_non_collidable_bodies[other_body] = true;
+        other_body_data->m_cold->m_non_collidable_bodies[body] = true;
     }
     else {
-        if (body_data->m_non_collidable_bodies.find(other_body) != body_data->m_non_collidable_bodies.end())
-            body_data->m_non_collidable_bodies.erase(other_body);
-        if (other_body_data->m_non_collidable_bodies.find(body) != other_body_data->m_non_collidable_bodies.end())
-            other_body_data->m_non_collidable_bodies.erase(body);
+        if (body_data->m_cold->m_non_collidable_bodies.find(other_body) != body_data->m_cold->m_non_collidable_bodies.end())
+            body_data->m_cold->m_non_collidable_bodies.erase(other_body);
+        if (other_body_data->m_cold->m_non_collidable_bodies.find(body) != other_body_data->m_cold->m_non_collidable_bodies.end())
+            other_body_data->m_cold->m_non_collidable_bodies.erase(body);
     }
+    body_data->m_non_collidable_count = static_cast<unsigned int>(body_data->m_cold->m_non_collidable_bodies.size());
+    other_body_data->m_non_collidable_count = static_cast<unsigned int>(other_body_data->m_cold->m_non_collidable_bodies.size());
     return Qnil;
 }
 
@@ -1039,11 +1124,11 @@ VALUE MSP::Body::rbf_get_non_collidable_bodies(VALUE self, VALUE v_body) {
     bool proc_given = (rb_block_given_p() != 0);
     VALUE v_non_collidable_bodies = rb_ary_new();
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
-    for (std::map<const NewtonBody*, bool>::iterator it = body_data->m_non_collidable_bodies.begin(); it != body_data->m_non_collidable_bodies.end(); ++it) {
+    for (std::map<const NewtonBody*, bool>::iterator it = body_data->m_cold->m_non_collidable_bodies.begin(); it != body_data->m_cold->m_non_collidable_bodies.end(); ++it) {
         VALUE v_address = c_body_to_value(it->first);
         if (proc_given) {
             BodyData* other_body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(it->first));
-            VALUE v_result = rb_yield_values(2, v_address, other_body_data->m_user_data);
+            VALUE v_result = rb_yield_values(2, v_address, other_body_data->m_cold->m_user_data);
             if (v_result != Qnil)
                 rb_ary_push(v_non_collidable_bodies, v_result);
         }
@@ -1056,7 +1141,7 @@ VALUE MSP::Body::rbf_get_non_collidable_bodies(VALUE self, VALUE v_body) {
 VALUE MSP::Body::rbf_clear_non_collidable_bodies(VALUE self, VALUE v_body) {
     const NewtonBody* body = c_value_to_body(v_body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
-    unsigned int count = (unsigned int)body_data->m_non_collidable_bodies.size();
+    unsigned int count = (unsigned int)body_data->m_cold->m_non_collidable_bodies.size();
     c_clear_non_collidable_bodies(body);
     return Util::to_value(count);
 }
@@ -1204,34 +1289,36 @@ VALUE MSP::Body::rbf_get_aabb(VALUE self, VALUE v_body) {
 VALUE MSP::Body::rbf_get_linear_damping(VALUE self, VALUE v_body) {
     const NewtonBody* body = c_value_to_body(v_body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
-    return Util::vector_to_value(body_data->m_linear_damping);
+    return Util::vector_to_value(body_data->m_cold->m_linear_damping);
 }
 
 VALUE MSP::Body::rbf_set_linear_damping(VALUE self, VALUE v_body, VALUE v_damp_vector) {
     const NewtonBody* body = c_value_to_body(v_body);
     dVector damp_vector(Util::value_to_vector(v_damp_vector));
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
-    body_data->m_linear_damping.m_x = Util::clamp_float(damp_vector.m_x, 0.0f, 1.0f);
-    body_data->m_linear_damping.m_y = Util::clamp_float(damp_vector.m_y, 0.0f, 1.0f);
-    body_data->m_linear_damping.m_z = Util::clamp_float(damp_vector.m_z, 0.0f, 1.0f);
-    body_data->m_linear_damping_enabled = (damp_vector.m_x > M_EPSILON || damp_vector.m_y > M_EPSILON || damp_vector.m_z > M_EPSILON);
+    body_data->m_cold->m_linear_damping.m_x = Util::clamp_float(damp_vector.m_x, 0.0f, 1.0f);
+    body_data->m_cold->m_linear_damping.m_y = Util::clamp_float(damp_vector.m_y, 0.0f, 1.0f);
+    body_data->m_cold->m_linear_damping.m_z = Util::clamp_float(damp_vector.m_z, 0.0f, 1.0f);
+    body_data->m_cold->m_linear_damping_enabled = (damp_vector.m_x > M_EPSILON || damp_vector.m_y > M_EPSILON || damp_vector.m_z > M_EPSILON);
+    c_update_force_model(body);
     return Qnil;
 }
 
 VALUE MSP::Body::rbf_get_angular_damping(VALUE self, VALUE v_body) {
     const NewtonBody* body = c_value_to_body(v_body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
-    return Util::vector_to_value(body_data->m_angular_damping);
+    return Util::vector_to_value(body_data->m_cold->m_angular_damping);
 }
 
 VALUE MSP::Body::rbf_set_angular_damping(VALUE self, VALUE v_body, VALUE v_damp_vector) {
     const NewtonBody* body = c_value_to_body(v_body);
     dVector damp_vector(Util::value_to_vector(v_damp_vector));
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
-    body_data->m_angular_damping.m_x = Util::clamp_float(damp_vector.m_x, 0.0f, 1.0f);
-    body_data->m_angular_damping.m_y = Util::clamp_float(damp_vector.m_y, 0.0f, 1.0f);
-    body_data->m_angular_damping.m_z = Util::clamp_float(damp_vector.m_z, 0.0f, 1.0f);
-    body_data->m_angular_damping_enabled = (damp_vector.m_x > M_EPSILON || damp_vector.m_y > M_EPSILON || damp_vector.m_z > M_EPSILON);
+    body_data->m_cold->m_angular_damping.m_x = Util::clamp_float(damp_vector.m_x, 0.0f, 1.0f);
+    body_data->m_cold->m_angular_damping.m_y = Util::clamp_float(damp_vector.m_y, 0.0f, 1.0f);
+    body_data->m_cold->m_angular_damping.m_z = Util::clamp_float(damp_vector.m_z, 0.0f, 1.0f);
+    body_data->m_cold->m_angular_damping_enabled = (damp_vector.m_x > M_EPSILON || damp_vector.m_y > M_EPSILON || damp_vector.m_z > M_EPSILON);
+    c_update_force_model(body);
     return Qnil;
 }
 
@@ -1268,6 +1355,7 @@ VALUE MSP::Body::rbf_add_impulse(VALUE self, VALUE v_body, VALUE v_center, VALUE
     dVector delta_vel(Util::value_to_vector(v_delta_vel).Scale(M_METER_TO_INCH));
     dFloat timestep = Util::value_to_dFloat(v_timestep);
     NewtonBodyAddImpulse(body, &center[0], &delta_vel[0], timestep);
+    MSP::World::c_invalidate_body_snapshot(NewtonBodyGetWorld(body));
     return Qtrue;
 }
 
@@ -1345,36 +1433,32 @@ VALUE MSP::Body::rbf_get_net_contact_force(VALUE self, VALUE v_body) {
 
 VALUE MSP::Body::rbf_get_net_joint_tension1(VALUE self, VALUE v_body) {
     const NewtonBody* body = c_value_to_body(v_body);
-    const NewtonWorld* world = NewtonBodyGetWorld(body);
+    BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
     dVector net_force(0.0f);
-    for (std::map<MSP::Joint::JointData*, bool>::const_iterator it = MSP::Joint::s_valid_joints.begin(); it != MSP::Joint::s_valid_joints.end(); ++it) {
-        if (it->first->m_world == world) {
-            dMatrix parent_matrix;
-            MSP::Joint::c_calculate_global_parent_matrix(it->first, parent_matrix);
-            dVector tension(parent_matrix.RotateVector(it->first->m_tension1));
-            if (it->first->m_parent == body)
-                net_force -= tension;
-            else if (it->first->m_child == body)
-                net_force += tension;
-        }
+    dMatrix parent_matrix;
+    for (MSP::Joint::JointData* joint_data = body_data->m_cold->m_contained_joints.first(); joint_data != nullptr; joint_data = MSP::Joint::ParentJointList::next(joint_data)) {
+        MSP::Joint::c_calculate_global_parent_matrix(joint_data, parent_matrix);
+        net_force -= parent_matrix.RotateVector(joint_data->m_tension1);
+    }
+    for (MSP::Joint::JointData* joint_data = body_data->m_cold->m_connected_joints.first(); joint_data != nullptr; joint_data = MSP::Joint::ChildJointList::next(joint_data)) {
+        MSP::Joint::c_calculate_global_parent_matrix(joint_data, parent_matrix);
+        net_force += parent_matrix.RotateVector(joint_data->m_tension1);
     }
     return Util::vector_to_value(net_force.Scale(M_INCH_TO_METER));
 }
 
 VALUE MSP::Body::rbf_get_net_joint_tension2(VALUE self, VALUE v_body) {
     const NewtonBody* body = c_value_to_body(v_body);
-    const NewtonWorld* world = NewtonBodyGetWorld(body);
+    BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
     dVector net_force(0.0f);
-    for (std::map<MSP::Joint::JointData*, bool>::const_iterator it = MSP::Joint::s_valid_joints.begin(); it != MSP::Joint::s_valid_joints.end(); ++it) {
-        if (it->first->m_world == world) {
-            dMatrix parent_matrix;
-            MSP::Joint::c_calculate_global_parent_matrix(it->first, parent_matrix);
-            dVector tension(parent_matrix.RotateVector(it->first->m_tension2));
-            if (it->first->m_parent == body)
-                net_force -= tension;
-            else if (it->first->m_child == body)
-                net_force += tension;
-        }
+    dMatrix parent_matrix;
+    for (MSP::Joint::JointData* joint_data = body_data->m_cold->m_contained_joints.first(); joint_data != nullptr; joint_data = MSP::Joint::ParentJointList::next(joint_data)) {
+        MSP::Joint::c_calculate_global_parent_matrix(joint_data, parent_matrix);
+        net_force -= parent_matrix.RotateVector(joint_data->m_tension2);
+    }
+    for (MSP::Joint::JointData* joint_data = body_data->m_cold->m_connected_joints.first(); joint_data != nullptr; joint_data = MSP::Joint::ChildJointList::next(joint_data)) {
+        MSP::Joint::c_calculate_global_parent_matrix(joint_data, parent_matrix);
+        net_force += parent_matrix.RotateVector(joint_data->m_tension2);
     }
     return Util::vector_to_value(net_force.Scale(M_INCH_TO_METER));
 }
@@ -1402,11 +1486,11 @@ VALUE MSP::Body::rbf_get_contacts(VALUE self, VALUE v_body, VALUE v_inc_non_coll
             VALUE v_force = Util::vector_to_value(force.Scale(M_INCH_TO_METER));
             VALUE v_speed = Util::to_value(speed);
             if (proc_given) {
-                VALUE v_result = rb_yield_values(6, v_touching_body, touching_body_data->m_user_data, v_point, v_normal, v_force, v_speed);
+                VALUE v_result = rb_yield_values(6, v_touching_body, touching_body_data->m_cold->m_user_data, v_point, v_normal, v_force, v_speed);
                 if (v_result != Qnil) rb_ary_push(v_contacts, v_result);
             }
             else
-                rb_ary_push(v_contacts, rb_ary_new3(6, v_touching_body, touching_body_data->m_user_data, v_point, v_normal, v_force, v_speed));
+                rb_ary_push(v_contacts, rb_ary_new3(6, v_touching_body, touching_body_data->m_cold->m_user_data, v_point, v_normal, v_force, v_speed));
         }
     }
     if (inc_non_collidable) {
@@ -1438,11 +1522,11 @@ VALUE MSP::Body::rbf_get_contacts(VALUE self, VALUE v_body, VALUE v_inc_non_coll
                 VALUE v_force = Util::vector_to_value(force.Scale(M_INCH_TO_METER));
                 VALUE v_speed = Util::to_value(speed);
                 if (proc_given) {
-                    VALUE v_result = rb_yield_values(6, v_touching_body, touching_body_data->m_user_data, v_point, v_normal, v_force, v_speed);
+                    VALUE v_result = rb_yield_values(6, v_touching_body, touching_body_data->m_cold->m_user_data, v_point, v_normal, v_force, v_speed);
                     if (v_result != Qnil) rb_ary_push(v_contacts, v_result);
                 }
                 else
-                    rb_ary_push(v_contacts, rb_ary_new3(6, v_touching_body, touching_body_data->m_user_data, v_point, v_normal, v_force, v_speed));
+                    rb_ary_push(v_contacts, rb_ary_new3(6, v_touching_body, touching_body_data->m_cold->m_user_data, v_point, v_normal, v_force, v_speed));
             }
         }
     }
@@ -1462,7 +1546,7 @@ VALUE MSP::Body::rbf_get_touching_bodies(VALUE self, VALUE v_body, VALUE v_inc_n
         VALUE v_touching_body = c_body_to_value(touching_body);
         if (proc_given) {
             BodyData* touching_body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(touching_body));
-            VALUE v_result = rb_yield_values(2, v_touching_body, touching_body_data->m_user_data);
+            VALUE v_result = rb_yield_values(2, v_touching_body, touching_body_data->m_cold->m_user_data);
             if (v_result != Qnil) rb_ary_push(v_touching_bodies, v_result);
         }
         else
@@ -1486,18 +1570,18 @@ VALUE MSP::Body::rbf_get_touching_bodies(VALUE self, VALUE v_body, VALUE v_inc_n
     return v_touching_bodies;
 }
 
-VALUE MSP::Body::rbf_get_contact_points(VALUE self, VALUE v_body, VALUE v_inc_non_collidable) {
+VALUE MSP::Body::rbf_get_contact_points(VALUE self, VALUE v_body, VALUE v_inc_non_collidable, VALUE v_packed) {
     const NewtonBody* body = c_value_to_body(v_body);
     bool inc_non_collidable = Util::value_to_bool(v_inc_non_collidable);
     const NewtonWorld* world = NewtonBodyGetWorld(body);
-    VALUE v_contact_points = rb_ary_new();
+    std::vector<dVector> contact_points;
     for (NewtonJoint* joint = NewtonBodyGetFirstContactJoint(body); joint; joint = NewtonBodyGetNextContactJoint(body, joint)) {
         for (void* contact = NewtonContactJointGetFirstContact(joint); contact; contact = NewtonContactJointGetNextContact(joint, contact)) {
             NewtonMaterial* material = NewtonContactGetMaterial(contact);
             dVector point;
             dVector normal;
             NewtonMaterialGetContactPositionAndNormal(material, body, &point[0], &normal[0]);
-            rb_ary_push(v_contact_points, Util::point_to_value(point));
+            contact_points.push_back(point);
         }
     }
     if (inc_non_collidable) {
@@ -1516,22 +1600,25 @@ VALUE MSP::Body::rbf_get_contact_points(VALUE self, VALUE v_body, VALUE v_inc_no
             colB = NewtonBodyGetCollision(tbody);
             NewtonBodyGetMatrix(tbody, &matB[0][0]);
             int count = NewtonCollisionCollide(world, MSP_NON_COL_CONTACTS_CAPACITY, colA, &matA[0][0], colB, &matB[0][0], points, normals, penetrations, attrA, attrB, 0);
-            if (count == 0) continue;
-            for (int i = 0; i < count*3; i += 3) {
-                dVector point(points[i+0], points[i+1], points[i+2]);
-                rb_ary_push(v_contact_points, Util::point_to_value(point));
-            }
+            for (int i = 0; i < count*3; i += 3)
+                contact_points.push_back(dVector(points[i+0], points[i+1], points[i+2]));
         }
     }
-    return v_contact_points;
+    const dVector* data = contact_points.empty() ? nullptr : &contact_points[0];
+    unsigned int num_points = static_cast<unsigned int>(contact_points.size());
+    if (Util::value_to_bool(v_packed))
+        return Util::points_to_packed(data, num_points);
+    else
+        return Util::points_to_value(data, num_points);
 }
 
-VALUE MSP::Body::rbf_get_collision_faces(VALUE self, VALUE v_body) {
+VALUE MSP::Body::rbf_get_collision_faces(VALUE self, VALUE v_body, VALUE v_packed) {
     const NewtonBody* body = c_value_to_body(v_body);
     const NewtonCollision* collision = NewtonBodyGetCollision(body);
     dMatrix matrix;
     NewtonBodyGetMatrix(body, &matrix[0][0]);
     CollisionIteratorData iterator_data(rb_ary_new());
+    iterator_data.m_packed = Util::value_to_bool(v_packed);
     NewtonCollisionForEachPolygonDo(collision, &matrix[0][0], collision_iterator, reinterpret_cast<void*>(&iterator_data));
     return iterator_data.m_faces;
 }
@@ -1596,13 +1683,13 @@ VALUE MSP::Body::rbf_apply_pick_and_drag(VALUE self, VALUE v_body, VALUE v_pick_
     NewtonBodySetFreezeState(body, 0);
     // Set it active
     NewtonBodySetSleepState(body, 0);
+    MSP::World::c_invalidate_body_snapshot(NewtonBodyGetWorld(body));
     // Return success
     return Qtrue;
 }
 
 VALUE MSP::Body::rbf_apply_buoyancy(VALUE self, VALUE v_body, VALUE v_plane_origin, VALUE v_plane_normal, VALUE v_density, VALUE v_linear_viscosity, VALUE v_angular_viscosity, VALUE v_linear_current, VALUE v_angular_current, VALUE v_timestep) {
     const NewtonBody* body = c_value_to_body(v_body);
-    const NewtonCollision* collision = NewtonBodyGetCollision(body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
     const NewtonWorld* world = NewtonBodyGetWorld(body);
     MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world));
@@ -1622,43 +1709,13 @@ VALUE MSP::Body::rbf_apply_buoyancy(VALUE self, VALUE v_body, VALUE v_plane_orig
     normal.m_w = plane_matrix.UntransformVector(Util::ORIGIN).m_z;
 
     dMatrix transformation_matrix;
-    dVector com;
     NewtonBodyGetMatrix(body, &transformation_matrix[0][0]);
-    NewtonBodyGetCentreOfMass(body, &com[0]);
-    com = transformation_matrix.TransformVector(com);
-
-    dVector force(0.0f);
-    dVector torque(0.0f);
-    NewtonConvexCollisionCalculateBuoyancyAcceleration(collision, &transformation_matrix[0][0], &com[0], &world_data->m_gravity[0], &normal[0], density, 0.0f, &force[0], &torque[0]);
 
-    dVector inertia;
-    dFloat mass;
-    NewtonBodyGetMass(body, &mass, &inertia.m_x, &inertia.m_y, &inertia.m_z);
-
-    if (dAbs(force.m_x) > M_EPSILON || dAbs(force.m_y) > M_EPSILON || dAbs(force.m_z) > M_EPSILON) {
-        c_body_add_force(body_data, force);
-        if (linear_viscosity > M_EPSILON) {
-            dVector veloc;
-            NewtonBodyGetVelocity(body, &veloc[0]);
-            dVector viscous_force((linear_current - veloc).Scale(mass * linear_viscosity / timestep));
-            c_body_add_force(body_data, viscous_force);
-        }
-    }
-    if (dAbs(torque.m_x) > M_EPSILON || dAbs(torque.m_y) > M_EPSILON || dAbs(torque.m_z) > M_EPSILON) {
-        c_body_add_torque(body_data, torque);
-        if (angular_viscosity > M_EPSILON) {
-            dVector omega;
-            NewtonBodyGetOmega(body, &omega[0]);
-            omega = transformation_matrix.UnrotateVector(angular_current - omega);
-            dFloat mag = angular_viscosity / timestep;
-            dVector viscous_torque(
-                omega.m_x * inertia.m_x * mag,
-                omega.m_y * inertia.m_y * mag,
-                omega.m_z * inertia.m_z * mag);
-            viscous_torque = transformation_matrix.RotateVector(viscous_torque);
-            c_body_add_torque(body_data, viscous_torque);
-        }
-    }
+    dVector force;
+    dVector torque;
+    c_calculate_buoyancy(body, transformation_matrix, normal, world_data->m_gravity, density, linear_viscosity, angular_viscosity, linear_current, angular_current, timestep, force, torque);
+    c_body_add_force(body_data, force);
+    c_body_add_torque(body_data, torque);
 
     return Qtrue;
 }
@@ -1671,24 +1728,26 @@ VALUE MSP::Body::rbf_apply_aerodynamics(VALUE self, VALUE v_body, VALUE v_drag,
     if (body_data->m_bstatic || !body_data->m_dynamic)
         return Qnil;
     const NewtonCollision* collision = NewtonBodyGetCollision(body);
+    MSP::Collision::AerodynamicTable fallback;
+    const MSP::Collision::AerodynamicTable& table = MSP::Collision::c_get_aerodynamic_table(collision, fallback);
     dMatrix matrix;
     dVector centre;
     NewtonBodyGetMatrix(body, &matrix[0][0]);
     NewtonBodyGetCentreOfMass(body, &centre[0]);
-    centre = matrix.TransformVector(centre);
     dVector velocity;
-    dVector omega;
     NewtonBodyGetVelocity(body, &velocity[0]);
-    NewtonBodyGetOmega(body, &omega[0]);
-    CollisionIteratorData2* iterator_data = new CollisionIteratorData2(body, centre, velocity, omega, drag, wind, dVector(0.0f), dVector(0.0f));
-    NewtonCollisionForEachPolygonDo(collision, &matrix[0][0], collision_iterator4, reinterpret_cast<void*>(iterator_data));
+    // Drag is summed in the local space of the collision, where the table
+    // lives, and rotated back to world space.
+    dVector force;
+    dVector torque;
+    MSP::Collision::c_compute_drag(table, matrix.UnrotateVector(velocity), centre, force, torque);
+    force = matrix.RotateVector(force.Scale(drag));
+    torque = matrix.RotateVector(torque.Scale(drag));
 
-    c_body_add_force(body_data, iterator_data->m_force);
-    c_body_add_torque(body_data, iterator_data->m_torque);
+    c_body_add_force(body_data, force);
+    c_body_add_torque(body_data, torque);
 
-    VALUE v_result = rb_ary_new3(2, Util::vector_to_value(iterator_data->m_force.Scale(M_INCH_TO_METER)), Util::vector_to_value(iterator_data->m_torque.Scale(M_INCH2_TO_METER2)));
-    delete iterator_data;
-    return v_result;
+    return rb_ary_new3(2, Util::vector_to_value(force.Scale(M_INCH_TO_METER)), Util::vector_to_value(torque.Scale(M_INCH2_TO_METER2)));
 }
 
 VALUE MSP::Body::rbf_copy(VALUE self, VALUE v_body, VALUE v_matrix, VALUE v_reapply_forces, VALUE v_type, VALUE v_group) {
@@ -1727,10 +1786,17 @@ VALUE MSP::Body::rbf_copy(VALUE self, VALUE v_body, VALUE v_matrix, VALUE v_reap
     NewtonBodyGetCentreOfMass(body, &com[0]);
     NewtonBodySetCentreOfMass(new_body, &com[0]);
 
-    BodyData* new_data = new BodyData(body_data, v_group);
+    BodyData* new_data = world_data->m_body_pool.create(body_data, v_group);
+    for (std::map<const NewtonBody*, bool>::iterator it = new_data->m_cold->m_non_collidable_bodies.begin(); it != new_data->m_cold->m_non_collidable_bodies.end(); ++it) {
+        BodyData* other_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(it->first));
+        other_data->m_cold->m_non_collidable_bodies[new_body] = true;
+        other_data->m_non_collidable_count = static_cast<unsigned int>(other_data->m_cold->m_non_collidable_bodies.size());
+    }
 
-    s_valid_bodies.insert(new_body);
+    new_data->m_handle = s_valid_bodies.insert(new_body);
+    MSP::World::c_invalidate_body_snapshot(world);
     NewtonBodySetUserData(new_body, new_data);
+    c_update_force_model(new_body);
 
     VALUE v_new_body = c_body_to_value(new_body);
 
@@ -1757,7 +1823,7 @@ VALUE MSP::Body::rbf_copy(VALUE self, VALUE v_body, VALUE v_matrix, VALUE v_reap
     NewtonBodySetContinuousCollisionMode(new_body, NewtonBodyGetContinuousCollisionMode(body));
 
     NewtonBodySetFreezeState(new_body, NewtonBodyGetFreezeState(body));
-    NewtonBodySetAutoSleep(new_body, body_data->m_auto_sleep_enabled ? 1 : 0);
+    NewtonBodySetAutoSleep(new_body, body_data->m_cold->m_auto_sleep_enabled ? 1 : 0);
     NewtonBodySetCollidable(new_body, body_data->m_collidable ? 1 : 0);
 
     if (reapply_forces) {
@@ -1775,7 +1841,7 @@ VALUE MSP::Body::rbf_copy(VALUE self, VALUE v_body, VALUE v_matrix, VALUE v_reap
 VALUE MSP::Body::rbf_get_destructor_proc(VALUE self, VALUE v_body) {
     const NewtonBody* body = c_value_to_body(v_body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
-    return body_data->m_destructor_proc;
+    return body_data->m_cold->m_destructor_proc;
 }
 
 VALUE MSP::Body::rbf_set_destructor_proc(VALUE self, VALUE v_body, VALUE v_proc) {
@@ -1784,7 +1850,7 @@ VALUE MSP::Body::rbf_set_destructor_proc(VALUE self, VALUE v_body, VALUE v_proc)
     const NewtonWorld* world = NewtonBodyGetWorld(body);
     MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world));
     if (v_proc == Qnil || rb_class_of(v_proc) == rb_cProc) {
-        body_data->m_destructor_proc = v_proc;
+        body_data->m_cold->m_destructor_proc = v_proc;
         rb_hash_aset(world_data->m_body_destructors, c_body_to_value(body), v_proc);
     }
     else
@@ -1795,7 +1861,7 @@ VALUE MSP::Body::rbf_set_destructor_proc(VALUE self, VALUE v_body, VALUE v_proc)
 VALUE MSP::Body::rbf_get_user_data(VALUE self, VALUE v_body) {
     const NewtonBody* body = c_value_to_body(v_body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
-    return body_data->m_user_data;
+    return body_data->m_cold->m_user_data;
 }
 
 VALUE MSP::Body::rbf_set_user_data(VALUE self, VALUE v_body, VALUE v_user_data) {
@@ -1803,7 +1869,7 @@ VALUE MSP::Body::rbf_set_user_data(VALUE self, VALUE v_body, VALUE v_user_data)
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
     const NewtonWorld* world = NewtonBodyGetWorld(body);
     MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world));
-    body_data->m_user_data = v_user_data;
+    body_data->m_cold->m_user_data = v_user_data;
     rb_hash_aset(world_data->m_body_user_datas, c_body_to_value(body), v_user_data);
     return Qnil;
 }
@@ -1818,20 +1884,20 @@ VALUE MSP::Body::rbf_set_record_touch_data_state(VALUE self, VALUE v_body, VALUE
     const NewtonBody* body = c_value_to_body(v_body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
     body_data->m_record_touch_data = Util::value_to_bool(v_state);
-    if (!body_data->m_record_touch_data) body_data->m_touchers.clear();
+    if (!body_data->m_record_touch_data) body_data->m_cold->m_touchers.clear();
     return Qnil;
 }
 
 VALUE MSP::Body::rbf_get_matrix_scale(VALUE self, VALUE v_body) {
     const NewtonBody* body = c_value_to_body(v_body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
-    return Util::vector_to_value(body_data->m_matrix_scale);
+    return Util::vector_to_value(body_data->m_cold->m_matrix_scale);
 }
 
 VALUE MSP::Body::rbf_set_matrix_scale(VALUE self, VALUE v_body, VALUE v_scale) {
     const NewtonBody* body = c_value_to_body(v_body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
-    body_data->m_matrix_scale = Util::value_to_vector(v_scale);
+    body_data->m_cold->m_matrix_scale = Util::value_to_vector(v_scale);
     return Qnil;
 }
 
@@ -1845,6 +1911,7 @@ VALUE MSP::Body::rbf_enable_gravity(VALUE self, VALUE v_body, VALUE v_state) {
     const NewtonBody* body = c_value_to_body(v_body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
     body_data->m_gravity_enabled = Util::value_to_bool(v_state);
+    c_update_force_model(body);
     return Qnil;
 }
 
@@ -1856,75 +1923,61 @@ VALUE MSP::Body::rbf_is_gravity_enabled(VALUE self, VALUE v_body) {
 
 VALUE MSP::Body::rbf_get_contained_joints(VALUE self, VALUE v_body) {
     const NewtonBody* body = c_value_to_body(v_body);
-    const NewtonWorld* world = NewtonBodyGetWorld(body);
-    bool proc_given = (rb_block_given_p() != 0);
-    VALUE v_contained_joints = rb_ary_new();
-    for (std::map<MSP::Joint::JointData*, bool>::const_iterator it = MSP::Joint::s_valid_joints.begin(); it != MSP::Joint::s_valid_joints.end(); ++it) {
-        if (it->first->m_parent == body && it->first->m_world == world) {
-            VALUE v_address = MSP::Joint::c_joint_to_value(it->first);
-            if (proc_given) {
-                VALUE v_result = rb_yield_values(2, v_address, it->first->m_user_data);
-                if (v_result != Qnil) rb_ary_push(v_contained_joints, v_result);
-            }
-            else
-                rb_ary_push(v_contained_joints, v_address);
-        }
+    BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
+    VALUE v_contained_joints = rb_ary_new2(static_cast<long>(body_data->m_cold->m_contained_joints.size()));
+    for (MSP::Joint::JointData* joint_data = body_data->m_cold->m_contained_joints.first(); joint_data != nullptr; joint_data = MSP::Joint::ParentJointList::next(joint_data))
+        rb_ary_push(v_contained_joints, MSP::Joint::c_joint_to_value(joint_data));
+    if (rb_block_given_p() == 0)
+        return v_contained_joints;
+    // The block may destroy joints, so each one is looked up by handle again.
+    VALUE v_results = rb_ary_new();
+    long count = RARRAY_LEN(v_contained_joints);
+    for (long i = 0; i < count; ++i) {
+        VALUE v_address = rb_ary_entry(v_contained_joints, i);
+        MSP::Joint::JointData* joint_data = MSP::Joint::s_valid_joints.find(Util::value_to_ull(v_address));
+        if (joint_data == nullptr) continue;
+        VALUE v_result = rb_yield_values(2, v_address, joint_data->m_user_data);
+        if (v_result != Qnil) rb_ary_push(v_results, v_result);
     }
-    return v_contained_joints;
+    return v_results;
 }
 
 VALUE MSP::Body::rbf_get_connected_joints(VALUE self, VALUE v_body) {
     const NewtonBody* body = c_value_to_body(v_body);
-    const NewtonWorld* world = NewtonBodyGetWorld(body);
-    bool proc_given = (rb_block_given_p() != 0);
-    VALUE v_connected_joints = rb_ary_new();
-    for (std::map<MSP::Joint::JointData*, bool>::const_iterator it = MSP::Joint::s_valid_joints.begin(); it != MSP::Joint::s_valid_joints.end(); ++it) {
-        if (it->first->m_child == body && it->first->m_world == world) {
-            VALUE v_address = MSP::Joint::c_joint_to_value(it->first);
-            if (proc_given) {
-                VALUE v_result = rb_yield_values(2, v_address, it->first->m_user_data);
-                if (v_result != Qnil) rb_ary_push(v_connected_joints, v_result);
-            }
-            else
-                rb_ary_push(v_connected_joints, v_address);
-        }
+    BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
+    VALUE v_connected_joints = rb_ary_new2(static_cast<long>(body_data->m_cold->m_connected_joints.size()));
+    for (MSP::Joint::JointData* joint_data = body_data->m_cold->m_connected_joints.first(); joint_data != nullptr; joint_data = MSP::Joint::ChildJointList::next(joint_data))
+        rb_ary_push(v_connected_joints, MSP::Joint::c_joint_to_value(joint_data));
+    if (rb_block_given_p() == 0)
+        return v_connected_joints;
+    // The block may destroy joints, so each one is looked up by handle again.
+    VALUE v_results = rb_ary_new();
+    long count = RARRAY_LEN(v_connected_joints);
+    for (long i = 0; i < count; ++i) {
+        VALUE v_address = rb_ary_entry(v_connected_joints, i);
+        MSP::Joint::JointData* joint_data = MSP::Joint::s_valid_joints.find(Util::value_to_ull(v_address));
+        if (joint_data == nullptr) continue;
+        VALUE v_result = rb_yield_values(2, v_address, joint_data->m_user_data);
+        if (v_result != Qnil) rb_ary_push(v_results, v_result);
     }
-    return v_connected_joints;
+    return v_results;
 }
 
 VALUE MSP::Body::rbf_get_connected_bodies(VALUE self, VALUE v_body) {
     const NewtonBody* body = c_value_to_body(v_body);
-    const NewtonWorld* world = NewtonBodyGetWorld(body);
-    bool proc_given = (rb_block_given_p() != 0);
+    BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
     VALUE v_connected_bodies = rb_ary_new();
-    for (std::map<MSP::Joint::JointData*, bool>::const_iterator it = MSP::Joint::s_valid_joints.begin(); it != MSP::Joint::s_valid_joints.end(); ++it) {
-        const MSP::Joint::JointData* joint_data = it->first;
-        if (joint_data->m_world == world && joint_data->m_connected) {
-            if (joint_data->m_child == body && joint_data->m_parent != nullptr) {
-                VALUE v_address = c_body_to_value(joint_data->m_parent);
-                if (proc_given) {
-                    BodyData* other_body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(joint_data->m_parent));
-                    VALUE v_result = rb_yield_values(2, v_address, other_body_data->m_user_data);
-                    if (v_result != Qnil)
-                        rb_ary_push(v_connected_bodies, v_result);
-                }
-                else
-                    rb_ary_push(v_connected_bodies, v_address);
-            }
-            else if (joint_data->m_parent == body && joint_data->m_child != nullptr) {
-                VALUE v_address = c_body_to_value(joint_data->m_child);
-                if (proc_given) {
-                    BodyData* other_body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(joint_data->m_child));
-                    VALUE v_result = rb_yield_values(2, v_address, other_body_data->m_user_data);
-                    if (v_result != Qnil)
-                        rb_ary_push(v_connected_bodies, v_result);
-                }
-                else
-                    rb_ary_push(v_connected_bodies, v_address);
-            }
-        }
+    for (MSP::Joint::JointData* joint_data = body_data->m_cold->m_connected_joints.first(); joint_data != nullptr; joint_data = MSP::Joint::ChildJointList::next(joint_data)) {
+        if (joint_data->m_parent == nullptr) continue;
+        const NewtonBody* other_body = s_valid_bodies.find(joint_data->m_parent_handle);
+        if (other_body != nullptr)
+            rb_ary_push(v_connected_bodies, c_body_to_value(other_body));
+    }
+    for (MSP::Joint::JointData* joint_data = body_data->m_cold->m_contained_joints.first(); joint_data != nullptr; joint_data = MSP::Joint::ParentJointList::next(joint_data)) {
+        if (joint_data->m_connected)
+            rb_ary_push(v_connected_bodies, c_body_to_value(joint_data->m_child));
     }
-    return v_connected_bodies;
+    return MSP::World::c_yield_bodies(v_connected_bodies);
 }
 
 VALUE MSP::Body::rbf_get_material_id(VALUE self, VALUE v_body) {
@@ -1945,7 +1998,7 @@ VALUE MSP::Body::rbf_set_material_id(VALUE self, VALUE v_body, VALUE v_id) {
 VALUE MSP::Body::rbf_get_collision_scale(VALUE self, VALUE v_body) {
     const NewtonBody* body = c_value_to_body(v_body);
     const NewtonCollision* collision = NewtonBodyGetCollision(body);
-    return Util::vector_to_value(MSP::Collision::s_valid_collisions[collision]->m_scale);
+    return Util::vector_to_value(MSP::Collision::c_get_collision_data(collision)->m_scale);
 }
 
 VALUE MSP::Body::rbf_set_collision_scale(VALUE self, VALUE v_body, VALUE v_scale) {
@@ -1955,12 +2008,12 @@ VALUE MSP::Body::rbf_set_collision_scale(VALUE self, VALUE v_body, VALUE v_scale
     if (NewtonCollisionGetType(collision) > 6)
         rb_raise(rb_eTypeError, "Only convex collisions can be scaled!");
     dVector scale(Util::value_to_vector(v_scale));
-    dVector& cscale = MSP::Collision::s_valid_collisions[collision]->m_scale;
+    dVector& cscale = MSP::Collision::c_get_collision_data(collision)->m_scale;
     cscale.m_x = Util::clamp_float(scale.m_x, 0.01f, 100.0f);
     cscale.m_y = Util::clamp_float(scale.m_y, 0.01f, 100.0f);
     cscale.m_z = Util::clamp_float(scale.m_z, 0.01f, 100.0f);
-    const dVector& dco = body_data->m_default_collision_offset;
-    const dVector& dcs = body_data->m_default_collision_scale;
+    const dVector& dco = body_data->m_cold->m_default_collision_offset;
+    const dVector& dcs = body_data->m_cold->m_default_collision_scale;
     dMatrix col_matrix;
     NewtonCollisionGetMatrix(collision, &col_matrix[0][0]);
     col_matrix.m_posit.m_x = dco.m_x * scale.m_x / dcs.m_x;
@@ -1968,30 +2021,32 @@ VALUE MSP::Body::rbf_set_collision_scale(VALUE self, VALUE v_body, VALUE v_scale
     col_matrix.m_posit.m_z = dco.m_z * scale.m_z / dcs.m_z;
     NewtonCollisionSetMatrix(collision, &col_matrix[0][0]);
     NewtonBodySetCollisionScale(body, cscale.m_x, cscale.m_y, cscale.m_z);
-    body_data->m_volume = Util::clamp_float(NewtonConvexCollisionCalculateVolume(collision), MIN_VOLUME, MAX_VOLUME) * M_INCH3_TO_METER3;
-    body_data->m_mass = Util::clamp_float(body_data->m_density * body_data->m_volume, MIN_MASS, MAX_MASS);
+    body_data->m_cold->m_volume = Util::clamp_float(NewtonConvexCollisionCalculateVolume(collision), MIN_VOLUME, MAX_VOLUME) * M_INCH3_TO_METER3;
+    body_data->m_mass = Util::clamp_float(body_data->m_cold->m_density * body_data->m_cold->m_volume, MIN_MASS, MAX_MASS);
     dVector com;
     NewtonBodyGetCentreOfMass(body, &com[0]);
     NewtonBodySetMassProperties(body, body_data->m_bstatic ? 0.0f : body_data->m_mass, collision);
+    c_update_force_model(body);
     NewtonBodySetCentreOfMass(body, &com[0]);
     NewtonBodySetSleepState(body, 0);
     body_data->m_matrix_changed = true;
+    MSP::World::c_invalidate_body_snapshot(NewtonBodyGetWorld(body));
     return Qnil;
 }
 
 VALUE MSP::Body::rbf_get_default_collision_scale(VALUE self, VALUE v_body) {
     const NewtonBody* body = c_value_to_body(v_body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
-    return Util::vector_to_value(body_data->m_default_collision_scale);
+    return Util::vector_to_value(body_data->m_cold->m_default_collision_scale);
 }
 
 VALUE MSP::Body::rbf_get_actual_matrix_scale(VALUE self, VALUE v_body) {
     const NewtonBody* body = c_value_to_body(v_body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
     const NewtonCollision* collision = NewtonBodyGetCollision(body);
-    const dVector& dcs = body_data->m_default_collision_scale;
-    const dVector& ms = body_data->m_matrix_scale;
-    const dVector& cs = MSP::Collision::s_valid_collisions[collision]->m_scale;
+    const dVector& dcs = body_data->m_cold->m_default_collision_scale;
+    const dVector& ms = body_data->m_cold->m_matrix_scale;
+    const dVector& cs = MSP::Collision::c_get_collision_data(collision)->m_scale;
     dVector actual_matrix_scale(ms.m_x * cs.m_x / dcs.m_x, ms.m_y * cs.m_y / dcs.m_y, ms.m_z * cs.m_z / dcs.m_z);
     return Util::vector_to_value(actual_matrix_scale);
 }
@@ -1999,7 +2054,7 @@ VALUE MSP::Body::rbf_get_actual_matrix_scale(VALUE self, VALUE v_body) {
 VALUE MSP::Body::rbf_get_group(VALUE self, VALUE v_body) {
     const NewtonBody* body = c_value_to_body(v_body);
     BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(body));
-    return body_data->m_group;
+    return body_data->m_cold->m_group;
 }
 
 VALUE MSP::Body::rbf_get_body_by_group(VALUE self, VALUE v_world, VALUE v_group) {
@@ -2020,7 +2075,7 @@ VALUE MSP::Body::rbf_get_body_data_by_group(VALUE self, VALUE v_world, VALUE v_g
         return Qnil;
     else {
         BodyData* body_data = reinterpret_cast<BodyData*>(NewtonBodyGetUserData(it->second));
-        return body_data->m_user_data;
+        return body_data->m_cold->m_user_data;
     }
 }
 
@@ -2036,6 +2091,7 @@ void MSP::Body::init_ruby(VALUE mNewton) {
 
     rb_define_module_function(mBody, "is_valid?", VALUEFUNC(MSP::Body::rbf_is_valid), 1);
     rb_define_module_function(mBody, "create", VALUEFUNC(MSP::Body::rbf_create), 6);
+    rb_define_module_function(mBody, "create_many", VALUEFUNC(MSP::Body::rbf_create_many), 6);
     rb_define_module_function(mBody, "destroy", VALUEFUNC(MSP::Body::rbf_destroy), 1);
     rb_define_module_function(mBody, "get_type", VALUEFUNC(MSP::Body::rbf_get_type), 1);
     rb_define_module_function(mBody, "get_world", VALUEFUNC(MSP::Body::rbf_get_world), 1);
@@ -2120,8 +2176,8 @@ void MSP::Body::init_ruby(VALUE mNewton) {
     rb_define_module_function(mBody, "get_net_joint_tension2", VALUEFUNC(MSP::Body::rbf_get_net_joint_tension2), 1);
     rb_define_module_function(mBody, "get_contacts", VALUEFUNC(MSP::Body::rbf_get_contacts), 2);
     rb_define_module_function(mBody, "get_touching_bodies", VALUEFUNC(MSP::Body::rbf_get_touching_bodies), 2);
-    rb_define_module_function(mBody, "get_contact_points", VALUEFUNC(MSP::Body::rbf_get_contact_points), 2);
-    rb_define_module_function(mBody, "get_collision_faces", VALUEFUNC(MSP::Body::rbf_get_collision_faces), 1);
+    rb_define_module_function(mBody, "get_contact_points", VALUEFUNC(MSP::Body::rbf_get_contact_points), 3);
+    rb_define_module_function(mBody, "get_collision_faces", VALUEFUNC(MSP::Body::rbf_get_collision_faces), 2);
     rb_define_module_function(mBody, "get_collision_faces2", VALUEFUNC(MSP::Body::rbf_get_collision_faces2), 1);
     rb_define_module_function(mBody, "get_collision_faces3", VALUEFUNC(MSP::Body::rbf_get_collision_faces3), 1);
     rb_define_module_function(mBody, "apply_pick_and_drag", VALUEFUNC(MSP::Body::rbf_apply_pick_and_drag), 6);
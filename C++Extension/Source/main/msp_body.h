@@ -10,6 +10,7 @@
 #define MSP_BODY_H
 
 #include "msp.h"
+#include "msp_joint.h"
 
 class MSP::Body {
 public:
@@ -34,90 +35,168 @@ public:
     static const dFloat MAX_VOLUME;
     static const dFloat MIN_DENSITY;
     static const dFloat MAX_DENSITY;
+    static const int FORCE_DAMPED;
+    static const int FORCE_PENDING;
 
     // Structures
+    struct TouchersTable {
+        struct Entry {
+            const NewtonBody* m_body;
+            char m_state;
+        };
+        std::vector<Entry> m_entries;
+        unsigned int m_count;
+        TouchersTable() :
+            m_count(0)
+        {
+        }
+        unsigned int capacity() const {
+            return static_cast<unsigned int>(m_entries.size());
+        }
+        bool empty() const {
+            return m_count == 0;
+        }
+        static unsigned int c_hash(const NewtonBody* body);
+        char* find(const NewtonBody* body);
+        void set(const NewtonBody* body, char state);
+        void erase(const NewtonBody* body);
+        void clear();
+    };
+
+    // Settings and containers that are only touched from Ruby or on rare
+    // events. Kept apart from BodyData, so that per-step callbacks do not
+    // pull them into cache.
+    struct BodyColdData {
+        dFloat m_density;
+        dFloat m_volume;
+        dVector m_linear_damping;
+        dVector m_angular_damping;
+        bool m_linear_damping_enabled;
+        bool m_angular_damping_enabled;
+        bool m_auto_sleep_enabled;
+        std::map<const NewtonBody*, bool> m_non_collidable_bodies;
+        TouchersTable m_touchers;
+        VALUE m_destructor_proc;
+        VALUE m_user_data;
+        VALUE m_group;
+        dVector m_matrix_scale;
+        dVector m_default_collision_scale;
+        dVector m_default_collision_offset;
+        // Joints with this body as parent and as child
+        MSP::Joint::ParentJointList m_contained_joints;
+        MSP::Joint::ChildJointList m_connected_joints;
+        BodyColdData(const dVector& matrix_scale, const dVector& default_collision_scale, const dVector& default_collision_offset, const VALUE& v_group) :
+            m_density(DEFAULT_DENSITY),
+            m_volume(0.0f),
+            m_linear_damping(DEFAULT_LINEAR_DAMPING),
+            m_angular_damping(DEFAULT_ANGULAR_DAMPING),
+            m_linear_damping_enabled(DEFAULT_LINEAR_DAMPING_ENABLED),
+            m_angular_damping_enabled(DEFAULT_ANGULAR_DAMPING_ENABLED),
+            m_auto_sleep_enabled(DEFAULT_AUTO_SLEEP_ENABLED),
+            m_destructor_proc(Qnil),
+            m_user_data(Qnil),
+            m_group(v_group),
+            m_matrix_scale(matrix_scale),
+            m_default_collision_scale(default_collision_scale),
+            m_default_collision_offset(default_collision_offset)
+        {
+        }
+        BodyColdData(const BodyColdData* other_cold, const VALUE& v_group) :
+            m_density(other_cold->m_density),
+            m_volume(other_cold->m_volume),
+            m_linear_damping(other_cold->m_linear_damping),
+            m_angular_damping(other_cold->m_angular_damping),
+            m_linear_damping_enabled(other_cold->m_linear_damping_enabled),
+            m_angular_damping_enabled(other_cold->m_angular_damping_enabled),
+            m_auto_sleep_enabled(other_cold->m_auto_sleep_enabled),
+            m_non_collidable_bodies(other_cold->m_non_collidable_bodies),
+            m_destructor_proc(Qnil),
+            m_user_data(Qnil),
+            m_group(v_group),
+            m_matrix_scale(other_cold->m_matrix_scale),
+            m_default_collision_scale(other_cold->m_default_collision_scale),
+            m_default_collision_offset(other_cold->m_default_collision_offset)
+        {
+        }
+    };
+
+    // Per-step data, allocated from the body pool of the world. Fields are
+    // ordered by the callbacks that read them: the force callback uses the
+    // first two cache lines and the collision callbacks use the third.
     struct BodyData {
+        // Force callback
         dVector m_add_force;
         dVector m_add_torque;
         dVector m_set_force;
         dVector m_set_torque;
+        // Force model, refreshed by c_update_force_model when mass, damping
+        // or gravity settings change. Drag terms hold damping times mass and
+        // inertia along the local axes.
+        dVector m_linear_drag;
+        dVector m_angular_drag;
+        dFloat m_gravity_scale;
+        dFloat m_mass;
+        int m_force_flags;
+        int m_material_id;
         bool m_add_force_state;
         bool m_add_torque_state;
         bool m_set_force_state;
         bool m_set_torque_state;
         bool m_dynamic;
         bool m_bstatic;
-        dFloat m_density;
-        dFloat m_volume;
-        dFloat m_mass;
+        bool m_gravity_enabled;
+        bool m_matrix_changed;
+        // Collision callbacks
+        bool m_collidable;
+        bool m_friction_enabled;
+        bool m_record_touch_data;
+        bool m_magnetic;
+        unsigned int m_non_collidable_count;
         dFloat m_elasticity;
         dFloat m_softness;
         dFloat m_static_friction;
         dFloat m_kinetic_friction;
-        dVector m_linear_damping;
-        dVector m_angular_damping;
-        bool m_linear_damping_enabled;
-        bool m_angular_damping_enabled;
-        bool m_friction_enabled;
-        bool m_auto_sleep_enabled;
-        bool m_collidable;
-        std::map<const NewtonBody*, bool> m_non_collidable_bodies;
-        bool m_record_touch_data;
-        std::map<const NewtonBody*, char> m_touchers;
+        // Magnet update
         int m_magnet_mode;
         dFloat m_magnet_force;
         dFloat m_magnet_range;
         dFloat m_magnet_strength;
-        bool m_magnetic;
-        VALUE m_destructor_proc;
-        VALUE m_user_data;
-        VALUE m_group;
-        dVector m_matrix_scale;
-        dVector m_default_collision_scale;
-        dVector m_default_collision_offset;
-        bool m_matrix_changed;
-        bool m_gravity_enabled;
-        int m_material_id;
+        unsigned long long m_handle;
+        BodyColdData* m_cold;
         BodyData(const dVector& matrix_scale, const dVector& default_collision_scale, const dVector& default_collision_offset, int material_id, const VALUE& v_group) :
             m_add_force(0.0f),
             m_add_torque(0.0f),
             m_set_force(0.0f),
             m_set_torque(0.0f),
+            m_linear_drag(0.0f),
+            m_angular_drag(0.0f),
+            m_gravity_scale(0.0f),
+            m_mass(0.0f),
+            m_force_flags(0),
+            m_material_id(material_id),
             m_add_force_state(false),
             m_add_torque_state(false),
             m_set_force_state(false),
             m_set_torque_state(false),
             m_dynamic(false),
             m_bstatic(false),
-            m_density(DEFAULT_DENSITY),
-            m_volume(0.0f),
-            m_mass(0.0f),
+            m_gravity_enabled(DEFAULT_GRAVITY_ENABLED),
+            m_matrix_changed(false),
+            m_collidable(DEFAULT_COLLIDABLE),
+            m_friction_enabled(DEFAULT_FRICTION_ENABLED),
+            m_record_touch_data(false),
+            m_magnetic(DEFAULT_MAGNETIC),
+            m_non_collidable_count(0),
             m_elasticity(DEFAULT_ELASTICITY),
             m_softness(DEFAULT_SOFTNESS),
             m_static_friction(DEFAULT_STATIC_FRICTION_COEF),
             m_kinetic_friction(DEFAULT_KINETIC_FRICTION_COEF),
-            m_linear_damping(DEFAULT_LINEAR_DAMPING),
-            m_angular_damping(DEFAULT_ANGULAR_DAMPING),
-            m_linear_damping_enabled(DEFAULT_LINEAR_DAMPING_ENABLED),
-            m_angular_damping_enabled(DEFAULT_ANGULAR_DAMPING_ENABLED),
-            m_friction_enabled(DEFAULT_FRICTION_ENABLED),
-            m_auto_sleep_enabled(DEFAULT_AUTO_SLEEP_ENABLED),
-            m_collidable(DEFAULT_COLLIDABLE),
-            m_record_touch_data(false),
             m_magnet_mode(1),
             m_magnet_force(0.0f),
             m_magnet_range(0.0f),
             m_magnet_strength(0.0f),
-            m_magnetic(DEFAULT_MAGNETIC),
-            m_destructor_proc(Qnil),
-            m_user_data(Qnil),
-            m_group(v_group),
-            m_matrix_scale(matrix_scale),
-            m_default_collision_scale(default_collision_scale),
-            m_default_collision_offset(default_collision_offset),
-            m_matrix_changed(false),
-            m_gravity_enabled(DEFAULT_GRAVITY_ENABLED),
-            m_material_id(material_id)
+            m_handle(0),
+            m_cold(new BodyColdData(matrix_scale, default_collision_scale, default_collision_offset, v_group))
         {
         }
         BodyData(const BodyData* other_body, const VALUE& v_group) :
@@ -125,79 +204,56 @@ public:
             m_add_torque(0.0f),
             m_set_force(0.0f),
             m_set_torque(0.0f),
+            m_linear_drag(0.0f),
+            m_angular_drag(0.0f),
+            m_gravity_scale(0.0f),
+            m_mass(other_body->m_mass),
+            m_force_flags(0),
+            m_material_id(other_body->m_material_id),
             m_add_force_state(false),
             m_add_torque_state(false),
             m_set_force_state(false),
             m_set_torque_state(false),
             m_dynamic(other_body->m_dynamic),
             m_bstatic(other_body->m_bstatic),
-            m_density(other_body->m_density),
-            m_volume(other_body->m_volume),
-            m_mass(other_body->m_mass),
+            m_gravity_enabled(other_body->m_gravity_enabled),
+            m_matrix_changed(false),
+            m_collidable(other_body->m_collidable),
+            m_friction_enabled(other_body->m_friction_enabled),
+            m_record_touch_data(false),
+            m_magnetic(other_body->m_magnetic),
+            m_non_collidable_count(other_body->m_non_collidable_count),
             m_elasticity(other_body->m_elasticity),
             m_softness(other_body->m_softness),
             m_static_friction(other_body->m_static_friction),
             m_kinetic_friction(other_body->m_kinetic_friction),
-            m_linear_damping(other_body->m_linear_damping),
-            m_angular_damping(other_body->m_angular_damping),
-            m_linear_damping_enabled(other_body->m_linear_damping_enabled),
-            m_angular_damping_enabled(other_body->m_angular_damping_enabled),
-            m_friction_enabled(other_body->m_friction_enabled),
-            m_auto_sleep_enabled(other_body->m_auto_sleep_enabled),
-            m_collidable(other_body->m_collidable),
-            m_non_collidable_bodies(other_body->m_non_collidable_bodies),
-            m_record_touch_data(false),
+            m_magnet_mode(other_body->m_magnet_mode),
             m_magnet_force(other_body->m_magnet_force),
             m_magnet_range(other_body->m_magnet_range),
-            m_magnetic(other_body->m_magnetic),
-            m_destructor_proc(Qnil),
-            m_user_data(Qnil),
-            m_group(v_group),
-            m_matrix_scale(other_body->m_matrix_scale),
-            m_default_collision_scale(other_body->m_default_collision_scale),
-            m_default_collision_offset(other_body->m_default_collision_offset),
-            m_matrix_changed(false),
-            m_gravity_enabled(other_body->m_gravity_enabled),
-            m_material_id(other_body->m_material_id)
+            m_magnet_strength(other_body->m_magnet_strength),
+            m_handle(0),
+            m_cold(new BodyColdData(other_body->m_cold, v_group))
         {
         }
         ~BodyData()
         {
+            delete m_cold;
         }
     };
 
     struct CollisionIteratorData {
         VALUE m_faces;
+        bool m_packed;
+        std::vector<dVector> m_vertices;
         CollisionIteratorData(VALUE v_faces) :
-            m_faces(v_faces)
-        {
-        }
-    };
-
-    struct CollisionIteratorData2 {
-        const NewtonBody* m_body;
-        dVector m_centre;
-        dVector m_velocity;
-        dVector m_omega;
-        dFloat m_drag;
-        dVector m_wind;
-        dVector m_force;
-        dVector m_torque;
-        CollisionIteratorData2(const NewtonBody* body, const dVector& centre, const dVector& velocity, const dVector& omega, dFloat drag, const dVector& wind, const dVector& force, const dVector& torque) :
-            m_body(body),
-            m_centre(centre),
-            m_velocity(velocity),
-            m_omega(omega),
-            m_drag(drag),
-            m_wind(wind),
-            m_force(force),
-            m_torque(torque)
+            m_faces(v_faces),
+            m_packed(false)
         {
         }
     };
 
     // Variables
-    static std::set<const NewtonBody*> s_valid_bodies;
+    static HandleTable<const NewtonBody*> s_valid_bodies;
 
     // Callbacks
     static void destructor_callback(const NewtonBody* const body);
@@ -206,10 +262,9 @@ public:
     static void collision_iterator(void* const user_data, int vertex_count, const dFloat* const face_array, int face_id);
     static void collision_iterator2(void* const user_data, int vertex_count, const dFloat* const face_array, int face_id);
     static void collision_iterator3(void* const user_data, int vertex_count, const dFloat* const face_array, int face_id);
-    static void collision_iterator4(void* const user_data, int vertex_count, const dFloat* const face_array, int face_id);
 
     // Helper Functions
-    static bool c_is_body_valid(const NewtonBody* address);
+    static bool c_is_body_valid(unsigned long long handle);
     static VALUE c_body_to_value(const NewtonBody* body);
     static const NewtonBody* c_value_to_body(VALUE v_body);
     static bool c_bodies_collidable(const NewtonBody* body0, const NewtonBody* body1);
@@ -220,10 +275,30 @@ public:
     static void c_body_set_force(BodyData* body_data, const dVector& force);
     static void c_body_add_torque(BodyData* body_data, const dVector& torque);
     static void c_body_set_torque(BodyData* body_data, const dVector& torque);
+    static void c_body_get_matrix(const NewtonBody* body, dMatrix& matrix_out);
+    static void c_update_force_model(const NewtonBody* body);
+    static void c_apply_pending_forces(BodyData* body_data, dVector& force, dVector& torque);
+    static bool c_calculate_buoyancy(
+        const NewtonBody* body,
+        const dMatrix& matrix,
+        const dVector& plane,
+        const dVector& gravity,
+        dFloat density,
+        dFloat linear_viscosity,
+        dFloat angular_viscosity,
+        const dVector& linear_current,
+        const dVector& angular_current,
+        dFloat timestep,
+        dVector& force_out,
+        dVector& torque_out);
+    static void c_apply_fluid_volumes(const NewtonBody* body, dFloat timestep, dVector& force, dVector& torque);
+    static dFloat c_calculate_collision_volume(const NewtonCollision* collision);
+    static const NewtonBody* c_create(const NewtonWorld* world, const NewtonCollision* collision, dMatrix matrix, int type, int id, VALUE v_group, dFloat volume);
 
     // Ruby Functions
     static VALUE rbf_is_valid(VALUE self, VALUE v_body);
     static VALUE rbf_create(VALUE self, VALUE v_world, VALUE v_collision, VALUE v_matrix, VALUE v_type, VALUE v_id, VALUE v_group);
+    static VALUE rbf_create_many(VALUE self, VALUE v_world, VALUE v_collision, VALUE v_matrices, VALUE v_type, VALUE v_ids, VALUE v_groups);
     static VALUE rbf_destroy(VALUE self, VALUE v_body);
     static VALUE rbf_get_type(VALUE self, VALUE v_body);
     static VALUE rbf_get_world(VALUE self, VALUE v_body);
@@ -308,8 +383,8 @@ public:
     static VALUE rbf_get_net_joint_tension2(VALUE self, VALUE v_body);
     static VALUE rbf_get_contacts(VALUE self, VALUE v_body, VALUE v_inc_non_collidable);
     static VALUE rbf_get_touching_bodies(VALUE self, VALUE v_body, VALUE v_inc_non_collidable);
-    static VALUE rbf_get_contact_points(VALUE self, VALUE v_body, VALUE v_inc_non_collidable);
-    static VALUE rbf_get_collision_faces(VALUE self, VALUE v_body);
+    static VALUE rbf_get_contact_points(VALUE self, VALUE v_body, VALUE v_inc_non_collidable, VALUE v_packed);
+    static VALUE rbf_get_collision_faces(VALUE self, VALUE v_body, VALUE v_packed);
     static VALUE rbf_get_collision_faces2(VALUE self, VALUE v_body);
     static VALUE rbf_get_collision_faces3(VALUE self, VALUE v_body);
     static VALUE rbf_apply_pick_and_drag(VALUE self, VALUE v_body, VALUE v_pick_pt, VALUE v_dest_pt, VALUE v_stiffness, VALUE v_damp, VALUE v_timestep);
@@ -9,6 +9,13 @@
 #include "msp_collision.h"
 #include "msp_world.h"
 
+#if !defined(_WIN_32_VER) && !defined(_WIN_64_VER)
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
 /*
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
   Constants
@@ -17,6 +24,9 @@
 
 const dFloat MSP::Collision::MIN_SIZE(1.0e-4f);
 const dFloat MSP::Collision::MAX_SIZE(1.0e5f);
+const unsigned int MSP::Collision::DISK_CACHE_MAGIC(0x4353504D); // MPSC
+const unsigned int MSP::Collision::DISK_CACHE_VERSION(1);
+const dFloat MSP::Collision::DECOMPOSITION_PROGRESS_SHARE(0.8f);
 
 
 /*
@@ -25,7 +35,73 @@ const dFloat MSP::Collision::MAX_SIZE(1.0e5f);
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 */
 
-std::map<const NewtonCollision*, MSP::Collision::CollisionData*> MSP::Collision::s_valid_collisions;
+MSP::HandleTable<const NewtonCollision*> MSP::Collision::s_valid_collisions;
+std::string MSP::Collision::s_disk_cache_path;
+
+
+/*
+ ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+  Callback Functions
+ ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+void MSP::Collision::serialize_callback(void* const serialize_handle, const void* const buffer, int size) {
+    std::vector<char>* blob = reinterpret_cast<std::vector<char>*>(serialize_handle);
+    const char* bytes = reinterpret_cast<const char*>(buffer);
+    blob->insert(blob->end(), bytes, bytes + size);
+}
+
+void MSP::Collision::deserialize_callback(void* const serialize_handle, void* const buffer, int size) {
+    SerializeReader* reader = reinterpret_cast<SerializeReader*>(serialize_handle);
+    size_t count = static_cast<size_t>(size);
+    size_t available = reader->m_size - reader->m_offset;
+    if (count > available) {
+        // Never read past the mapping; a truncated blob yields zeros.
+        memset(reinterpret_cast<char*>(buffer) + available, 0, count - available);
+        count = available;
+    }
+    memcpy(buffer, reader->m_data + reader->m_offset, count);
+    reader->m_offset += count;
+}
+
+void MSP::Collision::aerodynamic_face_iterator(void* const user_data, int vertex_count, const dFloat* const face_array, int face_id) {
+    AerodynamicTable* table = reinterpret_cast<AerodynamicTable*>(user_data);
+    dVector p0(face_array[0], face_array[1], face_array[2]);
+    dVector normal(dVector(face_array[3], face_array[4], face_array[5]) - p0);
+    normal = normal.CrossProduct(dVector(face_array[6], face_array[7], face_array[8]) - p0);
+    dFloat normal_mag = Util::get_vector_magnitude(normal);
+    if (normal_mag < 1.0e-6f) return;
+    Util::scale_vector(normal, 1.0f / normal_mag);
+    // Sum the triangle fan into one area-weighted centroid. Drag acts along
+    // the face normal, so the torque of the fan equals the torque of its
+    // total area at that centroid.
+    dVector centroid(0.0f);
+    dFloat area = 0.0f;
+    for (int i = 1; i < vertex_count - 1; ++i) {
+        dVector p1(face_array[i * 3], face_array[i * 3 + 1], face_array[i * 3 + 2]);
+        dVector p2(face_array[i * 3 + 3], face_array[i * 3 + 4], face_array[i * 3 + 5]);
+        dFloat triangle_area = dAbs((p1 - p0).CrossProduct(p2 - p0).DotProduct3(normal)) * 0.5f;
+        centroid += (p0 + p1 + p2).Scale(triangle_area / 3.0f);
+        area += triangle_area;
+    }
+    if (area < M_EPSILON) return;
+    centroid = centroid.Scale(1.0f / area);
+    for (int i = 0; i < 3; ++i) {
+        table->m_centroid[i].push_back(centroid[i]);
+        table->m_normal[i].push_back(normal[i]);
+    }
+    table->m_area.push_back(area);
+}
+
+int MSP::Collision::decomposition_progress_callback(dFloat progress, void* const user_data) {
+    DecompositionProgress* data = reinterpret_cast<DecompositionProgress*>(user_data);
+    return c_report_progress(*data, progress) ? 1 : 0;
+}
+
+void MSP::Collision::hull_job(NewtonWorld* const world, void* const user_data, int thread_index) {
+    HullBatch* batch = reinterpret_cast<HullBatch*>(user_data);
+    c_reduce_hulls(world, *batch);
+}
 
 
 /*
@@ -34,25 +110,694 @@ std::map<const NewtonCollision*, MSP::Collision::CollisionData*> MSP::Collision:
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 */
 
-bool MSP::Collision::c_is_collision_valid(const NewtonCollision* address) {
-    return s_valid_collisions.find(address) != s_valid_collisions.end();
+bool MSP::Collision::c_is_collision_valid(unsigned long long handle) {
+    return s_valid_collisions.is_valid(handle);
+}
+
+MSP::Collision::CollisionData* MSP::Collision::c_get_collision_data(const NewtonCollision* collision) {
+    return reinterpret_cast<CollisionData*>(NewtonCollisionGetUserData(collision));
+}
+
+void MSP::Collision::c_attach_collision_data(const NewtonCollision* collision, CollisionData* data) {
+    data->m_owner = collision;
+    NewtonCollisionSetUserData(collision, data);
+}
+
+void MSP::Collision::c_release_collision_data(const NewtonCollision* collision) {
+    CollisionData* data = c_get_collision_data(collision);
+    // Temporary instances, made by Newton without invoking the copy callback,
+    // share the data of their source and must not release it.
+    if (data == nullptr || data->m_owner != collision)
+        return;
+    if (data->m_handle != 0)
+        s_valid_collisions.erase(data->m_handle);
+    delete data;
 }
 
 const NewtonCollision* MSP::Collision::c_value_to_collision(VALUE v_collision) {
-    const NewtonCollision* address = reinterpret_cast<NewtonCollision*>(rb_num2ull(v_collision));
-    if (Util::s_validate_objects && s_valid_collisions.find(address) == s_valid_collisions.end())
+    unsigned long long handle = rb_num2ull(v_collision);
+    const NewtonCollision* address = s_valid_collisions.find(handle);
+    if (address == nullptr)
         rb_raise(rb_eTypeError, "Given address doesn't reference a valid collision!");
     return address;
 }
 
 VALUE MSP::Collision::c_collision_to_value(const NewtonCollision* collision) {
-    return rb_ull2inum(reinterpret_cast<unsigned long long>(collision));
+    CollisionData* data = c_get_collision_data(collision);
+    if (data->m_handle == 0)
+        data->m_handle = s_valid_collisions.insert(collision);
+    return rb_ull2inum(data->m_handle);
 }
 
 bool MSP::Collision::c_is_collision_convex(const NewtonCollision* collision) {
     return NewtonCollisionGetType(collision) < 7;
 }
 
+void MSP::Collision::c_values_to_vertices(VALUE v_vertices, std::vector<dFloat>& vertices_out) {
+    // Vertices are either a string of packed doubles, a flat array of
+    // coordinates, or an array of points.
+    vertices_out.clear();
+    if (TYPE(v_vertices) == T_STRING) {
+        long length = RSTRING_LEN(v_vertices);
+        if (length % (sizeof(double) * 3) != 0)
+            rb_raise(rb_eArgError, "Size of packed vertices must be a multiple of 3 doubles!");
+        unsigned int count = static_cast<unsigned int>(length / sizeof(double));
+        vertices_out.resize(count);
+        const char* data = RSTRING_PTR(v_vertices);
+        double value;
+        for (unsigned int i = 0; i < count; ++i) {
+            memcpy(&value, data + i * sizeof(double), sizeof(double));
+            vertices_out[i] = static_cast<dFloat>(value);
+        }
+        return;
+    }
+    Check_Type(v_vertices, T_ARRAY);
+    unsigned int count = static_cast<unsigned int>(RARRAY_LEN(v_vertices));
+    if (count == 0)
+        return;
+    if (rb_obj_is_kind_of(rb_ary_entry(v_vertices, 0), rb_cNumeric) == Qtrue) {
+        if (count % 3 != 0)
+            rb_raise(rb_eArgError, "Size of flat vertices must be a multiple of 3!");
+        vertices_out.resize(count);
+        for (unsigned int i = 0; i < count; ++i)
+            vertices_out[i] = Util::value_to_dFloat(rb_ary_entry(v_vertices, i));
+        return;
+    }
+    vertices_out.resize(count * 3);
+    for (unsigned int i = 0; i < count; ++i) {
+        dVector point(Util::value_to_point(rb_ary_entry(v_vertices, i)));
+        vertices_out[i * 3] = point.m_x;
+        vertices_out[i * 3 + 1] = point.m_y;
+        vertices_out[i * 3 + 2] = point.m_z;
+    }
+}
+
+void MSP::Collision::c_values_to_indices(VALUE v_indices, std::vector<int>& indices_out) {
+    // Indices are either a string of packed 32-bit integers or an array.
+    indices_out.clear();
+    if (TYPE(v_indices) == T_STRING) {
+        long length = RSTRING_LEN(v_indices);
+        if (length % sizeof(int) != 0)
+            rb_raise(rb_eArgError, "Size of packed indices must be a multiple of 4 bytes!");
+        indices_out.resize(length / sizeof(int));
+        if (length != 0)
+            memcpy(&indices_out[0], RSTRING_PTR(v_indices), length);
+        return;
+    }
+    Check_Type(v_indices, T_ARRAY);
+    unsigned int count = static_cast<unsigned int>(RARRAY_LEN(v_indices));
+    indices_out.resize(count);
+    for (unsigned int i = 0; i < count; ++i)
+        indices_out[i] = Util::value_to_int(rb_ary_entry(v_indices, i));
+}
+
+void MSP::Collision::c_add_tree_face(NewtonCollision* collision, const dFloat* vertices, const int* indices, int count, FaceBuffers& buffers) {
+    if (count < 3)
+        return;
+    // Compute the polygon normal with Newell's method.
+    dVector normal(0.0f);
+    for (int i = 0; i < count; ++i) {
+        const dFloat* cur = vertices + indices[i] * 3;
+        const dFloat* next = vertices + indices[(i + 1) % count] * 3;
+        normal.m_x += (cur[1] - next[1]) * (cur[2] + next[2]);
+        normal.m_y += (cur[2] - next[2]) * (cur[0] + next[0]);
+        normal.m_z += (cur[0] - next[0]) * (cur[1] + next[1]);
+    }
+    // Project onto the plane of the dominant normal axis, keeping winding.
+    int axis = 0;
+    if (dAbs(normal.m_y) > dAbs(normal[axis])) axis = 1;
+    if (dAbs(normal.m_z) > dAbs(normal[axis])) axis = 2;
+    if (dAbs(normal[axis]) < M_EPSILON)
+        return;
+    int u = (axis + 1) % 3;
+    int v = (axis + 2) % 3;
+    dFloat sign = normal[axis] > 0.0f ? 1.0f : -1.0f;
+    std::vector<dFloat>& projected = buffers.m_projected;
+    projected.resize(count * 2);
+    for (int i = 0; i < count; ++i) {
+        projected[i * 2] = vertices[indices[i] * 3 + u];
+        projected[i * 2 + 1] = vertices[indices[i] * 3 + v];
+    }
+    std::vector<dFloat>& points = buffers.m_points;
+    std::vector<int>& remaining = buffers.m_remaining;
+    remaining.resize(count);
+    for (int i = 0; i < count; ++i)
+        remaining[i] = i;
+    // Clip ears until a convex polygon remains. Convex polygons, which are
+    // most faces, are passed to Newton as a whole.
+    while (true) {
+        int num_remaining = static_cast<int>(remaining.size());
+        int ear = -1;
+        bool convex = true;
+        for (int i = 0; i < num_remaining; ++i) {
+            int a = remaining[(i + num_remaining - 1) % num_remaining];
+            int b = remaining[i];
+            int c = remaining[(i + 1) % num_remaining];
+            dFloat cross = ((projected[b * 2] - projected[a * 2]) * (projected[c * 2 + 1] - projected[b * 2 + 1]) -
+                (projected[b * 2 + 1] - projected[a * 2 + 1]) * (projected[c * 2] - projected[b * 2])) * sign;
+            if (cross < 0.0f) {
+                convex = false;
+                continue;
+            }
+            if (ear != -1 || cross < M_EPSILON)
+                continue;
+            // A convex corner is an ear when no other vertex lies inside it.
+            bool empty = true;
+            for (int j = 0; j < num_remaining && empty; ++j) {
+                int p = remaining[j];
+                if (p == a || p == b || p == c) continue;
+                dFloat px = projected[p * 2];
+                dFloat py = projected[p * 2 + 1];
+                dFloat d0 = ((projected[b * 2] - projected[a * 2]) * (py - projected[a * 2 + 1]) - (projected[b * 2 + 1] - projected[a * 2 + 1]) * (px - projected[a * 2])) * sign;
+                dFloat d1 = ((projected[c * 2] - projected[b * 2]) * (py - projected[b * 2 + 1]) - (projected[c * 2 + 1] - projected[b * 2 + 1]) * (px - projected[b * 2])) * sign;
+                dFloat d2 = ((projected[a * 2] - projected[c * 2]) * (py - projected[c * 2 + 1]) - (projected[a * 2 + 1] - projected[c * 2 + 1]) * (px - projected[c * 2])) * sign;
+                if (d0 >= 0.0f && d1 >= 0.0f && d2 >= 0.0f)
+                    empty = false;
+            }
+            if (empty)
+                ear = i;
+        }
+        // Degenerate polygons without ears are passed as they are.
+        if (convex || num_remaining == 3 || ear == -1) {
+            points.resize(num_remaining * 3);
+            for (int i = 0; i < num_remaining; ++i)
+                for (int j = 0; j < 3; ++j)
+                    points[i * 3 + j] = vertices[indices[remaining[i]] * 3 + j];
+            NewtonTreeCollisionAddFace(collision, num_remaining, &points[0], 3 * sizeof(dFloat), 0);
+            return;
+        }
+        points.resize(9);
+        for (int k = 0; k < 3; ++k) {
+            int corner = remaining[(ear + num_remaining - 1 + k) % num_remaining];
+            for (int j = 0; j < 3; ++j)
+                points[k * 3 + j] = vertices[indices[corner] * 3 + j];
+        }
+        NewtonTreeCollisionAddFace(collision, 3, &points[0], 3 * sizeof(dFloat), 0);
+        remaining.erase(remaining.begin() + ear);
+    }
+}
+
+void MSP::Collision::c_append_key(std::vector<char>& key, const void* data, size_t size) {
+    const char* bytes = reinterpret_cast<const char*>(data);
+    key.insert(key.end(), bytes, bytes + size);
+}
+
+const NewtonCollision* MSP::Collision::c_find_cached_shape(const NewtonWorld* world, const std::vector<char>& key) {
+    MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world));
+    unsigned long long hash = Util::hash_bytes(key.empty() ? nullptr : &key[0], key.size());
+    std::pair<std::multimap<unsigned long long, MSP::World::CachedShape>::iterator, std::multimap<unsigned long long, MSP::World::CachedShape>::iterator> range(world_data->m_shape_cache.equal_range(hash));
+    for (std::multimap<unsigned long long, MSP::World::CachedShape>::iterator it = range.first; it != range.second; ++it) {
+        if (it->second.m_key == key)
+            // The instance receives its own collision data from the copy
+            // constructor callback.
+            return NewtonCollisionCreateInstance(it->second.m_collision);
+    }
+    if (s_disk_cache_path.empty())
+        return nullptr;
+    NewtonCollision* collision = c_load_shape_from_disk(world, key, hash);
+    if (collision == nullptr)
+        return nullptr;
+    // The loaded shape becomes the prototype of the memory cache.
+    c_attach_collision_data(collision, new CollisionData);
+    world_data->m_shape_cache.insert(std::pair<unsigned long long, MSP::World::CachedShape>(hash, MSP::World::CachedShape(key, collision)));
+    return NewtonCollisionCreateInstance(collision);
+}
+
+void MSP::Collision::c_cache_shape(const NewtonWorld* world, const std::vector<char>& key, const NewtonCollision* collision) {
+    MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world));
+    unsigned long long hash = Util::hash_bytes(key.empty() ? nullptr : &key[0], key.size());
+    // The cache keeps its own instance, so the given collision may be
+    // destroyed by its user.
+    world_data->m_shape_cache.insert(std::pair<unsigned long long, MSP::World::CachedShape>(hash, MSP::World::CachedShape(key, NewtonCollisionCreateInstance(collision))));
+    if (!s_disk_cache_path.empty())
+        c_save_shape_to_disk(world, key, hash, collision);
+}
+
+void MSP::Collision::c_clear_shape_cache(const NewtonWorld* world) {
+    MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world));
+    for (std::multimap<unsigned long long, MSP::World::CachedShape>::iterator it = world_data->m_shape_cache.begin(); it != world_data->m_shape_cache.end(); ++it)
+        NewtonDestroyCollision(it->second.m_collision);
+    world_data->m_shape_cache.clear();
+}
+
+std::string MSP::Collision::c_get_disk_cache_file(unsigned long long hash) {
+    char name[32];
+    sprintf(name, "%016llx.msc", hash);
+    std::string path(s_disk_cache_path);
+    char last = path[path.size() - 1];
+    if (last != '/' && last != '\\')
+        path += '/';
+    path += name;
+    return path;
+}
+
+#if defined(_WIN_32_VER) || defined(_WIN_64_VER)
+// The cache path comes from Ruby as UTF-8, whereas the ANSI file functions
+// expect the system code page, so paths are passed to the wide functions.
+std::wstring MSP::Collision::c_utf8_to_wide(const std::string& text) {
+    int length = MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, NULL, 0);
+    if (length <= 0)
+        return std::wstring();
+    std::wstring wide(length, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, &wide[0], length);
+    // Drop the terminator written by the conversion.
+    wide.resize(length - 1);
+    return wide;
+}
+#endif
+
+NewtonCollision* MSP::Collision::c_load_shape_from_disk(const NewtonWorld* world, const std::vector<char>& key, unsigned long long hash) {
+    std::string path(c_get_disk_cache_file(hash));
+    // Map the file rather than reading it, so that large trees are paged in
+    // directly by the deserializer.
+#if defined(_WIN_32_VER) || defined(_WIN_64_VER)
+    HANDLE file = CreateFileW(c_utf8_to_wide(path).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return nullptr;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        CloseHandle(file);
+        return nullptr;
+    }
+    const char* data = reinterpret_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    size_t size = static_cast<size_t>(file_size.QuadPart);
+    if (data == nullptr) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return nullptr;
+    }
+#else
+    int file = open(path.c_str(), O_RDONLY);
+    if (file == -1)
+        return nullptr;
+    struct stat file_stat;
+    if (fstat(file, &file_stat) != 0 || file_stat.st_size == 0) {
+        close(file);
+        return nullptr;
+    }
+    size_t size = static_cast<size_t>(file_stat.st_size);
+    void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (address == MAP_FAILED) {
+        close(file);
+        return nullptr;
+    }
+    const char* data = reinterpret_cast<const char*>(address);
+#endif
+    NewtonCollision* collision = nullptr;
+    unsigned int header[6];
+    if (size >= sizeof(header)) {
+        memcpy(header, data, sizeof(header));
+        size_t key_size = header[4];
+        size_t blob_size = header[5];
+        if (header[0] == DISK_CACHE_MAGIC &&
+            header[1] == DISK_CACHE_VERSION &&
+            header[2] == static_cast<unsigned int>(NewtonWorldGetVersion()) &&
+            header[3] == static_cast<unsigned int>(NewtonWorldFloatSize()) &&
+            key_size == key.size() &&
+            sizeof(header) + key_size + blob_size == size &&
+            (key_size == 0 || memcmp(data + sizeof(header), &key[0], key_size) == 0))
+        {
+            SerializeReader reader(data + sizeof(header) + key_size, blob_size);
+            collision = NewtonCreateCollisionFromSerialization(world, deserialize_callback, &reader);
+        }
+    }
+#if defined(_WIN_32_VER) || defined(_WIN_64_VER)
+    UnmapViewOfFile(data);
+    CloseHandle(mapping);
+    CloseHandle(file);
+#else
+    munmap(address, size);
+    close(file);
+#endif
+    return collision;
+}
+
+void MSP::Collision::c_save_shape_to_disk(const NewtonWorld* world, const std::vector<char>& key, unsigned long long hash, const NewtonCollision* collision) {
+    std::vector<char> blob;
+    NewtonCollisionSerialize(world, collision, serialize_callback, &blob);
+    unsigned int header[6];
+    header[0] = DISK_CACHE_MAGIC;
+    header[1] = DISK_CACHE_VERSION;
+    header[2] = static_cast<unsigned int>(NewtonWorldGetVersion());
+    header[3] = static_cast<unsigned int>(NewtonWorldFloatSize());
+    header[4] = static_cast<unsigned int>(key.size());
+    header[5] = static_cast<unsigned int>(blob.size());
+    std::string path(c_get_disk_cache_file(hash));
+    // Write to a temporary file first, so that a concurrent reader or an
+    // interrupted write never sees a partial entry.
+    std::string temp_path(path + ".tmp");
+#if defined(_WIN_32_VER) || defined(_WIN_64_VER)
+    std::wstring wide_path(c_utf8_to_wide(path));
+    std::wstring wide_temp_path(c_utf8_to_wide(temp_path));
+    FILE* file = _wfopen(wide_temp_path.c_str(), L"wb");
+#else
+    FILE* file = fopen(temp_path.c_str(), "wb");
+#endif
+    if (file == nullptr)
+        return;
+    bool success = fwrite(header, sizeof(header), 1, file) == 1;
+    if (success && !key.empty())
+        success = fwrite(&key[0], key.size(), 1, file) == 1;
+    if (success && !blob.empty())
+        success = fwrite(&blob[0], blob.size(), 1, file) == 1;
+    success = (fclose(file) == 0) && success;
+#if defined(_WIN_32_VER) || defined(_WIN_64_VER)
+    if (success) {
+        _wremove(wide_path.c_str());
+        success = _wrename(wide_temp_path.c_str(), wide_path.c_str()) == 0;
+    }
+    if (!success)
+        _wremove(wide_temp_path.c_str());
+#else
+    if (success) {
+        remove(path.c_str());
+        success = rename(temp_path.c_str(), path.c_str()) == 0;
+    }
+    if (!success)
+        remove(temp_path.c_str());
+#endif
+}
+
+const MSP::Collision::AerodynamicTable& MSP::Collision::c_get_aerodynamic_table(const NewtonCollision* collision, AerodynamicTable& fallback) {
+    CollisionData* data = c_get_collision_data(collision);
+    AerodynamicTable& table = data != nullptr ? data->m_aerodynamics : fallback;
+    dVector scale(1.0f);
+    NewtonCollisionGetScale(collision, &scale.m_x, &scale.m_y, &scale.m_z);
+    // The faces only change with the scale of the collision.
+    if (table.m_built && dAbs(table.m_scale.m_x - scale.m_x) < M_EPSILON && dAbs(table.m_scale.m_y - scale.m_y) < M_EPSILON && dAbs(table.m_scale.m_z - scale.m_z) < M_EPSILON)
+        return table;
+    for (int i = 0; i < 3; ++i) {
+        table.m_centroid[i].clear();
+        table.m_normal[i].clear();
+    }
+    table.m_area.clear();
+    dMatrix identity(dGetIdentityMatrix());
+    NewtonCollisionForEachPolygonDo(collision, &identity[0][0], aerodynamic_face_iterator, &table);
+    size_t padded = (table.m_area.size() + 3) & ~static_cast<size_t>(3);
+    for (int i = 0; i < 3; ++i) {
+        table.m_centroid[i].resize(padded, 0.0f);
+        table.m_normal[i].resize(padded, 0.0f);
+    }
+    table.m_area.resize(padded, 0.0f);
+    table.m_scale = scale;
+    table.m_built = true;
+    return table;
+}
+
+void MSP::Collision::c_compute_drag(const AerodynamicTable& table, const dVector& velocity, const dVector& centre, dVector& force_out, dVector& torque_out) {
+    // Velocity and centre are in the local space of the table. Each face
+    // facing the flow is pushed back along its normal by area * v^2, where v
+    // is the velocity along the normal. The caller applies the drag factor.
+    const dFloat* cx = table.m_area.empty() ? nullptr : &table.m_centroid[0][0];
+    const dFloat* cy = table.m_area.empty() ? nullptr : &table.m_centroid[1][0];
+    const dFloat* cz = table.m_area.empty() ? nullptr : &table.m_centroid[2][0];
+    const dFloat* nx = table.m_area.empty() ? nullptr : &table.m_normal[0][0];
+    const dFloat* ny = table.m_area.empty() ? nullptr : &table.m_normal[1][0];
+    const dFloat* nz = table.m_area.empty() ? nullptr : &table.m_normal[2][0];
+    const dFloat* area = table.m_area.empty() ? nullptr : &table.m_area[0];
+    int count = static_cast<int>(table.m_area.size());
+    dFloat force[3] = { 0.0f, 0.0f, 0.0f };
+    dFloat torque[3] = { 0.0f, 0.0f, 0.0f };
+    int i = 0;
+#ifdef MSP_USE_SSE
+    __m128 vx = _mm_set1_ps(velocity.m_x);
+    __m128 vy = _mm_set1_ps(velocity.m_y);
+    __m128 vz = _mm_set1_ps(velocity.m_z);
+    __m128 ox = _mm_set1_ps(centre.m_x);
+    __m128 oy = _mm_set1_ps(centre.m_y);
+    __m128 oz = _mm_set1_ps(centre.m_z);
+    __m128 zero = _mm_setzero_ps();
+    __m128 fx = zero, fy = zero, fz = zero;
+    __m128 tx = zero, ty = zero, tz = zero;
+    // The table is padded to a multiple of four, so no tail is left.
+    for (; i < count; i += 4) {
+        __m128 n0 = _mm_loadu_ps(nx + i);
+        __m128 n1 = _mm_loadu_ps(ny + i);
+        __m128 n2 = _mm_loadu_ps(nz + i);
+        __m128 lv = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, n0), _mm_mul_ps(vy, n1)), _mm_mul_ps(vz, n2));
+        __m128 w = _mm_and_ps(_mm_cmpgt_ps(lv, zero), _mm_mul_ps(_mm_loadu_ps(area + i), _mm_mul_ps(lv, lv)));
+        __m128 f0 = _mm_mul_ps(n0, w);
+        __m128 f1 = _mm_mul_ps(n1, w);
+        __m128 f2 = _mm_mul_ps(n2, w);
+        __m128 r0 = _mm_sub_ps(_mm_loadu_ps(cx + i), ox);
+        __m128 r1 = _mm_sub_ps(_mm_loadu_ps(cy + i), oy);
+        __m128 r2 = _mm_sub_ps(_mm_loadu_ps(cz + i), oz);
+        fx = _mm_add_ps(fx, f0);
+        fy = _mm_add_ps(fy, f1);
+        fz = _mm_add_ps(fz, f2);
+        tx = _mm_add_ps(tx, _mm_sub_ps(_mm_mul_ps(r1, f2), _mm_mul_ps(r2, f1)));
+        ty = _mm_add_ps(ty, _mm_sub_ps(_mm_mul_ps(r2, f0), _mm_mul_ps(r0, f2)));
+        tz = _mm_add_ps(tz, _mm_sub_ps(_mm_mul_ps(r0, f1), _mm_mul_ps(r1, f0)));
+    }
+    __m128 sums[6] = { fx, fy, fz, tx, ty, tz };
+    dFloat* outputs[6] = { &force[0], &force[1], &force[2], &torque[0], &torque[1], &torque[2] };
+    for (int j = 0; j < 6; ++j) {
+        __m128 acc = _mm_add_ps(sums[j], _mm_shuffle_ps(sums[j], sums[j], _MM_SHUFFLE(1, 0, 3, 2)));
+        acc = _mm_add_ps(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(2, 3, 0, 1)));
+        *outputs[j] = _mm_cvtss_f32(acc);
+    }
+#endif
+    for (; i < count; ++i) {
+        dFloat lv = velocity.m_x * nx[i] + velocity.m_y * ny[i] + velocity.m_z * nz[i];
+        if (lv <= 0.0f) continue;
+        dFloat w = area[i] * lv * lv;
+        dFloat f0 = nx[i] * w;
+        dFloat f1 = ny[i] * w;
+        dFloat f2 = nz[i] * w;
+        dFloat r0 = cx[i] - centre.m_x;
+        dFloat r1 = cy[i] - centre.m_y;
+        dFloat r2 = cz[i] - centre.m_z;
+        force[0] += f0;
+        force[1] += f1;
+        force[2] += f2;
+        torque[0] += r1 * f2 - r2 * f1;
+        torque[1] += r2 * f0 - r0 * f2;
+        torque[2] += r0 * f1 - r1 * f0;
+    }
+    force_out = dVector(-force[0], -force[1], -force[2]);
+    torque_out = dVector(-torque[0], -torque[1], -torque[2]);
+}
+
+void MSP::Collision::c_polygons_to_buffers(VALUE v_polygons, std::vector<dFloat>& vertices, std::vector<int>& indices, std::vector<int>& counts) {
+    Check_Type(v_polygons, T_ARRAY);
+    // Polygons are flattened into a vertex buffer, indexed in order.
+    unsigned int polygons_length = (unsigned int)RARRAY_LEN(v_polygons);
+    counts.reserve(polygons_length);
+    for (unsigned int i = 0; i < polygons_length; ++i) {
+        VALUE v_polygon = rb_ary_entry(v_polygons, i);
+        if (TYPE(v_polygon) != T_ARRAY) continue;
+        unsigned int vertex_count = (unsigned int)RARRAY_LEN(v_polygon);
+        for (unsigned int j = 0; j < vertex_count; ++j) {
+            dVector point(Util::value_to_point(rb_ary_entry(v_polygon, j)));
+            indices.push_back(static_cast<int>(vertices.size() / 3));
+            vertices.push_back(point.m_x);
+            vertices.push_back(point.m_y);
+            vertices.push_back(point.m_z);
+        }
+        counts.push_back(static_cast<int>(vertex_count));
+    }
+}
+
+void MSP::Collision::c_reduce_hulls(const NewtonWorld* world, HullBatch& batch) {
+    // Hulling a cluster only allocates through the locked world allocator,
+    // so clusters can be reduced on any thread. Adding hulls to the world
+    // shape cache is left to the calling thread.
+    int num_clusters = static_cast<int>(batch.m_clusters.size());
+    for (int i = NewtonAtomicAdd(&batch.m_cluster_index, 1); i < num_clusters; i = NewtonAtomicAdd(&batch.m_cluster_index, 1)) {
+        HullCluster& cluster = batch.m_clusters[i];
+        if (cluster.m_points.size() < 12)
+            continue;
+        NewtonMesh* hull = NewtonMeshCreateConvexHull(world, static_cast<int>(cluster.m_points.size() / 3), &cluster.m_points[0], sizeof(dFloat) * 3, batch.m_tolerance);
+        if (hull == nullptr)
+            continue;
+        int vertex_count = NewtonMeshGetVertexCount(hull);
+        int stride = NewtonMeshGetVertexStrideInByte(hull) / sizeof(dFloat64);
+        const dFloat64* vertices = NewtonMeshGetVertexArray(hull);
+        cluster.m_hull.resize(vertex_count * 3);
+        for (int j = 0; j < vertex_count; ++j) {
+            cluster.m_hull[j * 3 + 0] = static_cast<dFloat>(vertices[j * stride + 0]);
+            cluster.m_hull[j * 3 + 1] = static_cast<dFloat>(vertices[j * stride + 1]);
+            cluster.m_hull[j * 3 + 2] = static_cast<dFloat>(vertices[j * stride + 2]);
+        }
+        NewtonMeshDestroy(hull);
+    }
+}
+
+VALUE MSP::Collision::c_call_progress(VALUE v_progress) {
+    DecompositionProgress* progress = reinterpret_cast<DecompositionProgress*>(v_progress);
+    return rb_funcall(progress->m_proc, Util::INTERN_CALL, 1, Util::to_value(progress->m_value));
+}
+
+bool MSP::Collision::c_report_progress(DecompositionProgress& progress, dFloat value) {
+    if (progress.m_state != 0 || progress.m_cancelled)
+        return false;
+    if (progress.m_proc == Qnil)
+        return true;
+    progress.m_value = progress.m_offset + progress.m_range * value;
+    // Exceptions must not unwind through Newton, so the proc is protected and
+    // the exception is raised again once the decomposition is released.
+    VALUE v_result = rb_protect(c_call_progress, reinterpret_cast<VALUE>(&progress), &progress.m_state);
+    if (progress.m_state == 0 && v_result == Qfalse)
+        progress.m_cancelled = true;
+    return progress.m_state == 0 && !progress.m_cancelled;
+}
+
+const NewtonCollision* MSP::Collision::c_create_compound_from_cd(
+    const NewtonWorld* world,
+    VALUE v_polygons,
+    dFloat max_concavity,
+    dFloat back_face_dist_factor,
+    int max_hull_count,
+    int max_vertices_per_hull,
+    dFloat hull_tolerance,
+    int id,
+    DecompositionProgress& progress)
+{
+    // Hull jobs need idle worker threads.
+    MSP::World::c_wait_for_update(world);
+    std::vector<dFloat> vertices;
+    std::vector<int> indices;
+    std::vector<int> counts;
+    c_polygons_to_buffers(v_polygons, vertices, indices, counts);
+    if (vertices.empty())
+        return nullptr;
+    // Decompositions are expensive, so they go through the shape cache as
+    // well, which includes the disk cache when enabled.
+    std::vector<char> key;
+    key.push_back('D');
+    c_append_key(key, &max_concavity, sizeof(dFloat));
+    c_append_key(key, &back_face_dist_factor, sizeof(dFloat));
+    c_append_key(key, &max_hull_count, sizeof(int));
+    c_append_key(key, &max_vertices_per_hull, sizeof(int));
+    c_append_key(key, &hull_tolerance, sizeof(dFloat));
+    c_append_key(key, &id, sizeof(int));
+    c_append_key(key, &vertices[0], vertices.size() * sizeof(dFloat));
+    c_append_key(key, &counts[0], counts.size() * sizeof(int));
+    const NewtonCollision* cached = c_find_cached_shape(world, key);
+    if (cached != nullptr)
+        return cached;
+
+    NewtonMesh* mesh = NewtonMeshCreate(world);
+    NewtonMeshBeginBuild(mesh);
+    int offset = 0;
+    for (std::vector<int>::iterator it = counts.begin(); it != counts.end(); ++it) {
+        if (*it >= 3) {
+            NewtonMeshBeginFace(mesh);
+            for (int i = 0; i < *it; ++i) {
+                const dFloat* point = &vertices[indices[offset + i] * 3];
+                NewtonMeshAddPoint(mesh, point[0], point[1], point[2]);
+            }
+            NewtonMeshEndFace(mesh);
+        }
+        offset += *it;
+    }
+    NewtonMeshEndBuild(mesh);
+    NewtonRemoveUnusedVertices(mesh, nullptr);
+    NewtonMeshFixTJoints(mesh);
+
+    progress.m_range = DECOMPOSITION_PROGRESS_SHARE;
+    NewtonMesh* convex_approximation = NewtonMeshApproximateConvexDecomposition(mesh, max_concavity, back_face_dist_factor, max_hull_count, max_vertices_per_hull, decomposition_progress_callback, &progress);
+    NewtonMeshDestroy(mesh);
+    if (convex_approximation == nullptr)
+        return nullptr;
+    if (progress.m_state != 0 || progress.m_cancelled) {
+        NewtonMeshDestroy(convex_approximation);
+        return nullptr;
+    }
+
+    // Gather the point cloud of every convex segment.
+    std::vector<HullCluster> clusters;
+    NewtonMesh* next_segment = nullptr;
+    for (NewtonMesh* segment = NewtonMeshCreateFirstSingleSegment(convex_approximation); segment; segment = next_segment) {
+        next_segment = NewtonMeshCreateNextSingleSegment(convex_approximation, segment);
+        int vertex_count = NewtonMeshGetVertexCount(segment);
+        int stride = NewtonMeshGetVertexStrideInByte(segment) / sizeof(dFloat64);
+        const dFloat64* segment_vertices = NewtonMeshGetVertexArray(segment);
+        clusters.push_back(HullCluster());
+        std::vector<dFloat>& points = clusters.back().m_points;
+        points.resize(vertex_count * 3);
+        for (int i = 0; i < vertex_count; ++i) {
+            points[i * 3 + 0] = static_cast<dFloat>(segment_vertices[i * stride + 0]);
+            points[i * 3 + 1] = static_cast<dFloat>(segment_vertices[i * stride + 1]);
+            points[i * 3 + 2] = static_cast<dFloat>(segment_vertices[i * stride + 2]);
+        }
+        NewtonMeshDestroy(segment);
+    }
+    NewtonMeshDestroy(convex_approximation);
+
+    // Reduce each cluster to its hull vertices in parallel, so that building
+    // the hull shapes below only deals with a few points per cluster.
+    HullBatch batch(clusters, hull_tolerance);
+    int num_clusters = static_cast<int>(clusters.size());
+    int num_jobs = dMin(NewtonGetThreadsCount(world), num_clusters);
+    if (num_jobs > 1) {
+        for (int i = 0; i < num_jobs; ++i)
+            NewtonDispachThreadJob(world, hull_job, &batch, "hull_job");
+        NewtonSyncThreadJobs(world);
+    }
+    else
+        c_reduce_hulls(world, batch);
+
+    NewtonCollision* compound = NewtonCreateCompoundCollision(world, id);
+    NewtonCompoundCollisionBeginAddRemove(compound);
+    progress.m_offset = DECOMPOSITION_PROGRESS_SHARE;
+    progress.m_range = 1.0f - DECOMPOSITION_PROGRESS_SHARE;
+    for (int i = 0; i < num_clusters; ++i) {
+        const std::vector<dFloat>& hull_points = clusters[i].m_hull;
+        if (hull_points.size() >= 12) {
+            NewtonCollision* hull = NewtonCreateConvexHull(world, static_cast<int>(hull_points.size() / 3), &hull_points[0], sizeof(dFloat) * 3, hull_tolerance, id, nullptr);
+            if (hull != nullptr) {
+                NewtonCompoundCollisionAddSubCollision(compound, hull);
+                NewtonDestroyCollision(hull);
+            }
+        }
+        if (!c_report_progress(progress, static_cast<dFloat>(i + 1) / static_cast<dFloat>(num_clusters)))
+            break;
+    }
+    NewtonCompoundCollisionEndAddRemove(compound);
+    if (progress.m_state != 0 || progress.m_cancelled) {
+        NewtonDestroyCollision(compound);
+        return nullptr;
+    }
+    c_attach_collision_data(compound, new CollisionData);
+    c_cache_shape(world, key, compound);
+    return compound;
+}
+
+VALUE MSP::Collision::c_create_static_mesh(const NewtonWorld* world, const std::vector<dFloat>& vertices, const std::vector<int>& indices, const std::vector<int>& counts, bool optimize, int id) {
+    std::vector<char> key;
+    key.push_back('M');
+    c_append_key(key, &optimize, sizeof(bool));
+    c_append_key(key, &id, sizeof(int));
+    int vertex_count = static_cast<int>(vertices.size());
+    c_append_key(key, &vertex_count, sizeof(int));
+    if (!vertices.empty()) c_append_key(key, &vertices[0], vertices.size() * sizeof(dFloat));
+    if (!indices.empty()) c_append_key(key, &indices[0], indices.size() * sizeof(int));
+    if (!counts.empty()) c_append_key(key, &counts[0], counts.size() * sizeof(int));
+    const NewtonCollision* cached = c_find_cached_shape(world, key);
+    if (cached != nullptr)
+        return c_collision_to_value(cached);
+
+    NewtonCollision* collision = NewtonCreateTreeCollision(world, id);
+    NewtonTreeCollisionBeginBuild(collision);
+    FaceBuffers buffers;
+    int offset = 0;
+    for (std::vector<int>::const_iterator it = counts.begin(); it != counts.end(); ++it) {
+        if (*it >= 3)
+            c_add_tree_face(collision, &vertices[0], &indices[offset], *it, buffers);
+        offset += *it;
+    }
+    NewtonTreeCollisionEndBuild(collision, optimize ? 1 : 0);
+    c_attach_collision_data(collision, new CollisionData);
+    c_cache_shape(world, key, collision);
+    return c_collision_to_value(collision);
+}
+
 
 /*
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -63,7 +808,7 @@ bool MSP::Collision::c_is_collision_convex(const NewtonCollision* collision) {
 VALUE MSP::Collision::rbf_create_null(VALUE self, VALUE v_world) {
     const NewtonWorld* world = MSP::World::c_value_to_world(v_world);
     const NewtonCollision* col = NewtonCreateNull(world);
-    s_valid_collisions[col] = new CollisionData;
+    c_attach_collision_data(col, new CollisionData);
     return c_collision_to_value(col);
 }
 
@@ -76,7 +821,7 @@ VALUE MSP::Collision::rbf_create_box(VALUE self, VALUE v_world, VALUE v_width, V
         Util::clamp_float(Util::value_to_dFloat(v_depth), MIN_SIZE, MAX_SIZE),
         Util::value_to_int(v_id),
         v_offset_matrix == Qnil ? NULL : &Util::value_to_matrix(v_offset_matrix)[0][0]);
-    s_valid_collisions[col] = new CollisionData;
+    c_attach_collision_data(col, new CollisionData);
     return c_collision_to_value(col);
 }
 
@@ -87,7 +832,7 @@ VALUE MSP::Collision::rbf_create_sphere(VALUE self, VALUE v_world, VALUE v_radiu
         Util::clamp_float(Util::value_to_dFloat(v_radius), MIN_SIZE, MAX_SIZE),
         Util::value_to_int(v_id),
         v_offset_matrix == Qnil ? NULL : &Util::value_to_matrix(v_offset_matrix)[0][0]);
-    s_valid_collisions[col] = new CollisionData;
+    c_attach_collision_data(col, new CollisionData);
     return c_collision_to_value(col);
 }
 
@@ -107,7 +852,7 @@ VALUE MSP::Collision::rbf_create_scaled_sphere(VALUE self, VALUE v_world, VALUE
     dFloat sy = h * ir;
     dFloat sz = d * ir;
     NewtonCollisionSetScale(col, sx, sy, sz);
-    s_valid_collisions[col] = new CollisionData(sx, sy, sz);
+    c_attach_collision_data(col, new CollisionData(sx, sy, sz));
     return c_collision_to_value(col);
 }
 
@@ -119,7 +864,7 @@ VALUE MSP::Collision::rbf_create_cone(VALUE self, VALUE v_world, VALUE v_radius,
         Util::clamp_float(Util::value_to_dFloat(v_height), MIN_SIZE, MAX_SIZE),
         Util::value_to_int(v_id),
         v_offset_matrix == Qnil ? NULL : &Util::value_to_matrix(v_offset_matrix)[0][0]);
-    s_valid_collisions[col] = new CollisionData;
+    c_attach_collision_data(col, new CollisionData);
     return c_collision_to_value(col);
 }
 
@@ -140,7 +885,7 @@ VALUE MSP::Collision::rbf_create_scaled_cone(VALUE self, VALUE v_world, VALUE v_
     dFloat sy = ry * ir;
     dFloat sz = rx * ir;
     NewtonCollisionSetScale(col, sx, sy, sz);
-    s_valid_collisions[col] = new CollisionData(sx, sy, sz);
+    c_attach_collision_data(col, new CollisionData(sx, sy, sz));
     return c_collision_to_value(col);
 }
 
@@ -153,7 +898,7 @@ VALUE MSP::Collision::rbf_create_cylinder(VALUE self, VALUE v_world, VALUE v_rad
         Util::clamp_float(Util::value_to_dFloat(v_height), MIN_SIZE, MAX_SIZE),
         Util::value_to_int(v_id),
         v_offset_matrix == Qnil ? NULL : &Util::value_to_matrix(v_offset_matrix)[0][0]);
-    s_valid_collisions[col] = new CollisionData;
+    c_attach_collision_data(col, new CollisionData);
     return c_collision_to_value(col);
 }
 
@@ -175,7 +920,7 @@ VALUE MSP::Collision::rbf_create_scaled_cylinder(VALUE self, VALUE v_world, VALU
     dFloat sy = ry * ir;
     dFloat sz = rx * ir;
     NewtonCollisionSetScale(col, sx, sy, sz);
-    s_valid_collisions[col] = new CollisionData(sx, sy, sz);
+    c_attach_collision_data(col, new CollisionData(sx, sy, sz));
     return c_collision_to_value(col);
 }
 
@@ -188,7 +933,7 @@ VALUE MSP::Collision::rbf_create_capsule(VALUE self, VALUE v_world, VALUE v_radi
         Util::clamp_float(Util::value_to_dFloat(v_height), 0.0f, MAX_SIZE),
         Util::value_to_int(v_id),
         v_offset_matrix == Qnil ? NULL : &Util::value_to_matrix(v_offset_matrix)[0][0]);
-    s_valid_collisions[col] = new CollisionData;
+    c_attach_collision_data(col, new CollisionData);
     return c_collision_to_value(col);
 }
 
@@ -211,7 +956,7 @@ VALUE MSP::Collision::rbf_create_scaled_capsule(VALUE self, VALUE v_world, VALUE
     dFloat sy = ry * ir;
     dFloat sz = rx * ir;
     NewtonCollisionSetScale(col, sx, sy, sz);
-    s_valid_collisions[col] = new CollisionData(sx, sy, sz);
+    c_attach_collision_data(col, new CollisionData(sx, sy, sz));
     return c_collision_to_value(col);
 }
 
@@ -224,7 +969,7 @@ VALUE MSP::Collision::rbf_create_tapered_capsule(VALUE self, VALUE v_world, VALU
         Util::clamp_float(Util::value_to_dFloat(v_height), 0.0f, MAX_SIZE),
         Util::value_to_int(v_id),
         v_offset_matrix == Qnil ? NULL : &Util::value_to_matrix(v_offset_matrix)[0][0]);
-    s_valid_collisions[col] = new CollisionData;
+    c_attach_collision_data(col, new CollisionData);
     return c_collision_to_value(col);
 }
 
@@ -237,7 +982,7 @@ VALUE MSP::Collision::rbf_create_tapered_cylinder(VALUE self, VALUE v_world, VAL
         Util::clamp_float(Util::value_to_dFloat(v_height), MIN_SIZE, MAX_SIZE),
         Util::value_to_int(v_id),
         v_offset_matrix == Qnil ? NULL : &Util::value_to_matrix(v_offset_matrix)[0][0]);
-    s_valid_collisions[col] = new CollisionData;
+    c_attach_collision_data(col, new CollisionData);
     return c_collision_to_value(col);
 }
 
@@ -249,7 +994,7 @@ VALUE MSP::Collision::rbf_create_chamfer_cylinder(VALUE self, VALUE v_world, VAL
         Util::clamp_float(Util::value_to_dFloat(v_height), 0.0f, MAX_SIZE),
         Util::value_to_int(v_id),
         v_offset_matrix == Qnil ? NULL : &Util::value_to_matrix(v_offset_matrix)[0][0]);
-    s_valid_collisions[col] = new CollisionData;
+    c_attach_collision_data(col, new CollisionData);
     return c_collision_to_value(col);
 }
 
@@ -270,34 +1015,40 @@ VALUE MSP::Collision::rbf_create_scaled_chamfer_cylinder(VALUE self, VALUE v_wor
     dFloat sy = ry / (h * 0.5f + r);
     dFloat sz = rx / (h * 0.5f + r);
     NewtonCollisionSetScale(col, sx, sy, sz);
-    s_valid_collisions[col] = new CollisionData(sx, sy, sz);
+    c_attach_collision_data(col, new CollisionData(sx, sy, sz));
     return c_collision_to_value(col);
 }
 
 VALUE MSP::Collision::rbf_create_convex_hull(VALUE self, VALUE v_world, VALUE v_vertices, VALUE v_tolerance, VALUE v_id, VALUE v_offset_matrix) {
     const NewtonWorld* world = MSP::World::c_value_to_world(v_world);
-    Check_Type(v_vertices, T_ARRAY);
-    unsigned int vertex_count = (unsigned int)RARRAY_LEN(v_vertices);
-    dFloat* vertex_cloud = new dFloat[vertex_count * 3];
-    unsigned int j = 0;
-    for (unsigned int i = 0; i < vertex_count; ++i) {
-        dVector point(Util::value_to_point(rb_ary_entry(v_vertices, i)));
-        vertex_cloud[j] = point.m_x;
-        vertex_cloud[j + 1] = point.m_y;
-        vertex_cloud[j + 2] = point.m_z;
-        j += 3;
-    }
-    const NewtonCollision* col = NewtonCreateConvexHull(
+    std::vector<dFloat> vertex_cloud;
+    c_values_to_vertices(v_vertices, vertex_cloud);
+    if (vertex_cloud.empty())
+        return Qnil;
+    dFloat tolerance = Util::value_to_dFloat(v_tolerance);
+    int id = Util::value_to_int(v_id);
+    bool offset_given = (v_offset_matrix != Qnil);
+    dMatrix offset_matrix(offset_given ? Util::value_to_matrix(v_offset_matrix) : dGetIdentityMatrix());
+    std::vector<char> key;
+    key.push_back('H');
+    c_append_key(key, &tolerance, sizeof(dFloat));
+    c_append_key(key, &id, sizeof(int));
+    c_append_key(key, &offset_matrix[0][0], sizeof(dFloat) * 16);
+    c_append_key(key, &vertex_cloud[0], vertex_cloud.size() * sizeof(dFloat));
+    const NewtonCollision* col = c_find_cached_shape(world, key);
+    if (col != nullptr)
+        return c_collision_to_value(col);
+    col = NewtonCreateConvexHull(
         world,
-        vertex_count,
-        vertex_cloud,
+        static_cast<int>(vertex_cloud.size() / 3),
+        &vertex_cloud[0],
         sizeof(dFloat) * 3,
-        Util::value_to_dFloat(v_tolerance),
-        Util::value_to_int(v_id),
-        v_offset_matrix == Qnil ? NULL : &Util::value_to_matrix(v_offset_matrix)[0][0]);
-    delete[] vertex_cloud;
+        tolerance,
+        id,
+        offset_given ? &offset_matrix[0][0] : NULL);
     if (col != NULL) {
-        s_valid_collisions[col] = new CollisionData;
+        c_attach_collision_data(col, new CollisionData);
+        c_cache_shape(world, key, col);
         return c_collision_to_value(col);
     }
     else
@@ -312,12 +1063,12 @@ VALUE MSP::Collision::rbf_create_compound(VALUE self, VALUE v_world, VALUE v_con
     NewtonCompoundCollisionBeginAddRemove(compound);
     unsigned int collisions_count = (unsigned int)RARRAY_LEN(v_convex_collisions);
     for (unsigned int i = 0; i < collisions_count; ++i) {
-        const NewtonCollision* col = reinterpret_cast<NewtonCollision*>(Util::value_to_ull(rb_ary_entry(v_convex_collisions, i)));
-        if (c_is_collision_valid(col) && c_is_collision_convex(col))
+        const NewtonCollision* col = s_valid_collisions.find(Util::value_to_ull(rb_ary_entry(v_convex_collisions, i)));
+        if (col != nullptr && c_is_collision_convex(col))
             NewtonCompoundCollisionAddSubCollision(compound, col);
     }
     NewtonCompoundCollisionEndAddRemove(compound);
-    s_valid_collisions[compound] = new CollisionData;
+    c_attach_collision_data(compound, new CollisionData);
     return c_collision_to_value(compound);
 }
 
@@ -330,92 +1081,94 @@ VALUE MSP::Collision::rbf_create_compound_from_cd(
     VALUE v_max_hull_count, // 256
     VALUE v_max_vertices_per_hull, // 100
     VALUE v_hull_tolerance, // 0.001
-    VALUE v_id)
+    VALUE v_id,
+    VALUE v_progress)
 {
-    return Qnil;
-#if 0
     const NewtonWorld* world = MSP::World::c_value_to_world(v_world);
-    MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world));
-    Check_Type(v_polygons, T_ARRAY);
-    int id = Util::value_to_int(v_id);
-    NewtonMesh* mesh = NewtonMeshCreate(world);
-    /*NewtonMeshBeginFace(mesh);
-    unsigned int polygon_count = (unsigned int)RARRAY_LEN(v_polygons);
-    for (unsigned int i = 0; i < polygon_count; ++i) {
-        VALUE v_polygon = rb_ary_entry(v_polygons, i);
-        unsigned int vertex_count = (unsigned int)RARRAY_LEN(v_polygon);
-        if (vertex_count > 0) {
-            dFloat* vertex_cloud = new dFloat[vertex_count * 3];
-            for (unsigned int j = 0; j < vertex_count; ++j) {
-                dVector point(Util::value_to_point(rb_ary_entry(v_polygon, j), world_data->scale));
-                vertex_cloud[j * 3 + 0] = point.m_x;
-                vertex_cloud[j * 3 + 1] = point.m_y;
-                vertex_cloud[j * 3 + 2] = point.m_z;
-            }
-            NewtonMeshAddFace(mesh, vertex_count, vertex_cloud, sizeof(dFloat) * 3, 0);
-            delete[] vertex_cloud;
-        }
-    }
-    NewtonMeshEndFace(mesh);*/
-    NewtonMeshBeginBuild(mesh);
-    unsigned int polygon_count = (unsigned int)RARRAY_LEN(v_polygons);
-    for (unsigned int i = 0; i < polygon_count; ++i) {
-        VALUE v_polygon = rb_ary_entry(v_polygons, i);
-        unsigned int vertex_count = (unsigned int)RARRAY_LEN(v_polygon);
-        if (vertex_count > 0) {
-            NewtonMeshBeginFace(mesh);
-            for (unsigned int j = 0; j < vertex_count; ++j) {
-                dVector point(Util::value_to_point(rb_ary_entry(v_polygon, j), world_data->scale));
-                NewtonMeshAddPoint(mesh, point.m_x, point.m_y, point.m_z);
-            }
-            NewtonMeshEndFace(mesh);
-        }
-    }
-    NewtonMeshEndBuild(mesh);
-    NewtonRemoveUnusedVertices(mesh, NULL);
-    NewtonMeshFixTJoints(mesh);
     dFloat max_concavity = Util::value_to_dFloat(v_max_concavity);
     dFloat back_face_dist_factor = Util::value_to_dFloat(v_back_face_distance_factor);
-    unsigned int max_hull_count = Util::value_to_uint(v_max_hull_count);
-    unsigned int max_vertices_per_hull = Util::value_to_uint(v_max_vertices_per_hull);
+    int max_hull_count = Util::value_to_int(v_max_hull_count);
+    int max_vertices_per_hull = Util::value_to_int(v_max_vertices_per_hull);
     dFloat hull_tolerance = Util::value_to_dFloat(v_hull_tolerance);
-    NewtonMesh* convex_approximation = NewtonMeshApproximateConvexDecomposition(mesh, max_concavity, back_face_dist_factor, max_hull_count, max_vertices_per_hull, nullptr, nullptr);
-    const NewtonCollision* collision = NewtonCreateCompoundCollisionFromMesh(world, convex_approximation, hull_tolerance, id, id);
-    NewtonMeshDestroy(convex_approximation);
-    NewtonMeshDestroy(mesh);
-    s_valid_collisions[collision] = dVector(1.0f, 1.0f, 1.0f);
-    return c_collision_to_value(collision);
-#endif
+    int id = Util::value_to_int(v_id);
+    if (v_progress != Qnil && rb_class_of(v_progress) != rb_cProc)
+        rb_raise(rb_eTypeError, "Expected a Proc object!");
+    DecompositionProgress progress(v_progress);
+    const NewtonCollision* collision = c_create_compound_from_cd(world, v_polygons, max_concavity, back_face_dist_factor, max_hull_count, max_vertices_per_hull, hull_tolerance, id, progress);
+    if (progress.m_state != 0)
+        rb_jump_tag(progress.m_state);
+    return collision != nullptr ? c_collision_to_value(collision) : Qnil;
 }
 
 VALUE MSP::Collision::rbf_create_static_mesh(VALUE self, VALUE v_world, VALUE v_polygons, VALUE v_optimize, VALUE v_id) {
     const NewtonWorld* world = MSP::World::c_value_to_world(v_world);
-    Check_Type(v_polygons, T_ARRAY);
     bool optimize = Util::value_to_bool(v_optimize);
     int id = Util::value_to_int(v_id);
+    std::vector<dFloat> vertices;
+    std::vector<int> indices;
+    std::vector<int> counts;
+    c_polygons_to_buffers(v_polygons, vertices, indices, counts);
+    return c_create_static_mesh(world, vertices, indices, counts, optimize, id);
+}
 
-    NewtonCollision* collision = NewtonCreateTreeCollision(world, id);
-    NewtonTreeCollisionBeginBuild(collision);
-    unsigned int polygons_length = (unsigned int)RARRAY_LEN(v_polygons);
-    for (unsigned int i = 0; i < polygons_length; ++i) {
-        VALUE v_polygon = rb_ary_entry(v_polygons, i);
-        if (TYPE(v_polygon) != T_ARRAY) continue;
-        unsigned int vertex_count = (unsigned int)RARRAY_LEN(v_polygon);
-        dFloat* vertex_cloud = new dFloat[vertex_count * 3];
-        unsigned int k = 0;
-        for (unsigned int j = 0; j < vertex_count; ++j) {
-            dVector point(Util::value_to_point(rb_ary_entry(v_polygon, j)));
-            vertex_cloud[k] = point.m_x;
-            vertex_cloud[k + 1] = point.m_y;
-            vertex_cloud[k + 2] = point.m_z;
-            k += 3;
-        }
-        NewtonTreeCollisionAddFace(collision, 3, &vertex_cloud[0], 3 * sizeof(dFloat), 0);
-        delete[] vertex_cloud;
+VALUE MSP::Collision::rbf_create_static_mesh_indexed(VALUE self, VALUE v_world, VALUE v_vertices, VALUE v_indices, VALUE v_counts, VALUE v_optimize, VALUE v_id) {
+    const NewtonWorld* world = MSP::World::c_value_to_world(v_world);
+    bool optimize = Util::value_to_bool(v_optimize);
+    int id = Util::value_to_int(v_id);
+    std::vector<dFloat> vertices;
+    std::vector<int> indices;
+    std::vector<int> counts;
+    c_values_to_vertices(v_vertices, vertices);
+    c_values_to_indices(v_indices, indices);
+    // Without face sizes, indices are read as triangles.
+    if (v_counts != Qnil)
+        c_values_to_indices(v_counts, counts);
+    else {
+        if (indices.size() % 3 != 0)
+            rb_raise(rb_eArgError, "Number of triangle indices must be a multiple of 3!");
+        counts.assign(indices.size() / 3, 3);
     }
-    NewtonTreeCollisionEndBuild(collision, optimize ? 1 : 0);
-    s_valid_collisions[collision] = new CollisionData;
-    return c_collision_to_value(collision);
+    int vertex_count = static_cast<int>(vertices.size() / 3);
+    int index_count = static_cast<int>(indices.size());
+    for (int i = 0; i < index_count; ++i)
+        if (indices[i] < 0 || indices[i] >= vertex_count)
+            rb_raise(rb_eArgError, "Vertex index %d is out of range!", indices[i]);
+    long long total = 0;
+    for (std::vector<int>::iterator it = counts.begin(); it != counts.end(); ++it) {
+        if (*it < 0)
+            rb_raise(rb_eArgError, "Face sizes can't be negative!");
+        total += *it;
+    }
+    if (total != index_count)
+        rb_raise(rb_eArgError, "Sum of face sizes doesn't match the number of indices!");
+    return c_create_static_mesh(world, vertices, indices, counts, optimize, id);
+}
+
+VALUE MSP::Collision::rbf_clear_cache(VALUE self, VALUE v_world) {
+    const NewtonWorld* world = MSP::World::c_value_to_world(v_world);
+    c_clear_shape_cache(world);
+    return Qnil;
+}
+
+VALUE MSP::Collision::rbf_get_cache_size(VALUE self, VALUE v_world) {
+    const NewtonWorld* world = MSP::World::c_value_to_world(v_world);
+    MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world));
+    return Util::to_value(static_cast<unsigned int>(world_data->m_shape_cache.size()));
+}
+
+VALUE MSP::Collision::rbf_get_disk_cache_path(VALUE self) {
+    if (s_disk_cache_path.empty())
+        return Qnil;
+    return Util::to_value(s_disk_cache_path.c_str());
+}
+
+VALUE MSP::Collision::rbf_set_disk_cache_path(VALUE self, VALUE v_path) {
+    if (v_path == Qnil) {
+        s_disk_cache_path.clear();
+        return Qnil;
+    }
+    s_disk_cache_path = Util::value_to_c_str(v_path);
+    return Qnil;
 }
 
 VALUE MSP::Collision::rbf_get_type(VALUE self, VALUE v_collision) {
@@ -425,13 +1178,13 @@ VALUE MSP::Collision::rbf_get_type(VALUE self, VALUE v_collision) {
 
 VALUE MSP::Collision::rbf_get_scale(VALUE self, VALUE v_collision) {
     const NewtonCollision* collision = c_value_to_collision(v_collision);
-    return Util::vector_to_value(s_valid_collisions[collision]->m_scale);
+    return Util::vector_to_value(c_get_collision_data(collision)->m_scale);
 }
 
 VALUE MSP::Collision::rbf_set_scale(VALUE self, VALUE v_collision, VALUE v_scale) {
     const NewtonCollision* collision = c_value_to_collision(v_collision);
     dVector scale(Util::value_to_vector(v_scale));
-    dVector& cscale = s_valid_collisions[collision]->m_scale;
+    dVector& cscale = c_get_collision_data(collision)->m_scale;
     cscale.m_x = Util::clamp_float(scale.m_x, 0.01f, 100.0f);
     cscale.m_y = Util::clamp_float(scale.m_y, 0.01f, 100.0f);
     cscale.m_z = Util::clamp_float(scale.m_z, 0.01f, 100.0f);
@@ -440,7 +1193,7 @@ VALUE MSP::Collision::rbf_set_scale(VALUE self, VALUE v_collision, VALUE v_scale
 }
 
 VALUE MSP::Collision::rbf_is_valid(VALUE self, VALUE v_collision) {
-    return c_is_collision_valid(reinterpret_cast<NewtonCollision*>(Util::value_to_ull(v_collision))) ? Qtrue : Qfalse;
+    return c_is_collision_valid(Util::value_to_ull(v_collision)) ? Qtrue : Qfalse;
 }
 
 VALUE MSP::Collision::rbf_destroy(VALUE self, VALUE v_collision) {
@@ -475,8 +1228,13 @@ void MSP::Collision::init_ruby(VALUE mNewton) {
     rb_define_module_function(mCollision, "create_scaled_chamfer_cylinder", VALUEFUNC(MSP::Collision::rbf_create_scaled_chamfer_cylinder), 6);
     rb_define_module_function(mCollision, "create_convex_hull", VALUEFUNC(MSP::Collision::rbf_create_convex_hull), 5);
     rb_define_module_function(mCollision, "create_compound", VALUEFUNC(MSP::Collision::rbf_create_compound), 3);
-    //rb_define_module_function(mCollision, "create_compound_from_cd", VALUEFUNC(MSP::Collision::rbf_create_compound_from_cd), 8);
+    rb_define_module_function(mCollision, "create_compound_from_cd", VALUEFUNC(MSP::Collision::rbf_create_compound_from_cd), 9);
     rb_define_module_function(mCollision, "create_static_mesh", VALUEFUNC(MSP::Collision::rbf_create_static_mesh), 4);
+    rb_define_module_function(mCollision, "create_static_mesh_indexed", VALUEFUNC(MSP::Collision::rbf_create_static_mesh_indexed), 6);
+    rb_define_module_function(mCollision, "clear_cache", VALUEFUNC(MSP::Collision::rbf_clear_cache), 1);
+    rb_define_module_function(mCollision, "get_cache_size", VALUEFUNC(MSP::Collision::rbf_get_cache_size), 1);
+    rb_define_module_function(mCollision, "get_disk_cache_path", VALUEFUNC(MSP::Collision::rbf_get_disk_cache_path), 0);
+    rb_define_module_function(mCollision, "set_disk_cache_path", VALUEFUNC(MSP::Collision::rbf_set_disk_cache_path), 1);
     rb_define_module_function(mCollision, "get_type", VALUEFUNC(MSP::Collision::rbf_get_type), 1);
     rb_define_module_function(mCollision, "get_scale", VALUEFUNC(MSP::Collision::rbf_get_scale), 1);
     rb_define_module_function(mCollision, "set_scale", VALUEFUNC(MSP::Collision::rbf_set_scale), 2);
@@ -16,33 +16,164 @@ private:
     // Constants
     static const dFloat MIN_SIZE;
     static const dFloat MAX_SIZE;
+    static const unsigned int DISK_CACHE_MAGIC;
+    static const unsigned int DISK_CACHE_VERSION;
+    static const dFloat DECOMPOSITION_PROGRESS_SHARE;
 
 public:
     // Structures
+    // Faces of a collision in its local space, used for aerodynamic drag.
+    // Arrays are padded with zero-area faces to a multiple of four.
+    struct AerodynamicTable {
+        std::vector<dFloat> m_centroid[3];
+        std::vector<dFloat> m_normal[3];
+        std::vector<dFloat> m_area;
+        dVector m_scale;
+        bool m_built;
+        AerodynamicTable() :
+            m_scale(1.0f, 1.0f, 1.0f, 1.0f),
+            m_built(false)
+        {
+        }
+    };
+
+    // Attached to collisions as Newton user data. The handle is only assigned
+    // once a collision is passed to Ruby, so internal copies made by Newton
+    // never touch the handle table.
     struct CollisionData {
         dVector m_scale;
+        AerodynamicTable m_aerodynamics;
+        const NewtonCollision* m_owner;
+        unsigned long long m_handle;
         CollisionData()
-            : m_scale(1.0f, 1.0f, 1.0f, 1.0f)
+            : m_scale(1.0f, 1.0f, 1.0f, 1.0f),
+            m_owner(nullptr),
+            m_handle(0)
         {
         }
         CollisionData(const dVector& scale)
-            : m_scale(scale)
+            : m_scale(scale),
+            m_owner(nullptr),
+            m_handle(0)
         {
         }
         CollisionData(dFloat x, dFloat y, dFloat z)
-            : m_scale(x, y, z, 1.0f)
+            : m_scale(x, y, z, 1.0f),
+            m_owner(nullptr),
+            m_handle(0)
+        {
+        }
+    };
+
+    // Buffers reused while adding polygons to a tree collision.
+    struct FaceBuffers {
+        std::vector<dFloat> m_points;
+        std::vector<dFloat> m_projected;
+        std::vector<int> m_remaining;
+    };
+
+    // Read position within a serialized shape.
+    struct SerializeReader {
+        const char* m_data;
+        size_t m_size;
+        size_t m_offset;
+        SerializeReader(const char* data, size_t size) :
+            m_data(data),
+            m_size(size),
+            m_offset(0)
+        {
+        }
+    };
+
+    // Point cloud of one convex cluster and the vertices of its hull.
+    struct HullCluster {
+        std::vector<dFloat> m_points;
+        std::vector<dFloat> m_hull;
+    };
+
+    // Clusters shared by the hull jobs, which pull clusters by index.
+    struct HullBatch {
+        std::vector<HullCluster>& m_clusters;
+        dFloat m_tolerance;
+        int m_cluster_index;
+        HullBatch(std::vector<HullCluster>& clusters, dFloat tolerance) :
+            m_clusters(clusters),
+            m_tolerance(tolerance),
+            m_cluster_index(0)
+        {
+        }
+    };
+
+    // Forwards progress of a decomposition to a Ruby proc. The state of an
+    // exception raised by the proc is kept until the Newton objects are
+    // released.
+    struct DecompositionProgress {
+        VALUE m_proc;
+        dFloat m_offset;
+        dFloat m_range;
+        dFloat m_value;
+        int m_state;
+        bool m_cancelled;
+        DecompositionProgress(VALUE proc) :
+            m_proc(proc),
+            m_offset(0.0f),
+            m_range(1.0f),
+            m_value(0.0f),
+            m_state(0),
+            m_cancelled(false)
         {
         }
     };
 
     // Variables
-    static std::map<const NewtonCollision*, CollisionData*> s_valid_collisions;
+    static HandleTable<const NewtonCollision*> s_valid_collisions;
+    static std::string s_disk_cache_path;
+
+    // Callback Functions
+    static void serialize_callback(void* const serialize_handle, const void* const buffer, int size);
+    static void deserialize_callback(void* const serialize_handle, void* const buffer, int size);
+    static void aerodynamic_face_iterator(void* const user_data, int vertex_count, const dFloat* const face_array, int face_id);
+    static int decomposition_progress_callback(dFloat progress, void* const user_data);
+    static void hull_job(NewtonWorld* const world, void* const user_data, int thread_index);
 
     // Helper Functions
-    static bool c_is_collision_valid(const NewtonCollision* address);
+    static bool c_is_collision_valid(unsigned long long handle);
+    static CollisionData* c_get_collision_data(const NewtonCollision* collision);
+    static void c_attach_collision_data(const NewtonCollision* collision, CollisionData* data);
+    static void c_release_collision_data(const NewtonCollision* collision);
     static const NewtonCollision* c_value_to_collision(VALUE v_collision);
     static VALUE c_collision_to_value(const NewtonCollision* collision);
     static bool c_is_collision_convex(const NewtonCollision* collision);
+    static void c_values_to_vertices(VALUE v_vertices, std::vector<dFloat>& vertices_out);
+    static void c_values_to_indices(VALUE v_indices, std::vector<int>& indices_out);
+    static void c_add_tree_face(NewtonCollision* collision, const dFloat* vertices, const int* indices, int count, FaceBuffers& buffers);
+    static void c_append_key(std::vector<char>& key, const void* data, size_t size);
+    static const NewtonCollision* c_find_cached_shape(const NewtonWorld* world, const std::vector<char>& key);
+    static void c_cache_shape(const NewtonWorld* world, const std::vector<char>& key, const NewtonCollision* collision);
+    static void c_clear_shape_cache(const NewtonWorld* world);
+    static std::string c_get_disk_cache_file(unsigned long long hash);
+#if defined(_WIN_32_VER) || defined(_WIN_64_VER)
+    static std::wstring c_utf8_to_wide(const std::string& text);
+#endif
+    static NewtonCollision* c_load_shape_from_disk(const NewtonWorld* world, const std::vector<char>& key, unsigned long long hash);
+    static void c_save_shape_to_disk(const NewtonWorld* world, const std::vector<char>& key, unsigned long long hash, const NewtonCollision* collision);
+    static const AerodynamicTable& c_get_aerodynamic_table(const NewtonCollision* collision, AerodynamicTable& fallback);
+    static void c_compute_drag(const AerodynamicTable& table, const dVector& velocity, const dVector& centre, dVector& force_out, dVector& torque_out);
+    static void c_polygons_to_buffers(VALUE v_polygons, std::vector<dFloat>& vertices, std::vector<int>& indices, std::vector<int>& counts);
+    static void c_reduce_hulls(const NewtonWorld* world, HullBatch& batch);
+    static VALUE c_call_progress(VALUE v_progress);
+    static bool c_report_progress(DecompositionProgress& progress, dFloat value);
+    static const NewtonCollision* c_create_compound_from_cd(
+        const NewtonWorld* world,
+        VALUE v_polygons,
+        dFloat max_concavity,
+        dFloat back_face_dist_factor,
+        int max_hull_count,
+        int max_vertices_per_hull,
+        dFloat hull_tolerance,
+        int id,
+        DecompositionProgress& progress);
+    static VALUE c_create_static_mesh(const NewtonWorld* world, const std::vector<dFloat>& vertices, const std::vector<int>& indices, const std::vector<int>& counts, bool optimize, int id);
 
     // Ruby Functions
     static VALUE rbf_create_null(VALUE self, VALUE v_world);
@@ -70,8 +201,14 @@ public:
         VALUE v_max_hull_count,
         VALUE v_max_vertices_per_hull,
         VALUE v_hull_tolerance,
-        VALUE v_id);
+        VALUE v_id,
+        VALUE v_progress);
     static VALUE rbf_create_static_mesh(VALUE self, VALUE v_world, VALUE v_polygons, VALUE v_optimize, VALUE v_id);
+    static VALUE rbf_create_static_mesh_indexed(VALUE self, VALUE v_world, VALUE v_vertices, VALUE v_indices, VALUE v_counts, VALUE v_optimize, VALUE v_id);
+    static VALUE rbf_clear_cache(VALUE self, VALUE v_world);
+    static VALUE rbf_get_cache_size(VALUE self, VALUE v_world);
+    static VALUE rbf_get_disk_cache_path(VALUE self);
+    static VALUE rbf_set_disk_cache_path(VALUE self, VALUE v_path);
     static VALUE rbf_get_type(VALUE self, VALUE v_collision);
     static VALUE rbf_get_scale(VALUE self, VALUE v_collision);
     static VALUE rbf_set_scale(VALUE self, VALUE v_collision, VALUE v_scale);
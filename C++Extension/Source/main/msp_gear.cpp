@@ -25,7 +25,7 @@ const dFloat MSP::Gear::DEFAULT_RATIO(1.0f);
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 */
 
-std::set<MSP::Gear::GearData*> MSP::Gear::s_valid_gears;
+MSP::HandleTable<MSP::Gear::GearData*> MSP::Gear::s_valid_gears;
 
 
 /*
@@ -34,18 +34,20 @@ std::set<MSP::Gear::GearData*> MSP::Gear::s_valid_gears;
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 */
 
-bool MSP::Gear::c_is_gear_valid(GearData* address) {
-    return s_valid_gears.find(address) != s_valid_gears.end();
+bool MSP::Gear::c_is_gear_valid(unsigned long long handle) {
+    return s_valid_gears.is_valid(handle);
 }
 
 VALUE MSP::Gear::c_gear_to_value(GearData* gear_data) {
-    return rb_ull2inum(reinterpret_cast<unsigned long long>(gear_data));
+    return rb_ull2inum(gear_data->m_handle);
 }
 
 MSP::Gear::GearData* MSP::Gear::c_value_to_gear(VALUE v_gear) {
-    GearData* address = reinterpret_cast<GearData*>(rb_num2ull(v_gear));
-    if (Util::s_validate_objects && s_valid_gears.find(address) == s_valid_gears.end())
+    unsigned long long handle = rb_num2ull(v_gear);
+    GearData* address = s_valid_gears.find(handle);
+    if (address == nullptr)
         rb_raise(rb_eTypeError, "Given address doesn't reference a valid gear!");
+    MSP::World::c_wait_for_update(address->m_world);
     return address;
 }
 
@@ -57,13 +59,18 @@ MSP::Gear::GearData* MSP::Gear::c_create(const NewtonWorld* world, MSP::Joint::J
     if (!c_are_joints_gearable(joint_data1, joint_data2) && !c_are_joints_gearable(joint_data2, joint_data1))
         rb_raise(rb_eTypeError, "Cannot create gear between %s and %s!", MSP::Joint::JOINT_NAMES[joint_data1->m_jtype], MSP::Joint::JOINT_NAMES[joint_data2->m_jtype]);
     GearData* gear_data = new GearData(world, joint_data1, joint_data2, 0.0f, 0.0f);
-    s_valid_gears.insert(gear_data);
+    gear_data->m_handle = s_valid_gears.insert(gear_data);
+    reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world))->m_gears.push_back(gear_data);
     return gear_data;
 }
 
 void MSP::Gear::c_destroy(GearData* gear_data) {
-    if (s_valid_gears.find(gear_data) != s_valid_gears.end())
-        s_valid_gears.erase(gear_data);
+    s_valid_gears.erase(gear_data->m_handle);
+    if (gear_data->m_constraint != nullptr) {
+        MSP::World::c_wait_for_update(gear_data->m_world);
+        NewtonDestroyJoint(gear_data->m_world, gear_data->m_constraint);
+    }
+    reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(gear_data->m_world))->m_gears.remove(gear_data);
     delete gear_data;
 }
 
@@ -109,6 +116,161 @@ bool MSP::Gear::c_are_joints_gearable(MSP::Joint::JointData* joint_data1, MSP::J
     return false;
 }
 
+void MSP::Gear::c_update_constraint(GearData* gear_data) {
+    MSP::Joint::JointData* joint_data1 = gear_data->m_joint_data1;
+    MSP::Joint::JointData* joint_data2 = gear_data->m_joint_data2;
+    // The constraint acts on the child of the first joint and on the first
+    // other body involved; motion of the remaining bodies is accounted for
+    // explicitly.
+    const NewtonBody* body0 = nullptr;
+    const NewtonBody* body1 = nullptr;
+    if (joint_data1->m_connected && joint_data2->m_connected) {
+        body0 = joint_data1->m_child;
+        const NewtonBody* candidates[3] = { joint_data2->m_child, joint_data2->m_parent, joint_data1->m_parent };
+        for (unsigned int i = 0; i < 3; ++i) {
+            if (candidates[i] != nullptr && candidates[i] != body0) {
+                body1 = candidates[i];
+                break;
+            }
+        }
+    }
+    if (gear_data->m_constraint != nullptr && (body0 != gear_data->m_body0 || body1 != gear_data->m_body1))
+        NewtonDestroyJoint(gear_data->m_world, gear_data->m_constraint);
+    if (gear_data->m_constraint == nullptr && body0 != nullptr) {
+        gear_data->m_constraint = NewtonConstraintCreateUserJoint(gear_data->m_world, 1, submit_constraints, body0, body1);
+        NewtonJointSetCollisionState(gear_data->m_constraint, 1);
+        NewtonJointSetUserData(gear_data->m_constraint, gear_data);
+        NewtonJointSetDestructor(gear_data->m_constraint, constraint_destructor);
+        gear_data->m_body0 = body0;
+        gear_data->m_body1 = body1;
+    }
+}
+
+void MSP::Gear::c_update_constraints(const NewtonWorld* world) {
+    MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world));
+    for (GearData* gear_data = world_data->m_gears.first(); gear_data != nullptr; gear_data = WorldGearList::next(gear_data))
+        c_update_constraint(gear_data);
+}
+
+bool MSP::Gear::c_calc_dof_terms(MSP::Joint::JointData* joint_data, dFloat scale, DofTerm* terms, unsigned int& count) {
+    if (!joint_data->m_connected)
+        return false;
+    dMatrix matrix0, matrix1;
+    MSP::Joint::c_calculate_global_matrix(joint_data, matrix0, matrix1);
+    dVector axis;
+    bool linear;
+    switch (joint_data->m_jtype) {
+        case MSP::Joint::HINGE:
+        case MSP::Joint::MOTOR:
+        case MSP::Joint::SERVO:
+            axis = matrix1.m_right;
+            linear = false;
+            break;
+        case MSP::Joint::SLIDER:
+        case MSP::Joint::PISTON:
+        case MSP::Joint::SPRING:
+            axis = matrix1.m_right;
+            linear = true;
+            break;
+        case MSP::Joint::CURVY_SLIDER:
+        case MSP::Joint::CURVY_PISTON:
+            if (!MSP::Joint::c_calc_curve_tangent(joint_data, axis))
+                return false;
+            linear = true;
+            break;
+        default:
+            return false;
+    }
+    const NewtonBody* bodies[2] = { joint_data->m_child, joint_data->m_parent };
+    for (unsigned int i = 0; i < 2; ++i) {
+        if (bodies[i] == nullptr) continue;
+        // The parent moves the DOF backwards.
+        dFloat body_scale = (i == 0) ? scale : -scale;
+        if (linear) {
+            // Linear DOFs are measured in meters, at the pivot of the child.
+            dMatrix matrix;
+            dVector centre;
+            NewtonBodyGetMatrix(bodies[i], &matrix[0][0]);
+            NewtonBodyGetCentreOfMass(bodies[i], &centre[0]);
+            centre = matrix.TransformVector(centre);
+            body_scale *= M_INCH_TO_METER;
+            c_add_dof_term(bodies[i], axis.Scale(body_scale), (matrix0.m_posit - centre).CrossProduct(axis).Scale(body_scale), terms, count);
+        }
+        else
+            c_add_dof_term(bodies[i], dVector(0.0f), axis.Scale(body_scale), terms, count);
+    }
+    return true;
+}
+
+void MSP::Gear::c_add_dof_term(const NewtonBody* body, const dVector& linear, const dVector& angular, DofTerm* terms, unsigned int& count) {
+    for (unsigned int i = 0; i < count; ++i) {
+        if (terms[i].m_body == body) {
+            terms[i].m_linear += linear;
+            terms[i].m_angular += angular;
+            return;
+        }
+    }
+    terms[count].m_body = body;
+    terms[count].m_linear = linear;
+    terms[count].m_angular = angular;
+    ++count;
+}
+
+
+/*
+ ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+  Callback Functions
+ ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+void MSP::Gear::submit_constraints(const NewtonJoint* joint, dFloat timestep, int thread_index) {
+    GearData* gear_data = reinterpret_cast<GearData*>(NewtonJointGetUserData(joint));
+    // The gear drives ratio * rate1 + rate2 to zero, where the rates are
+    // those of the joints' DOFs, in rad/s or m/s.
+    DofTerm terms[4];
+    unsigned int count = 0;
+    if (!c_calc_dof_terms(gear_data->m_joint_data1, gear_data->m_ratio, terms, count) ||
+        !c_calc_dof_terms(gear_data->m_joint_data2, 1.0f, terms, count))
+        return;
+    dFloat jacobian0[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    dFloat jacobian1[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    dFloat rel_vel = 0.0f;
+    for (unsigned int i = 0; i < count; ++i) {
+        const DofTerm& term = terms[i];
+        dVector velocity;
+        dVector omega;
+        NewtonBodyGetVelocity(term.m_body, &velocity[0]);
+        NewtonBodyGetOmega(term.m_body, &omega[0]);
+        rel_vel += term.m_linear.DotProduct3(velocity) + term.m_angular.DotProduct3(omega);
+        dFloat* jacobian;
+        if (term.m_body == gear_data->m_body0)
+            jacobian = jacobian0;
+        else if (term.m_body == gear_data->m_body1)
+            jacobian = jacobian1;
+        else
+            continue;
+        for (unsigned int j = 0; j < 3; ++j) {
+            jacobian[j] += term.m_linear[j];
+            jacobian[j + 3] += term.m_angular[j];
+        }
+    }
+    dFloat norm2 = 0.0f;
+    for (unsigned int j = 0; j < 6; ++j)
+        norm2 += jacobian0[j] * jacobian0[j] + jacobian1[j] * jacobian1[j];
+    // A row that moves neither body would be singular.
+    if (norm2 < M_EPSILON * M_EPSILON)
+        return;
+    NewtonUserJointAddGeneralRow(joint, jacobian0, jacobian1);
+    NewtonUserJointSetRowAcceleration(joint, -rel_vel / timestep);
+}
+
+void MSP::Gear::constraint_destructor(const NewtonJoint* joint) {
+    GearData* gear_data = reinterpret_cast<GearData*>(NewtonJointGetUserData(joint));
+    gear_data->m_constraint = nullptr;
+    gear_data->m_body0 = nullptr;
+    gear_data->m_body1 = nullptr;
+}
+
 
 /*
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -117,7 +279,7 @@ bool MSP::Gear::c_are_joints_gearable(MSP::Joint::JointData* joint_data1, MSP::J
 */
 
 VALUE MSP::Gear::rbf_is_valid(VALUE self, VALUE v_gear) {
-    return c_is_gear_valid(reinterpret_cast<GearData*>(Util::value_to_ull(v_gear))) ? Qtrue : Qfalse;
+    return c_is_gear_valid(Util::value_to_ull(v_gear)) ? Qtrue : Qfalse;
 }
 
 VALUE MSP::Gear::rbf_create(VALUE self, VALUE v_world, VALUE v_joint1, VALUE v_joint2) {
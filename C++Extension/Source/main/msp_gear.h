@@ -26,6 +26,12 @@ public:
         VALUE m_user_data;
         dFloat m_initial_position1;
         dFloat m_initial_position2;
+        unsigned long long m_handle;
+        ListLink<GearData> m_world_link;
+        // Constraint coupling the joints and the two bodies it acts on
+        NewtonJoint* m_constraint;
+        const NewtonBody* m_body0;
+        const NewtonBody* m_body1;
         GearData(const NewtonWorld* world, Joint::JointData* joint_data1, Joint::JointData* joint_data2, dFloat initial_position1, dFloat initial_position2) :
             m_world(world),
             m_joint_data1(joint_data1),
@@ -33,7 +39,11 @@ public:
             m_ratio(DEFAULT_RATIO),
             m_user_data(Qnil),
             m_initial_position1(initial_position1),
-            m_initial_position2(initial_position2)
+            m_initial_position2(initial_position2),
+            m_handle(0),
+            m_constraint(nullptr),
+            m_body0(nullptr),
+            m_body1(nullptr)
         {
         }
         ~GearData()
@@ -41,16 +51,33 @@ public:
         }
     };
 
+    typedef IntrusiveList<GearData, &GearData::m_world_link> WorldGearList;
+
+    // Contribution of one body to the rate of a joint's DOF
+    struct DofTerm {
+        const NewtonBody* m_body;
+        dVector m_linear;
+        dVector m_angular;
+    };
+
     // Variables
-    static std::set<GearData*> s_valid_gears;
+    static HandleTable<GearData*> s_valid_gears;
+
+    // Callback Functions
+    static void submit_constraints(const NewtonJoint* joint, dFloat timestep, int thread_index);
+    static void constraint_destructor(const NewtonJoint* joint);
 
     // Helper Functions
-    static bool c_is_gear_valid(GearData* address);
+    static bool c_is_gear_valid(unsigned long long handle);
     static VALUE c_gear_to_value(GearData* gear_data);
     static GearData* c_value_to_gear(VALUE v_gear);
     static GearData* c_create(const NewtonWorld* world, MSP::Joint::JointData* joint_data1, MSP::Joint::JointData* joint_data2);
     static void c_destroy(GearData* gear_data);
     static bool c_are_joints_gearable(MSP::Joint::JointData* joint_data1, MSP::Joint::JointData* joint_data2);
+    static void c_update_constraint(GearData* gear_data);
+    static void c_update_constraints(const NewtonWorld* world);
+    static bool c_calc_dof_terms(MSP::Joint::JointData* joint_data, dFloat scale, DofTerm* terms, unsigned int& count);
+    static void c_add_dof_term(const NewtonBody* body, const dVector& linear, const dVector& angular, DofTerm* terms, unsigned int& count);
 
     // Ruby Functions
     static VALUE rbf_is_valid(VALUE self, VALUE v_gear);
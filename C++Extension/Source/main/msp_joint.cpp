@@ -9,6 +9,9 @@
 #include "msp_joint.h"
 #include "msp_world.h"
 #include "msp_body.h"
+#include "msp_gear.h"
+#include <algorithm>
+#include <cmath>
 
 /*
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -37,6 +40,64 @@ const dFloat MSP::Joint::CUSTOM_LARGE_VALUE(1.0e20f);
 const dFloat MSP::Joint::DEFAULT_STIFFNESS_RANGE(500.0f);
 const dFloat MSP::Joint::MIN_PIN_LENGTH(50.0f);
 const char* MSP::Joint::JOINT_NAMES[16] = { "None", "Hinge", "Motor", "Servo", "Slider", "Piston", "UpVector", "Spring", "Corkscrew", "BallAndSocket", "Universal", "Fixed", "CurvySlider", "CurvyPiston", "Plane", "PointToPoint" };
+const MSP::Joint::ControllerFunction MSP::Joint::CONTROLLER_FUNCTIONS[] = {
+    { "sin", FUNCTION_MATH, 1, 1 },
+    { "cos", FUNCTION_MATH, 1, 1 },
+    { "tan", FUNCTION_MATH, 1, 1 },
+    { "asin", FUNCTION_MATH, 1, 1 },
+    { "acos", FUNCTION_MATH, 1, 1 },
+    { "atan", FUNCTION_MATH, 1, 1 },
+    { "atan2", FUNCTION_MATH, 2, 2 },
+    { "sinh", FUNCTION_MATH, 1, 1 },
+    { "cosh", FUNCTION_MATH, 1, 1 },
+    { "tanh", FUNCTION_MATH, 1, 1 },
+    { "asinh", FUNCTION_MATH, 1, 1 },
+    { "acosh", FUNCTION_MATH, 1, 1 },
+    { "atanh", FUNCTION_MATH, 1, 1 },
+    { "sqrt", FUNCTION_MATH, 1, 1 },
+    { "cbrt", FUNCTION_MATH, 1, 1 },
+    { "exp", FUNCTION_MATH, 1, 1 },
+    { "log", FUNCTION_MATH, 1, 2 },
+    { "log2", FUNCTION_MATH, 1, 1 },
+    { "log10", FUNCTION_MATH, 1, 1 },
+    { "hypot", FUNCTION_MATH, 2, 2 },
+    { "oscillator", FUNCTION_TIME, 1, 2 },
+    { "oscillator_slope", FUNCTION_TIME, 1, 2 },
+    { "oscillator2", FUNCTION_TIME, 1, 2 },
+    { "oscillator2_slope", FUNCTION_TIME, 1, 2 },
+    { "accumulator", FUNCTION_TIME, 1, 2 },
+    { "repeater", FUNCTION_TIME, 2, 3 },
+    { "abs", FUNCTION_METHOD, 1, 1 },
+    { "to_f", FUNCTION_METHOD, 1, 1 },
+    { "to_i", FUNCTION_METHOD, 1, 1 },
+    { "floor", FUNCTION_METHOD, 1, 1 },
+    { "ceil", FUNCTION_METHOD, 1, 1 },
+    { "round", FUNCTION_METHOD, 1, 1 },
+    { "truncate", FUNCTION_METHOD, 1, 1 },
+    { "key", FUNCTION_INPUT, 1, 1 },
+    { "toggle_key", FUNCTION_INPUT, 1, 1 },
+    { "slider", FUNCTION_INPUT, 1, 5 },
+    { "key_slider", FUNCTION_INPUT, 3, 7 },
+    { "joystick", FUNCTION_INPUT, 1, 1 },
+    { "joybutton", FUNCTION_INPUT, 1, 1 },
+    { "joypad", FUNCTION_INPUT, 0, 0 },
+    { "leftx", FUNCTION_INPUT, 0, 0 },
+    { "lefty", FUNCTION_INPUT, 0, 0 },
+    { "leftz", FUNCTION_INPUT, 0, 0 },
+    { "rightx", FUNCTION_INPUT, 0, 0 },
+    { "righty", FUNCTION_INPUT, 0, 0 },
+    { "rightz", FUNCTION_INPUT, 0, 0 },
+    { "numx", FUNCTION_INPUT, 0, 0 },
+    { "numy", FUNCTION_INPUT, 0, 0 },
+    { "frame", FUNCTION_INPUT, 0, 0 },
+    { "get_var", FUNCTION_INPUT, 1, 1 },
+    { "get_global_var", FUNCTION_INPUT, 1, 1 }
+};
+const int MSP::Joint::CONTROLLER_FUNCTION_COUNT(sizeof(CONTROLLER_FUNCTIONS) / sizeof(CONTROLLER_FUNCTIONS[0]));
+const double MSP::Joint::CONTROLLER_PI(3.141592653589793);
+const double MSP::Joint::CONTROLLER_E(2.718281828459045);
+const unsigned int MSP::Joint::CURVE_TREE_LEAF_SIZE(4);
+const unsigned int MSP::Joint::CURVE_TREE_STACK_SIZE(64);
 
 
 /*
@@ -45,8 +106,9 @@ const char* MSP::Joint::JOINT_NAMES[16] = { "None", "Hinge", "Motor", "Servo", "
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 */
 
-std::map<MSP::Joint::JointData*, bool> MSP::Joint::s_valid_joints;
+MSP::HandleTable<MSP::Joint::JointData*> MSP::Joint::s_valid_joints;
 std::map<VALUE, std::map<MSP::Joint::JointData*, bool>> MSP::Joint::s_map_group_to_joints;
+std::multimap<unsigned long long, MSP::Joint::CurveData*> MSP::Joint::s_curves;
 
 
 /*
@@ -74,7 +136,7 @@ void MSP::Joint::submit_constraints(const NewtonJoint* joint, dFloat timestep, i
         for (int i = 0; i < NewtonUserJoinRowsCount(joint); ++i) {
             if (dAbs(NewtonUserJointGetRowForce(joint, i)) >= joint_data->m_breaking_force) {
                 MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(joint_data->m_world));
-                world_data->m_joints_to_disconnect.push_back(joint);
+                world_data->m_thread_buffers[thread_index].m_joints_to_disconnect.push_back(joint);
                 return;
             }
         }
@@ -84,6 +146,11 @@ void MSP::Joint::submit_constraints(const NewtonJoint* joint, dFloat timestep, i
 void MSP::Joint::constraint_destructor(const NewtonJoint* joint) {
     JointData* joint_data = reinterpret_cast<JointData*>(NewtonJointGetUserData(joint));
     on_disconnect(joint_data);
+    // The link is already cleared if the child body is being destroyed.
+    if (ChildJointList::is_linked(joint_data)) {
+        MSP::Body::BodyData* child_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(joint_data->m_child));
+        child_data->m_cold->m_connected_joints.remove(joint_data);
+    }
     joint_data->m_constraint = nullptr;
     joint_data->m_connected = false;
     joint_data->m_child = nullptr;
@@ -154,25 +221,26 @@ void MSP::Joint::adjust_pin_matrix_proc(JointData* joint_data, dMatrix& pin_matr
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 */
 
-bool MSP::Joint::c_is_joint_valid(JointData* address) {
-    return s_valid_joints.find(address) != s_valid_joints.end();
+bool MSP::Joint::c_is_joint_valid(unsigned long long handle) {
+    return s_valid_joints.is_valid(handle);
 }
 
 VALUE MSP::Joint::c_joint_to_value(JointData* joint_data) {
-    return rb_ull2inum(reinterpret_cast<unsigned long long>(joint_data));
+    return rb_ull2inum(joint_data->m_handle);
 }
 
 MSP::Joint::JointData* MSP::Joint::c_value_to_joint(VALUE v_joint) {
-    JointData* address = reinterpret_cast<JointData*>(rb_num2ull(v_joint));
-    if (Util::s_validate_objects && s_valid_joints.find(address) == s_valid_joints.end())
+    unsigned long long handle = rb_num2ull(v_joint);
+    JointData* address = s_valid_joints.find(handle);
+    if (address == nullptr)
         rb_raise(rb_eTypeError, "Given address doesn't reference a valid joint!");
+    // Joint state is read by the solver while an update is pending.
+    MSP::World::c_wait_for_update(address->m_world);
     return address;
 }
 
 MSP::Joint::JointData* MSP::Joint::c_value_to_joint2(VALUE v_joint, JointType joint_type) {
-    JointData* address = reinterpret_cast<JointData*>(rb_num2ull(v_joint));
-    if (Util::s_validate_objects && s_valid_joints.find(address) == s_valid_joints.end())
-        rb_raise(rb_eTypeError, "Given address doesn't reference a valid joint!");
+    JointData* address = c_value_to_joint(v_joint);
     if (Util::s_validate_objects && address->m_jtype != joint_type)
         rb_raise(rb_eTypeError, "Given address doesn't reference a joint of a particular type!");
     return address;
@@ -252,7 +320,7 @@ dFloat MSP::Joint::c_calculate_angle2(const dVector& dir, const dVector& cosDir,
 }
 
 void MSP::Joint::c_get_pin_matrix(JointData* joint_data, dMatrix& matrix_out) {
-    if (joint_data->m_parent != nullptr && MSP::Body::c_is_body_valid(joint_data->m_parent)) {
+    if (joint_data->m_parent != nullptr && MSP::Body::c_is_body_valid(joint_data->m_parent_handle)) {
         dMatrix parent_matrix;
         NewtonBodyGetMatrix(joint_data->m_parent, &parent_matrix[0][0]);
         matrix_out = joint_data->m_pin_matrix * parent_matrix;
@@ -268,14 +336,35 @@ MSP::Joint::JointData* MSP::Joint::c_create(const NewtonWorld* world, const Newt
         pin_matrix = pin_matrix * parent_matrix.Inverse();
     }
     JointData* joint_data = new JointData(world, 6, parent, pin_matrix, v_group);
+    if (parent != nullptr) {
+        MSP::Body::BodyData* parent_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(parent));
+        joint_data->m_parent_handle = parent_data->m_handle;
+        parent_data->m_cold->m_contained_joints.push_back(joint_data);
+    }
     if (v_group != Qnil) s_map_group_to_joints[v_group][joint_data] = true;
-    s_valid_joints[joint_data] = true;
+    joint_data->m_handle = s_valid_joints.insert(joint_data);
+    MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world));
+    world_data->m_joints.push_back(joint_data);
     return joint_data;
 }
 
 void MSP::Joint::c_destroy(JointData* joint_data) {
-    if (s_valid_joints.find(joint_data) != s_valid_joints.end())
-        s_valid_joints.erase(joint_data);
+    s_valid_joints.erase(joint_data->m_handle);
+    MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(joint_data->m_world));
+    world_data->m_joints.remove(joint_data);
+    // Gears referencing the joint go with it.
+    MSP::Gear::GearData* gear_data = world_data->m_gears.first();
+    while (gear_data != nullptr) {
+        MSP::Gear::GearData* next_gear_data = MSP::Gear::WorldGearList::next(gear_data);
+        if (gear_data->m_joint_data1 == joint_data || gear_data->m_joint_data2 == joint_data)
+            MSP::Gear::c_destroy(gear_data);
+        gear_data = next_gear_data;
+    }
+    // The link is cleared when the parent body is destroyed.
+    if (ParentJointList::is_linked(joint_data)) {
+        MSP::Body::BodyData* parent_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(joint_data->m_parent));
+        parent_data->m_cold->m_contained_joints.remove(joint_data);
+    }
     VALUE v_group = rb_ary_entry(joint_data->m_user_data, 1);
     if (v_group != Qnil) {
         std::map<VALUE, std::map<JointData*, bool>>::iterator it(s_map_group_to_joints.find(v_group));
@@ -286,12 +375,1685 @@ void MSP::Joint::c_destroy(JointData* joint_data) {
                 s_map_group_to_joints.erase(it);
         }
     }
+    c_release_controller_program(joint_data);
     if (joint_data->m_connected)
         NewtonDestroyJoint(joint_data->m_world, joint_data->m_constraint);
     on_destroy(joint_data);
     delete joint_data;
 }
 
+bool MSP::Joint::c_is_truthy(const ControllerValue& value) {
+    return value.m_type != CONTROLLER_NIL && !(value.m_type == CONTROLLER_BOOL && value.m_number == 0.0);
+}
+
+bool MSP::Joint::c_is_numeric(const ControllerValue& value) {
+    return value.m_type == CONTROLLER_INT || value.m_type == CONTROLLER_FLOAT || value.m_type == CONTROLLER_RATIONAL;
+}
+
+bool MSP::Joint::c_call_controller_function(int function, const ControllerValue* args, int count, double time, ControllerValue& result_out) {
+    // Methods of nil
+    if (args[0].m_type == CONTROLLER_NIL && (function == CF_TO_F || function == CF_TO_I)) {
+        result_out.m_number = 0.0;
+        result_out.m_type = function == CF_TO_F ? CONTROLLER_FLOAT : CONTROLLER_INT;
+        return true;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (!c_is_numeric(args[i]))
+            return false;
+    }
+    double x = args[0].m_number;
+    double r = 0.0;
+    int type = CONTROLLER_FLOAT;
+    switch (function) {
+        case CF_SIN: r = sin(x); break;
+        case CF_COS: r = cos(x); break;
+        case CF_TAN: r = tan(x); break;
+        case CF_ASIN:
+            if (x < -1.0 || x > 1.0) return false;
+            r = asin(x);
+            break;
+        case CF_ACOS:
+            if (x < -1.0 || x > 1.0) return false;
+            r = acos(x);
+            break;
+        case CF_ATAN: r = atan(x); break;
+        case CF_ATAN2: r = atan2(x, args[1].m_number); break;
+        case CF_SINH: r = sinh(x); break;
+        case CF_COSH: r = cosh(x); break;
+        case CF_TANH: r = tanh(x); break;
+        case CF_ASINH: r = std::asinh(x); break;
+        case CF_ACOSH:
+            if (x < 1.0) return false;
+            r = std::acosh(x);
+            break;
+        case CF_ATANH:
+            if (x < -1.0 || x > 1.0) return false;
+            r = std::atanh(x);
+            break;
+        case CF_SQRT:
+            if (x < 0.0) return false;
+            r = sqrt(x);
+            break;
+        case CF_CBRT: r = std::cbrt(x); break;
+        case CF_EXP: r = exp(x); break;
+        case CF_LOG:
+            if (x < 0.0) return false;
+            if (count == 1)
+                r = log(x);
+            else {
+                if (args[1].m_number < 0.0) return false;
+                r = log(x) / log(args[1].m_number);
+            }
+            break;
+        case CF_LOG2:
+            if (x < 0.0) return false;
+            r = std::log2(x);
+            break;
+        case CF_LOG10:
+            if (x < 0.0) return false;
+            r = log10(x);
+            break;
+        case CF_HYPOT: r = std::hypot(x, args[1].m_number); break;
+        case CF_OSCILLATOR:
+        case CF_OSCILLATOR_SLOPE:
+        case CF_OSCILLATOR2:
+        case CF_OSCILLATOR2_SLOPE:
+        {
+            double rtime = time - args[1].m_number;
+            if (rtime < 0.0)
+                break;
+            double inc = x * 2.0 * CONTROLLER_PI;
+            if (function == CF_OSCILLATOR)
+                r = sin(inc * rtime);
+            else if (function == CF_OSCILLATOR_SLOPE)
+                r = inc * cos(inc * rtime);
+            else if (function == CF_OSCILLATOR2)
+                r = sin(2.0 * CONTROLLER_PI * (x * rtime - 0.25)) * 0.5 + 0.5;
+            else
+                r = x * CONTROLLER_PI * cos(2.0 * CONTROLLER_PI * (x * rtime - 0.25));
+            break;
+        }
+        case CF_ACCUMULATOR:
+        {
+            double rtime = time - args[1].m_number;
+            type = CONTROLLER_INT;
+            if (rtime > 0.0 && x > 1.0e-6)
+                r = floor(rtime / x);
+            break;
+        }
+        case CF_REPEATER:
+        {
+            double rtime = time - args[2].m_number;
+            type = CONTROLLER_INT;
+            if (rtime > 0.0 && x > 1.0e-6 && fmod(rtime, x) < args[1].m_number)
+                r = 1.0;
+            break;
+        }
+        case CF_ABS:
+            r = fabs(x);
+            type = args[0].m_type;
+            break;
+        case CF_TO_F:
+            r = x;
+            break;
+        case CF_TO_I:
+        case CF_FLOOR:
+        case CF_CEIL:
+        case CF_ROUND:
+        case CF_TRUNCATE:
+            // Infinity and NaN can't be converted to integers.
+            if (x != x || x > DBL_MAX || x < -DBL_MAX) return false;
+            if (function == CF_FLOOR)
+                r = floor(x);
+            else if (function == CF_CEIL)
+                r = ceil(x);
+            else if (function == CF_ROUND)
+                r = x < 0.0 ? -floor(-x + 0.5) : floor(x + 0.5);
+            else
+                r = x < 0.0 ? ceil(x) : floor(x);
+            type = CONTROLLER_INT;
+            break;
+        default:
+            return false;
+    }
+    result_out.m_number = r;
+    result_out.m_type = type;
+    return true;
+}
+
+bool MSP::Joint::c_evaluate_controller(const ControllerProgram* program, const NewtonWorld* world, ControllerValue& result_out) {
+    MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world));
+    std::vector<ControllerValue>& stack = world_data->m_controller_stack;
+    if (stack.size() < program->m_stack_size)
+        stack.resize(program->m_stack_size);
+    const std::vector<ControllerValue>& inputs = world_data->m_controller_values;
+    unsigned int code_size = static_cast<unsigned int>(program->m_code.size());
+    unsigned int pc = 0;
+    int sp = 0;
+    while (pc < code_size) {
+        const ControllerOp& op = program->m_code[pc++];
+        switch (op.m_opcode) {
+            case OP_PUSH:
+                stack[sp++] = op.m_value;
+                break;
+            case OP_PUSH_INPUT:
+                stack[sp++] = inputs[op.m_arg];
+                break;
+            case OP_PUSH_TIME:
+                stack[sp].m_number = world_data->m_time;
+                stack[sp].m_type = CONTROLLER_FLOAT;
+                ++sp;
+                break;
+            case OP_NEG:
+            {
+                ControllerValue& a = stack[sp - 1];
+                if (!c_is_numeric(a))
+                    return false;
+                a.m_number = -a.m_number;
+                break;
+            }
+            case OP_NOT:
+            {
+                ControllerValue& a = stack[sp - 1];
+                a.m_number = c_is_truthy(a) ? 0.0 : 1.0;
+                a.m_type = CONTROLLER_BOOL;
+                break;
+            }
+            case OP_EQ:
+            case OP_NE:
+            {
+                ControllerValue& a = stack[sp - 2];
+                const ControllerValue& b = stack[sp - 1];
+                --sp;
+                bool equal = (c_is_numeric(a) && c_is_numeric(b)) ? (a.m_number == b.m_number) : (a.m_type == b.m_type && a.m_number == b.m_number);
+                a.m_number = (equal == (op.m_opcode == OP_EQ)) ? 1.0 : 0.0;
+                a.m_type = CONTROLLER_BOOL;
+                break;
+            }
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MUL:
+            case OP_DIV:
+            case OP_MOD:
+            case OP_POW:
+            case OP_LT:
+            case OP_LE:
+            case OP_GT:
+            case OP_GE:
+            {
+                ControllerValue& a = stack[sp - 2];
+                const ControllerValue& b = stack[sp - 1];
+                --sp;
+                if (!c_is_numeric(a) || !c_is_numeric(b))
+                    return false;
+                // Integer operations stay integers and operations mixing
+                // integers and rationals stay rationals, as in Ruby.
+                bool ints = (a.m_type == CONTROLLER_INT && b.m_type == CONTROLLER_INT);
+                bool exact = (a.m_type != CONTROLLER_FLOAT && b.m_type != CONTROLLER_FLOAT);
+                double x = a.m_number;
+                double y = b.m_number;
+                a.m_type = ints ? CONTROLLER_INT : (exact ? CONTROLLER_RATIONAL : CONTROLLER_FLOAT);
+                switch (op.m_opcode) {
+                    case OP_ADD:
+                        a.m_number = x + y;
+                        break;
+                    case OP_SUB:
+                        a.m_number = x - y;
+                        break;
+                    case OP_MUL:
+                        a.m_number = x * y;
+                        break;
+                    case OP_DIV:
+                        if (exact && y == 0.0) return false;
+                        a.m_number = ints ? floor(x / y) : x / y;
+                        break;
+                    case OP_MOD:
+                    {
+                        if (exact && y == 0.0) return false;
+                        // Result takes the sign of the divisor.
+                        double m = fmod(x, y);
+                        if (m != 0.0 && (m < 0.0) != (y < 0.0))
+                            m += y;
+                        a.m_number = m;
+                        break;
+                    }
+                    case OP_POW:
+                        if (exact) {
+                            // An integer raised to a negative integer is a
+                            // rational, and a fractional exponent gives a float.
+                            if (y != floor(y))
+                                a.m_type = CONTROLLER_FLOAT;
+                            else if (y < 0.0) {
+                                if (x == 0.0) return false;
+                                a.m_type = CONTROLLER_RATIONAL;
+                            }
+                        }
+                        a.m_number = pow(x, y);
+                        break;
+                    case OP_LT:
+                        a.m_number = (x < y) ? 1.0 : 0.0;
+                        a.m_type = CONTROLLER_BOOL;
+                        break;
+                    case OP_LE:
+                        a.m_number = (x <= y) ? 1.0 : 0.0;
+                        a.m_type = CONTROLLER_BOOL;
+                        break;
+                    case OP_GT:
+                        a.m_number = (x > y) ? 1.0 : 0.0;
+                        a.m_type = CONTROLLER_BOOL;
+                        break;
+                    case OP_GE:
+                        a.m_number = (x >= y) ? 1.0 : 0.0;
+                        a.m_type = CONTROLLER_BOOL;
+                        break;
+                }
+                break;
+            }
+            case OP_JUMP:
+                pc = static_cast<unsigned int>(op.m_arg);
+                break;
+            case OP_JUMP_IF_FALSE:
+                --sp;
+                if (!c_is_truthy(stack[sp]))
+                    pc = static_cast<unsigned int>(op.m_arg);
+                break;
+            case OP_AND:
+                // Keep the left operand as the result when it decides.
+                if (!c_is_truthy(stack[sp - 1]))
+                    pc = static_cast<unsigned int>(op.m_arg);
+                else
+                    --sp;
+                break;
+            case OP_OR:
+                if (c_is_truthy(stack[sp - 1]))
+                    pc = static_cast<unsigned int>(op.m_arg);
+                else
+                    --sp;
+                break;
+            case OP_CALL:
+            {
+                sp -= op.m_count;
+                ControllerValue result;
+                if (!c_call_controller_function(op.m_arg, &stack[sp], op.m_count, world_data->m_time, result))
+                    return false;
+                stack[sp++] = result;
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    result_out = stack[0];
+    return true;
+}
+
+int MSP::Joint::c_register_controller_input(const NewtonWorld* world, const std::string& source) {
+    MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world));
+    std::vector<std::string>& inputs = world_data->m_controller_inputs;
+    for (unsigned int i = 0; i < inputs.size(); ++i) {
+        if (inputs[i] == source)
+            return static_cast<int>(i);
+    }
+    ControllerValue value;
+    value.m_number = 0.0;
+    value.m_type = CONTROLLER_NIL;
+    inputs.push_back(source);
+    world_data->m_controller_values.push_back(value);
+    return static_cast<int>(inputs.size() - 1);
+}
+
+void MSP::Joint::c_release_controller_program(JointData* joint_data) {
+    if (joint_data->m_controller_program == nullptr)
+        return;
+    delete joint_data->m_controller_program;
+    joint_data->m_controller_program = nullptr;
+    MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(joint_data->m_world));
+    world_data->m_controller_inputs_dirty = true;
+}
+
+void MSP::Joint::c_prune_controller_inputs(const NewtonWorld* world) {
+    MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world));
+    world_data->m_controller_inputs_dirty = false;
+    std::vector<std::string>& inputs = world_data->m_controller_inputs;
+    std::vector<ControllerValue>& values = world_data->m_controller_values;
+    values.resize(inputs.size());
+    // Mark the inputs that programs still reference, then compact the table
+    // and rebind the programs to the new indices.
+    std::vector<int> remap(inputs.size(), -1);
+    for (JointData* joint_data = world_data->m_joints.first(); joint_data != nullptr; joint_data = WorldJointList::next(joint_data)) {
+        if (joint_data->m_controller_program == nullptr)
+            continue;
+        const std::vector<ControllerOp>& code = joint_data->m_controller_program->m_code;
+        for (std::vector<ControllerOp>::const_iterator it = code.begin(); it != code.end(); ++it) {
+            if (it->m_opcode == OP_PUSH_INPUT)
+                remap[it->m_arg] = 0;
+        }
+    }
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < inputs.size(); ++i) {
+        if (remap[i] == -1)
+            continue;
+        remap[i] = static_cast<int>(count);
+        if (count != i) {
+            inputs[count].swap(inputs[i]);
+            values[count] = values[i];
+        }
+        ++count;
+    }
+    inputs.resize(count);
+    values.resize(count);
+    for (JointData* joint_data = world_data->m_joints.first(); joint_data != nullptr; joint_data = WorldJointList::next(joint_data)) {
+        if (joint_data->m_controller_program == nullptr)
+            continue;
+        std::vector<ControllerOp>& code = joint_data->m_controller_program->m_code;
+        for (std::vector<ControllerOp>::iterator it = code.begin(); it != code.end(); ++it) {
+            if (it->m_opcode == OP_PUSH_INPUT)
+                it->m_arg = remap[it->m_arg];
+        }
+    }
+}
+
+void MSP::Joint::c_update_controllers(const NewtonWorld* world) {
+    MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world));
+    for (JointData* joint_data = world_data->m_joints.first(); joint_data != nullptr; joint_data = WorldJointList::next(joint_data)) {
+        if (joint_data->m_controller_program == nullptr)
+            continue;
+        ControllerValue result;
+        // An error leaves the controller nil, as an exception does in Ruby.
+        if (!c_evaluate_controller(joint_data->m_controller_program, world, result))
+            result.m_type = CONTROLLER_NIL;
+        if (c_is_numeric(result))
+            joint_data->m_set_controller_proc(joint_data, static_cast<dFloat>(result.m_number) * joint_data->m_controller_program->m_ratio, true);
+        else if (result.m_type == CONTROLLER_NIL)
+            joint_data->m_set_controller_proc(joint_data, 0.0f, false);
+    }
+}
+
+const MSP::Joint::CurveData* MSP::Joint::c_acquire_curve(const std::vector<dVector>& points, bool loop) {
+    // Hash the point coordinates, so that joints on the same track find each other's curve.
+    unsigned long long hash = 14695981039346656037ULL;
+    for (std::vector<dVector>::const_iterator it = points.begin(); it != points.end(); ++it) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&(*it)[0]);
+        for (unsigned int i = 0; i < sizeof(dFloat) * 3; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+    hash ^= loop ? 1 : 0;
+    std::pair<std::multimap<unsigned long long, CurveData*>::iterator, std::multimap<unsigned long long, CurveData*>::iterator> range(s_curves.equal_range(hash));
+    for (std::multimap<unsigned long long, CurveData*>::iterator it = range.first; it != range.second; ++it) {
+        CurveData* curve = it->second;
+        if (curve->m_loop != loop || curve->m_points.size() != points.size())
+            continue;
+        bool equal = true;
+        for (unsigned int i = 0; i < points.size(); ++i) {
+            const dVector& pt1 = curve->m_points[i];
+            const dVector& pt2 = points[i];
+            if (pt1.m_x != pt2.m_x || pt1.m_y != pt2.m_y || pt1.m_z != pt2.m_z) {
+                equal = false;
+                break;
+            }
+        }
+        if (equal) {
+            ++curve->m_ref_count;
+            return curve;
+        }
+    }
+    CurveData* curve = new CurveData(points, loop, hash);
+    c_build_curve_edges(curve);
+    s_curves.insert(std::pair<unsigned long long, CurveData*>(hash, curve));
+    return curve;
+}
+
+void MSP::Joint::c_release_curve(const CurveData* curve) {
+    CurveData* address = const_cast<CurveData*>(curve);
+    if (--address->m_ref_count > 0) return;
+    std::pair<std::multimap<unsigned long long, CurveData*>::iterator, std::multimap<unsigned long long, CurveData*>::iterator> range(s_curves.equal_range(address->m_hash));
+    for (std::multimap<unsigned long long, CurveData*>::iterator it = range.first; it != range.second; ++it) {
+        if (it->second == address) {
+            s_curves.erase(it);
+            break;
+        }
+    }
+    delete address;
+}
+
+void MSP::Joint::c_build_curve_edges(CurveData* curve) {
+    unsigned int points_size = (unsigned int)curve->m_points.size();
+    if (points_size < 2) return;
+    // Frame all edges by rotating the frame of the preceding edge, starting from the first edge.
+    // Joints orient these frames to their pins with a twist about the curve.
+    dMatrix last_matrix;
+    unsigned int pt_index = 0;
+    for (unsigned int i = 0; i < (curve->m_loop ? points_size : points_size - 1); ++i) {
+        const dVector& pt1 = curve->m_points[pt_index];
+        const dVector& pt2 = curve->m_points[(i == points_size - 1 && curve->m_loop) ? 0 : i + 1];
+        dVector dir(pt2 - pt1);
+        dFloat mag = Util::get_vector_magnitude(dir);
+        if (mag > M_EPSILON) {
+            Util::scale_vector(dir, 1.0f / mag);
+            curve->m_edges.push_back(CurveEdge(mag, curve->m_length, pt_index, i + 1));
+            CurveEdge& edge_data = curve->m_edges.back();
+            if (curve->m_edges.size() == 1)
+                Util::matrix_from_pin_dir(pt1, dir, edge_data.m_normal_matrix);
+            else
+                Util::rotate_matrix_to_dir(last_matrix, dir, edge_data.m_normal_matrix);
+            edge_data.m_normal_matrix.m_posit = pt1;
+            last_matrix = edge_data.m_normal_matrix;
+            curve->m_edge_offsets.push_back(curve->m_length);
+            pt_index = i + 1;
+            curve->m_length += mag;
+        }
+    }
+    unsigned int edges_count = (unsigned int)curve->m_edges.size();
+    if (edges_count == 0) return;
+    curve->m_edge_offsets.push_back(curve->m_length);
+    // Build the bounding box tree for closest point queries.
+    curve->m_edge_tree.reserve(edges_count * 2);
+    c_build_curve_tree(curve, 0, edges_count);
+}
+
+unsigned int MSP::Joint::c_build_curve_tree(CurveData* curve, unsigned int first_edge, unsigned int edge_count) {
+    unsigned int node_index = (unsigned int)curve->m_edge_tree.size();
+    curve->m_edge_tree.push_back(CurveTreeNode());
+    dVector min_pt, max_pt;
+    if (edge_count > CURVE_TREE_LEAF_SIZE) {
+        // Edges adjacent along the curve are also adjacent in space, so splitting the range in half yields tight boxes.
+        unsigned int half_count = edge_count / 2;
+        c_build_curve_tree(curve, first_edge, half_count);
+        unsigned int second_child = c_build_curve_tree(curve, first_edge + half_count, edge_count - half_count);
+        const CurveTreeNode& child1 = curve->m_edge_tree[node_index + 1];
+        const CurveTreeNode& child2 = curve->m_edge_tree[second_child];
+        min_pt = child1.m_min;
+        max_pt = child1.m_max;
+        for (int j = 0; j < 3; ++j) {
+            min_pt[j] = dMin(min_pt[j], child2.m_min[j]);
+            max_pt[j] = dMax(max_pt[j], child2.m_max[j]);
+        }
+        curve->m_edge_tree[node_index].m_second_child = second_child;
+    }
+    else {
+        min_pt = curve->m_edges[first_edge].m_normal_matrix.m_posit;
+        max_pt = min_pt;
+        for (unsigned int i = first_edge; i < first_edge + edge_count; ++i) {
+            const CurveEdge& edge_data = curve->m_edges[i];
+            dVector end_pt(edge_data.m_normal_matrix.m_posit + edge_data.m_normal_matrix.m_right.Scale(edge_data.m_length));
+            for (int j = 0; j < 3; ++j) {
+                min_pt[j] = dMin(min_pt[j], dMin(edge_data.m_normal_matrix.m_posit[j], end_pt[j]));
+                max_pt[j] = dMax(max_pt[j], dMax(edge_data.m_normal_matrix.m_posit[j], end_pt[j]));
+            }
+        }
+        curve->m_edge_tree[node_index].m_second_child = 0;
+    }
+    CurveTreeNode& node = curve->m_edge_tree[node_index];
+    node.m_min = min_pt;
+    node.m_max = max_pt;
+    node.m_first_edge = first_edge;
+    node.m_edge_count = edge_count;
+    return node_index;
+}
+
+unsigned int MSP::Joint::c_find_curve_edge_at_distance(const CurveData* curve, dFloat distance, unsigned int hint) {
+    const std::vector<dFloat>& offsets = curve->m_edge_offsets;
+    unsigned int edges_count = (unsigned int)curve->m_edges.size();
+    // The distance changes little between updates, so try the hinted edge and its neighbours first.
+    if (hint < edges_count) {
+        if (distance >= offsets[hint]) {
+            if (distance < offsets[hint + 1])
+                return hint;
+            if (hint + 1 < edges_count && distance < offsets[hint + 2])
+                return hint + 1;
+        }
+        else if (hint > 0 && distance >= offsets[hint - 1])
+            return hint - 1;
+    }
+    // Otherwise find the last edge starting at or before the distance.
+    std::vector<dFloat>::const_iterator it = std::upper_bound(offsets.begin(), offsets.begin() + edges_count, distance);
+    return (it == offsets.begin()) ? 0 : (unsigned int)(it - offsets.begin()) - 1;
+}
+
+unsigned int MSP::Joint::c_find_curve_edge_at_point(const CurveData* curve, unsigned int point_index) {
+    // Find the first edge starting at or after the point, or the last edge if there is none.
+    unsigned int low = 0;
+    unsigned int high = (unsigned int)curve->m_edges.size();
+    while (low < high) {
+        unsigned int middle = (low + high) / 2;
+        if (curve->m_edges[middle].m_start_index < point_index)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return (low < curve->m_edges.size()) ? low : (unsigned int)curve->m_edges.size() - 1;
+}
+
+bool MSP::Joint::c_calc_curve_data_at_position(const CurveData* curve, dFloat position, dMatrix& normal_matrix, dFloat &distance, dFloat &overpass) {
+    if (curve->m_edges.empty()) return false;
+    if (curve->m_loop) {
+        distance = fmod(position, curve->m_length);
+        if (distance < 0.0f) distance += curve->m_length;
+        overpass = 0.0f;
+    }
+    else {
+        distance = Util::clamp_float(position, 0.0f, curve->m_length);
+        overpass = position - distance;
+        if (overpass < -M_EPSILON) {
+            normal_matrix = curve->m_edges.front().m_normal_matrix;
+            return true;
+        }
+        else if (overpass > M_EPSILON) {
+            const CurveEdge& edge_data = curve->m_edges.back();
+            normal_matrix = edge_data.m_normal_matrix;
+            normal_matrix.m_posit = normal_matrix.m_posit + normal_matrix.m_right.Scale(edge_data.m_length);
+            return true;
+        }
+    }
+    // Find the first edge ending at or after the distance.
+    std::vector<dFloat>::const_iterator it = std::lower_bound(curve->m_edge_offsets.begin() + 1, curve->m_edge_offsets.end(), distance);
+    if (it != curve->m_edge_offsets.end()) {
+        unsigned int edge_index = (unsigned int)(it - curve->m_edge_offsets.begin()) - 1;
+        const CurveEdge& edge_data = curve->m_edges[edge_index];
+        normal_matrix = edge_data.m_normal_matrix;
+        normal_matrix.m_posit = normal_matrix.m_posit + normal_matrix.m_right.Scale(distance - curve->m_edge_offsets[edge_index]);
+        return true;
+    }
+    const CurveEdge& edge_data = curve->m_edges.back();
+    normal_matrix = edge_data.m_normal_matrix;
+    normal_matrix.m_posit = normal_matrix.m_posit + normal_matrix.m_right.Scale(edge_data.m_length);
+    return true;
+}
+
+bool MSP::Joint::c_calc_curve_data_at_point(const CurveData* curve, const dVector &location, dMatrix& normal_matrix, dFloat &distance, dFloat &overpass) {
+    if (curve->m_edge_tree.empty()) return false;
+    // Find the closest point on curve. The result matches a linear scan: the
+    // first edge within epsilon, or else the first edge of minimum distance.
+    dVector closest_point;
+    dFloat closest_distance = 0.0f;
+    dFloat closest_left_over = 0.0f;
+    unsigned int closest_index = 0;
+    unsigned int closest_normal1_index = 0;
+    unsigned int closest_normal2_index = 0;
+    bool closest_set = false;
+    unsigned int stack[CURVE_TREE_STACK_SIZE];
+    unsigned int stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0) {
+        unsigned int node_index = stack[--stack_size];
+        const CurveTreeNode& node = curve->m_edge_tree[node_index];
+        if (closest_set) {
+            dFloat box_dist = c_calc_curve_box_distance2(node, location);
+            if (closest_distance < M_EPSILON) {
+                if (box_dist >= M_EPSILON || node.m_first_edge >= closest_index) continue;
+            }
+            else if (box_dist > closest_distance)
+                continue;
+        }
+        if (node.m_edge_count > CURVE_TREE_LEAF_SIZE) {
+            // Visit the nearer child first.
+            unsigned int child1 = node_index + 1;
+            unsigned int child2 = node.m_second_child;
+            if (c_calc_curve_box_distance2(curve->m_edge_tree[child2], location) < c_calc_curve_box_distance2(curve->m_edge_tree[child1], location)) {
+                stack[stack_size++] = child1;
+                stack[stack_size++] = child2;
+            }
+            else {
+                stack[stack_size++] = child2;
+                stack[stack_size++] = child1;
+            }
+            continue;
+        }
+        for (unsigned int index = node.m_first_edge; index < node.m_first_edge + node.m_edge_count; ++index) {
+            const CurveEdge& edge_data = curve->m_edges[index];
+            dFloat lpointz = (location - edge_data.m_normal_matrix.m_posit).DotProduct3(edge_data.m_normal_matrix.m_right);
+            dVector cpoint;
+            dFloat section_dist;
+            dFloat left_over;
+            unsigned int normal1_index;
+            unsigned int normal2_index;
+            if (lpointz < 0.0f) {
+                normal1_index = index - 1;
+                normal2_index = index;
+                cpoint = curve->m_points[edge_data.m_start_index];
+                section_dist = 0.0f;
+                left_over = lpointz;
+            }
+            else if (lpointz > edge_data.m_length) {
+                normal1_index = index;
+                normal2_index = index + 1;
+                cpoint = curve->m_points[edge_data.m_end_index];
+                section_dist = edge_data.m_length;
+                left_over = lpointz - edge_data.m_length;
+            }
+            else {
+                normal1_index = index;
+                normal2_index = index;
+                cpoint = edge_data.m_normal_matrix.m_posit + edge_data.m_normal_matrix.m_right.Scale(lpointz);
+                section_dist = lpointz;
+                left_over = 0.0f;
+            }
+            dFloat cdist = Util::get_vector_magnitude2(location - cpoint);
+            bool closer;
+            if (!closest_set)
+                closer = true;
+            else if (closest_distance < M_EPSILON)
+                closer = cdist < M_EPSILON && index < closest_index;
+            else
+                closer = cdist < closest_distance || (cdist == closest_distance && index < closest_index);
+            if (closer) {
+                distance = edge_data.m_preceding_curve_length + section_dist;
+                closest_point = cpoint;
+                closest_distance = cdist;
+                closest_index = index;
+                closest_normal1_index = normal1_index;
+                closest_normal2_index = normal2_index;
+                closest_left_over = left_over;
+                closest_set = true;
+            }
+        }
+    }
+    if (!closest_set)
+        return false;
+    // Calculate the normal at point
+    unsigned int edges_count = (unsigned int)curve->m_edges.size();
+    if (closest_normal1_index >= edges_count)
+        closest_normal1_index = curve->m_loop ? edges_count - 1 : closest_normal2_index;
+    else if (closest_normal2_index >= edges_count)
+        closest_normal2_index = curve->m_loop ? 0 : closest_normal1_index;
+    const CurveEdge& edge_data1 = curve->m_edges[closest_normal1_index];
+    const CurveEdge& edge_data2 = curve->m_edges[closest_normal2_index];
+    dFloat cos_angle = edge_data1.m_normal_matrix.m_right.DotProduct3(edge_data2.m_normal_matrix.m_right);
+    if (dAbs(cos_angle) > 0.999995f) {
+        normal_matrix = edge_data1.m_normal_matrix;
+        if (closest_normal1_index == closest_normal2_index && !curve->m_loop)
+            overpass = closest_left_over;
+        else
+            overpass = 0.0f;
+    }
+    else {
+        if (dSqrt(closest_distance) > M_EPSILON) {
+            dVector udir(edge_data1.m_normal_matrix.m_right.CrossProduct(edge_data2.m_normal_matrix.m_right));
+            dVector vdir(location - closest_point);
+            dVector zdir(udir.CrossProduct(vdir));
+            dFloat mag = Util::get_vector_magnitude(zdir);
+            if (mag > M_EPSILON)
+                Util::rotate_matrix_to_dir(edge_data1.m_normal_matrix, zdir, normal_matrix);
+            else
+                normal_matrix = edge_data1.m_normal_matrix;
+        }
+        else
+            normal_matrix = edge_data1.m_normal_matrix;
+        overpass = 0.0f;
+    }
+    normal_matrix.m_posit = closest_point;
+    return closest_set;
+}
+
+dFloat MSP::Joint::c_calc_curve_box_distance2(const CurveTreeNode& node, const dVector& location) {
+    dFloat dist = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+        dFloat delta = 0.0f;
+        if (location[i] < node.m_min[i])
+            delta = node.m_min[i] - location[i];
+        else if (location[i] > node.m_max[i])
+            delta = location[i] - node.m_max[i];
+        dist += delta * delta;
+    }
+    return dist;
+}
+
+bool MSP::Joint::c_calc_curve_data_at_point2(const std::vector<dVector>& points, bool loop, const dVector& location, dVector& point, dVector& vector, dFloat &distance, unsigned int &edge_index) {
+    unsigned int points_size = (unsigned int)points.size();
+    if (points_size < 2) return false;
+    dFloat closest_dist = 0.0f;
+    dFloat closest_left_over = 0.0f;
+    bool closest_set = false;
+    dFloat traveled_dist = 0.0f;
+    unsigned int pt1_index = 0;
+    for (unsigned int i = 0; i < (loop ? points_size : points_size - 1); ++i) {
+        const dVector& pt1 = points[pt1_index];
+        const dVector& pt2 = points[(i == points_size - 1 && loop) ? 0 : i + 1];
+        dVector edge_dir(pt2 - pt1);
+        dFloat edge_len = Util::get_vector_magnitude(edge_dir);
+        if (edge_len > M_EPSILON) {
+            Util::scale_vector(edge_dir, 1.0f / edge_len);
+            dFloat lpointz = (location - pt1).DotProduct3(edge_dir);
+            dVector cpoint;
+            dFloat section_dist;
+            dFloat left_over;
+            if (lpointz < 0.0f) {
+                cpoint = pt1;
+                section_dist = 0.0f;
+                left_over = lpointz;
+            }
+            else if (lpointz > edge_len) {
+                cpoint = pt2;
+                section_dist = edge_len;
+                left_over = lpointz - edge_len;
+            }
+            else {
+                cpoint = pt1 + edge_dir.Scale(lpointz);
+                section_dist = lpointz;
+                left_over = 0.0f;
+            }
+            dFloat cdist = Util::get_vector_magnitude2(location - cpoint);
+            if (!closest_set || cdist < closest_dist) {
+                closest_dist = cdist;
+                closest_left_over = left_over;
+                distance = traveled_dist + section_dist;
+                if (dAbs(left_over) < M_EPSILON) {
+                    point = cpoint;
+                    vector = edge_dir;
+                    edge_index = i;
+                }
+                closest_set = true;
+            }
+            traveled_dist += edge_len;
+            pt1_index = i + 1;
+        }
+    }
+    if (!closest_set) return false;
+    if (dAbs(closest_left_over) > M_EPSILON) {
+        dFloat temp_curve_len = 0.0f;
+        pt1_index = 0;
+        for (unsigned int i = 0; i < (loop ? points_size : points_size - 1); ++i) {
+            const dVector& pt1 = points[pt1_index];
+            const dVector& pt2 = points[(i == points_size - 1 && loop) ? 0 : i + 1];
+            dVector edge_dir(pt2 - pt1);
+            dFloat edge_len = Util::get_vector_magnitude(edge_dir);
+            if (edge_len > M_EPSILON) {
+                temp_curve_len += edge_len;
+                pt1_index = i + 1;
+            }
+        }
+        distance += closest_left_over;
+        if (loop) {
+            distance = fmod(distance, temp_curve_len);
+            if (distance < 0.0f) distance += temp_curve_len;
+        }
+        else
+            distance = Util::clamp_float(distance, 0.0f, temp_curve_len);
+        traveled_dist = 0.0f;
+        pt1_index = 0;
+        for (unsigned int i = 0; i < (loop ? points_size : points_size - 1); ++i) {
+            const dVector& pt1 = points[pt1_index];
+            const dVector& pt2 = points[(i == points_size - 1 && loop) ? 0 : i + 1];
+            dVector edge_dir(pt2 - pt1);
+            dFloat edge_len = Util::get_vector_magnitude(edge_dir);
+            if (edge_len > M_EPSILON) {
+                if (traveled_dist + edge_len >= distance) {
+                    Util::scale_vector(edge_dir, 1.0f / edge_len);
+                    point = pt1 + edge_dir.Scale(distance - traveled_dist);
+                    vector = edge_dir;
+                    edge_index = pt1_index;
+                    break;
+                }
+                traveled_dist += edge_len;
+                pt1_index = i + 1;
+            }
+        }
+    }
+    return true;
+}
+
+bool MSP::Joint::c_calc_curve_data_at_point3(const CurveData* curve, dFloat last_dist, unsigned int hint, const dVector &location, dMatrix& normal_matrix, dFloat &distance, dFloat &overpass) {
+    unsigned int total_edges_count = (unsigned int)curve->m_edges.size();
+    if (total_edges_count == 0) return false;
+    // Find the current edge data, starting the search from the edge of the last update.
+    unsigned int cur_index;
+    if (last_dist <= M_EPSILON)
+        cur_index = 0;
+    else if (last_dist >= curve->m_length - M_EPSILON)
+        cur_index = total_edges_count - 1;
+    else
+        cur_index = c_find_curve_edge_at_distance(curve, last_dist, hint);
+    const CurveEdge* cur_edge_data = &curve->m_edges[cur_index];
+    // First check if the location denotes the current edge data.
+    dFloat cur_lpointz = (location - cur_edge_data->m_normal_matrix.m_posit).DotProduct3(cur_edge_data->m_normal_matrix.m_right);
+    if (cur_lpointz >= 0.0f && cur_lpointz <= cur_edge_data->m_length) {
+        normal_matrix = cur_edge_data->m_normal_matrix;
+        normal_matrix.m_posit += normal_matrix.m_right.Scale(cur_lpointz);
+        distance = cur_edge_data->m_preceding_curve_length + cur_lpointz;
+        overpass = 0.0f;
+        return true;
+    }
+    // Otherwise check all the preceding and consequent edges.
+    bool found_potential_ref_point = false;
+    if (curve->m_loop) {
+        // Check all the preceding edges until reach the half curve length.
+        // Do first run in reverse, starting from the current edge and proceeding until we reach the beginning.
+        dFloat previous_left_over = 0.0f;
+        const CurveEdge* previous_edge_data = nullptr;
+        bool previous_set = false;
+        for (unsigned int i = cur_index + 1; i > 0; --i) {
+            unsigned int index = i - 1;
+            const CurveEdge* edge_data = &curve->m_edges[index];
+            dFloat lpointz = (location - edge_data->m_normal_matrix.m_posit).DotProduct3(edge_data->m_normal_matrix.m_right);
+            dFloat left_over = 0.0f;
+            if (lpointz < 0.0f)
+                left_over = lpointz;
+            else if (lpointz > edge_data->m_length)
+                left_over = lpointz - edge_data->m_length;
+            else {
+                // Snap to edge when left over is zero
+                normal_matrix = edge_data->m_normal_matrix;
+                normal_matrix.m_posit = edge_data->m_normal_matrix.m_posit + edge_data->m_normal_matrix.m_right.Scale(lpointz);
+                distance = edge_data->m_preceding_curve_length + lpointz;
+                overpass = 0.0f;
+                found_potential_ref_point = true;
+                break;
+            }
+            // Snap to point of the previous edge in case left_over changes from negative to positive
+            if (previous_set && previous_left_over < 0.0f && left_over > 0.0f) {
+                c_calc_curve_pivot_normal(edge_data->m_normal_matrix, previous_edge_data->m_normal_matrix, previous_edge_data->m_normal_matrix.m_posit, location, normal_matrix);
+                distance = previous_edge_data->m_preceding_curve_length;
+                overpass = 0.0f;
+                found_potential_ref_point = true;
+                break;
+            }
+            // Update previous data
+            previous_edge_data = edge_data;
+            previous_left_over = left_over;
+            previous_set = true;
+        }
+        // Do the second run in reverse, starting from the end and proceeding until we reach the current edge.
+        if (!found_potential_ref_point) {
+            //~ previous_set = false;
+            for (unsigned int index = total_edges_count - 1; index > cur_index; --index) {
+                const CurveEdge* edge_data = &curve->m_edges[index];
+                dFloat lpointz = (location - edge_data->m_normal_matrix.m_posit).DotProduct3(edge_data->m_normal_matrix.m_right);
+                dFloat left_over = 0.0f;
+                if (lpointz < 0.0f)
+                    left_over = lpointz;
+                else if (lpointz > edge_data->m_length)
+                    left_over = lpointz - edge_data->m_length;
+                else {
+                    // Snap to edge when left over is zero
+                    normal_matrix = edge_data->m_normal_matrix;
+                    normal_matrix.m_posit = edge_data->m_normal_matrix.m_posit + edge_data->m_normal_matrix.m_right.Scale(lpointz);
+                    distance = edge_data->m_preceding_curve_length + lpointz;
+                    overpass = 0.0f;
+                    found_potential_ref_point = true;
+                    break;
+                }
+                // Snap to point of the previous edge in case left_over changes from negative to positive
+                if (previous_set && previous_left_over < 0.0f && left_over > 0.0f) {
+                    c_calc_curve_pivot_normal(edge_data->m_normal_matrix, previous_edge_data->m_normal_matrix, previous_edge_data->m_normal_matrix.m_posit, location, normal_matrix);
+                    distance = previous_edge_data->m_preceding_curve_length;
+                    overpass = 0.0f;
+                    found_potential_ref_point = true;
+                    break;
+                }
+                // Update previous data
+                previous_edge_data = edge_data;
+                previous_left_over = left_over;
+                previous_set = true;
+            }
+        }
+        // Check all the succeeding edges until reach the half curve length.
+        // Do first run, starting from the current edge and proceeding until we reach the end.
+        previous_set = false;
+        for (unsigned int index = cur_index; index < total_edges_count; ++index) {
+            const CurveEdge* edge_data = &curve->m_edges[index];
+            dFloat lpointz = (location - edge_data->m_normal_matrix.m_posit).DotProduct3(edge_data->m_normal_matrix.m_right);
+            dFloat left_over = 0.0f;
+            if (lpointz < 0.0f)
+                left_over = lpointz;
+            else if (lpointz > edge_data->m_length)
+                left_over = lpointz - edge_data->m_length;
+            else {
+                // Snap to edge when left over is zero
+                if (found_potential_ref_point) {
+                    dFloat original_dist1 = dAbs(last_dist - distance);
+                    dFloat original_dist2 = curve->m_length - original_dist1;
+                    dFloat current_dist1 = dAbs(edge_data->m_preceding_curve_length + lpointz - last_dist);
+                    dFloat current_dist2 = curve->m_length - current_dist1;
+                    dFloat min_original_dist = (original_dist1 < original_dist2) ? original_dist1 : original_dist2;
+                    dFloat min_current_dist = (current_dist1 < current_dist2) ? current_dist1 : current_dist2;
+                    if (min_original_dist <= min_current_dist) return true;
+                }
+                normal_matrix = edge_data->m_normal_matrix;
+                normal_matrix.m_posit = edge_data->m_normal_matrix.m_posit + edge_data->m_normal_matrix.m_right.Scale(lpointz);
+                distance = edge_data->m_preceding_curve_length + lpointz;
+                overpass = 0.0f;
+                return true;
+            }
+            // Snap to point of the current edge in case left_over changes from positive to negative
+            if (previous_set && previous_left_over > 0.0f && left_over < 0.0f) {
+                if (found_potential_ref_point) {
+                    dFloat original_dist1 = dAbs(last_dist - distance);
+                    dFloat original_dist2 = curve->m_length - original_dist1;
+                    dFloat current_dist1 = dAbs(edge_data->m_preceding_curve_length - last_dist);
+                    dFloat current_dist2 = curve->m_length - current_dist1;
+                    dFloat min_original_dist = (original_dist1 < original_dist2) ? original_dist1 : original_dist2;
+                    dFloat min_current_dist = (current_dist1 < current_dist2) ? current_dist1 : current_dist2;
+                    if (min_original_dist <= min_current_dist) return true;
+                }
+                c_calc_curve_pivot_normal(previous_edge_data->m_normal_matrix, edge_data->m_normal_matrix, edge_data->m_normal_matrix.m_posit, location, normal_matrix);
+                distance = edge_data->m_preceding_curve_length;
+                overpass = 0.0f;
+                return true;
+            }
+            // Update previous data
+            previous_edge_data = edge_data;
+            previous_left_over = left_over;
+            previous_set = true;
+        }
+        // Do second run, starting from the beginning and proceeding until we reach the current edge.
+        //~ previous_set = false;
+        for (unsigned int index = 0; index < cur_index; ++index) {
+            const CurveEdge* edge_data = &curve->m_edges[index];
+            dFloat lpointz = (location - edge_data->m_normal_matrix.m_posit).DotProduct3(edge_data->m_normal_matrix.m_right);
+            dFloat left_over = 0.0f;
+            if (lpointz < 0.0f)
+                left_over = lpointz;
+            else if (lpointz > edge_data->m_length)
+                left_over = lpointz - edge_data->m_length;
+            else {
+                // Snap to edge when left over is zero
+                if (found_potential_ref_point) {
+                    dFloat original_dist1 = dAbs(last_dist - distance);
+                    dFloat original_dist2 = curve->m_length - original_dist1;
+                    dFloat current_dist1 = dAbs(edge_data->m_preceding_curve_length + lpointz - last_dist);
+                    dFloat current_dist2 = curve->m_length - current_dist1;
+                    dFloat min_original_dist = (original_dist1 < original_dist2) ? original_dist1 : original_dist2;
+                    dFloat min_current_dist = (current_dist1 < current_dist2) ? current_dist1 : current_dist2;
+                    if (min_original_dist <= min_current_dist) return true;
+                }
+                normal_matrix = edge_data->m_normal_matrix;
+                normal_matrix.m_posit = edge_data->m_normal_matrix.m_posit + edge_data->m_normal_matrix.m_right.Scale(lpointz);
+                distance = edge_data->m_preceding_curve_length + lpointz;
+                overpass = 0.0f;
+                return true;
+            }
+            // Snap to point of the current edge in case left_over changes from positive to negative
+            if (previous_set && previous_left_over > 0.0f && left_over < 0.0f) {
+                if (found_potential_ref_point) {
+                    dFloat original_dist1 = dAbs(last_dist - distance);
+                    dFloat original_dist2 = curve->m_length - original_dist1;
+                    dFloat current_dist1 = dAbs(edge_data->m_preceding_curve_length - last_dist);
+                    dFloat current_dist2 = curve->m_length - current_dist1;
+                    dFloat min_original_dist = (original_dist1 < original_dist2) ? original_dist1 : original_dist2;
+                    dFloat min_current_dist = (current_dist1 < current_dist2) ? current_dist1 : current_dist2;
+                    if (min_original_dist <= min_current_dist) return true;
+                }
+                c_calc_curve_pivot_normal(previous_edge_data->m_normal_matrix, edge_data->m_normal_matrix, edge_data->m_normal_matrix.m_posit, location, normal_matrix);
+                distance = edge_data->m_preceding_curve_length;
+                overpass = 0.0f;
+                return true;
+            }
+            // Update previous data
+            previous_edge_data = edge_data;
+            previous_left_over = left_over;
+            previous_set = true;
+        }
+        // If nothing found, snap to the starting point.
+        if (!found_potential_ref_point) {
+            const CurveEdge* edge_data1 = &curve->m_edges.back();
+            const CurveEdge* edge_data2 = &curve->m_edges.front();
+            c_calc_curve_pivot_normal(edge_data1->m_normal_matrix, edge_data2->m_normal_matrix, edge_data2->m_normal_matrix.m_posit, location, normal_matrix);
+            distance = 0.0f;
+            overpass = 0.0f;
+            return true;
+        }
+    }
+    else { // Loop disabled
+        // Find the closest preceding edge
+        dFloat previous_left_over = 0.0f;
+        const CurveEdge* previous_edge_data = nullptr;
+        bool previous_set = false;
+        for (unsigned int i = cur_index + 1; i > 0; --i) {
+            unsigned int index = i - 1;
+            const CurveEdge* edge_data = &curve->m_edges[index];
+            dFloat lpointz = (location - edge_data->m_normal_matrix.m_posit).DotProduct3(edge_data->m_normal_matrix.m_right);
+            dFloat left_over = 0.0f;
+            if (lpointz < 0.0f) {
+                left_over = lpointz;
+                // Minimum limit
+                if (index == 0) {
+                    normal_matrix = edge_data->m_normal_matrix;
+                    distance = 0.0f;
+                    overpass = left_over;
+                    found_potential_ref_point = true;
+                    break;
+                }
+            }
+            else if (lpointz > edge_data->m_length)
+                left_over = lpointz - edge_data->m_length;
+            else {
+                // Snap to edge when left over is zero
+                normal_matrix = edge_data->m_normal_matrix;
+                normal_matrix.m_posit = edge_data->m_normal_matrix.m_posit + edge_data->m_normal_matrix.m_right.Scale(lpointz);
+                distance = edge_data->m_preceding_curve_length + lpointz;
+                overpass = 0.0f;
+                found_potential_ref_point = true;
+                break;
+            }
+            // Snap to point of the previous edge in case left_over changes from negative to positive
+            if (previous_set && previous_left_over < 0.0f && left_over > 0.0f) {
+                c_calc_curve_pivot_normal(edge_data->m_normal_matrix, previous_edge_data->m_normal_matrix, previous_edge_data->m_normal_matrix.m_posit, location, normal_matrix);
+                distance = previous_edge_data->m_preceding_curve_length;
+                overpass = 0.0f;
+                found_potential_ref_point = true;
+                break;
+            }
+            // Update previous data
+            previous_edge_data = edge_data;
+            previous_left_over = left_over;
+            previous_set = true;
+        }
+        // Find the closest succeeding point
+        previous_set = false;
+        for (unsigned int index = cur_index; index < total_edges_count; ++index) {
+            const CurveEdge* edge_data = &curve->m_edges[index];
+            dFloat lpointz = (location - edge_data->m_normal_matrix.m_posit).DotProduct3(edge_data->m_normal_matrix.m_right);
+            dFloat left_over = 0.0f;
+            if (lpointz < 0.0f)
+                left_over = lpointz;
+            else if (lpointz > edge_data->m_length) {
+                left_over = lpointz - edge_data->m_length;
+                // Maximum limit
+                if (index == total_edges_count - 1) {
+                    if (found_potential_ref_point) {
+                        dFloat original_dist = dAbs(last_dist - distance);
+                        dFloat current_dist = dAbs(curve->m_length - last_dist);
+                        if (original_dist <= current_dist) return true;
+                    }
+                    normal_matrix = edge_data->m_normal_matrix;
+                    normal_matrix.m_posit = edge_data->m_normal_matrix.m_posit + edge_data->m_normal_matrix.m_right.Scale(edge_data->m_length);
+                    distance = curve->m_length;
+                    overpass = left_over;
+                    return true;
+                }
+            }
+            else {
+                // Snap to edge when left over is zero
+                if (found_potential_ref_point) {
+                    dFloat original_dist = dAbs(last_dist - distance);
+                    dFloat current_dist = dAbs(edge_data->m_preceding_curve_length + lpointz - last_dist);
+                    if (original_dist <= current_dist) return true;
+                }
+                normal_matrix = edge_data->m_normal_matrix;
+                normal_matrix.m_posit = edge_data->m_normal_matrix.m_posit + edge_data->m_normal_matrix.m_right.Scale(lpointz);
+                distance = edge_data->m_preceding_curve_length + lpointz;
+                overpass = 0.0f;
+                return true;
+            }
+            // Snap to point of the current edge in case left_over changes from positive to negative
+            if (previous_set && previous_left_over > 0.0f && left_over < 0.0f) {
+                if (found_potential_ref_point) {
+                    dFloat original_dist = dAbs(last_dist - distance);
+                    dFloat current_dist = dAbs(edge_data->m_preceding_curve_length - last_dist);
+                    if (original_dist <= current_dist) return true;
+                }
+                c_calc_curve_pivot_normal(previous_edge_data->m_normal_matrix, edge_data->m_normal_matrix, edge_data->m_normal_matrix.m_posit, location, normal_matrix);
+                distance = edge_data->m_preceding_curve_length;
+                overpass = 0.0f;
+                return true;
+            }
+            // Update previous data
+            previous_edge_data = edge_data;
+            previous_left_over = left_over;
+            previous_set = true;
+        }
+    }
+    return found_potential_ref_point;
+}
+
+bool MSP::Joint::c_calc_curve_tangent(JointData* joint_data, dVector& tangent_out) {
+    const CurveData* curve = (joint_data->m_get_curve_proc != nullptr) ? joint_data->m_get_curve_proc(joint_data) : nullptr;
+    if (curve == nullptr)
+        return false;
+    dMatrix matrix0, matrix1, matrix2;
+    c_calculate_global_matrix2(joint_data, matrix0, matrix1, matrix2);
+    dVector location(matrix2.UntransformVector(matrix0.m_posit));
+    dMatrix loc_normal_matrix;
+    dFloat distance, overpass;
+    // Search the edge tree instead of starting from the edge of the last
+    // update, as the joint changes that while the solver runs.
+    if (!c_calc_curve_data_at_point(curve, location, loc_normal_matrix, distance, overpass))
+        return false;
+    // The curve twist turns about the tangent, so it is not needed here.
+    tangent_out = matrix2.RotateVector(loc_normal_matrix.m_right);
+    return true;
+}
+
+void MSP::Joint::c_calc_curve_pivot_normal(const dMatrix& normal_matrix1, const dMatrix& normal_matrix2, const dVector& pivot_point, const dVector& location, dMatrix& normal_matrix_out) {
+    dFloat cos_angle = normal_matrix1.m_right.DotProduct3(normal_matrix2.m_right);
+    if (dAbs(cos_angle) > 0.999995f)
+        normal_matrix_out = normal_matrix1;
+    else {
+        if (Util::get_vector_magnitude2(location - pivot_point) > M_EPSILON) {
+            dVector udir(normal_matrix1.m_right.CrossProduct(normal_matrix2.m_right));
+            dVector vdir(location - pivot_point);
+            dVector zdir(udir.CrossProduct(vdir));
+            dFloat mag = Util::get_vector_magnitude2(zdir);
+            if (mag > M_EPSILON)
+                Util::rotate_matrix_to_dir(normal_matrix1, zdir, normal_matrix_out);
+            else
+                normal_matrix_out = normal_matrix1;
+        }
+        else
+            normal_matrix_out = normal_matrix1;
+    }
+    normal_matrix_out.m_posit = pivot_point;
+}
+
+
+/*
+ ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+  Controller Parser
+ ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+bool MSP::Joint::ControllerParser::compile() {
+    while (m_pos < m_length && isspace(static_cast<unsigned char>(m_source[m_pos])))
+        ++m_pos;
+    while (m_length > m_pos && isspace(static_cast<unsigned char>(m_source[m_length - 1])))
+        --m_length;
+    if (m_pos == m_length)
+        return false;
+    parse_statement();
+    skip_space();
+    return !m_failed && m_pos == m_length && m_depth == 1;
+}
+
+void MSP::Joint::ControllerParser::emit(int opcode, int arg, int count, int depth_change) {
+    ControllerOp op;
+    op.m_opcode = opcode;
+    op.m_arg = arg;
+    op.m_count = count;
+    op.m_value.m_number = 0.0;
+    op.m_value.m_type = CONTROLLER_NIL;
+    m_program->m_code.push_back(op);
+    m_depth += depth_change;
+    if (m_depth > static_cast<int>(m_program->m_stack_size))
+        m_program->m_stack_size = static_cast<unsigned int>(m_depth);
+}
+
+void MSP::Joint::ControllerParser::emit_value(int type, double number) {
+    emit(OP_PUSH, 0, 0, 1);
+    ControllerValue& value = m_program->m_code.back().m_value;
+    value.m_number = number;
+    value.m_type = type;
+}
+
+void MSP::Joint::ControllerParser::skip_space() {
+    // Newlines, semicolons and comments are left in place, so that scripts
+    // with more than one statement fail to compile.
+    while (m_pos < m_length && (m_source[m_pos] == ' ' || m_source[m_pos] == '\t' || m_source[m_pos] == '\r'))
+        ++m_pos;
+}
+
+bool MSP::Joint::ControllerParser::at_identifier_char(unsigned int pos) const {
+    if (pos >= m_length)
+        return false;
+    char c = m_source[pos];
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+bool MSP::Joint::ControllerParser::accept(const char* token) {
+    skip_space();
+    unsigned int length = static_cast<unsigned int>(strlen(token));
+    if (m_pos + length > m_length || strncmp(m_source + m_pos, token, length) != 0)
+        return false;
+    // Don't take a prefix of a longer operator, such as * of ** or < of <=.
+    if (m_pos + length < m_length && strchr("*/%+-<>=!&|", token[length - 1]) != nullptr) {
+        char next = m_source[m_pos + length];
+        if (next == '=' || next == '~')
+            return false;
+        if (length == 1 && next == token[0] && strchr("*<>:&|", next) != nullptr)
+            return false;
+        if (strcmp(token, "<=") == 0 && next == '>')
+            return false;
+    }
+    m_pos += length;
+    return true;
+}
+
+bool MSP::Joint::ControllerParser::accept_word(const char* word) {
+    skip_space();
+    unsigned int length = static_cast<unsigned int>(strlen(word));
+    if (m_pos + length > m_length || strncmp(m_source + m_pos, word, length) != 0 || at_identifier_char(m_pos + length))
+        return false;
+    m_pos += length;
+    return true;
+}
+
+bool MSP::Joint::ControllerParser::read_identifier(std::string& name_out) {
+    skip_space();
+    if (m_pos >= m_length || (m_source[m_pos] >= '0' && m_source[m_pos] <= '9') || !at_identifier_char(m_pos))
+        return false;
+    unsigned int start = m_pos;
+    while (at_identifier_char(m_pos))
+        ++m_pos;
+    name_out.assign(m_source + start, m_pos - start);
+    return true;
+}
+
+bool MSP::Joint::ControllerParser::read_number(double& number_out, bool& is_int_out) {
+    skip_space();
+    std::string digits;
+    is_int_out = true;
+    // Underscores may only separate digits.
+    while (m_pos < m_length && ((m_source[m_pos] >= '0' && m_source[m_pos] <= '9') || (m_source[m_pos] == '_' && !digits.empty() && m_pos + 1 < m_length && m_source[m_pos + 1] >= '0' && m_source[m_pos + 1] <= '9'))) {
+        if (m_source[m_pos] != '_')
+            digits.push_back(m_source[m_pos]);
+        ++m_pos;
+    }
+    if (digits.empty())
+        return false;
+    // A dot followed by a letter is a method call on an integer.
+    if (m_pos + 1 < m_length && m_source[m_pos] == '.' && m_source[m_pos + 1] >= '0' && m_source[m_pos + 1] <= '9') {
+        is_int_out = false;
+        digits.push_back('.');
+        ++m_pos;
+        while (m_pos < m_length && ((m_source[m_pos] >= '0' && m_source[m_pos] <= '9') || m_source[m_pos] == '_')) {
+            if (m_source[m_pos] != '_')
+                digits.push_back(m_source[m_pos]);
+            ++m_pos;
+        }
+    }
+    if (m_pos < m_length && (m_source[m_pos] == 'e' || m_source[m_pos] == 'E')) {
+        unsigned int pos = m_pos + 1;
+        if (pos < m_length && (m_source[pos] == '+' || m_source[pos] == '-'))
+            ++pos;
+        if (pos < m_length && m_source[pos] >= '0' && m_source[pos] <= '9') {
+            is_int_out = false;
+            digits.append(m_source + m_pos, pos - m_pos);
+            m_pos = pos;
+            while (m_pos < m_length && m_source[m_pos] >= '0' && m_source[m_pos] <= '9')
+                digits.push_back(m_source[m_pos++]);
+        }
+    }
+    if (at_identifier_char(m_pos))
+        return false;
+    number_out = strtod(digits.c_str(), nullptr);
+    return true;
+}
+
+bool MSP::Joint::ControllerParser::skip_literal() {
+    skip_space();
+    if (m_pos >= m_length)
+        return false;
+    char c = m_source[m_pos];
+    if (c == '\'' || c == '"') {
+        ++m_pos;
+        while (m_pos < m_length && m_source[m_pos] != c) {
+            if (m_source[m_pos] == '\\')
+                ++m_pos;
+            // Interpolation makes the argument dynamic.
+            else if (c == '"' && m_source[m_pos] == '#' && m_pos + 1 < m_length && strchr("{@$", m_source[m_pos + 1]) != nullptr)
+                return false;
+            ++m_pos;
+        }
+        if (m_pos >= m_length)
+            return false;
+        ++m_pos;
+        return true;
+    }
+    if (c == ':') {
+        ++m_pos;
+        std::string name;
+        return (m_pos < m_length && m_source[m_pos] != ' ' && read_identifier(name));
+    }
+    if (c == '-' || c == '+')
+        ++m_pos;
+    double number;
+    bool is_int;
+    if (m_pos < m_length && m_source[m_pos] >= '0' && m_source[m_pos] <= '9')
+        return read_number(number, is_int);
+    return (c != '-' && c != '+' && (accept_word("nil") || accept_word("true") || accept_word("false")));
+}
+
+int MSP::Joint::ControllerParser::find_function(const std::string& name, int kind) const {
+    for (int i = 0; i < CONTROLLER_FUNCTION_COUNT; ++i) {
+        if (name == CONTROLLER_FUNCTIONS[i].m_name) {
+            if (kind == FUNCTION_METHOD ? CONTROLLER_FUNCTIONS[i].m_kind == FUNCTION_METHOD : CONTROLLER_FUNCTIONS[i].m_kind != FUNCTION_METHOD)
+                return i;
+        }
+    }
+    return -1;
+}
+
+void MSP::Joint::ControllerParser::parse_statement() {
+    parse_not();
+    while (!m_failed) {
+        int opcode;
+        if (accept_word("and"))
+            opcode = OP_AND;
+        else if (accept_word("or"))
+            opcode = OP_OR;
+        else
+            break;
+        unsigned int jump = static_cast<unsigned int>(m_program->m_code.size());
+        emit(opcode, 0, 0, -1);
+        parse_not();
+        m_program->m_code[jump].m_arg = static_cast<int>(m_program->m_code.size());
+    }
+}
+
+void MSP::Joint::ControllerParser::parse_not() {
+    if (accept_word("not")) {
+        parse_not();
+        emit(OP_NOT, 0, 0, 0);
+    }
+    else
+        parse_ternary();
+}
+
+void MSP::Joint::ControllerParser::parse_ternary() {
+    parse_or();
+    if (m_failed || !accept("?"))
+        return;
+    unsigned int jump_false = static_cast<unsigned int>(m_program->m_code.size());
+    emit(OP_JUMP_IF_FALSE, 0, 0, -1);
+    parse_ternary();
+    unsigned int jump_end = static_cast<unsigned int>(m_program->m_code.size());
+    emit(OP_JUMP, 0, 0, -1);
+    m_program->m_code[jump_false].m_arg = static_cast<int>(m_program->m_code.size());
+    if (!accept(":")) {
+        m_failed = true;
+        return;
+    }
+    parse_ternary();
+    m_program->m_code[jump_end].m_arg = static_cast<int>(m_program->m_code.size());
+}
+
+void MSP::Joint::ControllerParser::parse_or() {
+    parse_and();
+    while (!m_failed && accept("||")) {
+        unsigned int jump = static_cast<unsigned int>(m_program->m_code.size());
+        emit(OP_OR, 0, 0, -1);
+        parse_and();
+        m_program->m_code[jump].m_arg = static_cast<int>(m_program->m_code.size());
+    }
+}
+
+void MSP::Joint::ControllerParser::parse_and() {
+    parse_equality();
+    while (!m_failed && accept("&&")) {
+        unsigned int jump = static_cast<unsigned int>(m_program->m_code.size());
+        emit(OP_AND, 0, 0, -1);
+        parse_equality();
+        m_program->m_code[jump].m_arg = static_cast<int>(m_program->m_code.size());
+    }
+}
+
+void MSP::Joint::ControllerParser::parse_equality() {
+    parse_comparison();
+    while (!m_failed) {
+        int opcode;
+        if (accept("=="))
+            opcode = OP_EQ;
+        else if (accept("!="))
+            opcode = OP_NE;
+        else
+            break;
+        parse_comparison();
+        emit(opcode, 0, 0, -1);
+    }
+}
+
+void MSP::Joint::ControllerParser::parse_comparison() {
+    parse_additive();
+    while (!m_failed) {
+        int opcode;
+        if (accept("<="))
+            opcode = OP_LE;
+        else if (accept(">="))
+            opcode = OP_GE;
+        else if (accept("<"))
+            opcode = OP_LT;
+        else if (accept(">"))
+            opcode = OP_GT;
+        else
+            break;
+        parse_additive();
+        emit(opcode, 0, 0, -1);
+    }
+}
+
+void MSP::Joint::ControllerParser::parse_additive() {
+    parse_term();
+    while (!m_failed) {
+        int opcode;
+        if (accept("+"))
+            opcode = OP_ADD;
+        else if (accept("-"))
+            opcode = OP_SUB;
+        else
+            break;
+        parse_term();
+        emit(opcode, 0, 0, -1);
+    }
+}
+
+void MSP::Joint::ControllerParser::parse_term() {
+    parse_unary();
+    while (!m_failed) {
+        int opcode;
+        if (accept("*"))
+            opcode = OP_MUL;
+        else if (accept("/"))
+            opcode = OP_DIV;
+        else if (accept("%"))
+            opcode = OP_MOD;
+        else
+            break;
+        parse_unary();
+        emit(opcode, 0, 0, -1);
+    }
+}
+
+void MSP::Joint::ControllerParser::parse_unary() {
+    skip_space();
+    // A minus sign attached to a number is part of the literal, except that
+    // Ruby still evaluates -2 ** 2 as -(2 ** 2).
+    if (m_pos + 1 < m_length && m_source[m_pos] == '-' && m_source[m_pos + 1] >= '0' && m_source[m_pos + 1] <= '9') {
+        ++m_pos;
+        double number;
+        bool is_int;
+        if (!read_number(number, is_int)) {
+            m_failed = true;
+            return;
+        }
+        if (accept("**")) {
+            emit_value(is_int ? CONTROLLER_INT : CONTROLLER_FLOAT, number);
+            parse_unary();
+            emit(OP_POW, 0, 0, -1);
+            emit(OP_NEG, 0, 0, 0);
+        }
+        else {
+            emit_value(is_int ? CONTROLLER_INT : CONTROLLER_FLOAT, -number);
+            parse_postfix();
+        }
+    }
+    else if (accept("-")) {
+        parse_unary();
+        emit(OP_NEG, 0, 0, 0);
+    }
+    else if (accept("+"))
+        parse_unary();
+    else
+        parse_power();
+}
+
+void MSP::Joint::ControllerParser::parse_power() {
+    parse_prefix();
+    if (!m_failed && accept("**")) {
+        parse_unary();
+        emit(OP_POW, 0, 0, -1);
+    }
+}
+
+void MSP::Joint::ControllerParser::parse_prefix() {
+    if (accept("!")) {
+        parse_prefix();
+        emit(OP_NOT, 0, 0, 0);
+    }
+    else {
+        parse_primary();
+        parse_postfix();
+    }
+}
+
+void MSP::Joint::ControllerParser::parse_postfix() {
+    while (!m_failed) {
+        skip_space();
+        if (m_pos + 1 >= m_length || m_source[m_pos] != '.' || !at_identifier_char(m_pos + 1))
+            return;
+        ++m_pos;
+        std::string name;
+        int function = read_identifier(name) ? find_function(name, FUNCTION_METHOD) : -1;
+        if (function == -1 || (accept("(") && !accept(")"))) {
+            m_failed = true;
+            return;
+        }
+        emit(OP_CALL, function, 1, 0);
+    }
+}
+
+void MSP::Joint::ControllerParser::parse_primary() {
+    if (m_failed)
+        return;
+    skip_space();
+    if (m_pos >= m_length) {
+        m_failed = true;
+        return;
+    }
+    char c = m_source[m_pos];
+    if (c == '(') {
+        ++m_pos;
+        parse_statement();
+        if (!accept(")"))
+            m_failed = true;
+        return;
+    }
+    if (c >= '0' && c <= '9') {
+        double number;
+        bool is_int;
+        if (read_number(number, is_int))
+            emit_value(is_int ? CONTROLLER_INT : CONTROLLER_FLOAT, number);
+        else
+            m_failed = true;
+        return;
+    }
+    unsigned int start = m_pos;
+    std::string name;
+    if (!read_identifier(name)) {
+        m_failed = true;
+        return;
+    }
+    if (name == "nil")
+        emit_value(CONTROLLER_NIL, 0.0);
+    else if (name == "true" || name == "false")
+        emit_value(CONTROLLER_BOOL, name == "true" ? 1.0 : 0.0);
+    else if (name == "PI")
+        emit_value(CONTROLLER_FLOAT, CONTROLLER_PI);
+    else if (name == "E")
+        emit_value(CONTROLLER_FLOAT, CONTROLLER_E);
+    else if (name == "Math") {
+        std::string member;
+        if ((!accept("::") && !accept(".")) || !read_identifier(member))
+            m_failed = true;
+        else if (member == "PI")
+            emit_value(CONTROLLER_FLOAT, CONTROLLER_PI);
+        else if (member == "E")
+            emit_value(CONTROLLER_FLOAT, CONTROLLER_E);
+        else {
+            int function = find_function(member, FUNCTION_MATH);
+            if (function == -1 || CONTROLLER_FUNCTIONS[function].m_kind != FUNCTION_MATH)
+                m_failed = true;
+            else
+                parse_call(function);
+        }
+    }
+    else if (name == "world") {
+        std::string member;
+        if (!accept(".") || !read_identifier(member) || member != "time" || (accept("(") && !accept(")")))
+            m_failed = true;
+        else
+            emit(OP_PUSH_TIME, 0, 0, 1);
+    }
+    else {
+        int function = find_function(name, FUNCTION_MATH);
+        if (function == -1)
+            m_failed = true;
+        else if (CONTROLLER_FUNCTIONS[function].m_kind == FUNCTION_INPUT)
+            parse_input(function, start);
+        else
+            parse_call(function);
+    }
+}
+
+void MSP::Joint::ControllerParser::parse_call(int function) {
+    const ControllerFunction& info = CONTROLLER_FUNCTIONS[function];
+    if (!accept("(")) {
+        m_failed = true;
+        return;
+    }
+    int count = 0;
+    if (!accept(")")) {
+        while (!m_failed) {
+            parse_ternary();
+            ++count;
+            if (accept(")"))
+                break;
+            if (!accept(",")) {
+                m_failed = true;
+                return;
+            }
+        }
+    }
+    if (m_failed || count < info.m_min_args || count > info.m_max_args) {
+        m_failed = true;
+        return;
+    }
+    // Optional arguments of time functions are delays, defaulting to zero.
+    if (info.m_kind == FUNCTION_TIME) {
+        for (; count < info.m_max_args; ++count)
+            emit_value(CONTROLLER_FLOAT, 0.0);
+    }
+    emit(OP_CALL, function, count, 1 - count);
+}
+
+void MSP::Joint::ControllerParser::parse_input(int function, unsigned int start) {
+    const ControllerFunction& info = CONTROLLER_FUNCTIONS[function];
+    int count = 0;
+    if (accept("(") && !accept(")")) {
+        while (true) {
+            if (!skip_literal()) {
+                m_failed = true;
+                return;
+            }
+            ++count;
+            if (accept(")"))
+                break;
+            if (!accept(",")) {
+                m_failed = true;
+                return;
+            }
+        }
+    }
+    if (count < info.m_min_args || count > info.m_max_args) {
+        m_failed = true;
+        return;
+    }
+    // The call is sampled in Ruby with its own source.
+    std::string source(m_source + start, m_pos - start);
+    int index = -1;
+    for (unsigned int i = 0; i < m_inputs.size(); ++i) {
+        if (m_inputs[i] == source) {
+            index = static_cast<int>(i);
+            break;
+        }
+    }
+    if (index == -1) {
+        index = static_cast<int>(m_inputs.size());
+        m_inputs.push_back(source);
+    }
+    emit(OP_PUSH_INPUT, index, 0, 1);
+}
+
 
 /*
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -300,7 +2062,7 @@ void MSP::Joint::c_destroy(JointData* joint_data) {
 */
 
 VALUE MSP::Joint::rbf_is_valid(VALUE self, VALUE v_joint) {
-    return c_is_joint_valid(reinterpret_cast<JointData*>(Util::value_to_ull(v_joint))) ? Qtrue : Qfalse;
+    return c_is_joint_valid(Util::value_to_ull(v_joint)) ? Qtrue : Qfalse;
 }
 
 VALUE MSP::Joint::rbf_create(VALUE self, VALUE v_world, VALUE v_parent, VALUE v_pin_matrix, VALUE v_group) {
@@ -330,11 +2092,12 @@ VALUE MSP::Joint::rbf_connect(VALUE self, VALUE v_joint, VALUE v_child) {
     const NewtonWorld* child_world = NewtonBodyGetWorld(child);
     if (child_world != joint_data->m_world)
         rb_raise(rb_eTypeError, "Given child body is not from the preset world!");
-    if (joint_data->m_parent != nullptr && !MSP::Body::c_is_body_valid(joint_data->m_parent))
+    if (joint_data->m_parent != nullptr && !MSP::Body::c_is_body_valid(joint_data->m_parent_handle))
         joint_data->m_parent = nullptr;
     if (child == joint_data->m_parent)
         rb_raise(rb_eTypeError, "Using same body as parent and child is not allowed!");
     joint_data->m_child = child;
+    reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(child))->m_cold->m_connected_joints.push_back(joint_data);
     c_calculate_local_matrix(joint_data);
     joint_data->m_constraint = NewtonConstraintCreateUserJoint(joint_data->m_world, joint_data->m_dof, submit_constraints, joint_data->m_child, joint_data->m_parent);
     NewtonJointSetCollisionState(joint_data->m_constraint, joint_data->m_bodies_collidable ? 1 : 0);
@@ -380,7 +2143,7 @@ VALUE MSP::Joint::rbf_get_type(VALUE self, VALUE v_joint) {
 
 VALUE MSP::Joint::rbf_get_parent(VALUE self, VALUE v_joint) {
     JointData* joint_data = c_value_to_joint(v_joint);
-    if (joint_data->m_parent != nullptr && !MSP::Body::c_is_body_valid(joint_data->m_parent))
+    if (joint_data->m_parent != nullptr && !MSP::Body::c_is_body_valid(joint_data->m_parent_handle))
         joint_data->m_parent = nullptr;
     return joint_data->m_parent != nullptr ? MSP::Body::c_body_to_value(joint_data->m_parent) : Qnil;
 }
@@ -392,7 +2155,7 @@ VALUE MSP::Joint::rbf_get_child(VALUE self, VALUE v_joint) {
 
 VALUE MSP::Joint::rbf_get_pin_matrix(VALUE self, VALUE v_joint) {
     JointData* joint_data = c_value_to_joint(v_joint);
-    if (joint_data->m_parent != nullptr && !MSP::Body::c_is_body_valid(joint_data->m_parent))
+    if (joint_data->m_parent != nullptr && !MSP::Body::c_is_body_valid(joint_data->m_parent_handle))
         joint_data->m_parent = nullptr;
     dMatrix pin_matrix;
     if (joint_data->m_parent != nullptr) {
@@ -409,7 +2172,7 @@ VALUE MSP::Joint::rbf_set_pin_matrix(VALUE self, VALUE v_joint, VALUE v_pin_matr
     JointData* joint_data = c_value_to_joint(v_joint);
     dMatrix pin_matrix(Util::value_to_matrix(v_pin_matrix));
     Util::extract_matrix_scale(pin_matrix);
-    if (joint_data->m_parent != nullptr && !MSP::Body::c_is_body_valid(joint_data->m_parent))
+    if (joint_data->m_parent != nullptr && !MSP::Body::c_is_body_valid(joint_data->m_parent_handle))
         joint_data->m_parent = nullptr;
     if (joint_data->m_parent != nullptr) {
         dMatrix parent_matrix;
@@ -574,6 +2337,35 @@ VALUE MSP::Joint::rbf_get_joint_data_by_group(VALUE self, VALUE v_group) {
     return Qnil;
 }
 
+VALUE MSP::Joint::rbf_set_controller_program(VALUE self, VALUE v_joint, VALUE v_source, VALUE v_ratio) {
+    JointData* joint_data = c_value_to_joint(v_joint);
+    dFloat ratio = Util::value_to_dFloat(v_ratio);
+    c_release_controller_program(joint_data);
+    // Joints without a numeric controller are left to Ruby.
+    if (v_source == Qnil || joint_data->m_set_controller_proc == nullptr)
+        return Qfalse;
+    StringValue(v_source);
+    ControllerProgram* program = new ControllerProgram;
+    program->m_ratio = ratio;
+    ControllerParser parser(RSTRING_PTR(v_source), static_cast<unsigned int>(RSTRING_LEN(v_source)), program);
+    if (!parser.compile()) {
+        delete program;
+        return Qfalse;
+    }
+    // Bind input calls to the input table of the world.
+    for (std::vector<ControllerOp>::iterator it = program->m_code.begin(); it != program->m_code.end(); ++it) {
+        if (it->m_opcode == OP_PUSH_INPUT)
+            it->m_arg = c_register_controller_input(joint_data->m_world, parser.m_inputs[it->m_arg]);
+    }
+    joint_data->m_controller_program = program;
+    return Qtrue;
+}
+
+VALUE MSP::Joint::rbf_has_controller_program(VALUE self, VALUE v_joint) {
+    JointData* joint_data = c_value_to_joint(v_joint);
+    return joint_data->m_controller_program != nullptr ? Qtrue : Qfalse;
+}
+
 
 /*
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -614,4 +2406,6 @@ void MSP::Joint::init_ruby(VALUE mNewton) {
     rb_define_module_function(mJoint, "get_joint_by_group", VALUEFUNC(MSP::Joint::rbf_get_joint_by_group), 1);
     rb_define_module_function(mJoint, "get_joints_by_group", VALUEFUNC(MSP::Joint::rbf_get_joints_by_group), 1);
     rb_define_module_function(mJoint, "get_joint_data_by_group", VALUEFUNC(MSP::Joint::rbf_get_joint_data_by_group), 1);
+    rb_define_module_function(mJoint, "set_controller_program", VALUEFUNC(MSP::Joint::rbf_set_controller_program), 3);
+    rb_define_module_function(mJoint, "has_controller_program?", VALUEFUNC(MSP::Joint::rbf_has_controller_program), 1);
 }
@@ -36,6 +36,10 @@ public:
     static const dFloat DEFAULT_STIFFNESS_RANGE;
     static const dFloat MIN_PIN_LENGTH;
     static const char* JOINT_NAMES[16];
+    static const double CONTROLLER_PI;
+    static const double CONTROLLER_E;
+    static const unsigned int CURVE_TREE_LEAF_SIZE;
+    static const unsigned int CURVE_TREE_STACK_SIZE;
 
     // Enumerators
     enum JointType {
@@ -57,7 +61,241 @@ public:
         POINT_TO_POINT
     };
 
+    // Controller value types
+    enum ControllerType {
+        CONTROLLER_NIL,
+        CONTROLLER_BOOL,
+        CONTROLLER_INT,
+        CONTROLLER_FLOAT,
+        CONTROLLER_RATIONAL
+    };
+
+    // Controller opcodes
+    enum ControllerOpcode {
+        OP_PUSH,
+        OP_PUSH_INPUT,
+        OP_PUSH_TIME,
+        OP_NEG,
+        OP_NOT,
+        OP_ADD,
+        OP_SUB,
+        OP_MUL,
+        OP_DIV,
+        OP_MOD,
+        OP_POW,
+        OP_LT,
+        OP_LE,
+        OP_GT,
+        OP_GE,
+        OP_EQ,
+        OP_NE,
+        OP_JUMP,
+        OP_JUMP_IF_FALSE,
+        OP_AND,
+        OP_OR,
+        OP_CALL
+    };
+
+    // Controller function kinds
+    enum ControllerFunctionKind {
+        FUNCTION_MATH,
+        FUNCTION_TIME,
+        FUNCTION_METHOD,
+        FUNCTION_INPUT
+    };
+
+    // Controller functions, indexing CONTROLLER_FUNCTIONS
+    enum ControllerFunctionId {
+        CF_SIN,
+        CF_COS,
+        CF_TAN,
+        CF_ASIN,
+        CF_ACOS,
+        CF_ATAN,
+        CF_ATAN2,
+        CF_SINH,
+        CF_COSH,
+        CF_TANH,
+        CF_ASINH,
+        CF_ACOSH,
+        CF_ATANH,
+        CF_SQRT,
+        CF_CBRT,
+        CF_EXP,
+        CF_LOG,
+        CF_LOG2,
+        CF_LOG10,
+        CF_HYPOT,
+        CF_OSCILLATOR,
+        CF_OSCILLATOR_SLOPE,
+        CF_OSCILLATOR2,
+        CF_OSCILLATOR2_SLOPE,
+        CF_ACCUMULATOR,
+        CF_REPEATER,
+        CF_ABS,
+        CF_TO_F,
+        CF_TO_I,
+        CF_FLOOR,
+        CF_CEIL,
+        CF_ROUND,
+        CF_TRUNCATE,
+        CF_KEY,
+        CF_TOGGLE_KEY,
+        CF_SLIDER,
+        CF_KEY_SLIDER,
+        CF_JOYSTICK,
+        CF_JOYBUTTON,
+        CF_JOYPAD,
+        CF_LEFTX,
+        CF_LEFTY,
+        CF_LEFTZ,
+        CF_RIGHTX,
+        CF_RIGHTY,
+        CF_RIGHTZ,
+        CF_NUMX,
+        CF_NUMY,
+        CF_FRAME,
+        CF_GET_VAR,
+        CF_GET_GLOBAL_VAR
+    };
+
     // Structures
+
+    // A controller value follows Ruby semantics: integers and floats are
+    // told apart, and only nil and false are falsy.
+    struct ControllerValue {
+        double m_number;
+        int m_type;
+    };
+
+    struct ControllerOp {
+        int m_opcode;
+        int m_arg;
+        int m_count;
+        ControllerValue m_value;
+    };
+
+    struct ControllerFunction {
+        const char* m_name;
+        int m_kind;
+        int m_min_args;
+        int m_max_args;
+    };
+
+    // A controller expression compiled to stack-based bytecode. Inputs that
+    // only Ruby can read, such as key states and sliders, are sampled once
+    // per update into the input table of the world and referenced by index.
+    struct ControllerProgram {
+        std::vector<ControllerOp> m_code;
+        unsigned int m_stack_size;
+        dFloat m_ratio;
+        ControllerProgram() :
+            m_stack_size(0),
+            m_ratio(1.0f)
+        {
+        }
+    };
+
+    // Recursive descent compiler for the controller grammar: numeric
+    // literals, arithmetic, comparison and logical operators, the ternary
+    // operator, Math functions, time functions, and input functions with
+    // literal arguments. Anything else fails the compilation, so that the
+    // caller can fall back to Ruby.
+    struct ControllerParser {
+        const char* m_source;
+        unsigned int m_length;
+        unsigned int m_pos;
+        ControllerProgram* m_program;
+        // Sources of input calls; OP_PUSH_INPUT indexes this list until the
+        // program is bound to a world.
+        std::vector<std::string> m_inputs;
+        int m_depth;
+        bool m_failed;
+        ControllerParser(const char* source, unsigned int length, ControllerProgram* program) :
+            m_source(source),
+            m_length(length),
+            m_pos(0),
+            m_program(program),
+            m_depth(0),
+            m_failed(false)
+        {
+        }
+        bool compile();
+        void emit(int opcode, int arg, int count, int depth_change);
+        void emit_value(int type, double number);
+        void skip_space();
+        bool at_identifier_char(unsigned int pos) const;
+        bool accept(const char* token);
+        bool accept_word(const char* word);
+        bool read_identifier(std::string& name_out);
+        bool read_number(double& number_out, bool& is_int_out);
+        bool skip_literal();
+        int find_function(const std::string& name, int kind) const;
+        void parse_statement();
+        void parse_not();
+        void parse_ternary();
+        void parse_or();
+        void parse_and();
+        void parse_equality();
+        void parse_comparison();
+        void parse_additive();
+        void parse_term();
+        void parse_unary();
+        void parse_power();
+        void parse_prefix();
+        void parse_postfix();
+        void parse_primary();
+        void parse_call(int function);
+        void parse_input(int function, unsigned int start);
+    };
+
+    struct CurveEdge {
+        dMatrix m_normal_matrix;
+        dFloat m_length;
+        dFloat m_preceding_curve_length;
+        unsigned int m_start_index;
+        unsigned int m_end_index;
+        CurveEdge(dFloat length, dFloat preceding_curve_length, unsigned int start_index, unsigned int end_index) :
+            m_length(length),
+            m_preceding_curve_length(preceding_curve_length),
+            m_start_index(start_index),
+            m_end_index(end_index)
+        {
+        }
+    };
+
+    // Bounding box over a contiguous range of edges. Nodes are stored in
+    // depth first order, so the first child of a branch node follows it.
+    struct CurveTreeNode {
+        dVector m_min;
+        dVector m_max;
+        unsigned int m_first_edge;
+        unsigned int m_edge_count;
+        unsigned int m_second_child;
+    };
+
+    // Immutable curve geometry, shared by all curvy joints with the same
+    // points and loop state. Edge frames are propagated from the first edge;
+    // each joint orients them to its pin with a twist about the curve.
+    struct CurveData {
+        std::vector<dVector> m_points;
+        std::vector<CurveEdge> m_edges;
+        std::vector<dFloat> m_edge_offsets;
+        std::vector<CurveTreeNode> m_edge_tree;
+        dFloat m_length;
+        bool m_loop;
+        unsigned long long m_hash;
+        unsigned int m_ref_count;
+        CurveData(const std::vector<dVector>& points, bool loop, unsigned long long hash) :
+            m_points(points),
+            m_length(0.0f),
+            m_loop(loop),
+            m_hash(hash),
+            m_ref_count(1)
+        {
+        }
+    };
+
     struct JointData {
         const NewtonWorld* m_world;
         unsigned int m_dof;
@@ -70,6 +308,7 @@ public:
         NewtonJoint* m_constraint;
         bool m_connected;
         const NewtonBody* m_parent;
+        unsigned long long m_parent_handle;
         const NewtonBody* m_child;
         dMatrix m_pin_matrix;
         dMatrix m_local_matrix0;
@@ -90,6 +329,17 @@ public:
         void (*m_on_stiffness_changed)(JointData* joint_data);
         void (*m_on_pin_matrix_changed)(JointData* joint_data);
         void (*m_adjust_pin_matrix_proc)(JointData* joint_data, dMatrix& pin_matrix);
+        // Assigns a controller value; a disabled controller stands for nil.
+        void (*m_set_controller_proc)(JointData* joint_data, dFloat controller, bool enabled);
+        // Obtains the attached curve of a curvy joint, or null; used by gears.
+        const CurveData* (*m_get_curve_proc)(JointData* joint_data);
+        ControllerProgram* m_controller_program;
+        unsigned long long m_handle;
+        // Links into the joint list of the world and into the joint lists
+        // of the parent and child bodies.
+        ListLink<JointData> m_world_link;
+        ListLink<JointData> m_parent_link;
+        ListLink<JointData> m_child_link;
         JointData(const NewtonWorld* world, unsigned int dof, const NewtonBody* parent, const dMatrix& pin_matrix, const VALUE& v_group) :
             m_world(world),
             m_dof(dof),
@@ -101,6 +351,7 @@ public:
             m_breaking_force(DEFAULT_BREAKING_FORCE),
             m_connected(false),
             m_parent(parent),
+            m_parent_handle(0),
             m_pin_matrix(pin_matrix),
             m_user_data(Qnil),
             m_group(v_group),
@@ -119,15 +370,27 @@ public:
             m_on_stiffness_changed = nullptr;
             m_on_pin_matrix_changed = nullptr;
             m_adjust_pin_matrix_proc = nullptr;
+            m_set_controller_proc = nullptr;
+            m_get_curve_proc = nullptr;
+            m_controller_program = nullptr;
+            m_handle = 0;
         }
         ~JointData()
         {
+            delete m_controller_program;
         }
     };
 
+    typedef IntrusiveList<JointData, &JointData::m_world_link> WorldJointList;
+    typedef IntrusiveList<JointData, &JointData::m_parent_link> ParentJointList;
+    typedef IntrusiveList<JointData, &JointData::m_child_link> ChildJointList;
+
     // Variables
-    static std::map<JointData*, bool> s_valid_joints;
+    static const ControllerFunction CONTROLLER_FUNCTIONS[];
+    static const int CONTROLLER_FUNCTION_COUNT;
+    static HandleTable<JointData*> s_valid_joints;
     static std::map<VALUE, std::map<JointData*, bool>> s_map_group_to_joints;
+    static std::multimap<unsigned long long, CurveData*> s_curves;
 
     // Callback Functions
     static void submit_constraints(const NewtonJoint* joint, dFloat timestep, int thread_index);
@@ -143,7 +406,7 @@ public:
     static void adjust_pin_matrix_proc(JointData* joint_data, dMatrix& pin_matrix);
 
     // Helper Functions
-    static bool c_is_joint_valid(JointData* address);
+    static bool c_is_joint_valid(unsigned long long handle);
     static VALUE c_joint_to_value(JointData* joint_data);
     static JointData* c_value_to_joint(VALUE v_joint);
     static JointData* c_value_to_joint2(VALUE v_joint, JointType joint_type);
@@ -157,6 +420,27 @@ public:
     static void c_get_pin_matrix(JointData* joint_data, dMatrix& matrix_out);
     static JointData* c_create(const NewtonWorld* world, const NewtonBody* parent, dMatrix pin_matrix, VALUE v_group);
     static void c_destroy(JointData* joint_data);
+    static bool c_is_truthy(const ControllerValue& value);
+    static bool c_is_numeric(const ControllerValue& value);
+    static bool c_call_controller_function(int function, const ControllerValue* args, int count, double time, ControllerValue& result_out);
+    static bool c_evaluate_controller(const ControllerProgram* program, const NewtonWorld* world, ControllerValue& result_out);
+    static int c_register_controller_input(const NewtonWorld* world, const std::string& source);
+    static void c_release_controller_program(JointData* joint_data);
+    static void c_prune_controller_inputs(const NewtonWorld* world);
+    static void c_update_controllers(const NewtonWorld* world);
+    static const CurveData* c_acquire_curve(const std::vector<dVector>& points, bool loop);
+    static void c_release_curve(const CurveData* curve);
+    static void c_build_curve_edges(CurveData* curve);
+    static unsigned int c_build_curve_tree(CurveData* curve, unsigned int first_edge, unsigned int edge_count);
+    static unsigned int c_find_curve_edge_at_distance(const CurveData* curve, dFloat distance, unsigned int hint);
+    static unsigned int c_find_curve_edge_at_point(const CurveData* curve, unsigned int point_index);
+    static dFloat c_calc_curve_box_distance2(const CurveTreeNode& node, const dVector& location);
+    static bool c_calc_curve_data_at_position(const CurveData* curve, dFloat position, dMatrix& normal_matrix, dFloat &distance, dFloat &overpass);
+    static bool c_calc_curve_data_at_point(const CurveData* curve, const dVector& location, dMatrix& normal_matrix, dFloat &distance, dFloat &overpass);
+    static bool c_calc_curve_data_at_point2(const std::vector<dVector>& points, bool loop, const dVector& location, dVector& point, dVector& vector, dFloat &distance, unsigned int &edge_index);
+    static bool c_calc_curve_data_at_point3(const CurveData* curve, dFloat last_dist, unsigned int hint, const dVector& location, dMatrix& normal_matrix, dFloat &distance, dFloat &overpass);
+    static void c_calc_curve_pivot_normal(const dMatrix& normal_matrix1, const dMatrix& normal_matrix2, const dVector& pivot_point, const dVector& location, dMatrix& normal_matrix_out);
+    static bool c_calc_curve_tangent(JointData* joint_data, dVector& tangent_out);
 
     // Ruby Functions
     static VALUE rbf_is_valid(VALUE self, VALUE v_joint);
@@ -189,6 +473,8 @@ public:
     static VALUE rbf_get_joint_by_group(VALUE self, VALUE v_group);
     static VALUE rbf_get_joints_by_group(VALUE self, VALUE v_group);
     static VALUE rbf_get_joint_data_by_group(VALUE self, VALUE v_group);
+    static VALUE rbf_set_controller_program(VALUE self, VALUE v_joint, VALUE v_source, VALUE v_ratio);
+    static VALUE rbf_has_controller_program(VALUE self, VALUE v_joint);
 
     // Main
     static void init_ruby(VALUE mNewton);
@@ -195,6 +195,17 @@ void MSP::BallAndSocket::on_disconnect(MSP::Joint::JointData* joint_data) {
     cj_data->m_cur_twist_alpha = 0.0f;
 }
 
+void MSP::BallAndSocket::set_controller_proc(MSP::Joint::JointData* joint_data, dFloat controller, bool enabled) {
+    BallAndSocketData* cj_data = reinterpret_cast<BallAndSocketData*>(joint_data->m_cj_data);
+    if (!enabled)
+        return;
+    if (cj_data->m_controller != controller) {
+        cj_data->m_controller = controller;
+        if (joint_data->m_connected)
+            NewtonBodySetSleepState(joint_data->m_child, 0);
+    }
+}
+
 
 /*
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -203,8 +214,8 @@ void MSP::BallAndSocket::on_disconnect(MSP::Joint::JointData* joint_data) {
 */
 
 VALUE MSP::BallAndSocket::rbf_is_valid(VALUE self, VALUE v_joint) {
-    MSP::Joint::JointData* address = reinterpret_cast<MSP::Joint::JointData*>(Util::value_to_ull(v_joint));
-    return (MSP::Joint::c_is_joint_valid(address) && address->m_jtype == MSP::Joint::BALL_AND_SOCKET) ? Qtrue : Qfalse;
+    MSP::Joint::JointData* address = MSP::Joint::s_valid_joints.find(Util::value_to_ull(v_joint));
+    return (address != nullptr && address->m_jtype == MSP::Joint::BALL_AND_SOCKET) ? Qtrue : Qfalse;
 }
 
 VALUE MSP::BallAndSocket::rbf_create(VALUE self, VALUE v_joint) {
@@ -217,6 +228,7 @@ VALUE MSP::BallAndSocket::rbf_create(VALUE self, VALUE v_joint) {
     joint_data->m_get_info = get_info;
     joint_data->m_on_destroy = on_destroy;
     joint_data->m_on_disconnect = on_disconnect;
+    joint_data->m_set_controller_proc = set_controller_proc;
 
     return MSP::Joint::c_joint_to_value(joint_data);
 }
@@ -331,13 +343,7 @@ VALUE MSP::BallAndSocket::rbf_get_controller(VALUE self, VALUE v_joint) {
 
 VALUE MSP::BallAndSocket::rbf_set_controller(VALUE self, VALUE v_joint, VALUE v_controller) {
     MSP::Joint::JointData* joint_data = MSP::Joint::c_value_to_joint2(v_joint, MSP::Joint::BALL_AND_SOCKET);
-    BallAndSocketData* cj_data = reinterpret_cast<BallAndSocketData*>(joint_data->m_cj_data);
-    dFloat desired_controller = Util::value_to_dFloat(v_controller);
-    if (cj_data->m_controller != desired_controller) {
-        cj_data->m_controller = desired_controller;
-        if (joint_data->m_connected)
-            NewtonBodySetSleepState(joint_data->m_child, 0);
-    }
+    set_controller_proc(joint_data, Util::value_to_dFloat(v_controller), true);
     return Qnil;
 }
 
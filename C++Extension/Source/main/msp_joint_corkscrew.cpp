@@ -217,8 +217,8 @@ void MSP::Corkscrew::adjust_pin_matrix_proc(MSP::Joint::JointData* joint_data, d
 */
 
 VALUE MSP::Corkscrew::rbf_is_valid(VALUE self, VALUE v_joint) {
-    MSP::Joint::JointData* address = reinterpret_cast<MSP::Joint::JointData*>(Util::value_to_ull(v_joint));
-    return (MSP::Joint::c_is_joint_valid(address) && address->m_jtype == MSP::Joint::CORKSCREW) ? Qtrue : Qfalse;
+    MSP::Joint::JointData* address = MSP::Joint::s_valid_joints.find(Util::value_to_ull(v_joint));
+    return (address != nullptr && address->m_jtype == MSP::Joint::CORKSCREW) ? Qtrue : Qfalse;
 }
 
 VALUE MSP::Corkscrew::rbf_create(VALUE self, VALUE v_joint) {
@@ -35,11 +35,11 @@ const int MSP::CurvyPiston::DEFAULT_CONTROLLER_MODE(0);
 */
 
 void MSP::CurvyPiston::c_clear_curve_edges(MSP::Joint::JointData* joint_data) {
+    // The edge state is read by the pending update.
+    MSP::World::c_wait_for_update(joint_data->m_world);
     CurvyPistonData* cj_data = reinterpret_cast<CurvyPistonData*>(joint_data->m_cj_data);
-    for (std::map<unsigned int, EdgeData*>::iterator it = cj_data->m_edges.begin(); it != cj_data->m_edges.end(); ++it) {
-        delete it->second;
-    }
-    cj_data->m_edges.clear();
+    cj_data->m_curve_twist = dGetIdentityMatrix();
+    cj_data->m_cur_edge_index = 0;
     cj_data->m_curve_len = 0.0f;
 }
 
@@ -47,658 +47,36 @@ void MSP::CurvyPiston::c_update_curve_edges(MSP::Joint::JointData* joint_data) {
     if (!joint_data->m_connected) return;
     c_clear_curve_edges(joint_data);
     CurvyPistonData* cj_data = reinterpret_cast<CurvyPistonData*>(joint_data->m_cj_data);
-    unsigned int points_size = (unsigned int)cj_data->m_points.size();
-    if (points_size < 2) return;
-    std::map<unsigned int, EdgeData*> temp_edges;
-    // Calculate all the succeeding edge normals from the current index.
-    dMatrix last_matrix(joint_data->m_local_matrix1 * joint_data->m_local_matrix2.Inverse());
-    unsigned int pt_index = cj_data->m_initial_edge_index;
-    for (unsigned int i = cj_data->m_initial_edge_index; i < (cj_data->m_loop ? points_size : points_size - 1); ++i) {
-        const dVector& pt1 = cj_data->m_points[pt_index];
-        const dVector& pt2 = cj_data->m_points[(i == points_size - 1 && cj_data->m_loop) ? 0 : i + 1];
-        dVector dir(pt2 - pt1);
-        dFloat mag = Util::get_vector_magnitude(dir);
-        if (mag > M_EPSILON) {
-            Util::scale_vector(dir, 1.0f / mag);
-            EdgeData *edge_data = new EdgeData(mag, 0.0f, pt_index, i + 1);
-            Util::rotate_matrix_to_dir(last_matrix, dir, edge_data->m_normal_matrix);
-            edge_data->m_normal_matrix.m_posit = cj_data->m_points[pt_index];
-            temp_edges[pt_index] = edge_data;
-            last_matrix = edge_data->m_normal_matrix;
-            pt_index = i + 1;
-            cj_data->m_curve_len += mag;
-        }
-    }
-    // As well as all the preceding edge normals from the current index.
-    last_matrix = joint_data->m_local_matrix1 * joint_data->m_local_matrix2.Inverse();
-    pt_index = cj_data->m_initial_edge_index;
-    for (unsigned int i = cj_data->m_initial_edge_index; i > 0; --i) {
-        const dVector& pt1 = cj_data->m_points[i - 1];
-        const dVector& pt2 = cj_data->m_points[pt_index];
-        dVector dir(pt2 - pt1);
-        dFloat mag = Util::get_vector_magnitude(dir);
-        if (mag > M_EPSILON) {
-            Util::scale_vector(dir, 1.0f / mag);
-            EdgeData *edge_data = new EdgeData(mag, 0.0f, i - 1, pt_index);
-            Util::rotate_matrix_to_dir(last_matrix, dir, edge_data->m_normal_matrix);
-            edge_data->m_normal_matrix.m_posit = cj_data->m_points[i - 1];
-            temp_edges[i - 1] = edge_data;
-            last_matrix = edge_data->m_normal_matrix;
-            pt_index = i - 1;
-            cj_data->m_curve_len += mag;
-        }
-    }
-    // Update the edges map so there is no jumps in indexes
-    dFloat elapsed_curve_len = 0.0f;
-    unsigned int index = 0;
-    for (std::map<unsigned int, EdgeData*>::iterator it = temp_edges.begin(); it != temp_edges.end(); ++it) {
-        cj_data->m_edges[index] = it->second;
-        it->second->m_preceding_curve_length = elapsed_curve_len;
-        ++index;
-        elapsed_curve_len += it->second->m_length;
-    }
-    temp_edges.clear();
-}
-
-bool MSP::CurvyPiston::c_calc_curve_data_at_position(const MSP::Joint::JointData* joint_data, dFloat position, dMatrix& normal_matrix, dFloat &distance, dFloat &overpass) {
-    if (!joint_data->m_connected) return false;
-    const CurvyPistonData* cj_data = reinterpret_cast<CurvyPistonData*>(joint_data->m_cj_data);
-    if (cj_data->m_loop) {
-        distance = fmod(position, cj_data->m_curve_len);
-        if (distance < 0.0f) distance += cj_data->m_curve_len;
-        overpass = 0.0f;
-    }
-    else {
-        distance = Util::clamp_float(position, 0.0f, cj_data->m_curve_len);
-        overpass = position - distance;
-        if (overpass < -M_EPSILON) {
-            normal_matrix = cj_data->m_edges.begin()->second->m_normal_matrix;
-            return true;
-        }
-        else if (overpass > M_EPSILON) {
-            const EdgeData* edge_data = cj_data->m_edges.rbegin()->second;
-            normal_matrix = edge_data->m_normal_matrix;
-            normal_matrix.m_posit = normal_matrix.m_posit + normal_matrix.m_right.Scale(edge_data->m_length);
-            return true;
-        }
-    }
-    dFloat traveled_dist = 0.0f;
-    for (std::map<unsigned int, EdgeData*>::const_iterator it = cj_data->m_edges.begin(); it != cj_data->m_edges.end(); ++it) {
-        const EdgeData* edge_data = it->second;
-        if (traveled_dist + edge_data->m_length >= distance) {
-            normal_matrix = edge_data->m_normal_matrix;
-            normal_matrix.m_posit = normal_matrix.m_posit + normal_matrix.m_right.Scale(distance - traveled_dist);
-            return true;
-        }
-        traveled_dist += edge_data->m_length;
-    }
-    const EdgeData* edge_data = cj_data->m_edges.rbegin()->second;
-    normal_matrix = edge_data->m_normal_matrix;
-    normal_matrix.m_posit = normal_matrix.m_posit + normal_matrix.m_right.Scale(edge_data->m_length);
-    return true;
-}
-
-bool MSP::CurvyPiston::c_calc_curve_data_at_point(const MSP::Joint::JointData* joint_data, const dVector &location, dMatrix& normal_matrix, dFloat &distance, dFloat &overpass) {
-    if (!joint_data->m_connected) return false;
-    const CurvyPistonData* cj_data = reinterpret_cast<CurvyPistonData*>(joint_data->m_cj_data);
-    // Find the closest point on curve
-    dVector closest_point;
-    dFloat closest_distance = 0.0f;
-    dFloat closest_left_over = 0.0f;
-    unsigned int closest_normal1_index;
-    unsigned int closest_normal2_index;
-    bool closest_set = false;
-    for (std::map<unsigned int, EdgeData*>::const_iterator it = cj_data->m_edges.begin(); it != cj_data->m_edges.end(); ++it) {
-        const EdgeData* edge_data = it->second;
-        dFloat lpointz = (location - edge_data->m_normal_matrix.m_posit).DotProduct3(edge_data->m_normal_matrix.m_right);
-        dVector cpoint;
-        dFloat section_dist;
-        dFloat left_over;
-        unsigned int normal1_index;
-        unsigned int normal2_index;
-        if (lpointz < 0.0f) {
-            normal1_index = it->first - 1;
-            normal2_index = it->first;
-            cpoint = cj_data->m_points[edge_data->m_start_index];
-            section_dist = 0.0f;
-            left_over = lpointz;
-        }
-        else if (lpointz > edge_data->m_length) {
-            normal1_index = it->first;
-            normal2_index = it->first + 1;
-            cpoint = cj_data->m_points[edge_data->m_end_index];
-            section_dist = edge_data->m_length;
-            left_over = lpointz - edge_data->m_length;
-        }
-        else {
-            normal1_index = it->first;
-            normal2_index = it->first;
-            cpoint = edge_data->m_normal_matrix.m_posit + edge_data->m_normal_matrix.m_right.Scale(lpointz);
-            section_dist = lpointz;
-            left_over = 0.0f;
-        }
-        dFloat cdist = Util::get_vector_magnitude2(location - cpoint);
-        if (!closest_set || cdist < closest_distance) {
-            distance = edge_data->m_preceding_curve_length + section_dist;
-            closest_point = cpoint;
-            closest_distance = cdist;
-            closest_normal1_index = normal1_index;
-            closest_normal2_index = normal2_index;
-            closest_left_over = left_over;
-            closest_set = true;
-            if (closest_distance < M_EPSILON) break;
-        }
-    }
-    if (!closest_set)
-        return false;
-    // Calculate the normal at point
-    std::map<unsigned int, EdgeData*>::const_iterator it1(cj_data->m_edges.find(closest_normal1_index));
-    std::map<unsigned int, EdgeData*>::const_iterator it2(cj_data->m_edges.find(closest_normal2_index));
-    if (it1 == cj_data->m_edges.end()) {
-        if (cj_data->m_loop)
-            it1 = cj_data->m_edges.find(cj_data->m_edges.rbegin()->first);
-        else
-            it1 = it2;
-    }
-    else if (it2 == cj_data->m_edges.end()) {
-        if (cj_data->m_loop)
-            it2 = cj_data->m_edges.begin();
-        else
-            it2 = it1;
-    }
-    dFloat cos_angle = it1->second->m_normal_matrix.m_right.DotProduct3(it2->second->m_normal_matrix.m_right);
-    if (dAbs(cos_angle) > 0.999995f) {
-        normal_matrix = it1->second->m_normal_matrix;
-        if (it1 == it2 && !cj_data->m_loop)
-            overpass = closest_left_over;
-        else
-            overpass = 0.0f;
-    }
-    else {
-        if (dSqrt(closest_distance) > M_EPSILON) {
-            dVector udir(it1->second->m_normal_matrix.m_right.CrossProduct(it2->second->m_normal_matrix.m_right));
-            dVector vdir(location - closest_point);
-            dVector zdir(udir.CrossProduct(vdir));
-            dFloat mag = Util::get_vector_magnitude(zdir);
-            if (mag > M_EPSILON)
-                Util::rotate_matrix_to_dir(it1->second->m_normal_matrix, zdir, normal_matrix);
-            else
-                normal_matrix = it1->second->m_normal_matrix;
-        }
-        else
-            normal_matrix = it1->second->m_normal_matrix;
-        overpass = 0.0f;
-    }
-    normal_matrix.m_posit = closest_point;
-    return closest_set;
-}
-
-bool MSP::CurvyPiston::c_calc_curve_data_at_point2(const MSP::Joint::JointData* joint_data, const dVector& location, dVector& point, dVector& vector, dFloat &distance, unsigned int &edge_index) {
-    const CurvyPistonData* cj_data = reinterpret_cast<CurvyPistonData*>(joint_data->m_cj_data);
-    unsigned int points_size = (unsigned int)cj_data->m_points.size();
-    if (points_size < 2) return false;
-    dFloat closest_dist = 0.0f;
-    dFloat closest_left_over = 0.0f;
-    bool closest_set = false;
-    dFloat traveled_dist = 0.0f;
-    unsigned int pt1_index = 0;
-    for (unsigned int i = 0; i < (cj_data->m_loop ? points_size : points_size - 1); ++i) {
-        const dVector& pt1 = cj_data->m_points[pt1_index];
-        const dVector& pt2 = cj_data->m_points[(i == points_size - 1 && cj_data->m_loop) ? 0 : i + 1];
-        dVector edge_dir(pt2 - pt1);
-        dFloat edge_len = Util::get_vector_magnitude(edge_dir);
-        if (edge_len > M_EPSILON) {
-            Util::scale_vector(edge_dir, 1.0f / edge_len);
-            dFloat lpointz = (location - pt1).DotProduct3(edge_dir);
-            dVector cpoint;
-            dFloat section_dist;
-            dFloat left_over;
-            if (lpointz < 0.0f) {
-                cpoint = pt1;
-                section_dist = 0.0f;
-                left_over = lpointz;
-            }
-            else if (lpointz > edge_len) {
-                cpoint = pt2;
-                section_dist = edge_len;
-                left_over = lpointz - edge_len;
-            }
-            else {
-                cpoint = pt1 + edge_dir.Scale(lpointz);
-                section_dist = lpointz;
-                left_over = 0.0f;
-            }
-            dFloat cdist = Util::get_vector_magnitude2(location - cpoint);
-            if (!closest_set || cdist < closest_dist) {
-                closest_dist = cdist;
-                closest_left_over = left_over;
-                distance = traveled_dist + section_dist;
-                if (dAbs(left_over) < M_EPSILON) {
-                    point = cpoint;
-                    vector = edge_dir;
-                    edge_index = i;
-                }
-                closest_set = true;
-            }
-            traveled_dist += edge_len;
-            pt1_index = i + 1;
-        }
-    }
-    if (!closest_set) return false;
-    if (dAbs(closest_left_over) > M_EPSILON) {
-        dFloat temp_curve_len = 0.0f;
-        pt1_index = 0;
-        for (unsigned int i = 0; i < (cj_data->m_loop ? points_size : points_size - 1); ++i) {
-            const dVector& pt1 = cj_data->m_points[pt1_index];
-            const dVector& pt2 = cj_data->m_points[(i == points_size - 1 && cj_data->m_loop) ? 0 : i + 1];
-            dVector edge_dir(pt2 - pt1);
-            dFloat edge_len = Util::get_vector_magnitude(edge_dir);
-            if (edge_len > M_EPSILON) {
-                temp_curve_len += edge_len;
-                pt1_index = i + 1;
-            }
-        }
-        distance += closest_left_over;
-        if (cj_data->m_loop) {
-            distance = fmod(distance, temp_curve_len);
-            if (distance < 0.0f) distance += temp_curve_len;
-        }
-        else
-            distance = Util::clamp_float(distance, 0.0f, temp_curve_len);
-        traveled_dist = 0.0f;
-        pt1_index = 0;
-        for (unsigned int i = 0; i < (cj_data->m_loop ? points_size : points_size - 1); ++i) {
-            const dVector& pt1 = cj_data->m_points[pt1_index];
-            const dVector& pt2 = cj_data->m_points[(i == points_size - 1 && cj_data->m_loop) ? 0 : i + 1];
-            dVector edge_dir(pt2 - pt1);
-            dFloat edge_len = Util::get_vector_magnitude(edge_dir);
-            if (edge_len > M_EPSILON) {
-                if (traveled_dist + edge_len >= distance) {
-                    Util::scale_vector(edge_dir, 1.0f / edge_len);
-                    point = pt1 + edge_dir.Scale(distance - traveled_dist);
-                    vector = edge_dir;
-                    edge_index = pt1_index;
-                    break;
-                }
-                traveled_dist += edge_len;
-                pt1_index = i + 1;
-            }
-        }
+    if (cj_data->m_curve != nullptr && cj_data->m_curve->m_loop != cj_data->m_loop)
+        c_detach_curve(joint_data);
+    if (cj_data->m_curve == nullptr) {
+        if (cj_data->m_points.size() < 2) return;
+        cj_data->m_curve = MSP::Joint::c_acquire_curve(cj_data->m_points, cj_data->m_loop);
+        std::vector<dVector>().swap(cj_data->m_points);
     }
-    return true;
+    const MSP::Joint::CurveData* curve = cj_data->m_curve;
+    if (curve->m_edges.empty()) return;
+    cj_data->m_curve_len = curve->m_length;
+    // Orient the shared edge frames, so that the frame of the initial edge is the pin rotated to the edge.
+    const MSP::Joint::CurveEdge& edge_data = curve->m_edges[MSP::Joint::c_find_curve_edge_at_point(curve, cj_data->m_initial_edge_index)];
+    dMatrix initial_matrix;
+    Util::rotate_matrix_to_dir(joint_data->m_local_matrix1 * joint_data->m_local_matrix2.Inverse(), edge_data.m_normal_matrix.m_right, initial_matrix);
+    initial_matrix.m_posit = edge_data.m_normal_matrix.m_posit;
+    cj_data->m_curve_twist = initial_matrix * edge_data.m_normal_matrix.Inverse();
 }
 
-bool MSP::CurvyPiston::c_calc_curve_data_at_point3(const MSP::Joint::JointData* joint_data, dFloat last_dist, const dVector &location, dMatrix& normal_matrix, dFloat &distance, dFloat &overpass) {
-    if (!joint_data->m_connected) return false;
-    const CurvyPistonData* cj_data = reinterpret_cast<CurvyPistonData*>(joint_data->m_cj_data);
-    // Find the current edge data.
-    const EdgeData* cur_edge_data = nullptr;
-    if (last_dist <= M_EPSILON)
-        cur_edge_data = cj_data->m_edges.begin()->second;
-    else if (last_dist >= cj_data->m_curve_len - M_EPSILON)
-        cur_edge_data = cj_data->m_edges.rbegin()->second;
-    else {
-        for (std::map<unsigned int, EdgeData*>::const_iterator it = cj_data->m_edges.begin(); it != cj_data->m_edges.end(); ++it) {
-            const EdgeData* edge_data = it->second;
-            if (last_dist >= edge_data->m_preceding_curve_length && last_dist < edge_data->m_preceding_curve_length + edge_data->m_length) {
-                cur_edge_data = edge_data;
-                break;
-            }
-        }
-        if (cur_edge_data == nullptr) return false;
-    }
-    // First check if the location denotes the current edge data.
-    dFloat cur_lpointz = (location - cur_edge_data->m_normal_matrix.m_posit).DotProduct3(cur_edge_data->m_normal_matrix.m_right);
-    if (cur_lpointz >= 0.0f && cur_lpointz <= cur_edge_data->m_length) {
-        normal_matrix = cur_edge_data->m_normal_matrix;
-        normal_matrix.m_posit += normal_matrix.m_right.Scale(cur_lpointz);
-        distance = cur_edge_data->m_preceding_curve_length + cur_lpointz;
-        overpass = 0.0f;
-        return true;
-    }
-    // Otherwise check all the preceding and consequent edges.
-    unsigned int total_edges_count = (unsigned int)cj_data->m_edges.size();
-    bool found_potential_ref_point = false;
-    if (cj_data->m_loop) {
-        // Check all the preceding edges until reach the half curve length.
-        // Do first run in reverse, starting from the current edge and proceeding until we reach the beginning.
-        dFloat previous_left_over = 0.0f;
-        const EdgeData* previous_edge_data = nullptr;
-        bool previous_set = false;
-        bool cur_edge_data_found = false;
-        for (std::map<unsigned int, EdgeData*>::const_reverse_iterator it = cj_data->m_edges.rbegin(); it != cj_data->m_edges.rend(); ++it) {
-            // Skip until we reach the current edge index
-            if (!cur_edge_data_found) {
-                if (it->second == cur_edge_data)
-                    cur_edge_data_found = true;
-                else
-                    continue;
-            }
-            // Otherwise do the processing
-            const EdgeData* edge_data = it->second;
-            dFloat lpointz = (location - edge_data->m_normal_matrix.m_posit).DotProduct3(edge_data->m_normal_matrix.m_right);
-            dFloat left_over = 0.0f;
-            if (lpointz < 0.0f)
-                left_over = lpointz;
-            else if (lpointz > edge_data->m_length)
-                left_over = lpointz - edge_data->m_length;
-            else {
-                // Snap to edge when left over is zero
-                normal_matrix = edge_data->m_normal_matrix;
-                normal_matrix.m_posit = edge_data->m_normal_matrix.m_posit + edge_data->m_normal_matrix.m_right.Scale(lpointz);
-                distance = edge_data->m_preceding_curve_length + lpointz;
-                overpass = 0.0f;
-                found_potential_ref_point = true;
-                break;
-            }
-            // Snap to point of the previous edge in case left_over changes from negative to positive
-            if (previous_set && previous_left_over < 0.0f && left_over > 0.0f) {
-                c_calc_pivot_normal(edge_data->m_normal_matrix, previous_edge_data->m_normal_matrix, previous_edge_data->m_normal_matrix.m_posit, location, normal_matrix);
-                distance = previous_edge_data->m_preceding_curve_length;
-                overpass = 0.0f;
-                found_potential_ref_point = true;
-                break;
-            }
-            // Update previous data
-            previous_edge_data = edge_data;
-            previous_left_over = left_over;
-            previous_set = true;
-        }
-        // Do the second run in reverse, starting from the end and proceeding until we reach the current edge.
-        if (!found_potential_ref_point) {
-            //~ previous_set = false;
-            for (std::map<unsigned int, EdgeData*>::const_reverse_iterator it = cj_data->m_edges.rbegin(); it != cj_data->m_edges.rend(); ++it) {
-                // Break when we reach the current edge index
-                if (it->second == cur_edge_data) break;
-                // Otherwise do the processing
-                const EdgeData* edge_data = it->second;
-                dFloat lpointz = (location - edge_data->m_normal_matrix.m_posit).DotProduct3(edge_data->m_normal_matrix.m_right);
-                dFloat left_over = 0.0f;
-                if (lpointz < 0.0f)
-                    left_over = lpointz;
-                else if (lpointz > edge_data->m_length)
-                    left_over = lpointz - edge_data->m_length;
-                else {
-                    // Snap to edge when left over is zero
-                    normal_matrix = edge_data->m_normal_matrix;
-                    normal_matrix.m_posit = edge_data->m_normal_matrix.m_posit + edge_data->m_normal_matrix.m_right.Scale(lpointz);
-                    distance = edge_data->m_preceding_curve_length + lpointz;
-                    overpass = 0.0f;
-                    found_potential_ref_point = true;
-                    break;
-                }
-                // Snap to point of the previous edge in case left_over changes from negative to positive
-                if (previous_set && previous_left_over < 0.0f && left_over > 0.0f) {
-                    c_calc_pivot_normal(edge_data->m_normal_matrix, previous_edge_data->m_normal_matrix, previous_edge_data->m_normal_matrix.m_posit, location, normal_matrix);
-                    distance = previous_edge_data->m_preceding_curve_length;
-                    overpass = 0.0f;
-                    found_potential_ref_point = true;
-                    break;
-                }
-                // Update previous data
-                previous_edge_data = edge_data;
-                previous_left_over = left_over;
-                previous_set = true;
-            }
-        }
-        // Check all the succeeding edges until reach the half curve length.
-        // Do first run, starting from the current edge and proceeding until we reach the end.
-        previous_set = false;
-        cur_edge_data_found = false;
-        for (std::map<unsigned int, EdgeData*>::const_iterator it = cj_data->m_edges.begin(); it != cj_data->m_edges.end(); ++it) {
-            // Skip until we reach the current edge index
-            if (!cur_edge_data_found) {
-                if (it->second == cur_edge_data)
-                    cur_edge_data_found = true;
-                else
-                    continue;
-            }
-            // Otherwise do the processing
-            const EdgeData* edge_data = it->second;
-            dFloat lpointz = (location - edge_data->m_normal_matrix.m_posit).DotProduct3(edge_data->m_normal_matrix.m_right);
-            dFloat left_over = 0.0f;
-            if (lpointz < 0.0f)
-                left_over = lpointz;
-            else if (lpointz > edge_data->m_length)
-                left_over = lpointz - edge_data->m_length;
-            else {
-                // Snap to edge when left over is zero
-                if (found_potential_ref_point) {
-                    dFloat original_dist1 = dAbs(last_dist - distance);
-                    dFloat original_dist2 = cj_data->m_curve_len - original_dist1;
-                    dFloat current_dist1 = dAbs(edge_data->m_preceding_curve_length + lpointz - last_dist);
-                    dFloat current_dist2 = cj_data->m_curve_len - current_dist1;
-                    dFloat min_original_dist = (original_dist1 < original_dist2) ? original_dist1 : original_dist2;
-                    dFloat min_current_dist = (current_dist1 < current_dist2) ? current_dist1 : current_dist2;
-                    if (min_original_dist <= min_current_dist) return true;
-                }
-                normal_matrix = edge_data->m_normal_matrix;
-                normal_matrix.m_posit = edge_data->m_normal_matrix.m_posit + edge_data->m_normal_matrix.m_right.Scale(lpointz);
-                distance = edge_data->m_preceding_curve_length + lpointz;
-                overpass = 0.0f;
-                return true;
-            }
-            // Snap to point of the current edge in case left_over changes from positive to negative
-            if (previous_set && previous_left_over > 0.0f && left_over < 0.0f) {
-                if (found_potential_ref_point) {
-                    dFloat original_dist1 = dAbs(last_dist - distance);
-                    dFloat original_dist2 = cj_data->m_curve_len - original_dist1;
-                    dFloat current_dist1 = dAbs(edge_data->m_preceding_curve_length - last_dist);
-                    dFloat current_dist2 = cj_data->m_curve_len - current_dist1;
-                    dFloat min_original_dist = (original_dist1 < original_dist2) ? original_dist1 : original_dist2;
-                    dFloat min_current_dist = (current_dist1 < current_dist2) ? current_dist1 : current_dist2;
-                    if (min_original_dist <= min_current_dist) return true;
-                }
-                c_calc_pivot_normal(previous_edge_data->m_normal_matrix, edge_data->m_normal_matrix, edge_data->m_normal_matrix.m_posit, location, normal_matrix);
-                distance = edge_data->m_preceding_curve_length;
-                overpass = 0.0f;
-                return true;
-            }
-            // Update previous data
-            previous_edge_data = edge_data;
-            previous_left_over = left_over;
-            previous_set = true;
-        }
-        // Do second run, starting from the beginning and proceeding until we reach the current edge.
-        //~ previous_set = false;
-        for (std::map<unsigned int, EdgeData*>::const_iterator it = cj_data->m_edges.begin(); it != cj_data->m_edges.end(); ++it) {
-            // Break when we reach the current edge index
-            if (it->second == cur_edge_data) break;
-            // Otherwise do the processing
-            const EdgeData* edge_data = it->second;
-            dFloat lpointz = (location - edge_data->m_normal_matrix.m_posit).DotProduct3(edge_data->m_normal_matrix.m_right);
-            dFloat left_over = 0.0f;
-            if (lpointz < 0.0f)
-                left_over = lpointz;
-            else if (lpointz > edge_data->m_length)
-                left_over = lpointz - edge_data->m_length;
-            else {
-                // Snap to edge when left over is zero
-                if (found_potential_ref_point) {
-                    dFloat original_dist1 = dAbs(last_dist - distance);
-                    dFloat original_dist2 = cj_data->m_curve_len - original_dist1;
-                    dFloat current_dist1 = dAbs(edge_data->m_preceding_curve_length + lpointz - last_dist);
-                    dFloat current_dist2 = cj_data->m_curve_len - current_dist1;
-                    dFloat min_original_dist = (original_dist1 < original_dist2) ? original_dist1 : original_dist2;
-                    dFloat min_current_dist = (current_dist1 < current_dist2) ? current_dist1 : current_dist2;
-                    if (min_original_dist <= min_current_dist) return true;
-                }
-                normal_matrix = edge_data->m_normal_matrix;
-                normal_matrix.m_posit = edge_data->m_normal_matrix.m_posit + edge_data->m_normal_matrix.m_right.Scale(lpointz);
-                distance = edge_data->m_preceding_curve_length + lpointz;
-                overpass = 0.0f;
-                return true;
-            }
-            // Snap to point of the current edge in case left_over changes from positive to negative
-            if (previous_set && previous_left_over > 0.0f && left_over < 0.0f) {
-                if (found_potential_ref_point) {
-                    dFloat original_dist1 = dAbs(last_dist - distance);
-                    dFloat original_dist2 = cj_data->m_curve_len - original_dist1;
-                    dFloat current_dist1 = dAbs(edge_data->m_preceding_curve_length - last_dist);
-                    dFloat current_dist2 = cj_data->m_curve_len - current_dist1;
-                    dFloat min_original_dist = (original_dist1 < original_dist2) ? original_dist1 : original_dist2;
-                    dFloat min_current_dist = (current_dist1 < current_dist2) ? current_dist1 : current_dist2;
-                    if (min_original_dist <= min_current_dist) return true;
-                }
-                c_calc_pivot_normal(previous_edge_data->m_normal_matrix, edge_data->m_normal_matrix, edge_data->m_normal_matrix.m_posit, location, normal_matrix);
-                distance = edge_data->m_preceding_curve_length;
-                overpass = 0.0f;
-                return true;
-            }
-            // Update previous data
-            previous_edge_data = edge_data;
-            previous_left_over = left_over;
-            previous_set = true;
-        }
-        // If nothing found, snap to the starting point.
-        if (!found_potential_ref_point) {
-            const EdgeData* edge_data1 = cj_data->m_edges.rbegin()->second;
-            const EdgeData* edge_data2 = cj_data->m_edges.begin()->second;
-            c_calc_pivot_normal(edge_data1->m_normal_matrix, edge_data2->m_normal_matrix, edge_data2->m_normal_matrix.m_posit, location, normal_matrix);
-            distance = 0.0f;
-            overpass = 0.0f;
-            return true;
-        }
-    }
-    else { // Loop disabled
-        // Find the closest preceding edge
-        dFloat previous_left_over = 0.0f;
-        const EdgeData* previous_edge_data = nullptr;
-        bool previous_set = false;
-        bool cur_edge_data_found = false;
-        for (std::map<unsigned int, EdgeData*>::const_reverse_iterator it = cj_data->m_edges.rbegin(); it != cj_data->m_edges.rend(); ++it) {
-            // Skip until we reach the current edge index
-            if (!cur_edge_data_found) {
-                if (it->second == cur_edge_data)
-                    cur_edge_data_found = true;
-                else
-                    continue;
-            }
-            // Otherwise do the processing
-            const EdgeData* edge_data = it->second;
-            dFloat lpointz = (location - edge_data->m_normal_matrix.m_posit).DotProduct3(edge_data->m_normal_matrix.m_right);
-            dFloat left_over = 0.0f;
-            if (lpointz < 0.0f) {
-                left_over = lpointz;
-                // Minimum limit
-                if (it->first == 0) {
-                    normal_matrix = edge_data->m_normal_matrix;
-                    distance = 0.0f;
-                    overpass = left_over;
-                    found_potential_ref_point = true;
-                    break;
-                }
-            }
-            else if (lpointz > edge_data->m_length)
-                left_over = lpointz - edge_data->m_length;
-            else {
-                // Snap to edge when left over is zero
-                normal_matrix = edge_data->m_normal_matrix;
-                normal_matrix.m_posit = edge_data->m_normal_matrix.m_posit + edge_data->m_normal_matrix.m_right.Scale(lpointz);
-                distance = edge_data->m_preceding_curve_length + lpointz;
-                overpass = 0.0f;
-                found_potential_ref_point = true;
-                break;
-            }
-            // Snap to point of the previous edge in case left_over changes from negative to positive
-            if (previous_set && previous_left_over < 0.0f && left_over > 0.0f) {
-                c_calc_pivot_normal(edge_data->m_normal_matrix, previous_edge_data->m_normal_matrix, previous_edge_data->m_normal_matrix.m_posit, location, normal_matrix);
-                distance = previous_edge_data->m_preceding_curve_length;
-                overpass = 0.0f;
-                found_potential_ref_point = true;
-                break;
-            }
-            // Update previous data
-            previous_edge_data = edge_data;
-            previous_left_over = left_over;
-            previous_set = true;
-        }
-        // Find the closest succeeding point
-        previous_set = false;
-        cur_edge_data_found = false;
-        for (std::map<unsigned int, EdgeData*>::const_iterator it = cj_data->m_edges.begin(); it != cj_data->m_edges.end(); ++it) {
-            // Skip until we reach the current edge index
-            if (!cur_edge_data_found) {
-                if (it->second == cur_edge_data)
-                    cur_edge_data_found = true;
-                else
-                    continue;
-            }
-            // Otherwise do the processing
-            const EdgeData* edge_data = it->second;
-            dFloat lpointz = (location - edge_data->m_normal_matrix.m_posit).DotProduct3(edge_data->m_normal_matrix.m_right);
-            dFloat left_over = 0.0f;
-            if (lpointz < 0.0f)
-                left_over = lpointz;
-            else if (lpointz > edge_data->m_length) {
-                left_over = lpointz - edge_data->m_length;
-                // Maximum limit
-                if (it->first == total_edges_count - 1) {
-                    if (found_potential_ref_point) {
-                        dFloat original_dist = dAbs(last_dist - distance);
-                        dFloat current_dist = dAbs(cj_data->m_curve_len - last_dist);
-                        if (original_dist <= current_dist) return true;
-                    }
-                    normal_matrix = edge_data->m_normal_matrix;
-                    normal_matrix.m_posit = edge_data->m_normal_matrix.m_posit + edge_data->m_normal_matrix.m_right.Scale(edge_data->m_length);
-                    distance = cj_data->m_curve_len;
-                    overpass = left_over;
-                    return true;
-                }
-            }
-            else {
-                // Snap to edge when left over is zero
-                if (found_potential_ref_point) {
-                    dFloat original_dist = dAbs(last_dist - distance);
-                    dFloat current_dist = dAbs(edge_data->m_preceding_curve_length + lpointz - last_dist);
-                    if (original_dist <= current_dist) return true;
-                }
-                normal_matrix = edge_data->m_normal_matrix;
-                normal_matrix.m_posit = edge_data->m_normal_matrix.m_posit + edge_data->m_normal_matrix.m_right.Scale(lpointz);
-                distance = edge_data->m_preceding_curve_length + lpointz;
-                overpass = 0.0f;
-                return true;
-            }
-            // Snap to point of the current edge in case left_over changes from positive to negative
-            if (previous_set && previous_left_over > 0.0f && left_over < 0.0f) {
-                if (found_potential_ref_point) {
-                    dFloat original_dist = dAbs(last_dist - distance);
-                    dFloat current_dist = dAbs(edge_data->m_preceding_curve_length - last_dist);
-                    if (original_dist <= current_dist) return true;
-                }
-                c_calc_pivot_normal(previous_edge_data->m_normal_matrix, edge_data->m_normal_matrix, edge_data->m_normal_matrix.m_posit, location, normal_matrix);
-                distance = edge_data->m_preceding_curve_length;
-                overpass = 0.0f;
-                return true;
-            }
-            // Update previous data
-            previous_edge_data = edge_data;
-            previous_left_over = left_over;
-            previous_set = true;
-        }
-    }
-    return found_potential_ref_point;
+void MSP::CurvyPiston::c_detach_curve(MSP::Joint::JointData* joint_data) {
+    CurvyPistonData* cj_data = reinterpret_cast<CurvyPistonData*>(joint_data->m_cj_data);
+    if (cj_data->m_curve == nullptr) return;
+    // The curve may be in use by the pending update.
+    MSP::World::c_wait_for_update(joint_data->m_world);
+    cj_data->m_points = cj_data->m_curve->m_points;
+    MSP::Joint::c_release_curve(cj_data->m_curve);
+    cj_data->m_curve = nullptr;
 }
 
-void MSP::CurvyPiston::c_calc_pivot_normal(const dMatrix& normal_matrix1, const dMatrix& normal_matrix2, const dVector& pivot_point, const dVector& location, dMatrix& normal_matrix_out) {
-    dFloat cos_angle = normal_matrix1.m_right.DotProduct3(normal_matrix2.m_right);
-    if (dAbs(cos_angle) > 0.999995f)
-        normal_matrix_out = normal_matrix1;
-    else {
-        if (Util::get_vector_magnitude2(location - pivot_point) > M_EPSILON) {
-            dVector udir(normal_matrix1.m_right.CrossProduct(normal_matrix2.m_right));
-            dVector vdir(location - pivot_point);
-            dVector zdir(udir.CrossProduct(vdir));
-            dFloat mag = Util::get_vector_magnitude2(zdir);
-            if (mag > M_EPSILON)
-                Util::rotate_matrix_to_dir(normal_matrix1, zdir, normal_matrix_out);
-            else
-                normal_matrix_out = normal_matrix1;
-        }
-        else
-            normal_matrix_out = normal_matrix1;
-    }
-    normal_matrix_out.m_posit = pivot_point;
+const std::vector<dVector>& MSP::CurvyPiston::c_get_points(const CurvyPistonData* cj_data) {
+    return (cj_data->m_curve != nullptr) ? cj_data->m_curve->m_points : cj_data->m_points;
 }
 
 
@@ -721,10 +99,11 @@ void MSP::CurvyPiston::submit_constraints(const NewtonJoint* joint, dFloat times
     dVector location(matrix2.UntransformVector(matrix0.m_posit));
     dMatrix loc_normal_matrix;
     dFloat distance, overpass;
-    if (!c_calc_curve_data_at_point3(joint_data, cj_data->m_cur_dist, location, loc_normal_matrix, distance, overpass)) {
+    if (cj_data->m_curve == nullptr || !MSP::Joint::c_calc_curve_data_at_point3(cj_data->m_curve, cj_data->m_cur_dist, cj_data->m_cur_edge_index, location, loc_normal_matrix, distance, overpass)) {
         cj_data->m_cur_normal_matrix_set = false;
         return;
     }
+    loc_normal_matrix = cj_data->m_curve_twist * loc_normal_matrix;
     dMatrix normal_matrix(loc_normal_matrix * matrix2);
     cj_data->m_cur_normal_matrix = normal_matrix;
     cj_data->m_cur_normal_matrix_set = true;
@@ -743,6 +122,7 @@ void MSP::CurvyPiston::submit_constraints(const NewtonJoint* joint, dFloat times
     cj_data->m_cur_vel = (cj_data->m_cur_pos - last_pos) * inv_timestep;
     cj_data->m_cur_accel = (cj_data->m_cur_vel - last_vel) * inv_timestep;
     cj_data->m_cur_dist = distance;
+    cj_data->m_cur_edge_index = MSP::Joint::c_find_curve_edge_at_distance(cj_data->m_curve, distance, cj_data->m_cur_edge_index);
 
     dFloat des_accel = 0.0f;
     if (cj_data->m_controller_enabled) {
@@ -961,7 +341,7 @@ void MSP::CurvyPiston::adjust_pin_matrix_proc(MSP::Joint::JointData* joint_data,
     dVector point, vector;
     NewtonBodyGetMatrix(joint_data->m_child, &matrix[0][0]);
     dVector origin(pin_matrix.UntransformVector(matrix.m_posit));
-    if (c_calc_curve_data_at_point2(joint_data, origin, point, vector, cj_data->m_cur_pos, cj_data->m_initial_edge_index)) {
+    if (MSP::Joint::c_calc_curve_data_at_point2(c_get_points(cj_data), cj_data->m_loop, origin, point, vector, cj_data->m_cur_pos, cj_data->m_initial_edge_index)) {
         point = pin_matrix.TransformVector(point);
         vector = pin_matrix.RotateVector(vector);
         Util::matrix_from_pin_dir(point, vector, pin_matrix);
@@ -970,6 +350,31 @@ void MSP::CurvyPiston::adjust_pin_matrix_proc(MSP::Joint::JointData* joint_data,
     }
 }
 
+void MSP::CurvyPiston::set_controller_proc(MSP::Joint::JointData* joint_data, dFloat controller, bool enabled) {
+    CurvyPistonData* cj_data = reinterpret_cast<CurvyPistonData*>(joint_data->m_cj_data);
+    if (!enabled) {
+        if (cj_data->m_controller_enabled) {
+            cj_data->m_controller_enabled = false;
+            if (joint_data->m_connected)
+                NewtonBodySetSleepState(joint_data->m_child, 0);
+        }
+    }
+    else {
+        if (cj_data->m_controller_mode == 0)
+             controller *= M_METER_TO_INCH;
+        if (!cj_data->m_controller_enabled || controller != cj_data->m_controller) {
+            cj_data->m_controller = controller;
+            cj_data->m_controller_enabled = true;
+            if (joint_data->m_connected)
+                NewtonBodySetSleepState(joint_data->m_child, 0);
+        }
+    }
+}
+
+const MSP::Joint::CurveData* MSP::CurvyPiston::get_curve_proc(MSP::Joint::JointData* joint_data) {
+    return reinterpret_cast<CurvyPistonData*>(joint_data->m_cj_data)->m_curve;
+}
+
 
 /*
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -978,8 +383,8 @@ void MSP::CurvyPiston::adjust_pin_matrix_proc(MSP::Joint::JointData* joint_data,
 */
 
 VALUE MSP::CurvyPiston::rbf_is_valid(VALUE self, VALUE v_joint) {
-    MSP::Joint::JointData* address = reinterpret_cast<MSP::Joint::JointData*>(Util::value_to_ull(v_joint));
-    return (MSP::Joint::c_is_joint_valid(address) && address->m_jtype == MSP::Joint::CURVY_PISTON) ? Qtrue : Qfalse;
+    MSP::Joint::JointData* address = MSP::Joint::s_valid_joints.find(Util::value_to_ull(v_joint));
+    return (address != nullptr && address->m_jtype == MSP::Joint::CURVY_PISTON) ? Qtrue : Qfalse;
 }
 
 VALUE MSP::CurvyPiston::rbf_create(VALUE self, VALUE v_joint) {
@@ -994,6 +399,8 @@ VALUE MSP::CurvyPiston::rbf_create(VALUE self, VALUE v_joint) {
     joint_data->m_on_connect = on_connect;
     joint_data->m_on_disconnect = on_disconnect;
     joint_data->m_adjust_pin_matrix_proc = adjust_pin_matrix_proc;
+    joint_data->m_set_controller_proc = set_controller_proc;
+    joint_data->m_get_curve_proc = get_curve_proc;
 
     return MSP::Joint::c_joint_to_value(joint_data);
 }
@@ -1004,6 +411,7 @@ VALUE MSP::CurvyPiston::rbf_add_point(VALUE self, VALUE v_joint, VALUE v_positio
     dVector point(Util::value_to_point(v_position));
     dMatrix pin_matrix;
     Joint::c_get_pin_matrix(joint_data, pin_matrix);
+    c_detach_curve(joint_data);
     cj_data->m_points.push_back(pin_matrix.UntransformVector(point));
     if (joint_data->m_connected)
         c_update_curve_edges(joint_data);
@@ -1014,7 +422,8 @@ VALUE MSP::CurvyPiston::rbf_remove_point(VALUE self, VALUE v_joint, VALUE v_poin
     MSP::Joint::JointData* joint_data = MSP::Joint::c_value_to_joint2(v_joint, MSP::Joint::CURVY_PISTON);
     CurvyPistonData* cj_data = reinterpret_cast<CurvyPistonData*>(joint_data->m_cj_data);
     unsigned int point_index = Util::value_to_uint(v_point_index);
-    if (point_index < cj_data->m_points.size()) {
+    if (point_index < c_get_points(cj_data).size()) {
+        c_detach_curve(joint_data);
         cj_data->m_points.erase(cj_data->m_points.begin() + point_index);
         if (joint_data->m_connected)
             c_update_curve_edges(joint_data);
@@ -1029,9 +438,10 @@ VALUE MSP::CurvyPiston::rbf_get_points(VALUE self, VALUE v_joint) {
     CurvyPistonData* cj_data = reinterpret_cast<CurvyPistonData*>(joint_data->m_cj_data);
     dMatrix pin_matrix;
     MSP::Joint::c_get_pin_matrix(joint_data, pin_matrix);
-    VALUE v_points = rb_ary_new2((unsigned int)cj_data->m_points.size());
+    const std::vector<dVector>& points = c_get_points(cj_data);
+    VALUE v_points = rb_ary_new2((unsigned int)points.size());
     unsigned int i = 0;
-    for (std::vector<dVector>::iterator it = cj_data->m_points.begin(); it != cj_data->m_points.end(); ++it) {
+    for (std::vector<dVector>::const_iterator it = points.begin(); it != points.end(); ++it) {
         dVector point(pin_matrix.TransformVector(*it));
         rb_ary_store(v_points, i, Util::point_to_value(point));
         ++i;
@@ -1042,13 +452,14 @@ VALUE MSP::CurvyPiston::rbf_get_points(VALUE self, VALUE v_joint) {
 VALUE MSP::CurvyPiston::rbf_get_points_size(VALUE self, VALUE v_joint) {
     MSP::Joint::JointData* joint_data = MSP::Joint::c_value_to_joint2(v_joint, MSP::Joint::CURVY_PISTON);
     CurvyPistonData* cj_data = reinterpret_cast<CurvyPistonData*>(joint_data->m_cj_data);
-    return Util::to_value(cj_data->m_points.size());
+    return Util::to_value(c_get_points(cj_data).size());
 }
 
 VALUE MSP::CurvyPiston::rbf_clear_points(VALUE self, VALUE v_joint) {
     MSP::Joint::JointData* joint_data = MSP::Joint::c_value_to_joint2(v_joint, MSP::Joint::CURVY_PISTON);
     CurvyPistonData* cj_data = reinterpret_cast<CurvyPistonData*>(joint_data->m_cj_data);
-    unsigned int count = (unsigned int)cj_data->m_points.size();
+    unsigned int count = (unsigned int)c_get_points(cj_data).size();
+    c_detach_curve(joint_data);
     cj_data->m_points.clear();
     c_clear_curve_edges(joint_data);
     return count;
@@ -1058,10 +469,11 @@ VALUE MSP::CurvyPiston::rbf_get_point_position(VALUE self, VALUE v_joint, VALUE
     MSP::Joint::JointData* joint_data = MSP::Joint::c_value_to_joint2(v_joint, MSP::Joint::CURVY_PISTON);
     CurvyPistonData* cj_data = reinterpret_cast<CurvyPistonData*>(joint_data->m_cj_data);
     unsigned int point_index = Util::value_to_uint(v_point_index);
-    if (point_index < cj_data->m_points.size()) {
+    const std::vector<dVector>& points = c_get_points(cj_data);
+    if (point_index < points.size()) {
         dMatrix pin_matrix;
         MSP::Joint::c_get_pin_matrix(joint_data, pin_matrix);
-        dVector point(pin_matrix.TransformVector(cj_data->m_points[point_index]));
+        dVector point(pin_matrix.TransformVector(points[point_index]));
         return Util::point_to_value(point);
     }
     else
@@ -1072,10 +484,11 @@ VALUE MSP::CurvyPiston::rbf_set_point_position(VALUE self, VALUE v_joint, VALUE
     MSP::Joint::JointData* joint_data = MSP::Joint::c_value_to_joint2(v_joint, MSP::Joint::CURVY_PISTON);
     CurvyPistonData* cj_data = reinterpret_cast<CurvyPistonData*>(joint_data->m_cj_data);
     unsigned int point_index = Util::value_to_uint(v_point_index);
-    if (point_index < cj_data->m_points.size()) {
+    if (point_index < c_get_points(cj_data).size()) {
         dVector point(Util::value_to_point(v_position));
         dMatrix pin_matrix;
         MSP::Joint::c_get_pin_matrix(joint_data, pin_matrix);
+        c_detach_curve(joint_data);
         cj_data->m_points[point_index] = pin_matrix.UntransformVector(point);
         if (joint_data->m_connected)
             c_update_curve_edges(joint_data);
@@ -1203,25 +616,10 @@ VALUE MSP::CurvyPiston::rbf_get_controller(VALUE self, VALUE v_joint) {
 
 VALUE MSP::CurvyPiston::rbf_set_controller(VALUE self, VALUE v_joint, VALUE v_controller) {
     MSP::Joint::JointData* joint_data = MSP::Joint::c_value_to_joint2(v_joint, MSP::Joint::CURVY_PISTON);
-    CurvyPistonData* cj_data = reinterpret_cast<CurvyPistonData*>(joint_data->m_cj_data);
-    if (v_controller == Qnil) {
-        if (cj_data->m_controller_enabled) {
-            cj_data->m_controller_enabled = false;
-            if (joint_data->m_connected)
-                NewtonBodySetSleepState(joint_data->m_child, 0);
-        }
-    }
-    else {
-        dFloat controller = Util::value_to_dFloat(v_controller);
-        if (cj_data->m_controller_mode == 0)
-             controller *= M_METER_TO_INCH;
-        if (!cj_data->m_controller_enabled || controller != cj_data->m_controller) {
-            cj_data->m_controller = controller;
-            cj_data->m_controller_enabled = true;
-            if (joint_data->m_connected)
-                NewtonBodySetSleepState(joint_data->m_child, 0);
-        }
-    }
+    if (v_controller == Qnil)
+        set_controller_proc(joint_data, 0.0f, false);
+    else
+        set_controller_proc(joint_data, Util::value_to_dFloat(v_controller), true);
     return Qnil;
 }
 
@@ -1300,13 +698,14 @@ VALUE MSP::CurvyPiston::rbf_enable_rotation(VALUE self, VALUE v_joint, VALUE v_s
 
 VALUE MSP::CurvyPiston::rbf_get_normal_martix_at_position(VALUE self, VALUE v_joint, VALUE v_position) {
     MSP::Joint::JointData* joint_data = MSP::Joint::c_value_to_joint2(v_joint, MSP::Joint::CURVY_PISTON);
+    CurvyPistonData* cj_data = reinterpret_cast<CurvyPistonData*>(joint_data->m_cj_data);
     dFloat position = Util::value_to_dFloat(v_position) * M_METER_TO_INCH;
     dMatrix normal_matrix;
     dFloat distance, overpass;
-    if (c_calc_curve_data_at_position(joint_data, position, normal_matrix, distance, overpass)) {
+    if (joint_data->m_connected && cj_data->m_curve != nullptr && MSP::Joint::c_calc_curve_data_at_position(cj_data->m_curve, position, normal_matrix, distance, overpass)) {
         dMatrix pin_matrix;
         Joint::c_get_pin_matrix(joint_data, pin_matrix);
-        return Util::matrix_to_value(normal_matrix * pin_matrix);
+        return Util::matrix_to_value(cj_data->m_curve_twist * normal_matrix * pin_matrix);
     }
     else
         return Qnil;
@@ -1314,14 +713,15 @@ VALUE MSP::CurvyPiston::rbf_get_normal_martix_at_position(VALUE self, VALUE v_jo
 
 VALUE MSP::CurvyPiston::rbf_get_normal_martix_at_point(VALUE self, VALUE v_joint, VALUE v_point) {
     MSP::Joint::JointData* joint_data = MSP::Joint::c_value_to_joint2(v_joint, MSP::Joint::CURVY_PISTON);
+    CurvyPistonData* cj_data = reinterpret_cast<CurvyPistonData*>(joint_data->m_cj_data);
     dVector point(Util::value_to_point(v_point));
     dMatrix pin_matrix;
     Joint::c_get_pin_matrix(joint_data, pin_matrix);
     dVector loc_point(pin_matrix.UntransformVector(point));
     dMatrix normal_matrix;
     dFloat distance, overpass;
-    if (c_calc_curve_data_at_point(joint_data, loc_point, normal_matrix, distance, overpass))
-        return rb_ary_new3(2, Util::matrix_to_value(normal_matrix * pin_matrix), Util::to_value(overpass * M_INCH_TO_METER));
+    if (joint_data->m_connected && cj_data->m_curve != nullptr && MSP::Joint::c_calc_curve_data_at_point(cj_data->m_curve, loc_point, normal_matrix, distance, overpass))
+        return rb_ary_new3(2, Util::matrix_to_value(cj_data->m_curve_twist * normal_matrix * pin_matrix), Util::to_value(overpass * M_INCH_TO_METER));
     else
         return Qnil;
 }
@@ -1329,11 +729,14 @@ VALUE MSP::CurvyPiston::rbf_get_normal_martix_at_point(VALUE self, VALUE v_joint
 VALUE MSP::CurvyPiston::rbf_get_normal_matrices(VALUE self, VALUE v_joint) {
     MSP::Joint::JointData* joint_data = MSP::Joint::c_value_to_joint2(v_joint, MSP::Joint::CURVY_PISTON);
     CurvyPistonData* cj_data = reinterpret_cast<CurvyPistonData*>(joint_data->m_cj_data);
-    VALUE v_normal_matrices = rb_ary_new2((unsigned int)cj_data->m_edges.size());
+    if (!joint_data->m_connected || cj_data->m_curve == nullptr)
+        return rb_ary_new();
+    const std::vector<MSP::Joint::CurveEdge>& edges = cj_data->m_curve->m_edges;
+    VALUE v_normal_matrices = rb_ary_new2((unsigned int)edges.size());
     dMatrix pin_matrix;
     Joint::c_get_pin_matrix(joint_data, pin_matrix);
-    for (std::map<unsigned int, EdgeData*>::iterator it = cj_data->m_edges.begin(); it != cj_data->m_edges.end(); ++it)
-        rb_ary_store(v_normal_matrices, it->first, Util::matrix_to_value(it->second->m_normal_matrix * pin_matrix));
+    for (unsigned int i = 0; i < edges.size(); ++i)
+        rb_ary_store(v_normal_matrices, i, Util::matrix_to_value(cj_data->m_curve_twist * edges[i].m_normal_matrix * pin_matrix));
     return v_normal_matrices;
 }
 
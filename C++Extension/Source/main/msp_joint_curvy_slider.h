@@ -24,24 +24,11 @@ private:
     static const bool DEFAULT_ROTATION_ENABLED;
 
     // Structures
-    struct EdgeData {
-        dMatrix m_normal_matrix;
-        dFloat m_length;
-        dFloat m_preceding_curve_length;
-        unsigned int m_start_index;
-        unsigned int m_end_index;
-        EdgeData(dFloat length, dFloat preceding_curve_length, unsigned int start_index, unsigned int end_index) :
-            m_length(length),
-            m_preceding_curve_length(preceding_curve_length),
-            m_start_index(start_index),
-            m_end_index(end_index)
-        {
-        }
-    };
-
     struct CurvySliderData {
+        // Points being edited; they are moved to a shared curve on connect.
         std::vector<dVector> m_points;
-        std::map<unsigned int, EdgeData*> m_edges;
+        const MSP::Joint::CurveData* m_curve;
+        dMatrix m_curve_twist;
         dFloat m_curve_len;
         dFloat m_cur_pos;
         dFloat m_cur_vel;
@@ -57,7 +44,10 @@ private:
         bool m_align;
         bool m_rotate;
         unsigned int m_initial_edge_index;
+        unsigned int m_cur_edge_index;
         CurvySliderData() :
+            m_curve(nullptr),
+            m_curve_twist(dGetIdentityMatrix()),
             m_curve_len(0.0f),
             m_cur_pos(0.0f),
             m_cur_vel(0.0f),
@@ -71,9 +61,14 @@ private:
             m_loop(DEFAULT_LOOP_ENABLED),
             m_align(DEFAULT_ALIGNMENT_ENABLED),
             m_rotate(DEFAULT_ROTATION_ENABLED),
-            m_initial_edge_index(0)
+            m_initial_edge_index(0),
+            m_cur_edge_index(0)
         {
         }
+        ~CurvySliderData() {
+            if (m_curve != nullptr)
+                MSP::Joint::c_release_curve(m_curve);
+        }
     };
 
     // Callback Functions
@@ -87,11 +82,10 @@ private:
     // Helper Functions
     static void c_clear_curve_edges(MSP::Joint::JointData* joint_data);
     static void c_update_curve_edges(MSP::Joint::JointData* joint_data);
-    static bool c_calc_curve_data_at_position(const MSP::Joint::JointData* joint_data, dFloat position, dMatrix& normal_matrix, dFloat &distance, dFloat &overpass);
-    static bool c_calc_curve_data_at_point(const MSP::Joint::JointData* joint_data, const dVector& location, dMatrix& normal_matrix, dFloat &distance, dFloat &overpass);
-    static bool c_calc_curve_data_at_point2(const MSP::Joint::JointData* joint_data, const dVector& location, dVector& point, dVector& vector, dFloat &distance, unsigned int &edge_index);
-    static bool c_calc_curve_data_at_point3(const MSP::Joint::JointData* joint_data, dFloat last_dist, const dVector& location, dMatrix& normal_matrix, dFloat &distance, dFloat &overpass);
-    static void c_calc_pivot_normal(const dMatrix& normal_matrix1, const dMatrix& normal_matrix2, const dVector& pivot_point, const dVector& location, dMatrix& normal_matrix_out);
+    static void c_detach_curve(MSP::Joint::JointData* joint_data);
+    static const std::vector<dVector>& c_get_points(const CurvySliderData* cj_data);
+    static void set_controller_proc(MSP::Joint::JointData* joint_data, dFloat controller, bool enabled);
+    static const MSP::Joint::CurveData* get_curve_proc(MSP::Joint::JointData* joint_data);
 
 public:
     // Ruby Functions
@@ -92,8 +92,8 @@ void MSP::Fixed::get_info(const NewtonJoint* const joint, NewtonJointRecord* con
 */
 
 VALUE MSP::Fixed::rbf_is_valid(VALUE self, VALUE v_joint) {
-    MSP::Joint::JointData* address = reinterpret_cast<MSP::Joint::JointData*>(Util::value_to_ull(v_joint));
-    return (MSP::Joint::c_is_joint_valid(address) && address->m_jtype == MSP::Joint::FIXED) ? Qtrue : Qfalse;
+    MSP::Joint::JointData* address = MSP::Joint::s_valid_joints.find(Util::value_to_ull(v_joint));
+    return (address != nullptr && address->m_jtype == MSP::Joint::FIXED) ? Qtrue : Qfalse;
 }
 
 VALUE MSP::Fixed::rbf_create(VALUE self, VALUE v_joint) {
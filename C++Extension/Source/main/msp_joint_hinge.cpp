@@ -206,6 +206,22 @@ void MSP::Hinge::adjust_pin_matrix_proc(MSP::Joint::JointData* joint_data, dMatr
     pin_matrix.m_posit = pin_matrix.TransformVector(point);
 }
 
+void MSP::Hinge::set_controller_proc(MSP::Joint::JointData* joint_data, dFloat controller, bool enabled) {
+    HingeData* cj_data = reinterpret_cast<HingeData*>(joint_data->m_cj_data);
+    if (!enabled)
+        return;
+    cj_data->m_controller = controller;
+    if (cj_data->m_mode != 0) {
+        dFloat desired_start_angle = cj_data->m_start_angle * cj_data->m_controller;
+        if (cj_data->m_desired_start_angle != desired_start_angle) {
+            cj_data->m_temp_disable_limits = true;
+            cj_data->m_desired_start_angle = desired_start_angle;
+            if (joint_data->m_connected)
+                NewtonBodySetSleepState(joint_data->m_child, 0);
+        }
+    }
+}
+
 
 /*
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -214,8 +230,8 @@ void MSP::Hinge::adjust_pin_matrix_proc(MSP::Joint::JointData* joint_data, dMatr
 */
 
 VALUE MSP::Hinge::rbf_is_valid(VALUE self, VALUE v_joint) {
-    MSP::Joint::JointData* address = reinterpret_cast<MSP::Joint::JointData*>(Util::value_to_ull(v_joint));
-    return (MSP::Joint::c_is_joint_valid(address) && address->m_jtype == MSP::Joint::HINGE) ? Qtrue : Qfalse;
+    MSP::Joint::JointData* address = MSP::Joint::s_valid_joints.find(Util::value_to_ull(v_joint));
+    return (address != nullptr && address->m_jtype == MSP::Joint::HINGE) ? Qtrue : Qfalse;
 }
 
 VALUE MSP::Hinge::rbf_create(VALUE self, VALUE v_joint) {
@@ -230,6 +246,7 @@ VALUE MSP::Hinge::rbf_create(VALUE self, VALUE v_joint) {
     joint_data->m_on_connect = on_connect;
     joint_data->m_on_disconnect = on_disconnect;
     //~ joint_data->m_adjust_pin_matrix_proc = adjust_pin_matrix_proc;
+    joint_data->m_set_controller_proc = set_controller_proc;
 
     return MSP::Joint::c_joint_to_value(joint_data);
 }
@@ -394,17 +411,7 @@ VALUE MSP::Hinge::rbf_get_controller(VALUE self, VALUE v_joint) {
 
 VALUE MSP::Hinge::rbf_set_controller(VALUE self, VALUE v_joint, VALUE v_controller) {
     MSP::Joint::JointData* joint_data = MSP::Joint::c_value_to_joint2(v_joint, MSP::Joint::HINGE);
-    HingeData* cj_data = reinterpret_cast<HingeData*>(joint_data->m_cj_data);
-    cj_data->m_controller = Util::value_to_dFloat(v_controller);
-    if (cj_data->m_mode != 0) {
-        dFloat desired_start_angle = cj_data->m_start_angle * cj_data->m_controller;
-        if (cj_data->m_desired_start_angle != desired_start_angle) {
-            cj_data->m_temp_disable_limits = true;
-            cj_data->m_desired_start_angle = desired_start_angle;
-            if (joint_data->m_connected)
-                NewtonBodySetSleepState(joint_data->m_child, 0);
-        }
-    }
+    set_controller_proc(joint_data, Util::value_to_dFloat(v_controller), true);
     return Qnil;
 }
 
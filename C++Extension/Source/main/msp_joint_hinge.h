@@ -83,6 +83,7 @@ public:
     static void on_connect(MSP::Joint::JointData* joint_data);
     static void on_disconnect(MSP::Joint::JointData* joint_data);
     static void adjust_pin_matrix_proc(MSP::Joint::JointData* joint_data, dMatrix& pin_matrix);
+    static void set_controller_proc(MSP::Joint::JointData* joint_data, dFloat controller, bool enabled);
 
     // Ruby Functions
     static VALUE rbf_is_valid(VALUE self, VALUE v_joint);
@@ -129,6 +129,17 @@ void MSP::Motor::adjust_pin_matrix_proc(MSP::Joint::JointData* joint_data, dMatr
     pin_matrix.m_posit = pin_matrix.TransformVector(point);
 }
 
+void MSP::Motor::set_controller_proc(MSP::Joint::JointData* joint_data, dFloat controller, bool enabled) {
+    MotorData* cj_data = reinterpret_cast<MotorData*>(joint_data->m_cj_data);
+    if (!enabled)
+        return;
+    if (controller != cj_data->m_controller) {
+        cj_data->m_controller = controller;
+        if (joint_data->m_connected)
+            NewtonBodySetSleepState(joint_data->m_child, 0);
+    }
+}
+
 
 /*
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -137,8 +148,8 @@ void MSP::Motor::adjust_pin_matrix_proc(MSP::Joint::JointData* joint_data, dMatr
 */
 
 VALUE MSP::Motor::rbf_is_valid(VALUE self, VALUE v_joint) {
-    MSP::Joint::JointData* address = reinterpret_cast<MSP::Joint::JointData*>(Util::value_to_ull(v_joint));
-    return (MSP::Joint::c_is_joint_valid(address) && address->m_jtype == MSP::Joint::MOTOR) ? Qtrue : Qfalse;
+    MSP::Joint::JointData* address = MSP::Joint::s_valid_joints.find(Util::value_to_ull(v_joint));
+    return (address != nullptr && address->m_jtype == MSP::Joint::MOTOR) ? Qtrue : Qfalse;
 }
 
 VALUE MSP::Motor::rbf_create(VALUE self, VALUE v_joint) {
@@ -152,6 +163,7 @@ VALUE MSP::Motor::rbf_create(VALUE self, VALUE v_joint) {
     joint_data->m_on_destroy = on_destroy;
     joint_data->m_on_disconnect = on_disconnect;
     //~ joint_data->adjust_pin_matrix_proc = adjust_pin_matrix_proc;
+    joint_data->m_set_controller_proc = set_controller_proc;
 
     return MSP::Joint::c_joint_to_value(joint_data);
 }
@@ -221,13 +233,7 @@ VALUE MSP::Motor::rbf_get_controller(VALUE self, VALUE v_joint) {
 
 VALUE MSP::Motor::rbf_set_controller(VALUE self, VALUE v_joint, VALUE v_controller) {
     MSP::Joint::JointData* joint_data = MSP::Joint::c_value_to_joint2(v_joint, MSP::Joint::MOTOR);
-    MotorData* cj_data = reinterpret_cast<MotorData*>(joint_data->m_cj_data);
-    dFloat controller = Util::value_to_dFloat(v_controller);
-    if (controller != cj_data->m_controller) {
-        cj_data->m_controller = controller;
-        if (joint_data->m_connected)
-            NewtonBodySetSleepState(joint_data->m_child, 0);
-    }
+    set_controller_proc(joint_data, Util::value_to_dFloat(v_controller), true);
     return Qnil;
 }
 
@@ -55,6 +55,7 @@ private:
     static void on_destroy(MSP::Joint::JointData* joint_data);
     static void on_disconnect(MSP::Joint::JointData* joint_data);
     static void adjust_pin_matrix_proc(MSP::Joint::JointData* joint_data, dMatrix& pin_matrix);
+    static void set_controller_proc(MSP::Joint::JointData* joint_data, dFloat controller, bool enabled);
 
 public:
     // Ruby Functions
@@ -217,6 +217,27 @@ void MSP::Piston::adjust_pin_matrix_proc(MSP::Joint::JointData* joint_data, dMat
     pin_matrix.m_posit = matrix.TransformVector(centre);
 }
 
+void MSP::Piston::set_controller_proc(MSP::Joint::JointData* joint_data, dFloat controller, bool enabled) {
+    PistonData* cj_data = reinterpret_cast<PistonData*>(joint_data->m_cj_data);
+    if (!enabled) {
+        if (cj_data->m_controller_enabled) {
+            cj_data->m_controller_enabled = false;
+            if (joint_data->m_connected)
+                NewtonBodySetSleepState(joint_data->m_child, 0);
+        }
+    }
+    else {
+        if (cj_data->m_controller_mode == 0)
+             controller *= M_METER_TO_INCH;
+        if (!cj_data->m_controller_enabled || controller != cj_data->m_controller) {
+            cj_data->m_controller = controller;
+            cj_data->m_controller_enabled = true;
+            if (joint_data->m_connected)
+                NewtonBodySetSleepState(joint_data->m_child, 0);
+        }
+    }
+}
+
 
 /*
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -225,8 +246,8 @@ void MSP::Piston::adjust_pin_matrix_proc(MSP::Joint::JointData* joint_data, dMat
 */
 
 VALUE MSP::Piston::rbf_is_valid(VALUE self, VALUE v_joint) {
-    MSP::Joint::JointData* address = reinterpret_cast<MSP::Joint::JointData*>(Util::value_to_ull(v_joint));
-    return (MSP::Joint::c_is_joint_valid(address) && address->m_jtype == MSP::Joint::PISTON) ? Qtrue : Qfalse;
+    MSP::Joint::JointData* address = MSP::Joint::s_valid_joints.find(Util::value_to_ull(v_joint));
+    return (address != nullptr && address->m_jtype == MSP::Joint::PISTON) ? Qtrue : Qfalse;
 }
 
 VALUE MSP::Piston::rbf_create(VALUE self, VALUE v_joint) {
@@ -240,6 +261,7 @@ VALUE MSP::Piston::rbf_create(VALUE self, VALUE v_joint) {
     joint_data->m_on_destroy = on_destroy;
     joint_data->m_on_disconnect = on_disconnect;
     //~ joint_data->m_adjust_pin_matrix_proc = adjust_pin_matrix_proc;
+    joint_data->m_set_controller_proc = set_controller_proc;
 
     return MSP::Joint::c_joint_to_value(joint_data);
 }
@@ -355,25 +377,10 @@ VALUE MSP::Piston::rbf_get_controller(VALUE self, VALUE v_joint) {
 
 VALUE MSP::Piston::rbf_set_controller(VALUE self, VALUE v_joint, VALUE v_controller) {
     MSP::Joint::JointData* joint_data = MSP::Joint::c_value_to_joint2(v_joint, MSP::Joint::PISTON);
-    PistonData* cj_data = reinterpret_cast<PistonData*>(joint_data->m_cj_data);
-    if (v_controller == Qnil) {
-        if (cj_data->m_controller_enabled) {
-            cj_data->m_controller_enabled = false;
-            if (joint_data->m_connected)
-                NewtonBodySetSleepState(joint_data->m_child, 0);
-        }
-    }
-    else {
-        dFloat controller = Util::value_to_dFloat(v_controller);
-        if (cj_data->m_controller_mode == 0)
-             controller *= M_METER_TO_INCH;
-        if (!cj_data->m_controller_enabled || controller != cj_data->m_controller) {
-            cj_data->m_controller = controller;
-            cj_data->m_controller_enabled = true;
-            if (joint_data->m_connected)
-                NewtonBodySetSleepState(joint_data->m_child, 0);
-        }
-    }
+    if (v_controller == Qnil)
+        set_controller_proc(joint_data, 0.0f, false);
+    else
+        set_controller_proc(joint_data, Util::value_to_dFloat(v_controller), true);
     return Qnil;
 }
 
@@ -103,6 +103,18 @@ void MSP::PointToPoint::on_disconnect(MSP::Joint::JointData* joint_data) {
     cj_data->m_cur_distance = 0.0f;
 }
 
+void MSP::PointToPoint::set_controller_proc(MSP::Joint::JointData* joint_data, dFloat controller, bool enabled) {
+    PointToPointData* cj_data = reinterpret_cast<PointToPointData*>(joint_data->m_cj_data);
+    if (!enabled)
+        return;
+    dFloat desired_controller = Util::max_float(controller, 0.0f);
+    if (desired_controller != cj_data->m_controller) {
+        cj_data->m_controller = desired_controller;
+        if (joint_data->m_connected)
+            NewtonBodySetSleepState(joint_data->m_child, 0);
+    }
+}
+
 
 /*
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -111,8 +123,8 @@ void MSP::PointToPoint::on_disconnect(MSP::Joint::JointData* joint_data) {
 */
 
 VALUE MSP::PointToPoint::rbf_is_valid(VALUE self, VALUE v_joint) {
-    MSP::Joint::JointData* address = reinterpret_cast<MSP::Joint::JointData*>(Util::value_to_ull(v_joint));
-    return (MSP::Joint::c_is_joint_valid(address) && address->m_jtype == MSP::Joint::POINT_TO_POINT) ? Qtrue : Qfalse;
+    MSP::Joint::JointData* address = MSP::Joint::s_valid_joints.find(Util::value_to_ull(v_joint));
+    return (address != nullptr && address->m_jtype == MSP::Joint::POINT_TO_POINT) ? Qtrue : Qfalse;
 }
 
 VALUE MSP::PointToPoint::rbf_create(VALUE self, VALUE v_joint) {
@@ -126,6 +138,7 @@ VALUE MSP::PointToPoint::rbf_create(VALUE self, VALUE v_joint) {
     joint_data->m_on_destroy = on_destroy;
     joint_data->m_on_connect = on_connect;
     joint_data->m_on_disconnect = on_disconnect;
+    joint_data->m_set_controller_proc = set_controller_proc;
 
     return MSP::Joint::c_joint_to_value(joint_data);
 }
@@ -208,13 +221,7 @@ VALUE MSP::PointToPoint::rbf_get_controller(VALUE self, VALUE v_joint) {
 
 VALUE MSP::PointToPoint::rbf_set_controller(VALUE self, VALUE v_joint, VALUE v_controller) {
     MSP::Joint::JointData* joint_data = MSP::Joint::c_value_to_joint2(v_joint, MSP::Joint::POINT_TO_POINT);
-    PointToPointData* cj_data = reinterpret_cast<PointToPointData*>(joint_data->m_cj_data);
-    dFloat desired_controller = Util::max_float(Util::value_to_dFloat(v_controller), 0.0f);
-    if (desired_controller != cj_data->m_controller) {
-        cj_data->m_controller = desired_controller;
-        if (joint_data->m_connected)
-            NewtonBodySetSleepState(joint_data->m_child, 0);
-    }
+    set_controller_proc(joint_data, Util::value_to_dFloat(v_controller), true);
     return Qnil;
 }
 
@@ -190,6 +190,25 @@ void MSP::Servo::adjust_pin_matrix_proc(MSP::Joint::JointData* joint_data, dMatr
     pin_matrix.m_posit = pin_matrix.TransformVector(point);
 }
 
+void MSP::Servo::set_controller_proc(MSP::Joint::JointData* joint_data, dFloat controller, bool enabled) {
+    ServoData* cj_data = reinterpret_cast<ServoData*>(joint_data->m_cj_data);
+    if (!enabled) {
+        if (cj_data->m_controller_enabled) {
+            cj_data->m_controller_enabled = false;
+            if (joint_data->m_connected)
+                NewtonBodySetSleepState(joint_data->m_child, 0);
+        }
+    }
+    else {
+        if (!cj_data->m_controller_enabled || controller != cj_data->m_controller) {
+            cj_data->m_controller_enabled = true;
+            cj_data->m_controller = controller;
+            if (joint_data->m_connected)
+                NewtonBodySetSleepState(joint_data->m_child, 0);
+        }
+    }
+}
+
 
 /*
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -198,8 +217,8 @@ void MSP::Servo::adjust_pin_matrix_proc(MSP::Joint::JointData* joint_data, dMatr
 */
 
 VALUE MSP::Servo::rbf_is_valid(VALUE self, VALUE v_joint) {
-    MSP::Joint::JointData* address = reinterpret_cast<MSP::Joint::JointData*>(Util::value_to_ull(v_joint));
-    return (MSP::Joint::c_is_joint_valid(address) && address->m_jtype == MSP::Joint::SERVO) ? Qtrue : Qfalse;
+    MSP::Joint::JointData* address = MSP::Joint::s_valid_joints.find(Util::value_to_ull(v_joint));
+    return (address != nullptr && address->m_jtype == MSP::Joint::SERVO) ? Qtrue : Qfalse;
 }
 
 VALUE MSP::Servo::rbf_create(VALUE self, VALUE v_joint) {
@@ -213,6 +232,7 @@ VALUE MSP::Servo::rbf_create(VALUE self, VALUE v_joint) {
     joint_data->m_on_destroy = on_destroy;
     joint_data->m_on_disconnect = on_disconnect;
     //~ joint_data->adjust_pin_matrix_proc = adjust_pin_matrix_proc;
+    joint_data->m_set_controller_proc = set_controller_proc;
 
     return MSP::Joint::c_joint_to_value(joint_data);
 }
@@ -321,23 +341,10 @@ VALUE MSP::Servo::rbf_get_controller(VALUE self, VALUE v_joint) {
 
 VALUE MSP::Servo::rbf_set_controller(VALUE self, VALUE v_joint, VALUE v_controller) {
     MSP::Joint::JointData* joint_data = MSP::Joint::c_value_to_joint2(v_joint, MSP::Joint::SERVO);
-    ServoData* cj_data = reinterpret_cast<ServoData*>(joint_data->m_cj_data);
-    if (v_controller == Qnil) {
-        if (cj_data->m_controller_enabled) {
-            cj_data->m_controller_enabled = false;
-            if (joint_data->m_connected)
-                NewtonBodySetSleepState(joint_data->m_child, 0);
-        }
-    }
-    else {
-        dFloat controller = Util::value_to_dFloat(v_controller);
-        if (!cj_data->m_controller_enabled || controller != cj_data->m_controller) {
-            cj_data->m_controller_enabled = true;
-            cj_data->m_controller = controller;
-            if (joint_data->m_connected)
-                NewtonBodySetSleepState(joint_data->m_child, 0);
-        }
-    }
+    if (v_controller == Qnil)
+        set_controller_proc(joint_data, 0.0f, false);
+    else
+        set_controller_proc(joint_data, Util::value_to_dFloat(v_controller), true);
     return Qnil;
 }
 
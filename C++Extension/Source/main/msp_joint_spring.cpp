@@ -201,6 +201,20 @@ void MSP::Spring::adjust_pin_matrix_proc(MSP::Joint::JointData* joint_data, dMat
     pin_matrix.m_posit = matrix.TransformVector(centre);
 }
 
+void MSP::Spring::set_controller_proc(MSP::Joint::JointData* joint_data, dFloat controller, bool enabled) {
+    SpringData* cj_data = reinterpret_cast<SpringData*>(joint_data->m_cj_data);
+    if (!enabled)
+        return;
+    cj_data->m_controller = controller;
+    dFloat desired_start_pos = cj_data->m_start_pos * cj_data->m_controller;
+    if (cj_data->m_desired_start_pos != desired_start_pos) {
+        cj_data->m_temp_disable_limits = true;
+        cj_data->m_desired_start_pos = desired_start_pos;
+        if (joint_data->m_connected)
+            NewtonBodySetSleepState(joint_data->m_child, 0);
+    }
+}
+
 
 /*
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -209,8 +223,8 @@ void MSP::Spring::adjust_pin_matrix_proc(MSP::Joint::JointData* joint_data, dMat
 */
 
 VALUE MSP::Spring::rbf_is_valid(VALUE self, VALUE v_joint) {
-    MSP::Joint::JointData* address = reinterpret_cast<MSP::Joint::JointData*>(Util::value_to_ull(v_joint));
-    return (MSP::Joint::c_is_joint_valid(address) && address->m_jtype == MSP::Joint::SPRING) ? Qtrue : Qfalse;
+    MSP::Joint::JointData* address = MSP::Joint::s_valid_joints.find(Util::value_to_ull(v_joint));
+    return (address != nullptr && address->m_jtype == MSP::Joint::SPRING) ? Qtrue : Qfalse;
 }
 
 VALUE MSP::Spring::rbf_create(VALUE self, VALUE v_joint) {
@@ -223,6 +237,7 @@ VALUE MSP::Spring::rbf_create(VALUE self, VALUE v_joint) {
     joint_data->m_on_destroy = on_destroy;
     joint_data->m_on_disconnect = on_disconnect;
     //~ joint_data->m_adjust_pin_matrix_proc = adjust_pin_matrix_proc;
+    joint_data->m_set_controller_proc = set_controller_proc;
 
     return MSP::Joint::c_joint_to_value(joint_data);
 }
@@ -385,15 +400,7 @@ VALUE MSP::Spring::rbf_get_controller(VALUE self, VALUE v_joint) {
 
 VALUE MSP::Spring::rbf_set_controller(VALUE self, VALUE v_joint, VALUE v_controller) {
     MSP::Joint::JointData* joint_data = MSP::Joint::c_value_to_joint2(v_joint, MSP::Joint::SPRING);
-    SpringData* cj_data = reinterpret_cast<SpringData*>(joint_data->m_cj_data);
-    cj_data->m_controller = Util::value_to_dFloat(v_controller);
-    dFloat desired_start_pos = cj_data->m_start_pos * cj_data->m_controller;
-    if (cj_data->m_desired_start_pos != desired_start_pos) {
-        cj_data->m_temp_disable_limits = true;
-        cj_data->m_desired_start_pos = desired_start_pos;
-        if (joint_data->m_connected)
-            NewtonBodySetSleepState(joint_data->m_child, 0);
-    }
+    set_controller_proc(joint_data, Util::value_to_dFloat(v_controller), true);
     return Qnil;
 }
 
@@ -203,6 +203,17 @@ void MSP::Universal::on_disconnect(MSP::Joint::JointData* joint_data) {
     cj_data->m_cur_alpha2 = 0.0f;
 }
 
+void MSP::Universal::set_controller_proc(MSP::Joint::JointData* joint_data, dFloat controller, bool enabled) {
+    UniversalData* cj_data = reinterpret_cast<UniversalData*>(joint_data->m_cj_data);
+    if (!enabled)
+        return;
+    if (cj_data->m_controller != controller) {
+        cj_data->m_controller = controller;
+        if (joint_data->m_connected)
+            NewtonBodySetSleepState(joint_data->m_child, 0);
+    }
+}
+
 
 /*
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -211,8 +222,8 @@ void MSP::Universal::on_disconnect(MSP::Joint::JointData* joint_data) {
 */
 
 VALUE MSP::Universal::rbf_is_valid(VALUE self, VALUE v_joint) {
-    MSP::Joint::JointData* address = reinterpret_cast<MSP::Joint::JointData*>(Util::value_to_ull(v_joint));
-    return (MSP::Joint::c_is_joint_valid(address) && address->m_jtype == MSP::Joint::UNIVERSAL) ? Qtrue : Qfalse;
+    MSP::Joint::JointData* address = MSP::Joint::s_valid_joints.find(Util::value_to_ull(v_joint));
+    return (address != nullptr && address->m_jtype == MSP::Joint::UNIVERSAL) ? Qtrue : Qfalse;
 }
 
 VALUE MSP::Universal::rbf_create(VALUE self, VALUE v_joint) {
@@ -224,6 +235,7 @@ VALUE MSP::Universal::rbf_create(VALUE self, VALUE v_joint) {
     joint_data->m_get_info = get_info;
     joint_data->m_on_destroy = on_destroy;
     joint_data->m_on_disconnect = on_disconnect;
+    joint_data->m_set_controller_proc = set_controller_proc;
 
     return MSP::Joint::c_joint_to_value(joint_data);
 }
@@ -365,13 +377,7 @@ VALUE MSP::Universal::rbf_get_controller(VALUE self, VALUE v_joint) {
 
 VALUE MSP::Universal::rbf_set_controller(VALUE self, VALUE v_joint, VALUE v_controller) {
     MSP::Joint::JointData* joint_data = MSP::Joint::c_value_to_joint2(v_joint, MSP::Joint::UNIVERSAL);
-    UniversalData* cj_data = reinterpret_cast<UniversalData*>(joint_data->m_cj_data);
-    dFloat desired_controller = Util::value_to_dFloat(v_controller);
-    if (cj_data->m_controller != desired_controller) {
-        cj_data->m_controller = desired_controller;
-        if (joint_data->m_connected)
-            NewtonBodySetSleepState(joint_data->m_child, 0);
-    }
+    set_controller_proc(joint_data, Util::value_to_dFloat(v_controller), true);
     return Qnil;
 }
 
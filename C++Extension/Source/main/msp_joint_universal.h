@@ -72,6 +72,7 @@ private:
     static void get_info(const NewtonJoint* const joint, NewtonJointRecord* const info);
     static void on_destroy(MSP::Joint::JointData* joint_data);
     static void on_disconnect(MSP::Joint::JointData* joint_data);
+    static void set_controller_proc(MSP::Joint::JointData* joint_data, dFloat controller, bool enabled);
 
 public:
     // Ruby Functions
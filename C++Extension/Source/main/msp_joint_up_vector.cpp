@@ -97,8 +97,8 @@ void MSP::UpVector::on_disconnect(MSP::Joint::JointData* joint_data) {
 */
 
 VALUE MSP::UpVector::rbf_is_valid(VALUE self, VALUE v_joint) {
-    MSP::Joint::JointData* address = reinterpret_cast<MSP::Joint::JointData*>(Util::value_to_ull(v_joint));
-    return (MSP::Joint::c_is_joint_valid(address) && address->m_jtype == MSP::Joint::UP_VECTOR) ? Qtrue : Qfalse;
+    MSP::Joint::JointData* address = MSP::Joint::s_valid_joints.find(Util::value_to_ull(v_joint));
+    return (address != nullptr && address->m_jtype == MSP::Joint::UP_VECTOR) ? Qtrue : Qfalse;
 }
 
 VALUE MSP::UpVector::rbf_create(VALUE self, VALUE v_joint) {
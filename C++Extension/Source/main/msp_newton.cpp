@@ -36,10 +36,12 @@ VALUE MSP::Newton::rbf_get_memory_used(VALUE self) {
 VALUE MSP::Newton::rbf_get_all_worlds(VALUE self) {
     bool proc_given = (rb_block_given_p() != 0);
     VALUE v_worlds = rb_ary_new();
-    for (std::map<const NewtonWorld*, MSP::World::WorldData*>::iterator it = MSP::World::valid_worlds.begin(); it != MSP::World::valid_worlds.end(); ++it) {
-        VALUE v_address = MSP::World::c_world_to_value(it->first);
+    for (unsigned int i = 0; i < MSP::World::valid_worlds.capacity(); ++i) {
+        const NewtonWorld* world = MSP::World::valid_worlds.at(i);
+        if (world == nullptr) continue;
+        VALUE v_address = MSP::World::c_world_to_value(world);
         if (proc_given) {
-            MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(it->first));
+            MSP::World::WorldData* world_data = reinterpret_cast<MSP::World::WorldData*>(NewtonWorldGetUserData(world));
             VALUE v_user_data = rb_ary_entry(world_data->m_user_info, 1);
             VALUE v_result = rb_yield_values(2, v_address, v_user_data);
             if (v_result != Qnil) rb_ary_push(v_worlds, v_result);
@@ -53,12 +55,13 @@ VALUE MSP::Newton::rbf_get_all_worlds(VALUE self) {
 VALUE MSP::Newton::rbf_get_all_bodies(VALUE self) {
     bool proc_given = (rb_block_given_p() != 0);
     VALUE v_bodies = rb_ary_new();
-    for (std::set<const NewtonBody*>::iterator it = MSP::Body::s_valid_bodies.begin(); it != MSP::Body::s_valid_bodies.end(); ++it) {
-        const NewtonBody* body = *it;
+    for (unsigned int i = 0; i < MSP::Body::s_valid_bodies.capacity(); ++i) {
+        const NewtonBody* body = MSP::Body::s_valid_bodies.at(i);
+        if (body == nullptr) continue;
         VALUE v_address = MSP::Body::c_body_to_value(body);
         if (proc_given) {
             MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body));
-            VALUE v_user_data = rb_ary_entry(body_data->m_user_data, 0);
+            VALUE v_user_data = rb_ary_entry(body_data->m_cold->m_user_data, 0);
             VALUE v_result = rb_yield_values(2, v_address, v_user_data);
             if (v_result != Qnil)
                 rb_ary_push(v_bodies, v_result);
@@ -72,10 +75,12 @@ VALUE MSP::Newton::rbf_get_all_bodies(VALUE self) {
 VALUE MSP::Newton::rbf_get_all_joints(VALUE self) {
     bool proc_given = (rb_block_given_p() != 0);
     VALUE v_joints = rb_ary_new();
-    for (std::map<MSP::Joint::JointData*, bool>::iterator it = MSP::Joint::s_valid_joints.begin(); it != MSP::Joint::s_valid_joints.end(); ++it) {
-        VALUE v_address = MSP::Joint::c_joint_to_value(it->first);
+    for (unsigned int i = 0; i < MSP::Joint::s_valid_joints.capacity(); ++i) {
+        MSP::Joint::JointData* joint_data = MSP::Joint::s_valid_joints.at(i);
+        if (joint_data == nullptr) continue;
+        VALUE v_address = MSP::Joint::c_joint_to_value(joint_data);
         if (proc_given) {
-            VALUE v_user_data = rb_ary_entry(it->first->m_user_data, 0);
+            VALUE v_user_data = rb_ary_entry(joint_data->m_user_data, 0);
             VALUE v_result = rb_yield_values(2, v_address, v_user_data);
             if (v_result != Qnil)
                 rb_ary_push(v_joints, v_result);
@@ -89,8 +94,9 @@ VALUE MSP::Newton::rbf_get_all_joints(VALUE self) {
 VALUE MSP::Newton::rbf_get_all_gears(VALUE self) {
     bool proc_given = (rb_block_given_p() != 0);
     VALUE v_gears = rb_ary_new();
-    for (std::set<MSP::Gear::GearData*>::iterator it = MSP::Gear::s_valid_gears.begin(); it != MSP::Gear::s_valid_gears.end(); ++it) {
-        MSP::Gear::GearData* object = *it;
+    for (unsigned int i = 0; i < MSP::Gear::s_valid_gears.capacity(); ++i) {
+        MSP::Gear::GearData* object = MSP::Gear::s_valid_gears.at(i);
+        if (object == nullptr) continue;
         VALUE v_address = MSP::Gear::c_gear_to_value(object);
         if (proc_given) {
             VALUE v_user_data = rb_ary_entry(object->m_user_data, 0);
@@ -33,7 +33,7 @@ VALUE MSP::Particle::V_GL_TRIANGLE_FAN;
 VALUE MSP::Particle::V_GL_POLYGON;
 
 VALUE MSP::Particle::s_reg_symbols;
-std::set<MSP::Particle::ParticleData*> MSP::Particle::s_valid_particles;
+MSP::HandleTable<MSP::Particle::ParticleData*> MSP::Particle::s_valid_particles;
 
 
 /*
@@ -42,19 +42,25 @@ std::set<MSP::Particle::ParticleData*> MSP::Particle::s_valid_particles;
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 */
 
-bool MSP::Particle::c_is_valid(ParticleData* address) {
-    return s_valid_particles.find(address) != s_valid_particles.end();
+bool MSP::Particle::c_is_valid(unsigned long long handle) {
+    return s_valid_particles.is_valid(handle);
 }
 
 MSP::Particle::ParticleData* MSP::Particle::c_value_to_particle(VALUE v_address) {
-    ParticleData* address = reinterpret_cast<ParticleData*>(Util::value_to_ull(v_address));
-    if (s_valid_particles.find(address) == s_valid_particles.end())
+    ParticleData* address = s_valid_particles.find(Util::value_to_ull(v_address));
+    if (address == nullptr)
         rb_raise(rb_eTypeError, "Given address doesn't reference a valid particle!");
     return address;
 }
 
-VALUE MSP::Particle::c_particle_to_value(ParticleData* address) {
-    return rb_ull2inum(reinterpret_cast<unsigned long long>(address));
+VALUE MSP::Particle::c_particle_to_value(ParticleData* data) {
+    return rb_ull2inum(data->m_handle);
+}
+
+void MSP::Particle::c_destroy_particle(ParticleData* data) {
+    s_valid_particles.erase(data->m_handle);
+    delete[] data->m_pts;
+    delete data;
 }
 
 bool MSP::Particle::c_update_particle(ParticleData* data, dFloat timestep) {
@@ -64,9 +70,7 @@ bool MSP::Particle::c_update_particle(ParticleData* data, dFloat timestep) {
     data->m_cur_life += timestep;
     // Check if need to delete the particle
     if (data->m_radius < 0.01f || data->m_radius > 100000.0 || data->m_cur_life > data->m_lifetime) {
-        s_valid_particles.erase(data);
-        delete[] data->m_pts;
-        delete data;
+        c_destroy_particle(data);
         return false;
     }
     // Calc life ratio
@@ -243,7 +247,7 @@ VALUE MSP::Particle::c_points_on_circle3d(const dVector& origin, dFloat radius,
 */
 
 VALUE MSP::Particle::rbf_is_valid(VALUE self, VALUE v_address) {
-    return c_is_valid(reinterpret_cast<ParticleData*>(Util::value_to_ull(v_address))) ? Qtrue : Qfalse;
+    return c_is_valid(Util::value_to_ull(v_address)) ? Qtrue : Qfalse;
 }
 
 VALUE MSP::Particle::rbf_create(VALUE self, VALUE v_opts) {
@@ -332,7 +336,7 @@ VALUE MSP::Particle::rbf_create(VALUE self, VALUE v_opts) {
         angle += offset;
     }
 
-    s_valid_particles.insert(data);
+    data->m_handle = s_valid_particles.insert(data);
     return c_particle_to_value(data);
 }
 
@@ -356,18 +360,16 @@ VALUE MSP::Particle::rbf_draw(VALUE self, VALUE v_address, VALUE v_view, VALUE v
 
 VALUE MSP::Particle::rbf_destroy(VALUE self, VALUE v_address) {
     ParticleData* data = c_value_to_particle(v_address);
-    s_valid_particles.erase(data);
-    delete[] data->m_pts;
-    delete data;
+    c_destroy_particle(data);
     return Qnil;
 }
 
 VALUE MSP::Particle::rbf_update_all(VALUE self, VALUE v_timestep) {
     dFloat timestep = Util::value_to_dFloat(v_timestep);
-    for (std::set<ParticleData*>::iterator it = s_valid_particles.begin(); it != s_valid_particles.end();) {
-        ParticleData* data = *it;
-        ++it;
-        c_update_particle(data, timestep);
+    for (unsigned int i = 0; i < s_valid_particles.capacity(); ++i) {
+        ParticleData* data = s_valid_particles.at(i);
+        if (data != nullptr)
+            c_update_particle(data, timestep);
     }
     return Qnil;
 }
@@ -380,8 +382,9 @@ VALUE MSP::Particle::rbf_draw_all(VALUE self, VALUE v_view, VALUE v_bb) {
     VALUE v_zaxis = rb_funcall(v_camera, Util::INTERN_ZAXIS, 0); // camera front
     dMatrix camera_tra(Util::value_to_vector(v_xaxis), Util::value_to_vector(v_yaxis), Util::value_to_vector(v_zaxis), Util::value_to_vector(v_eye));
     std::map<dFloat, std::vector<ParticleData*>> sorted_data;
-    for (std::set<ParticleData*>::iterator it = s_valid_particles.begin(); it != s_valid_particles.end(); ++it) {
-        ParticleData* data = *it;
+    for (unsigned int i = 0; i < s_valid_particles.capacity(); ++i) {
+        ParticleData* data = s_valid_particles.at(i);
+        if (data == nullptr) continue;
         dVector pv(data->m_position - camera_tra.m_posit);
         if (pv.DotProduct3(camera_tra.m_right) > M_EPSILON) {
             dFloat dist = Util::get_vector_magnitude2(pv);
@@ -396,12 +399,11 @@ VALUE MSP::Particle::rbf_draw_all(VALUE self, VALUE v_view, VALUE v_bb) {
 }
 
 VALUE MSP::Particle::rbf_destroy_all(VALUE self) {
-    for (std::set<ParticleData*>::iterator it = s_valid_particles.begin(); it != s_valid_particles.end(); ++it) {
-        ParticleData* data = *it;
-        delete[] data->m_pts;
-        delete data;
+    for (unsigned int i = 0; i < s_valid_particles.capacity(); ++i) {
+        ParticleData* data = s_valid_particles.at(i);
+        if (data != nullptr)
+            c_destroy_particle(data);
     }
-    s_valid_particles.clear();
     return Qnil;
 }
 
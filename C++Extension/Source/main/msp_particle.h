@@ -38,6 +38,7 @@ private:
         unsigned int m_num_seg;
         dFloat m_cur_life;
         dFloat* m_pts;
+        unsigned long long m_handle;
     };
 
     // Variables
@@ -60,12 +61,13 @@ private:
     static VALUE V_GL_POLYGON;
 
     static VALUE s_reg_symbols;
-    static std::set<ParticleData*> s_valid_particles;
+    static HandleTable<ParticleData*> s_valid_particles;
 
     // Helper Functions
-    static bool c_is_valid(ParticleData* address);
+    static bool c_is_valid(unsigned long long handle);
     static ParticleData* c_value_to_particle(VALUE v_address);
-    static VALUE c_particle_to_value(ParticleData* address);
+    static VALUE c_particle_to_value(ParticleData* data);
+    static void c_destroy_particle(ParticleData* data);
     static bool c_update_particle(ParticleData* data, dFloat timestep);
     static void c_draw_particle(ParticleData* data, VALUE v_view, VALUE v_bb, const dMatrix& camera_tra);
     static VALUE c_points_on_circle2d(const dVector& origin, dFloat radius, unsigned int num_seg, dFloat rot_angle);
@@ -79,6 +79,9 @@ ID Util::INTERN_ACTIVE_MODEL;
 ID Util::INTERN_ACTIVE_VIEW;
 
 bool Util::s_validate_objects(true);
+bool Util::s_point3d_basic_new(false);
+bool Util::s_vector3d_basic_new(false);
+bool Util::s_transformation_basic_new(false);
 
 
 /*
@@ -175,26 +178,23 @@ VALUE Util::to_value(const wchar_t* value, unsigned int length) {
     return rb_funcall(v_data, INTERN_PACK, 1, rb_str_new2("U*"));
 }
 
+VALUE Util::new_instance(VALUE klass, bool basic_new, int argc, const VALUE* argv) {
+    // Skip the dispatch of the new method when the class doesn't override it.
+#ifndef RUBY_VERSION18
+    if (basic_new)
+        return rb_class_new_instance(argc, argv, klass);
+#endif
+    return rb_funcall2(klass, INTERN_NEW, argc, argv);
+}
+
 VALUE Util::vector_to_value(const dVector& value) {
-    return rb_funcall(
-        SU_VECTOR3D,
-        INTERN_NEW,
-        3,
-        rb_float_new(value.m_x),
-        rb_float_new(value.m_y),
-        rb_float_new(value.m_z)
-    );
+    VALUE argv[3] = { rb_float_new(value.m_x), rb_float_new(value.m_y), rb_float_new(value.m_z) };
+    return new_instance(SU_VECTOR3D, s_vector3d_basic_new, 3, argv);
 }
 
 VALUE Util::point_to_value(const dVector& value) {
-    return rb_funcall(
-        SU_POINT3D,
-        INTERN_NEW,
-        3,
-        rb_float_new(value.m_x),
-        rb_float_new(value.m_y),
-        rb_float_new(value.m_z)
-    );
+    VALUE argv[3] = { rb_float_new(value.m_x), rb_float_new(value.m_y), rb_float_new(value.m_z) };
+    return new_instance(SU_POINT3D, s_point3d_basic_new, 3, argv);
 }
 
 VALUE Util::matrix_to_value(const dMatrix& value) {
@@ -220,7 +220,32 @@ VALUE Util::matrix_to_value(const dMatrix& value) {
     rb_ary_store(v_matrix, 14, rb_float_new(value.m_posit.m_z));
     rb_ary_store(v_matrix, 15, rb_float_new(value.m_posit.m_w));
 
-    return rb_funcall(SU_TRANSFORMATION, INTERN_NEW, 1, v_matrix);
+    return new_instance(SU_TRANSFORMATION, s_transformation_basic_new, 1, &v_matrix);
+}
+
+VALUE Util::vectors_to_value(const dVector* values, unsigned int count) {
+    VALUE v_vectors = rb_ary_new2(count);
+    for (unsigned int i = 0; i < count; ++i)
+        rb_ary_store(v_vectors, i, vector_to_value(values[i]));
+    return v_vectors;
+}
+
+VALUE Util::points_to_value(const dVector* values, unsigned int count) {
+    VALUE v_points = rb_ary_new2(count);
+    for (unsigned int i = 0; i < count; ++i)
+        rb_ary_store(v_points, i, point_to_value(values[i]));
+    return v_points;
+}
+
+VALUE Util::points_to_packed(const dVector* values, unsigned int count) {
+    // Three native doubles per point; unpack with 'D*'.
+    VALUE v_string = rb_str_new(nullptr, static_cast<long>(count * 3 * sizeof(double)));
+    char* data = RSTRING_PTR(v_string);
+    for (unsigned int i = 0; i < count; ++i) {
+        double coords[3] = { static_cast<double>(values[i].m_x), static_cast<double>(values[i].m_y), static_cast<double>(values[i].m_z) };
+        memcpy(data + i * sizeof(coords), coords, sizeof(coords));
+    }
+    return v_string;
 }
 
 VALUE Util::color_to_value(const dVector& value, dFloat alpha) {
@@ -269,9 +294,16 @@ dMatrix Util::value_to_matrix(VALUE value) {
     if (rb_obj_is_kind_of(value, SU_TRANSFORMATION) == Qfalse)
         value = rb_funcall(SU_TRANSFORMATION, INTERN_NEW, 1, value);
     VALUE v_matrix_ary = rb_funcall(value, INTERN_TO_A, 0);
+    double ma[16];
+    for (int i = 0; i < 16; ++i)
+        ma[i] = rb_num2dbl(rb_ary_entry(v_matrix_ary, i));
+    return values_to_matrix(ma);
+}
+
+dMatrix Util::values_to_matrix(const double* values) {
     dFloat ma[16];
     for (int i = 0; i < 16; ++i)
-        ma[i] = static_cast<dFloat>(rb_num2dbl(rb_ary_entry(v_matrix_ary, i)));
+        ma[i] = static_cast<dFloat>(values[i]);
     // Extract global scale
     if (dAbs(ma[15]) > M_EPSILON) {
         dFloat inv_wscale = 1.0f / ma[15];
@@ -353,6 +385,11 @@ bool Util::is_vector_valid(const dVector& vector) {
     return (vector.m_x == vector.m_x && vector.m_y == vector.m_y && vector.m_z == vector.m_z);
 }
 
+long long Util::get_grid_key(long long x, long long y, long long z) {
+    // Pack the lower 21 bits of each cell coordinate into a single key.
+    return ((x & 0x1FFFFF) << 42) | ((y & 0x1FFFFF) << 21) | (z & 0x1FFFFF);
+}
+
 bool Util::is_matrix_uniform(const dMatrix& matrix) {
     return (dAbs(matrix.m_front.DotProduct3(matrix.m_up)) < M_EPSILON2 && dAbs(matrix.m_front.DotProduct3(matrix.m_right)) < M_EPSILON2 && dAbs(matrix.m_up.DotProduct3(matrix.m_right)) < M_EPSILON2);
 }
@@ -515,6 +552,17 @@ VALUE Util::call_proc(VALUE v_proc) {
     return rb_funcall(v_proc, INTERN_CALL, 0);
 }
 
+unsigned long long Util::hash_bytes(const void* data, size_t size) {
+    // 64-bit FNV-1a
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
 VALUE Util::rescue_proc(VALUE v_args, VALUE v_exception) {
     VALUE v_message = rb_funcall(v_exception, INTERN_INSPECT, 0);
     rb_funcall(rb_stdout, INTERN_PUTS, 1, v_message);
@@ -539,6 +587,12 @@ void Util::init_ruby() {
     SU_TRANSFORMATION = rb_eval_string("::Geom::Transformation");
 
     INTERN_NEW = rb_intern("new");
+
+#ifndef RUBY_VERSION18
+    s_point3d_basic_new = rb_get_alloc_func(SU_POINT3D) != 0 && rb_method_basic_definition_p(CLASS_OF(SU_POINT3D), INTERN_NEW) != 0;
+    s_vector3d_basic_new = rb_get_alloc_func(SU_VECTOR3D) != 0 && rb_method_basic_definition_p(CLASS_OF(SU_VECTOR3D), INTERN_NEW) != 0;
+    s_transformation_basic_new = rb_get_alloc_func(SU_TRANSFORMATION) != 0 && rb_method_basic_definition_p(CLASS_OF(SU_TRANSFORMATION), INTERN_NEW) != 0;
+#endif
     INTERN_TO_A = rb_intern("to_a");
     INTERN_X = rb_intern("x");
     INTERN_Y = rb_intern("y");
@@ -92,6 +92,9 @@ namespace Util {
     extern ID INTERN_ACTIVE_VIEW;
 
     extern bool s_validate_objects;
+    extern bool s_point3d_basic_new;
+    extern bool s_vector3d_basic_new;
+    extern bool s_transformation_basic_new;
 
     // Functions
     float min_float(float a, float b);
@@ -164,9 +167,13 @@ namespace Util {
     VALUE to_value(const wchar_t* value);
     VALUE to_value(const wchar_t* value, unsigned int length);
 
+    VALUE new_instance(VALUE klass, bool basic_new, int argc, const VALUE* argv);
     VALUE vector_to_value(const dVector& value);
     VALUE point_to_value(const dVector& value);
     VALUE matrix_to_value(const dMatrix& value);
+    VALUE vectors_to_value(const dVector* values, unsigned int count);
+    VALUE points_to_value(const dVector* values, unsigned int count);
+    VALUE points_to_packed(const dVector* values, unsigned int count);
     VALUE color_to_value(const dVector& value, dFloat alpha);
 
     inline bool value_to_bool(VALUE value) {
@@ -235,6 +242,7 @@ namespace Util {
     dVector value_to_vector(VALUE value);
     dVector value_to_point(VALUE value);
     dMatrix value_to_matrix(VALUE value);
+    dMatrix values_to_matrix(const double* values);
     dVector value_to_color(VALUE value);
 
     dFloat get_vector_magnitude(const dVector& vector);
@@ -245,6 +253,7 @@ namespace Util {
     void zero_out_vector(dVector& vector);
     bool vectors_identical(const dVector& a, const dVector& b);
     bool is_vector_valid(const dVector& vector);
+    long long get_grid_key(long long x, long long y, long long z);
 
     bool is_matrix_uniform(const dMatrix& matrix);
     bool is_matrix_flat(const dMatrix& matrix);
@@ -261,6 +270,8 @@ namespace Util {
     VALUE call_proc(VALUE v_proc);
     VALUE rescue_proc(VALUE v_args, VALUE v_exception);
 
+    unsigned long long hash_bytes(const void* data, size_t size);
+
     template<typename T>
     inline bool is_number(T number) {
         return number == number;
@@ -12,6 +12,8 @@
 #include "msp_joint.h"
 #include "msp_gear.h"
 
+#include <algorithm>
+
 /*
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
   Constants
@@ -26,6 +28,15 @@ const dFloat MSP::World::DEFAULT_CONTACT_MERGE_TOLERANCE(0.005f);
 const dFloat MSP::World::MIN_TOUCH_DISTANCE(0.005f);
 const dFloat MSP::World::MIN_TIMESTEP(1.0f / 1200.0f);
 const dFloat MSP::World::MAX_TIMESTEP(1.0f / 30.0f);
+const dFloat MSP::World::DEFAULT_MAGNET_THETA(0.5f);
+const int MSP::World::MAGNET_LEAF_SIZE(4);
+const int MSP::World::MAGNET_MAX_DEPTH(16);
+const int MSP::World::MIN_SENSOR_PAIRS_PER_JOB(16);
+const int MSP::World::SNAPSHOT_CHUNK_SIZE(256);
+const int MSP::World::QUERY_AWAKE(1);
+const int MSP::World::QUERY_DYNAMIC(2);
+const int MSP::World::RAY_BATCH_CHUNK_SIZE(16);
+const int MSP::World::EXPLOSION_SAMPLE_COUNT(9);
 
 
 /*
@@ -34,7 +45,7 @@ const dFloat MSP::World::MAX_TIMESTEP(1.0f / 30.0f);
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 */
 
-std::map<const NewtonWorld*, MSP::World::WorldData*> MSP::World::valid_worlds;
+MSP::HandleTable<const NewtonWorld*> MSP::World::valid_worlds;
 
 
 /*
@@ -45,24 +56,24 @@ std::map<const NewtonWorld*, MSP::World::WorldData*> MSP::World::valid_worlds;
 
 void MSP::World::destructor_callback(const NewtonWorld* const world) {
     WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
-    if (valid_worlds.find(world) != valid_worlds.end())
-        valid_worlds.erase(world);
+    if (world_data->m_update_pending) {
+        NewtonWaitForUpdateToFinish(world);
+        world_data->m_update_pending = false;
+    }
+    valid_worlds.erase(world_data->m_handle);
     c_clear_touch_events(world);
     // Call world destructor procedure
     if (rb_ary_entry(world_data->m_user_info, 0) != Qnil)
         rb_rescue2(RUBY_METHOD_FUNC(Util::call_proc), rb_ary_entry(world_data->m_user_info, 0), RUBY_METHOD_FUNC(Util::rescue_proc), Qnil, rb_eException, (VALUE)0);
-    for (std::set<MSP::Gear::GearData*>::iterator it = MSP::Gear::s_valid_gears.begin(); it != MSP::Gear::s_valid_gears.end();) {
-        MSP::Gear::GearData* gear_data = *it;
-        ++it;
-        if (gear_data->m_world == world)
-            MSP::Gear::c_destroy(gear_data);
-    }
-    for (std::map<MSP::Joint::JointData*, bool>::iterator it = MSP::Joint::s_valid_joints.begin(); it != MSP::Joint::s_valid_joints.end();) {
-        MSP::Joint::JointData* joint_data = it->first;
-        ++it;
-        if (joint_data->m_world == world)
-            MSP::Joint::c_destroy(joint_data);
-    }
+    // Destroying an object unlinks it from its world list.
+    while (!world_data->m_gears.empty())
+        MSP::Gear::c_destroy(world_data->m_gears.first());
+    while (!world_data->m_joints.empty())
+        MSP::Joint::c_destroy(world_data->m_joints.first());
+    // Bodies hold their data in the pool of this world, so they are destroyed
+    // here rather than after the callback returns.
+    NewtonDestroyAllBodies(world);
+    MSP::Collision::c_clear_shape_cache(world);
     delete world_data;
 }
 
@@ -78,15 +89,15 @@ int MSP::World::aabb_overlap_callback(const NewtonJoint* const contact, dFloat t
         (NewtonBodyGetFreezeState(body0) == 1 && NewtonBodyGetFreezeState(body1) == 1) ||
         (data0->m_bstatic && NewtonBodyGetFreezeState(body1) == 1) ||
         (data1->m_bstatic && NewtonBodyGetFreezeState(body0) == 1) ||
-        (data0->m_non_collidable_bodies.find(body1) != data0->m_non_collidable_bodies.end()) ||
-        (data1->m_non_collidable_bodies.find(body0) != data1->m_non_collidable_bodies.end())) {
+        (data0->m_non_collidable_count != 0 && data1->m_non_collidable_count != 0 &&
+            data0->m_cold->m_non_collidable_bodies.find(body1) != data0->m_cold->m_non_collidable_bodies.end())) {
         if (NewtonBodyGetContinuousCollisionMode(body0) == 1) {
             NewtonBodySetContinuousCollisionMode(body0, 0);
-            world_data->m_temp_cccd_bodies.push_back(body0);
+            world_data->m_thread_buffers[thread_index].m_cccd_bodies.push_back(body0);
         }
         if (NewtonBodyGetContinuousCollisionMode(body1) == 1) {
             NewtonBodySetContinuousCollisionMode(body1, 0);
-            world_data->m_temp_cccd_bodies.push_back(body1);
+            world_data->m_thread_buffers[thread_index].m_cccd_bodies.push_back(body1);
         }
         return 0;
     }
@@ -139,35 +150,33 @@ void MSP::World::contact_callback(const NewtonJoint* const contact_joint, dFloat
     }
     const NewtonWorld* world = NewtonBodyGetWorld(body0);
     WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    // Touchers are only read here; events are recorded per thread and merged after the update.
+    ThreadBuffer& buffer = world_data->m_thread_buffers[thread_index];
     void* contact = NewtonContactJointGetFirstContact(contact_joint);
     const NewtonMaterial* material = NewtonContactGetMaterial(contact);
     if (data0->m_record_touch_data) {
-        if (data0->m_touchers.find(body1) == data0->m_touchers.end()) {
+        if (data0->m_cold->m_touchers.find(body1) == nullptr) {
             dVector point;
             dVector normal;
             dVector force;
             NewtonMaterialGetContactPositionAndNormal(material, body0, &point[0], &normal[0]);
             NewtonMaterialGetContactForce(material, body0, &force[0]);
-            BodyTouchData* touch_data = new BodyTouchData(body0, body1, point, normal, force, NewtonMaterialGetContactNormalSpeed(material));
-            world_data->m_touch_data.push_back(touch_data);
-            data0->m_touchers[body1] = 0;
+            buffer.m_touch_data.push_back(BodyTouchData(data0->m_handle, data1->m_handle, point, normal, force, NewtonMaterialGetContactNormalSpeed(material)));
         }
         else
-            data0->m_touchers[body1] = 2;
+            buffer.m_touching_data.push_back(BodyTouchingData(data0->m_handle, data1->m_handle));
     }
     if (data1->m_record_touch_data) {
-        if (data1->m_touchers.find(body0) == data1->m_touchers.end()) {
+        if (data1->m_cold->m_touchers.find(body0) == nullptr) {
             dVector point;
             dVector normal;
             dVector force;
             NewtonMaterialGetContactPositionAndNormal(material, body1, &point[0], &normal[0]);
             NewtonMaterialGetContactForce(material, body1, &force[0]);
-            BodyTouchData* touch_data = new BodyTouchData(body1, body0, point, normal, force, NewtonMaterialGetContactNormalSpeed(material));
-            world_data->m_touch_data.push_back(touch_data);
-            data1->m_touchers[body0] = 0;
+            buffer.m_touch_data.push_back(BodyTouchData(data1->m_handle, data0->m_handle, point, normal, force, NewtonMaterialGetContactNormalSpeed(material)));
         }
         else
-            data1->m_touchers[body0] = 2;
+            buffer.m_touching_data.push_back(BodyTouchingData(data1->m_handle, data0->m_handle));
     }
 }
 
@@ -189,28 +198,84 @@ dFloat MSP::World::ray_filter_callback(const NewtonBody* const body, const Newto
 
 dFloat MSP::World::continuous_ray_filter_callback(const NewtonBody* const body, const NewtonCollision* const shape_hit, const dFloat* const hit_contact, const dFloat* const hit_normal, dLong collision_id, void* const user_data, dFloat intersect_param) {
     RayData* ray_data = reinterpret_cast<RayData*>(user_data);
-    HitData* hit = new HitData(body, dVector(hit_contact), dVector(hit_normal));
-    ray_data->m_hits.push_back(hit);
+    ray_data->m_hits.push_back(HitData(body, dVector(hit_contact), dVector(hit_normal)));
     return 1.0f;
 }
 
+unsigned MSP::World::ray_batch_prefilter_callback(const NewtonBody* const body, const NewtonCollision* const collision, void* const user_data) {
+    const RayBatchHit* hit = reinterpret_cast<const RayBatchHit*>(user_data);
+    if ((hit->m_flags & QUERY_AWAKE) != 0 && NewtonBodyGetSleepState(body) != 0)
+        return 0;
+    if ((hit->m_flags & QUERY_DYNAMIC) != 0) {
+        const MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body));
+        if (!body_data->m_dynamic || body_data->m_bstatic)
+            return 0;
+    }
+    return 1;
+}
+
+dFloat MSP::World::ray_batch_filter_callback(const NewtonBody* const body, const NewtonCollision* const shape_hit, const dFloat* const hit_contact, const dFloat* const hit_normal, dLong collision_id, void* const user_data, dFloat intersect_param) {
+    RayBatchHit* hit = reinterpret_cast<RayBatchHit*>(user_data);
+    if (intersect_param <= hit->m_param) {
+        hit->m_body = body;
+        hit->m_param = intersect_param;
+        hit->m_point = dVector(hit_contact);
+        hit->m_normal = dVector(hit_normal);
+    }
+    return intersect_param;
+}
+
+void MSP::World::ray_batch_job(NewtonWorld* const world, void* const user_data, int thread_index) {
+    c_cast_ray_batch(world, *reinterpret_cast<RayBatch*>(user_data), thread_index);
+}
+
 int MSP::World::body_iterator(const NewtonBody* const body, void* const user_data) {
     std::vector<const NewtonBody*>* bodies = reinterpret_cast<std::vector<const NewtonBody*>*>(user_data);
     bodies->push_back(body);
     return 1;
 }
 
+int MSP::World::explosion_iterator(const NewtonBody* const body, void* const user_data) {
+    std::vector<const NewtonBody*>* bodies = reinterpret_cast<std::vector<const NewtonBody*>*>(user_data);
+    const MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body));
+    if (body_data->m_dynamic && !body_data->m_bstatic && body_data->m_mass > MSP::Body::MIN_MASS)
+        bodies->push_back(body);
+    return 1;
+}
+
+void MSP::World::explosion_job(NewtonWorld* const world, void* const user_data, int thread_index) {
+    c_cast_explosion_rays(world, *reinterpret_cast<ExplosionCast*>(user_data), thread_index);
+}
+
+int MSP::World::sensor_iterator(const NewtonBody* const body, void* const user_data) {
+    SensorQuery* query = reinterpret_cast<SensorQuery*>(user_data);
+    if (body == query->m_body || MSP::Body::c_bodies_collidable(query->m_body, body))
+        return 1;
+    MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(query->m_body));
+    char* state = body_data->m_cold->m_touchers.find(body);
+    if (state == nullptr)
+        query->m_pairs->push_back(SensorPair(query->m_body, body));
+    else
+        *state = 2;
+    return 1;
+}
+
+void MSP::World::sensor_collide_job(NewtonWorld* const world, void* const user_data, int thread_index) {
+    c_collide_sensor_pairs(world, thread_index);
+}
+
+void MSP::World::snapshot_job(NewtonWorld* const world, void* const user_data, int thread_index) {
+    c_fill_snapshot_chunks(*reinterpret_cast<BodySnapshot*>(user_data));
+}
+
 void MSP::World::collision_copy_constructor_callback(const NewtonWorld* const world, NewtonCollision* const collision, const NewtonCollision* const source_collision) {
-    MSP::Collision::CollisionData* data = MSP::Collision::s_valid_collisions[source_collision];
-    MSP::Collision::s_valid_collisions[collision] = new MSP::Collision::CollisionData(data->m_scale);
+    MSP::Collision::CollisionData* data = MSP::Collision::c_get_collision_data(source_collision);
+    if (data != nullptr)
+        MSP::Collision::c_attach_collision_data(collision, new MSP::Collision::CollisionData(data->m_scale));
 }
 
 void MSP::World::collision_destructor_callback(const NewtonWorld* const world, const NewtonCollision* const collision) {
-    std::map<const NewtonCollision*, MSP::Collision::CollisionData*>::iterator it = MSP::Collision::s_valid_collisions.find(collision);
-    if (it != MSP::Collision::s_valid_collisions.end()) {
-        delete it->second;
-        MSP::Collision::s_valid_collisions.erase(it);
-    }
+    MSP::Collision::c_release_collision_data(collision);
 }
 
 void MSP::World::draw_collision_iterator(void* const user_data, int vertex_count, const dFloat* const face_array, int face_id) {
@@ -230,111 +295,301 @@ void MSP::World::draw_collision_iterator(void* const user_data, int vertex_count
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 */
 
-bool MSP::World::c_is_world_valid(const NewtonWorld* address) {
-    return valid_worlds.find(address) != valid_worlds.end();
+bool MSP::World::c_is_world_valid(unsigned long long handle) {
+    return valid_worlds.is_valid(handle);
 }
 
 VALUE MSP::World::c_world_to_value(const NewtonWorld* world) {
-    return rb_ull2inum(reinterpret_cast<unsigned long long>(world));
+    return rb_ull2inum(reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world))->m_handle);
 }
 
 const NewtonWorld* MSP::World::c_value_to_world(VALUE v_world) {
-    const NewtonWorld* address = reinterpret_cast<NewtonWorld*>(rb_num2ull(v_world));
-    if (Util::s_validate_objects && valid_worlds.find(address) == valid_worlds.end())
+    const NewtonWorld* address = c_value_to_world2(v_world);
+    // Ruby may not touch the world while the solver runs on worker threads.
+    c_wait_for_update(address);
+    return address;
+}
+
+// Unlike c_value_to_world, leaves a pending update running.
+const NewtonWorld* MSP::World::c_value_to_world2(VALUE v_world) {
+    unsigned long long handle = rb_num2ull(v_world);
+    const NewtonWorld* address = valid_worlds.find(handle);
+    if (address == nullptr)
         rb_raise(rb_eTypeError, "Given address doesn't reference a valid world!");
     return address;
 }
 
 void MSP::World::c_update_magnets(const NewtonWorld* world, dFloat timestep) {
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    world_data->m_magnet_bodies.clear();
+    world_data->m_magnetic_indices.clear();
+    world_data->m_range_magnet_indices.clear();
+    world_data->m_field_magnet_indices.clear();
+    // Cache world space centres of mass of all magnets and magnetic bodies once per step.
     dMatrix matrix;
     dVector com;
-    dMatrix other_matrix;
-    dVector other_com;
-    dVector dir;
     for (const NewtonBody* body = NewtonWorldGetFirstBody(world); body; body = NewtonWorldGetNextBody(world, body)) {
         MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body));
-        if (body_data->m_magnet_mode == 1) {
-            // Magnet force is dissipated linearly over the magnet range.
-            /*if (dAbs(body_data->magnet_force) > M_EPSILON && body_data->magnet_range > M_EPSILON) {
-                NewtonBodyGetMatrix(body, &matrix[0][0]);
-                NewtonBodyGetCentreOfMass(body, &com[0]);
-                com = matrix.TransformVector(com);
-                for (const NewtonBody* other_body = NewtonWorldGetFirstBody(world); other_body; other_body = NewtonWorldGetNextBody(world, other_body)) {
-                    if (other_body != body) {
-                        MSP::Body::BodyData* other_body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(other_body));
-                        if (other_body_data->magnetic) {
-                            NewtonBodyGetMatrix(other_body, &other_matrix[0][0]);
-                            NewtonBodyGetCentreOfMass(other_body, &other_com[0]);
-                            other_com = other_matrix.TransformVector(other_com);
-                            dir = other_com - com;
-                            dFloat dist = Util::get_vector_magnitude(dir);
-                            if (dist > M_EPSILON && dist < body_data->magnet_range) {
-                                Util::scale_vector(dir, (body_data->magnet_range - dist) * body_data->magnet_force / (body_data->magnet_range * dist));
-                                MSP::Body::c_body_add_force(other_body_data, dVector(-dir.m_x, -dir.m_y, -dir.m_z));
-                                // For every action there is an equal and opposite reaction
-                                MSP::Body::c_body_add_force(body_data, dir);
-                            }
-                        }
-                    }
-                }
-            }*/
-            // Magnet force is dissipated quadratically over the magnet range.
-            // actual_magnet_force = magnet_force * (distance - magnet_range)^2 / magnet_range^2
-            if (dAbs(body_data->m_magnet_force) > M_EPSILON) {
-                NewtonBodyGetMatrix(body, &matrix[0][0]);
-                NewtonBodyGetCentreOfMass(body, &com[0]);
-                com = matrix.TransformVector(com);
-                for (const NewtonBody* other_body = NewtonWorldGetFirstBody(world); other_body; other_body = NewtonWorldGetNextBody(world, other_body)) {
-                    if (other_body != body) {
-                        MSP::Body::BodyData* other_body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(other_body));
-                        if (other_body_data->m_magnetic) {
-                            NewtonBodyGetMatrix(other_body, &other_matrix[0][0]);
-                            NewtonBodyGetCentreOfMass(other_body, &other_com[0]);
-                            other_com = other_matrix.TransformVector(other_com);
-                            dir = other_com - com;
-                            dFloat dist = Util::get_vector_magnitude(dir);
-                            if (dist > M_EPSILON && dist < body_data->m_magnet_range) {
-                                // f * (x-r)^2 / r^2 -> f * (x^2 - 2xr + r^2) / r^2
-                                dFloat diff = dist - body_data->m_magnet_range;
-                                dFloat actual_force = body_data->m_magnet_force * diff * diff / (body_data->m_magnet_range * body_data->m_magnet_range);
-                                Util::scale_vector(dir, actual_force / dist);
-                                MSP::Body::c_body_add_force(other_body_data, dVector(-dir.m_x, -dir.m_y, -dir.m_z));
-                                // For every action there is an equal and opposite reaction
-                                MSP::Body::c_body_add_force(body_data, dir);
-                            }
-                        }
+        bool range_magnet = body_data->m_magnet_mode == 1 && dAbs(body_data->m_magnet_force) > M_EPSILON && body_data->m_magnet_range > M_EPSILON;
+        bool field_magnet = body_data->m_magnet_mode != 1 && dAbs(body_data->m_magnet_strength) > M_EPSILON;
+        if (!range_magnet && !field_magnet && !body_data->m_magnetic)
+            continue;
+        NewtonBodyGetMatrix(body, &matrix[0][0]);
+        NewtonBodyGetCentreOfMass(body, &com[0]);
+        int index = static_cast<int>(world_data->m_magnet_bodies.size());
+        world_data->m_magnet_bodies.push_back(MagnetBody(body, matrix.TransformVector(com)));
+        if (body_data->m_magnetic)
+            world_data->m_magnetic_indices.push_back(index);
+        if (range_magnet)
+            world_data->m_range_magnet_indices.push_back(index);
+        else if (field_magnet)
+            world_data->m_field_magnet_indices.push_back(index);
+    }
+    if (world_data->m_magnetic_indices.empty())
+        return;
+    if (!world_data->m_range_magnet_indices.empty())
+        c_apply_range_magnets(world_data);
+    if (!world_data->m_field_magnet_indices.empty())
+        c_apply_field_magnets(world_data);
+    for (std::vector<MagnetBody>::iterator it = world_data->m_magnet_bodies.begin(); it != world_data->m_magnet_bodies.end(); ++it) {
+        if (it->m_force_state)
+            MSP::Body::c_body_add_force(reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(it->m_body)), it->m_force);
+    }
+}
+
+void MSP::World::c_apply_range_magnets(WorldData* world_data) {
+    // actual_magnet_force = magnet_force * (distance - magnet_range)^2 / magnet_range^2
+    // Magnetic bodies are bucketed in a uniform grid, sorted by cell key, with
+    // cell size equal to the average magnet range.
+    std::vector<MagnetBody>& bodies = world_data->m_magnet_bodies;
+    std::vector<std::pair<long long, int>>& grid = world_data->m_magnet_grid;
+    dFloat cell_size = 0.0f;
+    for (std::vector<int>::iterator it = world_data->m_range_magnet_indices.begin(); it != world_data->m_range_magnet_indices.end(); ++it) {
+        MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(bodies[*it].m_body));
+        cell_size += body_data->m_magnet_range;
+    }
+    cell_size /= static_cast<dFloat>(world_data->m_range_magnet_indices.size());
+    dFloat inv_cell_size = 1.0f / cell_size;
+    grid.clear();
+    for (std::vector<int>::iterator it = world_data->m_magnetic_indices.begin(); it != world_data->m_magnetic_indices.end(); ++it) {
+        const dVector& com = bodies[*it].m_com;
+        long long key = Util::get_grid_key(
+            static_cast<long long>(dFloor(com.m_x * inv_cell_size)),
+            static_cast<long long>(dFloor(com.m_y * inv_cell_size)),
+            static_cast<long long>(dFloor(com.m_z * inv_cell_size)));
+        grid.push_back(std::pair<long long, int>(key, *it));
+    }
+    std::sort(grid.begin(), grid.end());
+    long long num_magnetic = static_cast<long long>(world_data->m_magnetic_indices.size());
+    for (std::vector<int>::iterator it = world_data->m_range_magnet_indices.begin(); it != world_data->m_range_magnet_indices.end(); ++it) {
+        MagnetBody& magnet = bodies[*it];
+        MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(magnet.m_body));
+        dFloat range = body_data->m_magnet_range;
+        dFloat inv_sq_range = 1.0f / (range * range);
+        double cell_min_x = floor(static_cast<double>(magnet.m_com.m_x - range) * inv_cell_size);
+        double cell_min_y = floor(static_cast<double>(magnet.m_com.m_y - range) * inv_cell_size);
+        double cell_min_z = floor(static_cast<double>(magnet.m_com.m_z - range) * inv_cell_size);
+        double cell_max_x = floor(static_cast<double>(magnet.m_com.m_x + range) * inv_cell_size);
+        double cell_max_y = floor(static_cast<double>(magnet.m_com.m_y + range) * inv_cell_size);
+        double cell_max_z = floor(static_cast<double>(magnet.m_com.m_z + range) * inv_cell_size);
+        // Counted in double, so that large ranges cannot overflow.
+        double num_cells = (cell_max_x - cell_min_x + 1.0) * (cell_max_y - cell_min_y + 1.0) * (cell_max_z - cell_min_z + 1.0);
+        // Gather the candidates either from the overlapped cells or, if the
+        // magnet spans more cells than there are magnetic bodies, from all of them.
+        world_data->m_magnet_temp.clear();
+        if (!(num_cells <= static_cast<double>(num_magnetic)))
+            world_data->m_magnet_temp.assign(world_data->m_magnetic_indices.begin(), world_data->m_magnetic_indices.end());
+        else {
+            // The cell count is bounded here, so the indices fit.
+            long long min_x = static_cast<long long>(cell_min_x);
+            long long min_y = static_cast<long long>(cell_min_y);
+            long long min_z = static_cast<long long>(cell_min_z);
+            long long max_x = static_cast<long long>(cell_max_x);
+            long long max_y = static_cast<long long>(cell_max_y);
+            long long max_z = static_cast<long long>(cell_max_z);
+            for (long long x = min_x; x <= max_x; ++x) {
+                for (long long y = min_y; y <= max_y; ++y) {
+                    for (long long z = min_z; z <= max_z; ++z) {
+                        std::pair<long long, int> cell(Util::get_grid_key(x, y, z), -1);
+                        for (std::vector<std::pair<long long, int>>::iterator cit = std::lower_bound(grid.begin(), grid.end(), cell); cit != grid.end() && cit->first == cell.first; ++cit)
+                            world_data->m_magnet_temp.push_back(cit->second);
                     }
                 }
             }
         }
-        else {
-            // actual_magnet_force = magnet_strength / distance^2
-            if (dAbs(body_data->m_magnet_strength) > M_EPSILON) {
-                NewtonBodyGetMatrix(body, &matrix[0][0]);
-                NewtonBodyGetCentreOfMass(body, &com[0]);
-                com = matrix.TransformVector(com);
-                for (const NewtonBody* other_body = NewtonWorldGetFirstBody(world); other_body; other_body = NewtonWorldGetNextBody(world, other_body)) {
-                    if (other_body != body) {
-                        MSP::Body::BodyData* other_body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(other_body));
-                        if (other_body_data->m_magnetic) {
-                            NewtonBodyGetMatrix(other_body, &other_matrix[0][0]);
-                            NewtonBodyGetCentreOfMass(other_body, &other_com[0]);
-                            other_com = other_matrix.TransformVector(other_com);
-                            dir = other_com - com;
-                            dFloat sq_dist = Util::get_vector_magnitude2(dir);
-                            dFloat dist = dSqrt(sq_dist);
-                            if (dist > M_EPSILON) {
-                                // f = m / d^2
-                                dFloat actual_force = body_data->m_magnet_strength / sq_dist;
-                                Util::scale_vector(dir, actual_force / dist);
-                                MSP::Body::c_body_add_force(other_body_data, dVector(-dir.m_x, -dir.m_y, -dir.m_z));
-                                // For every action there is an equal and opposite reaction
-                                MSP::Body::c_body_add_force(body_data, dir);
-                            }
-                        }
+        for (std::vector<int>::iterator cit = world_data->m_magnet_temp.begin(); cit != world_data->m_magnet_temp.end(); ++cit) {
+            if (*cit == *it) continue;
+            MagnetBody& other = bodies[*cit];
+            dVector dir(other.m_com - magnet.m_com);
+            dFloat dist = Util::get_vector_magnitude(dir);
+            if (dist > M_EPSILON && dist < range) {
+                // f * (x-r)^2 / r^2 -> f * (x^2 - 2xr + r^2) / r^2
+                dFloat diff = dist - range;
+                dFloat actual_force = body_data->m_magnet_force * diff * diff * inv_sq_range;
+                Util::scale_vector(dir, actual_force / dist);
+                other.m_force -= dir;
+                other.m_force_state = true;
+                // For every action there is an equal and opposite reaction
+                magnet.m_force += dir;
+                magnet.m_force_state = true;
+            }
+        }
+    }
+}
+
+int MSP::World::c_build_magnet_node(WorldData* world_data, int begin, int end, const dVector& center, dFloat half_size, int depth) {
+    int node_index = static_cast<int>(world_data->m_magnet_nodes.size());
+    world_data->m_magnet_nodes.push_back(MagnetNode(center, half_size, begin, end));
+    std::vector<int>& indices = world_data->m_field_magnet_indices;
+    // Accumulate the total strength and the strength-weighted centre of the cell.
+    dFloat strength = 0.0f;
+    dFloat abs_strength = 0.0f;
+    dVector strength_center(0.0f);
+    bool positive = false;
+    bool negative = false;
+    for (int i = begin; i < end; ++i) {
+        const MagnetBody& magnet = world_data->m_magnet_bodies[indices[i]];
+        dFloat s = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(magnet.m_body))->m_magnet_strength;
+        strength += s;
+        abs_strength += dAbs(s);
+        strength_center += magnet.m_com.Scale(dAbs(s));
+        if (s > 0.0f) positive = true;
+        else negative = true;
+    }
+    {
+        MagnetNode& node = world_data->m_magnet_nodes[node_index];
+        node.m_strength = strength;
+        node.m_strength_center = strength_center.Scale(1.0f / abs_strength);
+        node.m_uniform = !(positive && negative);
+    }
+    if (end - begin <= MAGNET_LEAF_SIZE || depth >= MAGNET_MAX_DEPTH)
+        return node_index;
+    // Sort the magnets of this cell by octant.
+    int counts[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    int starts[9];
+    world_data->m_magnet_temp.resize(end - begin);
+    for (int i = begin; i < end; ++i) {
+        const dVector& com = world_data->m_magnet_bodies[indices[i]].m_com;
+        int octant = (com.m_x > center.m_x ? 1 : 0) | (com.m_y > center.m_y ? 2 : 0) | (com.m_z > center.m_z ? 4 : 0);
+        ++counts[octant];
+    }
+    starts[0] = begin;
+    for (int i = 0; i < 8; ++i)
+        starts[i + 1] = starts[i] + counts[i];
+    for (int i = 0; i < 8; ++i)
+        counts[i] = starts[i] - begin;
+    for (int i = begin; i < end; ++i) {
+        const dVector& com = world_data->m_magnet_bodies[indices[i]].m_com;
+        int octant = (com.m_x > center.m_x ? 1 : 0) | (com.m_y > center.m_y ? 2 : 0) | (com.m_z > center.m_z ? 4 : 0);
+        world_data->m_magnet_temp[counts[octant]++] = indices[i];
+    }
+    for (int i = begin; i < end; ++i)
+        indices[i] = world_data->m_magnet_temp[i - begin];
+    dFloat child_half_size = half_size * 0.5f;
+    for (int i = 0; i < 8; ++i) {
+        if (starts[i] == starts[i + 1]) continue;
+        dVector child_center(
+            center.m_x + ((i & 1) ? child_half_size : -child_half_size),
+            center.m_y + ((i & 2) ? child_half_size : -child_half_size),
+            center.m_z + ((i & 4) ? child_half_size : -child_half_size));
+        int child_index = c_build_magnet_node(world_data, starts[i], starts[i + 1], child_center, child_half_size, depth + 1);
+        world_data->m_magnet_nodes[node_index].m_children[i] = child_index;
+    }
+    return node_index;
+}
+
+void MSP::World::c_apply_field_magnets(WorldData* world_data) {
+    // actual_magnet_force = magnet_strength / distance^2
+    // Magnets are organized in an octree. A cell, whose magnets have strength
+    // of the same sign, is treated as a single magnet if its size, divided by
+    // its distance from the magnetic body, is less than the magnet theta.
+    std::vector<MagnetBody>& bodies = world_data->m_magnet_bodies;
+    std::vector<int>& indices = world_data->m_field_magnet_indices;
+    std::vector<MagnetNode>& nodes = world_data->m_magnet_nodes;
+    std::vector<int>& stack = world_data->m_magnet_stack;
+    dVector min_pt(bodies[indices[0]].m_com);
+    dVector max_pt(min_pt);
+    for (std::vector<int>::iterator it = indices.begin(); it != indices.end(); ++it) {
+        const dVector& com = bodies[*it].m_com;
+        for (int i = 0; i < 3; ++i) {
+            if (com[i] < min_pt[i]) min_pt[i] = com[i];
+            if (com[i] > max_pt[i]) max_pt[i] = com[i];
+        }
+    }
+    dVector center((min_pt + max_pt).Scale(0.5f));
+    dFloat half_size = dMax(dMax(max_pt.m_x - min_pt.m_x, max_pt.m_y - min_pt.m_y), max_pt.m_z - min_pt.m_z) * 0.5f + M_EPSILON;
+    nodes.clear();
+    c_build_magnet_node(world_data, 0, static_cast<int>(indices.size()), center, half_size, 0);
+    dFloat theta = world_data->m_magnet_theta;
+    for (std::vector<int>::iterator it = world_data->m_magnetic_indices.begin(); it != world_data->m_magnetic_indices.end(); ++it) {
+        MagnetBody& other = bodies[*it];
+        stack.clear();
+        stack.push_back(0);
+        while (!stack.empty()) {
+            MagnetNode& node = nodes[stack.back()];
+            stack.pop_back();
+            bool leaf = true;
+            for (int i = 0; i < 8; ++i) {
+                if (node.m_children[i] != -1) {
+                    leaf = false;
+                    break;
+                }
+            }
+            if (!leaf && node.m_uniform) {
+                dVector dir(other.m_com - node.m_strength_center);
+                dFloat sq_dist = Util::get_vector_magnitude2(dir);
+                bool inside =
+                    dAbs(other.m_com.m_x - node.m_center.m_x) <= node.m_half_size &&
+                    dAbs(other.m_com.m_y - node.m_center.m_y) <= node.m_half_size &&
+                    dAbs(other.m_com.m_z - node.m_center.m_z) <= node.m_half_size;
+                dFloat size = node.m_half_size * 2.0f;
+                if (!inside && size * size < theta * theta * sq_dist) {
+                    dFloat dist = dSqrt(sq_dist);
+                    Util::scale_vector(dir, node.m_strength / (sq_dist * dist));
+                    other.m_force -= dir;
+                    other.m_force_state = true;
+                    // The reaction is distributed among the cell magnets afterwards.
+                    node.m_force += dir;
+                    node.m_force_state = true;
+                    continue;
+                }
+            }
+            if (leaf) {
+                for (int i = node.m_begin; i < node.m_end; ++i) {
+                    if (indices[i] == *it) continue;
+                    MagnetBody& magnet = bodies[indices[i]];
+                    dVector dir(other.m_com - magnet.m_com);
+                    dFloat sq_dist = Util::get_vector_magnitude2(dir);
+                    dFloat dist = dSqrt(sq_dist);
+                    if (dist > M_EPSILON) {
+                        // f = m / d^2
+                        dFloat strength = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(magnet.m_body))->m_magnet_strength;
+                        Util::scale_vector(dir, strength / (sq_dist * dist));
+                        other.m_force -= dir;
+                        other.m_force_state = true;
+                        // For every action there is an equal and opposite reaction
+                        magnet.m_force += dir;
+                        magnet.m_force_state = true;
                     }
                 }
             }
+            else {
+                for (int i = 0; i < 8; ++i) {
+                    if (node.m_children[i] != -1)
+                        stack.push_back(node.m_children[i]);
+                }
+            }
+        }
+    }
+    // Distribute the reactions of the approximated cells among their magnets.
+    for (std::vector<MagnetNode>::iterator it = nodes.begin(); it != nodes.end(); ++it) {
+        if (!it->m_force_state) continue;
+        dFloat inv_strength = 1.0f / it->m_strength;
+        for (int i = it->m_begin; i < it->m_end; ++i) {
+            MagnetBody& magnet = bodies[indices[i]];
+            dFloat strength = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(magnet.m_body))->m_magnet_strength;
+            magnet.m_force += it->m_force.Scale(strength * inv_strength);
+            magnet.m_force_state = true;
         }
     }
 }
@@ -343,57 +598,59 @@ void MSP::World::c_process_touch_events(const NewtonWorld* world) {
     WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
 
     // Generate onTouch events for non-collidable bodies.
+    // Gather candidate pairs from the broadphase.
+    world_data->m_sensor_pairs.clear();
     for (const NewtonBody* body0 = NewtonWorldGetFirstBody(world); body0; body0 = NewtonWorldGetNextBody(world, body0)) {
         MSP::Body::BodyData* body0_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body0));
         if (!body0_data->m_record_touch_data)
             continue;
-        const NewtonCollision* colA = NewtonBodyGetCollision(body0);
-        const NewtonCollision* colB;
-        dMatrix matA;
-        dMatrix matB;
-        NewtonBodyGetMatrix(body0, &matA[0][0]);
-        dFloat points[3];
-        dFloat normals[3];
-        dFloat penetrations[3];
-        long long attrA[1];
-        long long attrB[1];
-        for (const NewtonBody* body1 = NewtonWorldGetFirstBody(world); body1; body1 = NewtonWorldGetNextBody(world, body1)) {
-            if (body0 == body1 ||
-                MSP::Body::c_bodies_collidable(body0, body1) ||
-                !MSP::Body::c_bodies_aabb_overlap(body0, body1))
-                continue;
-            if (body0_data->m_touchers.find(body1) == body0_data->m_touchers.end()) {
-                colB = NewtonBodyGetCollision(body1);
-                NewtonBodyGetMatrix(body1, &matB[0][0]);
-                if (NewtonCollisionCollide(world, 1, colA, &matA[0][0], colB, &matB[0][0], points, normals, penetrations, attrA, attrB, 0) != 0) {
-                    BodyTouchData* touch_data = new BodyTouchData(body0, body1, dVector(points), dVector(normals), dVector(0.0f), 0.0f);
-                    world_data->m_touch_data.push_back(touch_data);
-                    body0_data->m_touchers[body1] = 0;
-                }
-            }
-            else
-                body0_data->m_touchers[body1] = 2;
-        }
+        dVector min_pt;
+        dVector max_pt;
+        NewtonBodyGetAABB(body0, &min_pt[0], &max_pt[0]);
+        SensorQuery query(body0, &world_data->m_sensor_pairs);
+        NewtonWorldForEachBodyInAABBDo(world, &min_pt[0], &max_pt[0], sensor_iterator, &query);
+    }
+    // Test the candidate pairs across the worker threads.
+    int num_pairs = static_cast<int>(world_data->m_sensor_pairs.size());
+    int num_jobs = dMin(NewtonGetThreadsCount(world), num_pairs / MIN_SENSOR_PAIRS_PER_JOB);
+    world_data->m_sensor_pair_index = 0;
+    if (num_jobs > 1) {
+        for (int i = 0; i < num_jobs; ++i)
+            NewtonDispachThreadJob(world, sensor_collide_job, world_data, "sensor_collide_job");
+        NewtonSyncThreadJobs(world);
+    }
+    else
+        c_collide_sensor_pairs(world, 0);
+    for (std::vector<SensorPair>::iterator it = world_data->m_sensor_pairs.begin(); it != world_data->m_sensor_pairs.end(); ++it) {
+        if (!it->m_touching) continue;
+        MSP::Body::BodyData* body0_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(it->m_body0));
+        MSP::Body::BodyData* body1_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(it->m_body1));
+        world_data->m_touch_data.push_back(BodyTouchData(body0_data->m_handle, body1_data->m_handle, it->m_point, it->m_normal, dVector(0.0f), 0.0f));
+        body0_data->m_cold->m_touchers.set(it->m_body1, 0);
     }
 
     // Generate onTouching and onUntouch events for all bodies with touchers.
     for (const NewtonBody* body = NewtonWorldGetFirstBody(world); body; body = NewtonWorldGetNextBody(world, body)) {
         MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body));
-        if (!body_data->m_record_touch_data || body_data->m_touchers.empty()) continue;
+        if (!body_data->m_record_touch_data || body_data->m_cold->m_touchers.empty()) continue;
         NewtonCollision* colA = NewtonBodyGetCollision(body);
         dMatrix matrixA;
         NewtonBodyGetMatrix(body, &matrixA[0][0]);
-        std::vector<const NewtonBody*> to_erase;
-        for (std::map<const NewtonBody*, char>::iterator it = body_data->m_touchers.begin(); it != body_data->m_touchers.end(); ++it) {
-            if (it->second == 0) {
-                body_data->m_touchers[it->first] = 1;
+        std::vector<const NewtonBody*>& to_erase = world_data->m_touchers_to_erase;
+        to_erase.clear();
+        for (unsigned int i = 0; i < body_data->m_cold->m_touchers.capacity(); ++i) {
+            MSP::Body::TouchersTable::Entry& entry = body_data->m_cold->m_touchers.m_entries[i];
+            if (entry.m_body == nullptr)
+                continue;
+            if (entry.m_state == 0) {
+                entry.m_state = 1;
                 continue;
             }
             bool touching = false;
-            if (it->second == 1) {
-                const NewtonCollision* colB = NewtonBodyGetCollision(it->first);
+            if (entry.m_state == 1) {
+                const NewtonCollision* colB = NewtonBodyGetCollision(entry.m_body);
                 dMatrix matrixB;
-                NewtonBodyGetMatrix(it->first, &matrixB[0][0]);
+                NewtonBodyGetMatrix(entry.m_body, &matrixB[0][0]);
                 touching = NewtonCollisionIntersectionTest(world, colA, &matrixA[0][0], colB, &matrixB[0][0], 0) == 1;
                 if (!touching && NewtonCollisionGetType(colA) < 9 && NewtonCollisionGetType(colB) < 9) {
                     dVector pointA;
@@ -406,42 +663,50 @@ void MSP::World::c_process_touch_events(const NewtonWorld* world) {
                     }
                 }
             }
-            else if (it->second == 2) {
+            else if (entry.m_state == 2) {
                 touching = true;
-                body_data->m_touchers[it->first] = 1;
-            }
-            if (touching) {
-                BodyTouchingData* touching_data = new BodyTouchingData(body, it->first);
-                world_data->m_touching_data.push_back(touching_data);
+                entry.m_state = 1;
             }
+            unsigned long long other_handle = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(entry.m_body))->m_handle;
+            if (touching)
+                world_data->m_touching_data.push_back(BodyTouchingData(body_data->m_handle, other_handle));
             else {
-                BodyUntouchData* untouch_data = new BodyUntouchData(body, it->first);
-                world_data->m_untouch_data.push_back(untouch_data);
-                to_erase.push_back(it->first);
+                world_data->m_untouch_data.push_back(BodyUntouchData(body_data->m_handle, other_handle));
+                to_erase.push_back(entry.m_body);
             }
         }
-        for (std::vector<const NewtonBody*>::iterator it = to_erase.begin(); it != to_erase.end(); ++it) {
-            const NewtonBody* body_to_erase = *it;
-            if (body_data->m_touchers.find(body_to_erase) != body_data->m_touchers.end())
-                body_data->m_touchers.erase(body_to_erase);
+        for (std::vector<const NewtonBody*>::iterator it = to_erase.begin(); it != to_erase.end(); ++it)
+            body_data->m_cold->m_touchers.erase(*it);
+    }
+}
+
+void MSP::World::c_collide_sensor_pairs(const NewtonWorld* world, int thread_index) {
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    int num_pairs = static_cast<int>(world_data->m_sensor_pairs.size());
+    dMatrix matA;
+    dMatrix matB;
+    dFloat points[3];
+    dFloat normals[3];
+    dFloat penetrations[3];
+    long long attrA[1];
+    long long attrB[1];
+    for (int i = NewtonAtomicAdd(&world_data->m_sensor_pair_index, 1); i < num_pairs; i = NewtonAtomicAdd(&world_data->m_sensor_pair_index, 1)) {
+        SensorPair& pair = world_data->m_sensor_pairs[i];
+        const NewtonCollision* colA = NewtonBodyGetCollision(pair.m_body0);
+        const NewtonCollision* colB = NewtonBodyGetCollision(pair.m_body1);
+        NewtonBodyGetMatrix(pair.m_body0, &matA[0][0]);
+        NewtonBodyGetMatrix(pair.m_body1, &matB[0][0]);
+        if (NewtonCollisionCollide(world, 1, colA, &matA[0][0], colB, &matB[0][0], points, normals, penetrations, attrA, attrB, thread_index) != 0) {
+            pair.m_point = dVector(points);
+            pair.m_normal = dVector(normals);
+            pair.m_touching = true;
         }
     }
 }
 
 void MSP::World::c_clear_touch_events(const NewtonWorld* world) {
     WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
-    for (std::vector<BodyTouchData*>::const_iterator it = world_data->m_touch_data.begin(); it != world_data->m_touch_data.end(); ++it) {
-        BodyTouchData* data = *it;
-        delete data;
-    }
-    for (std::vector<BodyTouchingData*>::const_iterator it = world_data->m_touching_data.begin(); it != world_data->m_touching_data.end(); ++it) {
-        BodyTouchingData* data = *it;
-        delete data;
-    }
-    for (std::vector<BodyUntouchData*>::const_iterator it = world_data->m_untouch_data.begin(); it != world_data->m_untouch_data.end(); ++it) {
-        BodyUntouchData* data = *it;
-        delete data;
-    }
+    // Event buffers keep their capacity to be reused by the following steps.
     world_data->m_touch_data.clear();
     world_data->m_touching_data.clear();
     world_data->m_untouch_data.clear();
@@ -454,6 +719,33 @@ void MSP::World::c_clear_matrix_change_record(const NewtonWorld* world) {
     }
 }
 
+void MSP::World::c_merge_thread_buffers(const NewtonWorld* world) {
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    for (std::vector<ThreadBuffer>::iterator it = world_data->m_thread_buffers.begin(); it != world_data->m_thread_buffers.end(); ++it) {
+        for (std::vector<BodyTouchData>::iterator dit = it->m_touch_data.begin(); dit != it->m_touch_data.end(); ++dit) {
+            MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(MSP::Body::s_valid_bodies.find(dit->m_body0)));
+            const NewtonBody* other_body = MSP::Body::s_valid_bodies.find(dit->m_body1);
+            char* state = body_data->m_cold->m_touchers.find(other_body);
+            if (state == nullptr) {
+                world_data->m_touch_data.push_back(*dit);
+                body_data->m_cold->m_touchers.set(other_body, 0);
+            }
+            else
+                *state = 2;
+        }
+        for (std::vector<BodyTouchingData>::iterator dit = it->m_touching_data.begin(); dit != it->m_touching_data.end(); ++dit) {
+            MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(MSP::Body::s_valid_bodies.find(dit->m_body0)));
+            body_data->m_cold->m_touchers.set(MSP::Body::s_valid_bodies.find(dit->m_body1), 2);
+        }
+        world_data->m_joints_to_disconnect.insert(world_data->m_joints_to_disconnect.end(), it->m_joints_to_disconnect.begin(), it->m_joints_to_disconnect.end());
+        world_data->m_temp_cccd_bodies.insert(world_data->m_temp_cccd_bodies.end(), it->m_cccd_bodies.begin(), it->m_cccd_bodies.end());
+        it->m_touch_data.clear();
+        it->m_touching_data.clear();
+        it->m_joints_to_disconnect.clear();
+        it->m_cccd_bodies.clear();
+    }
+}
+
 void MSP::World::c_disconnect_flagged_joints(const NewtonWorld* world) {
     WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
     for (std::vector<const NewtonJoint*>::iterator it = world_data->m_joints_to_disconnect.begin(); it != world_data->m_joints_to_disconnect.end(); ++it)
@@ -468,6 +760,482 @@ void MSP::World::c_enable_cccd_bodies(const NewtonWorld* world) {
     world_data->m_temp_cccd_bodies.clear();
 }
 
+void MSP::World::c_begin_update(const NewtonWorld* world, dFloat timestep) {
+    c_wait_for_update(world);
+    MSP::Gear::c_update_constraints(world);
+    c_clear_touch_events(world);
+    c_update_magnets(world, timestep);
+    c_update_shockwaves(world, timestep);
+}
+
+void MSP::World::c_finish_update(const NewtonWorld* world, dFloat timestep) {
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    c_merge_thread_buffers(world);
+    c_enable_cccd_bodies(world);
+    c_disconnect_flagged_joints(world);
+    c_process_touch_events(world);
+    world_data->m_time += timestep;
+    world_data->m_snapshot.m_valid = false;
+}
+
+bool MSP::World::c_wait_for_update(const NewtonWorld* world) {
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    if (!world_data->m_update_pending) return false;
+    NewtonWaitForUpdateToFinish(world);
+    world_data->m_update_pending = false;
+    c_finish_update(world, world_data->m_pending_timestep);
+    return true;
+}
+
+void MSP::World::c_invalidate_body_snapshot(const NewtonWorld* world) {
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    world_data->m_snapshot.m_valid = false;
+}
+
+const MSP::World::BodySnapshot& MSP::World::c_get_body_snapshot(const NewtonWorld* world) {
+    // Finishing a pending update moves bodies, so it must precede the check.
+    c_wait_for_update(world);
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    BodySnapshot& snapshot = world_data->m_snapshot;
+    if (snapshot.m_valid)
+        return snapshot;
+    snapshot.m_bodies.clear();
+    for (const NewtonBody* body = NewtonWorldGetFirstBody(world); body; body = NewtonWorldGetNextBody(world, body))
+        snapshot.m_bodies.push_back(body);
+    int count = static_cast<int>(snapshot.m_bodies.size());
+    for (int i = 0; i < 3; ++i) {
+        snapshot.m_min[i].resize(count);
+        snapshot.m_max[i].resize(count);
+        snapshot.m_position[i].resize(count);
+    }
+    snapshot.m_awake.resize(count);
+    snapshot.m_dynamic.resize(count);
+    int num_chunks = (count + SNAPSHOT_CHUNK_SIZE - 1) / SNAPSHOT_CHUNK_SIZE;
+    snapshot.m_chunk_min.resize(num_chunks);
+    snapshot.m_chunk_max.resize(num_chunks);
+    snapshot.m_chunk_index = 0;
+    int num_jobs = dMin(NewtonGetThreadsCount(world), num_chunks);
+    if (num_jobs > 1) {
+        for (int i = 0; i < num_jobs; ++i)
+            NewtonDispachThreadJob(world, snapshot_job, &snapshot, "snapshot_job");
+        NewtonSyncThreadJobs(world);
+    }
+    else
+        c_fill_snapshot_chunks(snapshot);
+    // Reduce the bounds of chunks to the world bounds.
+    snapshot.m_min_pt = dVector(0.0f);
+    snapshot.m_max_pt = dVector(0.0f);
+    for (int i = 0; i < num_chunks; ++i) {
+        const dVector& min_pt = snapshot.m_chunk_min[i];
+        const dVector& max_pt = snapshot.m_chunk_max[i];
+        for (int j = 0; j < 3; ++j) {
+            snapshot.m_min_pt[j] = i == 0 ? min_pt[j] : dMin(snapshot.m_min_pt[j], min_pt[j]);
+            snapshot.m_max_pt[j] = i == 0 ? max_pt[j] : dMax(snapshot.m_max_pt[j], max_pt[j]);
+        }
+    }
+    snapshot.m_valid = true;
+    return snapshot;
+}
+
+void MSP::World::c_fill_snapshot_chunks(BodySnapshot& snapshot) {
+    int count = static_cast<int>(snapshot.m_bodies.size());
+    int num_chunks = static_cast<int>(snapshot.m_chunk_min.size());
+    dVector min_pt;
+    dVector max_pt;
+    dMatrix matrix;
+    for (int chunk = NewtonAtomicAdd(&snapshot.m_chunk_index, 1); chunk < num_chunks; chunk = NewtonAtomicAdd(&snapshot.m_chunk_index, 1)) {
+        int begin = chunk * SNAPSHOT_CHUNK_SIZE;
+        int end = dMin(begin + SNAPSHOT_CHUNK_SIZE, count);
+        for (int i = begin; i < end; ++i) {
+            const NewtonBody* body = snapshot.m_bodies[i];
+            const MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body));
+            NewtonBodyGetAABB(body, &min_pt[0], &max_pt[0]);
+            NewtonBodyGetMatrix(body, &matrix[0][0]);
+            for (int j = 0; j < 3; ++j) {
+                snapshot.m_min[j][i] = min_pt[j];
+                snapshot.m_max[j][i] = max_pt[j];
+                snapshot.m_position[j][i] = matrix.m_posit[j];
+            }
+            snapshot.m_awake[i] = NewtonBodyGetSleepState(body) == 0 ? 1 : 0;
+            snapshot.m_dynamic[i] = (body_data->m_dynamic && !body_data->m_bstatic) ? 1 : 0;
+        }
+        for (int j = 0; j < 3; ++j) {
+            snapshot.m_chunk_min[chunk][j] = c_reduce_min(&snapshot.m_min[j][begin], end - begin);
+            snapshot.m_chunk_max[chunk][j] = c_reduce_max(&snapshot.m_max[j][begin], end - begin);
+        }
+    }
+}
+
+dFloat MSP::World::c_reduce_min(const dFloat* values, int count) {
+    dFloat result = values[0];
+    int i = 0;
+#ifdef MSP_USE_SSE
+    if (count >= 4) {
+        __m128 acc = _mm_loadu_ps(values);
+        for (i = 4; i + 4 <= count; i += 4)
+            acc = _mm_min_ps(acc, _mm_loadu_ps(values + i));
+        acc = _mm_min_ps(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1, 0, 3, 2)));
+        acc = _mm_min_ps(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(2, 3, 0, 1)));
+        result = _mm_cvtss_f32(acc);
+    }
+#endif
+    for (; i < count; ++i)
+        if (values[i] < result) result = values[i];
+    return result;
+}
+
+dFloat MSP::World::c_reduce_max(const dFloat* values, int count) {
+    dFloat result = values[0];
+    int i = 0;
+#ifdef MSP_USE_SSE
+    if (count >= 4) {
+        __m128 acc = _mm_loadu_ps(values);
+        for (i = 4; i + 4 <= count; i += 4)
+            acc = _mm_max_ps(acc, _mm_loadu_ps(values + i));
+        acc = _mm_max_ps(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1, 0, 3, 2)));
+        acc = _mm_max_ps(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(2, 3, 0, 1)));
+        result = _mm_cvtss_f32(acc);
+    }
+#endif
+    for (; i < count; ++i)
+        if (values[i] > result) result = values[i];
+    return result;
+}
+
+bool MSP::World::c_snapshot_body_passes(const BodySnapshot& snapshot, int index, int flags) {
+    if ((flags & QUERY_AWAKE) != 0 && snapshot.m_awake[index] == 0) return false;
+    if ((flags & QUERY_DYNAMIC) != 0 && snapshot.m_dynamic[index] == 0) return false;
+    return true;
+}
+
+void MSP::World::c_select_bodies(const BodySnapshot& snapshot, int flags, std::vector<int>& indices_out) {
+    indices_out.clear();
+    int count = static_cast<int>(snapshot.m_bodies.size());
+    for (int i = 0; i < count; ++i)
+        if (c_snapshot_body_passes(snapshot, i, flags))
+            indices_out.push_back(i);
+}
+
+void MSP::World::c_select_bodies_in_aabb(const BodySnapshot& snapshot, int flags, const dVector& min_pt, const dVector& max_pt, std::vector<int>& indices_out) {
+    indices_out.clear();
+    int count = static_cast<int>(snapshot.m_bodies.size());
+    int i = 0;
+#ifdef MSP_USE_SSE
+    __m128 query_min[3];
+    __m128 query_max[3];
+    for (int j = 0; j < 3; ++j) {
+        query_min[j] = _mm_set1_ps(min_pt[j]);
+        query_max[j] = _mm_set1_ps(max_pt[j]);
+    }
+    for (; i + 4 <= count; i += 4) {
+        __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int j = 0; j < 3; ++j) {
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(_mm_loadu_ps(&snapshot.m_max[j][i]), query_min[j]));
+            mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_loadu_ps(&snapshot.m_min[j][i]), query_max[j]));
+        }
+        int bits = _mm_movemask_ps(mask);
+        for (int k = 0; k < 4; ++k)
+            if ((bits & (1 << k)) != 0 && c_snapshot_body_passes(snapshot, i + k, flags))
+                indices_out.push_back(i + k);
+    }
+#endif
+    for (; i < count; ++i) {
+        bool overlap = true;
+        for (int j = 0; j < 3; ++j)
+            if (snapshot.m_max[j][i] < min_pt[j] || snapshot.m_min[j][i] > max_pt[j]) overlap = false;
+        if (overlap && c_snapshot_body_passes(snapshot, i, flags))
+            indices_out.push_back(i);
+    }
+}
+
+void MSP::World::c_select_bodies_in_sphere(const BodySnapshot& snapshot, int flags, const dVector& center, dFloat radius, std::vector<int>& indices_out) {
+    indices_out.clear();
+    int count = static_cast<int>(snapshot.m_bodies.size());
+    dFloat radius2 = radius * radius;
+    int i = 0;
+    // A body is selected when the point of its bounding box closest to the
+    // center is within the radius.
+#ifdef MSP_USE_SSE
+    __m128 query_center[3];
+    for (int j = 0; j < 3; ++j)
+        query_center[j] = _mm_set1_ps(center[j]);
+    __m128 query_radius2 = _mm_set1_ps(radius2);
+    __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4) {
+        __m128 dist2 = zero;
+        for (int j = 0; j < 3; ++j) {
+            __m128 below = _mm_sub_ps(_mm_loadu_ps(&snapshot.m_min[j][i]), query_center[j]);
+            __m128 above = _mm_sub_ps(query_center[j], _mm_loadu_ps(&snapshot.m_max[j][i]));
+            __m128 dist = _mm_max_ps(_mm_max_ps(below, above), zero);
+            dist2 = _mm_add_ps(dist2, _mm_mul_ps(dist, dist));
+        }
+        int bits = _mm_movemask_ps(_mm_cmple_ps(dist2, query_radius2));
+        for (int k = 0; k < 4; ++k)
+            if ((bits & (1 << k)) != 0 && c_snapshot_body_passes(snapshot, i + k, flags))
+                indices_out.push_back(i + k);
+    }
+#endif
+    for (; i < count; ++i) {
+        dFloat dist2 = 0.0f;
+        for (int j = 0; j < 3; ++j) {
+            dFloat dist = dMax(dMax(snapshot.m_min[j][i] - center[j], center[j] - snapshot.m_max[j][i]), 0.0f);
+            dist2 += dist * dist;
+        }
+        if (dist2 <= radius2 && c_snapshot_body_passes(snapshot, i, flags))
+            indices_out.push_back(i);
+    }
+}
+
+void MSP::World::c_select_bodies_in_frustum(const BodySnapshot& snapshot, int flags, const std::vector<dVector>& planes, std::vector<int>& indices_out) {
+    indices_out.clear();
+    int count = static_cast<int>(snapshot.m_bodies.size());
+    int num_planes = static_cast<int>(planes.size());
+    // A body is rejected when the corner of its bounding box farthest along
+    // the normal of any plane is behind that plane.
+    std::vector<const dFloat*> corners(num_planes * 3);
+    for (int p = 0; p < num_planes; ++p)
+        for (int j = 0; j < 3; ++j)
+            corners[p * 3 + j] = planes[p][j] >= 0.0f ? &snapshot.m_max[j][0] : &snapshot.m_min[j][0];
+    int i = 0;
+#ifdef MSP_USE_SSE
+    __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4) {
+        __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < num_planes; ++p) {
+            const dVector& plane = planes[p];
+            __m128 dist = _mm_set1_ps(plane[3]);
+            for (int j = 0; j < 3; ++j)
+                dist = _mm_add_ps(dist, _mm_mul_ps(_mm_loadu_ps(corners[p * 3 + j] + i), _mm_set1_ps(plane[j])));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(dist, zero));
+        }
+        int bits = _mm_movemask_ps(mask);
+        for (int k = 0; k < 4; ++k)
+            if ((bits & (1 << k)) != 0 && c_snapshot_body_passes(snapshot, i + k, flags))
+                indices_out.push_back(i + k);
+    }
+#endif
+    for (; i < count; ++i) {
+        bool inside = true;
+        for (int p = 0; p < num_planes && inside; ++p) {
+            const dVector& plane = planes[p];
+            dFloat dist = plane[3];
+            for (int j = 0; j < 3; ++j)
+                dist += corners[p * 3 + j][i] * plane[j];
+            if (dist < 0.0f) inside = false;
+        }
+        if (inside && c_snapshot_body_passes(snapshot, i, flags))
+            indices_out.push_back(i);
+    }
+}
+
+VALUE MSP::World::c_selection_to_value(const BodySnapshot& snapshot, const std::vector<int>& indices) {
+    VALUE v_bodies = rb_ary_new2(static_cast<long>(indices.size()));
+    for (std::vector<int>::const_iterator it = indices.begin(); it != indices.end(); ++it)
+        rb_ary_push(v_bodies, MSP::Body::c_body_to_value(snapshot.m_bodies[*it]));
+    return v_bodies;
+}
+
+// Returns the given bodies without a block. With a block, yields each body
+// that is still valid, as the block may destroy bodies, and collects the
+// results that aren't nil. Breaking out of the block skips the destructors of
+// C++ locals, so callers must not have any alive at this point.
+VALUE MSP::World::c_yield_bodies(VALUE v_bodies) {
+    if (rb_block_given_p() == 0)
+        return v_bodies;
+    VALUE v_results = rb_ary_new();
+    long count = RARRAY_LEN(v_bodies);
+    for (long i = 0; i < count; ++i) {
+        VALUE v_address = rb_ary_entry(v_bodies, i);
+        const NewtonBody* body = MSP::Body::s_valid_bodies.find(Util::value_to_ull(v_address));
+        if (body == nullptr) continue;
+        MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body));
+        VALUE v_result = rb_yield_values(2, v_address, body_data->m_cold->m_user_data);
+        if (v_result != Qnil) rb_ary_push(v_results, v_result);
+    }
+    return v_results;
+}
+
+
+void MSP::World::c_cast_ray_batch(const NewtonWorld* world, RayBatch& batch, int thread_index) {
+    // Each record is a 64-bit body handle, zero if nothing was hit, followed
+    // by 7 doubles: distance to the hit, hit point and hit normal.
+    const size_t point_size = sizeof(double) * 3;
+    const size_t record_size = sizeof(unsigned long long) + sizeof(double) * 7;
+    int num_chunks = (batch.m_count + RAY_BATCH_CHUNK_SIZE - 1) / RAY_BATCH_CHUNK_SIZE;
+    double values[7];
+    for (int chunk = NewtonAtomicAdd(&batch.m_chunk_index, 1); chunk < num_chunks; chunk = NewtonAtomicAdd(&batch.m_chunk_index, 1)) {
+        int begin = chunk * RAY_BATCH_CHUNK_SIZE;
+        int end = dMin(begin + RAY_BATCH_CHUNK_SIZE, batch.m_count);
+        for (int i = begin; i < end; ++i) {
+            double origin_values[3];
+            double target_values[3];
+            memcpy(origin_values, batch.m_origins + i * point_size, point_size);
+            memcpy(target_values, batch.m_targets + i * point_size, point_size);
+            dVector origin(static_cast<dFloat>(origin_values[0]), static_cast<dFloat>(origin_values[1]), static_cast<dFloat>(origin_values[2]));
+            dVector target(static_cast<dFloat>(target_values[0]), static_cast<dFloat>(target_values[1]), static_cast<dFloat>(target_values[2]));
+            RayBatchHit hit(batch.m_flags);
+            NewtonWorldRayCast(world, &origin[0], &target[0], ray_batch_filter_callback, &hit, ray_batch_prefilter_callback, thread_index);
+            unsigned long long handle = 0;
+            if (hit.m_body != nullptr) {
+                handle = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(hit.m_body))->m_handle;
+                values[0] = static_cast<double>(Util::get_vector_magnitude(target - origin) * hit.m_param);
+                for (int j = 0; j < 3; ++j) {
+                    values[j + 1] = static_cast<double>(hit.m_point[j]);
+                    values[j + 4] = static_cast<double>(hit.m_normal[j]);
+                }
+            }
+            else {
+                for (int j = 0; j < 7; ++j)
+                    values[j] = 0.0;
+            }
+            char* record = batch.m_output + i * record_size;
+            memcpy(record, &handle, sizeof(unsigned long long));
+            memcpy(record + sizeof(unsigned long long), values, sizeof(values));
+        }
+    }
+}
+
+void MSP::World::c_apply_explosion(const NewtonWorld* world, const dVector& center, dFloat blast_radius, dFloat blast_force, dFloat inner_radius, dFloat outer_radius) {
+    // Sample rays must not see the world mid-update.
+    c_wait_for_update(world);
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    std::vector<const NewtonBody*>& bodies = world_data->m_explosion_bodies;
+    std::vector<ExplosionRay>& rays = world_data->m_explosion_rays;
+    bodies.clear();
+    rays.clear();
+    // Gather dynamic bodies, with centres of mass between the inner and the
+    // outer radius, from the broadphase.
+    dVector extent(outer_radius, outer_radius, outer_radius);
+    dVector min_pt(center - extent);
+    dVector max_pt(center + extent);
+    NewtonWorldForEachBodyInAABBDo(world, &min_pt[0], &max_pt[0], explosion_iterator, &bodies);
+    std::vector<dVector> centres;
+    centres.reserve(bodies.size());
+    int num_bodies = 0;
+    for (std::vector<const NewtonBody*>::iterator it = bodies.begin(); it != bodies.end(); ++it) {
+        dMatrix matrix;
+        dVector centre;
+        NewtonBodyGetMatrix(*it, &matrix[0][0]);
+        NewtonBodyGetCentreOfMass(*it, &centre[0]);
+        centre = matrix.TransformVector(centre);
+        dFloat dist = Util::get_vector_magnitude(centre - center);
+        if (dist <= inner_radius || dist > outer_radius)
+            continue;
+        bodies[num_bodies] = *it;
+        centres.push_back(centre);
+        // Sample the centre of mass and the eight extreme points of the
+        // collision along the diagonals of the body. Unlike points within the
+        // bounding box, these lie on the collision even if it is concave.
+        // Rays are extended slightly past the surface points, so that a body
+        // in plain sight is always hit.
+        const NewtonCollision* collision = NewtonBodyGetCollision(*it);
+        rays.push_back(ExplosionRay(num_bodies, centre));
+        for (int i = 0; i < EXPLOSION_SAMPLE_COUNT - 1; ++i) {
+            dVector dir((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+            dVector point;
+            NewtonCollisionSupportVertex(collision, &dir[0], &point[0]);
+            point = matrix.TransformVector(point);
+            rays.push_back(ExplosionRay(num_bodies, point + (point - center).Scale(0.01f)));
+        }
+        ++num_bodies;
+    }
+    bodies.resize(num_bodies);
+    // Cast the sample rays across the worker threads.
+    ExplosionCast cast(center, &rays);
+    int num_chunks = (static_cast<int>(rays.size()) + RAY_BATCH_CHUNK_SIZE - 1) / RAY_BATCH_CHUNK_SIZE;
+    int num_jobs = dMin(NewtonGetThreadsCount(world), num_chunks);
+    if (num_jobs > 1) {
+        for (int i = 0; i < num_jobs; ++i)
+            NewtonDispachThreadJob(world, explosion_job, &cast, "explosion_job");
+        NewtonSyncThreadJobs(world);
+    }
+    else
+        c_cast_explosion_rays(world, cast, 0);
+    // Each sample that reaches its body applies a share of the force, so the
+    // total force is weighted by the exposed fraction of the body.
+    dFloat inv_blast_radius = 1.0f / blast_radius;
+    dFloat sample_ratio = 1.0f / static_cast<dFloat>(EXPLOSION_SAMPLE_COUNT);
+    for (std::vector<ExplosionRay>::iterator it = rays.begin(); it != rays.end(); ++it) {
+        const NewtonBody* body = bodies[it->m_body_index];
+        if (it->m_hit.m_body != body)
+            continue;
+        dVector force(it->m_hit.m_point - center);
+        dFloat dist = Util::get_vector_magnitude(force);
+        if (dist < M_EPSILON || dist > blast_radius)
+            continue;
+        MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body));
+        Util::scale_vector(force, (blast_radius - dist) * blast_force * inv_blast_radius * sample_ratio / dist);
+        MSP::Body::c_body_add_force(body_data, force);
+        dFloat moment = force.DotProduct3(it->m_hit.m_normal);
+        dVector torque((it->m_hit.m_point - centres[it->m_body_index]).CrossProduct(it->m_hit.m_normal.Scale(-moment)));
+        MSP::Body::c_body_add_torque(body_data, torque);
+    }
+}
+
+void MSP::World::c_cast_explosion_rays(const NewtonWorld* world, ExplosionCast& cast, int thread_index) {
+    std::vector<ExplosionRay>& rays = *cast.m_rays;
+    int num_rays = static_cast<int>(rays.size());
+    int num_chunks = (num_rays + RAY_BATCH_CHUNK_SIZE - 1) / RAY_BATCH_CHUNK_SIZE;
+    for (int chunk = NewtonAtomicAdd(&cast.m_ray_index, 1); chunk < num_chunks; chunk = NewtonAtomicAdd(&cast.m_ray_index, 1)) {
+        int begin = chunk * RAY_BATCH_CHUNK_SIZE;
+        int end = dMin(begin + RAY_BATCH_CHUNK_SIZE, num_rays);
+        for (int i = begin; i < end; ++i) {
+            ExplosionRay& ray = rays[i];
+            NewtonWorldRayCast(world, &cast.m_center[0], &ray.m_target[0], ray_batch_filter_callback, &ray.m_hit, nullptr, thread_index);
+        }
+    }
+}
+
+void MSP::World::c_update_shockwaves(const NewtonWorld* world, dFloat timestep) {
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    if (world_data->m_shockwaves.empty())
+        return;
+    for (std::vector<Shockwave>::iterator it = world_data->m_shockwaves.begin(); it != world_data->m_shockwaves.end(); ++it) {
+        dFloat front = dMin(it->m_front + it->m_speed * timestep, it->m_radius);
+        c_apply_explosion(world, it->m_center, it->m_radius, it->m_force, it->m_front, front);
+        it->m_front = front;
+    }
+    std::vector<Shockwave>::iterator end = world_data->m_shockwaves.begin();
+    for (std::vector<Shockwave>::iterator it = world_data->m_shockwaves.begin(); it != world_data->m_shockwaves.end(); ++it)
+        if (it->m_front < it->m_radius)
+            *end++ = *it;
+    world_data->m_shockwaves.erase(end, world_data->m_shockwaves.end());
+}
+
+void MSP::World::c_update_fluid_volume(FluidVolume& volume) {
+    // The surface is the XY plane of the matrix, raised to the top of the box
+    // for bounded volumes.
+    dVector normal(volume.m_matrix.m_right);
+    Util::normalize_vector(normal);
+    dVector surface(volume.m_bounded ? volume.m_matrix.TransformVector(dVector(0.0f, 0.0f, volume.m_max.m_z)) : volume.m_matrix.m_posit);
+    volume.m_plane = dVector(normal.m_x, normal.m_y, normal.m_z, -normal.DotProduct3(surface));
+    volume.m_linear_current = volume.m_matrix.RotateVector(volume.m_local_linear_current);
+    volume.m_angular_current = volume.m_matrix.RotateVector(volume.m_local_angular_current);
+    if (!volume.m_bounded)
+        return;
+    for (int i = 0; i < 8; ++i) {
+        dVector corner(volume.m_matrix.TransformVector(dVector(
+            (i & 1) ? volume.m_max.m_x : volume.m_min.m_x,
+            (i & 2) ? volume.m_max.m_y : volume.m_min.m_y,
+            (i & 4) ? volume.m_max.m_z : volume.m_min.m_z)));
+        if (i == 0) {
+            volume.m_aabb_min = corner;
+            volume.m_aabb_max = corner;
+        }
+        else {
+            volume.m_aabb_min = dVector(dMin(volume.m_aabb_min.m_x, corner.m_x), dMin(volume.m_aabb_min.m_y, corner.m_y), dMin(volume.m_aabb_min.m_z, corner.m_z));
+            volume.m_aabb_max = dVector(dMax(volume.m_aabb_max.m_x, corner.m_x), dMax(volume.m_aabb_max.m_y, corner.m_y), dMax(volume.m_aabb_max.m_z, corner.m_z));
+        }
+    }
+}
+
+std::vector<MSP::World::FluidVolume>::iterator MSP::World::c_find_fluid_volume(WorldData* world_data, int id) {
+    for (std::vector<FluidVolume>::iterator it = world_data->m_fluid_volumes.begin(); it != world_data->m_fluid_volumes.end(); ++it)
+        if (it->m_id == id)
+            return it;
+    return world_data->m_fluid_volumes.end();
+}
+
 
 /*
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -476,7 +1244,7 @@ void MSP::World::c_enable_cccd_bodies(const NewtonWorld* world) {
 */
 
 VALUE MSP::World::rbf_is_valid(VALUE self, VALUE v_world) {
-    return c_is_world_valid(reinterpret_cast<NewtonWorld*>(Util::value_to_ull(v_world))) ? Qtrue : Qfalse;
+    return c_is_world_valid(Util::value_to_ull(v_world)) ? Qtrue : Qfalse;
 }
 
 VALUE MSP::World::rbf_create(VALUE self) {
@@ -484,7 +1252,8 @@ VALUE MSP::World::rbf_create(VALUE self) {
     int id = NewtonMaterialCreateGroupID(world);
     WorldData* world_data = new WorldData(id);
     world_data->m_max_threads = NewtonGetThreadsCount(world);
-    valid_worlds[world] = world_data;
+    world_data->m_thread_buffers.resize(NewtonGetMaxThreadsCount(world));
+    world_data->m_handle = valid_worlds.insert(world);
     NewtonWorldSetUserData(world, world_data);
     NewtonInvalidateCache(world);
     NewtonSetContactMergeTolerance(world, DEFAULT_CONTACT_MERGE_TOLERANCE);
@@ -503,6 +1272,7 @@ VALUE MSP::World::rbf_create(VALUE self) {
 
 VALUE MSP::World::rbf_destroy(VALUE self, VALUE v_world) {
     const NewtonWorld* world = c_value_to_world(v_world);
+    c_wait_for_update(world);
     NewtonDestroy(world);
     return Qnil;
 }
@@ -533,6 +1303,7 @@ VALUE MSP::World::rbf_get_cur_threads_count(VALUE self, VALUE v_world) {
 
 VALUE MSP::World::rbf_destroy_all_bodies(VALUE self, VALUE v_world) {
     const NewtonWorld* world = c_value_to_world(v_world);
+    c_wait_for_update(world);
     int count = NewtonWorldGetBodyCount(world);
     NewtonDestroyAllBodies(world);
     return Util::to_value(count);
@@ -551,14 +1322,9 @@ VALUE MSP::World::rbf_get_constraint_count(VALUE self, VALUE v_world) {
 VALUE MSP::World::rbf_update(VALUE self, VALUE v_world, VALUE v_timestep) {
     const NewtonWorld* world = c_value_to_world(v_world);
     dFloat timestep = Util::clamp_float(Util::value_to_dFloat(v_timestep), MIN_TIMESTEP, MAX_TIMESTEP);
-    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
-    c_clear_touch_events(world);
-    c_update_magnets(world, timestep);
+    c_begin_update(world, timestep);
     NewtonUpdate(world, timestep);
-    c_enable_cccd_bodies(world);
-    c_disconnect_flagged_joints(world);
-    c_process_touch_events(world);
-    world_data->m_time += timestep;
+    c_finish_update(world, timestep);
     return Util::to_value(timestep);
 }
 
@@ -566,16 +1332,27 @@ VALUE MSP::World::rbf_update_async(VALUE self, VALUE v_world, VALUE v_timestep)
     const NewtonWorld* world = c_value_to_world(v_world);
     dFloat timestep = Util::clamp_float(Util::value_to_dFloat(v_timestep), MIN_TIMESTEP, MAX_TIMESTEP);
     WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
-    c_clear_touch_events(world);
-    c_update_magnets(world, timestep);
-    NewtonUpdate(world, timestep);
-    c_enable_cccd_bodies(world);
-    c_disconnect_flagged_joints(world);
-    c_process_touch_events(world);
-    world_data->m_time += timestep;
+    c_begin_update(world, timestep);
+    // The post-step work is deferred until wait_for_update is called.
+    world_data->m_pending_timestep = timestep;
+    world_data->m_update_pending = true;
+    NewtonUpdateAsync(world, timestep);
     return Util::to_value(timestep);
 }
 
+VALUE MSP::World::rbf_wait_for_update(VALUE self, VALUE v_world) {
+    const NewtonWorld* world = c_value_to_world2(v_world);
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    if (!c_wait_for_update(world)) return Qnil;
+    return Util::to_value(world_data->m_pending_timestep);
+}
+
+VALUE MSP::World::rbf_is_update_pending(VALUE self, VALUE v_world) {
+    const NewtonWorld* world = c_value_to_world2(v_world);
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    return Util::to_value(world_data->m_update_pending);
+}
+
 VALUE MSP::World::rbf_get_gravity(VALUE self, VALUE v_world) {
     const NewtonWorld* world = c_value_to_world(v_world);
     WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
@@ -597,7 +1374,7 @@ VALUE MSP::World::rbf_get_bodies(VALUE self, VALUE v_world) {
         VALUE v_address = MSP::Body::c_body_to_value(body);
         if (proc_given) {
             MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body));
-            VALUE v_result = rb_yield_values(2, v_address, body_data->m_user_data);
+            VALUE v_result = rb_yield_values(2, v_address, body_data->m_cold->m_user_data);
             if (v_result != Qnil) rb_ary_push(v_bodies, v_result);
         }
         else
@@ -608,58 +1385,155 @@ VALUE MSP::World::rbf_get_bodies(VALUE self, VALUE v_world) {
 
 VALUE MSP::World::rbf_get_joints(VALUE self, VALUE v_world) {
     const NewtonWorld* world = c_value_to_world(v_world);
-    bool proc_given = (rb_block_given_p() != 0);
-    VALUE v_joints = rb_ary_new();
-    for (std::map<MSP::Joint::JointData*, bool>::iterator it = MSP::Joint::s_valid_joints.begin(); it != MSP::Joint::s_valid_joints.end(); ++it) {
-        if (it->first->m_world == world) {
-            VALUE v_address = MSP::Joint::c_joint_to_value(it->first);
-            if (proc_given) {
-                VALUE v_result = rb_yield_values(2, v_address, it->first->m_user_data);
-                if (v_result != Qnil) rb_ary_push(v_joints, v_result);
-            }
-            else
-                rb_ary_push(v_joints, v_address);
-        }
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    VALUE v_joints = rb_ary_new2(static_cast<long>(world_data->m_joints.size()));
+    for (MSP::Joint::JointData* joint_data = world_data->m_joints.first(); joint_data != nullptr; joint_data = MSP::Joint::WorldJointList::next(joint_data))
+        rb_ary_push(v_joints, MSP::Joint::c_joint_to_value(joint_data));
+    if (rb_block_given_p() == 0)
+        return v_joints;
+    // The block may destroy joints, so each one is looked up by handle again.
+    VALUE v_results = rb_ary_new();
+    long count = RARRAY_LEN(v_joints);
+    for (long i = 0; i < count; ++i) {
+        VALUE v_address = rb_ary_entry(v_joints, i);
+        MSP::Joint::JointData* joint_data = MSP::Joint::s_valid_joints.find(Util::value_to_ull(v_address));
+        if (joint_data == nullptr) continue;
+        VALUE v_result = rb_yield_values(2, v_address, joint_data->m_user_data);
+        if (v_result != Qnil) rb_ary_push(v_results, v_result);
     }
-    return v_joints;
+    return v_results;
 }
 
 VALUE MSP::World::rbf_get_gears(VALUE self, VALUE v_world) {
     const NewtonWorld* world = c_value_to_world(v_world);
-    bool proc_given = (rb_block_given_p() != 0);
-    VALUE v_gears = rb_ary_new();
-    for (std::set<MSP::Gear::GearData*>::iterator it = MSP::Gear::s_valid_gears.begin(); it != MSP::Gear::s_valid_gears.end(); ++it) {
-        MSP::Gear::GearData* gear_data = *it;
-        if (gear_data->m_world == world) {
-            VALUE v_address = MSP::Gear::c_gear_to_value(gear_data);
-            if (proc_given) {
-                VALUE v_result = rb_yield_values(2, v_address, gear_data->m_user_data);
-                if (v_result != Qnil) rb_ary_push(v_gears, v_result);
-            }
-            else
-                rb_ary_push(v_gears, v_address);
-        }
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    VALUE v_gears = rb_ary_new2(static_cast<long>(world_data->m_gears.size()));
+    for (MSP::Gear::GearData* gear_data = world_data->m_gears.first(); gear_data != nullptr; gear_data = MSP::Gear::WorldGearList::next(gear_data))
+        rb_ary_push(v_gears, MSP::Gear::c_gear_to_value(gear_data));
+    if (rb_block_given_p() == 0)
+        return v_gears;
+    // The block may destroy gears, so each one is looked up by handle again.
+    VALUE v_results = rb_ary_new();
+    long count = RARRAY_LEN(v_gears);
+    for (long i = 0; i < count; ++i) {
+        VALUE v_address = rb_ary_entry(v_gears, i);
+        MSP::Gear::GearData* gear_data = MSP::Gear::s_valid_gears.find(Util::value_to_ull(v_address));
+        if (gear_data == nullptr) continue;
+        VALUE v_result = rb_yield_values(2, v_address, gear_data->m_user_data);
+        if (v_result != Qnil) rb_ary_push(v_results, v_result);
     }
-    return v_gears;
+    return v_results;
 }
 
 VALUE MSP::World::rbf_get_bodies_in_aabb(VALUE self, VALUE v_world, VALUE v_min_pt, VALUE v_max_pt) {
     const NewtonWorld* world = c_value_to_world(v_world);
-    std::vector<const NewtonBody*> bodies;
-    NewtonWorldForEachBodyInAABBDo(world, &(Util::value_to_point(v_min_pt))[0], &(Util::value_to_point(v_max_pt))[0], body_iterator, &bodies);
-    bool proc_given = (rb_block_given_p() != 0);
-    VALUE v_bodies = rb_ary_new();
-    for (std::vector<const NewtonBody*>::iterator it = bodies.begin(); it != bodies.end(); ++it) {
-        VALUE v_address = MSP::Body::c_body_to_value(*it);
-        if (proc_given) {
-            MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(*it));
-            VALUE v_result = rb_yield_values(2, v_address, body_data->m_user_data);
-            if (v_result != Qnil) rb_ary_push(v_bodies, v_result);
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    dVector min_pt(Util::value_to_point(v_min_pt));
+    dVector max_pt(Util::value_to_point(v_max_pt));
+    VALUE v_bodies;
+    // A small box is answered faster by the broadphase than by building the
+    // snapshot, so the snapshot is only scanned when it's already up to date.
+    if (world_data->m_snapshot.m_valid) {
+        std::vector<int> indices;
+        c_select_bodies_in_aabb(world_data->m_snapshot, 0, min_pt, max_pt, indices);
+        v_bodies = c_selection_to_value(world_data->m_snapshot, indices);
+    }
+    else {
+        std::vector<const NewtonBody*> bodies;
+        NewtonWorldForEachBodyInAABBDo(world, &min_pt[0], &max_pt[0], body_iterator, &bodies);
+        v_bodies = rb_ary_new2(static_cast<long>(bodies.size()));
+        for (std::vector<const NewtonBody*>::iterator it = bodies.begin(); it != bodies.end(); ++it)
+            rb_ary_push(v_bodies, MSP::Body::c_body_to_value(*it));
+    }
+    return c_yield_bodies(v_bodies);
+}
+
+VALUE MSP::World::rbf_get_bodies_in_sphere(VALUE self, VALUE v_world, VALUE v_center, VALUE v_radius, VALUE v_flags) {
+    const NewtonWorld* world = c_value_to_world(v_world);
+    dVector center(Util::value_to_point(v_center));
+    dFloat radius = Util::value_to_dFloat(v_radius);
+    int flags = Util::value_to_int(v_flags);
+    const BodySnapshot& snapshot = c_get_body_snapshot(world);
+    VALUE v_bodies;
+    {
+        std::vector<int> indices;
+        c_select_bodies_in_sphere(snapshot, flags, center, radius, indices);
+        v_bodies = c_selection_to_value(snapshot, indices);
+    }
+    return c_yield_bodies(v_bodies);
+}
+
+VALUE MSP::World::rbf_get_bodies_in_frustum(VALUE self, VALUE v_world, VALUE v_planes, VALUE v_flags) {
+    const NewtonWorld* world = c_value_to_world(v_world);
+    Check_Type(v_planes, T_ARRAY);
+    unsigned int plane_count = static_cast<unsigned int>(RARRAY_LEN(v_planes));
+    // Validate the planes before any vector is alive, as raising skips its destructor.
+    for (unsigned int i = 0; i < plane_count; ++i) {
+        VALUE v_plane = rb_ary_entry(v_planes, i);
+        Check_Type(v_plane, T_ARRAY);
+        if (RARRAY_LEN(v_plane) != 4)
+            rb_raise(rb_eTypeError, "Expected a plane in the form of [a, b, c, d]!");
+        for (int j = 0; j < 4; ++j)
+            Util::value_to_dFloat(rb_ary_entry(v_plane, j));
+    }
+    int flags = Util::value_to_int(v_flags);
+    const BodySnapshot& snapshot = c_get_body_snapshot(world);
+    VALUE v_bodies;
+    {
+        std::vector<dVector> planes;
+        planes.reserve(plane_count);
+        for (unsigned int i = 0; i < plane_count; ++i) {
+            VALUE v_plane = rb_ary_entry(v_planes, i);
+            planes.push_back(dVector(
+                Util::value_to_dFloat(rb_ary_entry(v_plane, 0)),
+                Util::value_to_dFloat(rb_ary_entry(v_plane, 1)),
+                Util::value_to_dFloat(rb_ary_entry(v_plane, 2)),
+                Util::value_to_dFloat(rb_ary_entry(v_plane, 3))));
         }
-        else
-            rb_ary_push(v_bodies, v_address);
+        std::vector<int> indices;
+        c_select_bodies_in_frustum(snapshot, flags, planes, indices);
+        v_bodies = c_selection_to_value(snapshot, indices);
     }
-    return v_bodies;
+    return c_yield_bodies(v_bodies);
+}
+
+VALUE MSP::World::rbf_select_bodies(VALUE self, VALUE v_world, VALUE v_flags) {
+    const NewtonWorld* world = c_value_to_world(v_world);
+    int flags = Util::value_to_int(v_flags);
+    const BodySnapshot& snapshot = c_get_body_snapshot(world);
+    VALUE v_bodies;
+    {
+        std::vector<int> indices;
+        c_select_bodies(snapshot, flags, indices);
+        v_bodies = c_selection_to_value(snapshot, indices);
+    }
+    return c_yield_bodies(v_bodies);
+}
+
+VALUE MSP::World::rbf_get_body_states(VALUE self, VALUE v_world, VALUE v_flags) {
+    const NewtonWorld* world = c_value_to_world(v_world);
+    int flags = Util::value_to_int(v_flags);
+    const BodySnapshot& snapshot = c_get_body_snapshot(world);
+    std::vector<int> indices;
+    c_select_bodies(snapshot, flags, indices);
+    // Each record is a 64-bit body handle followed by 9 doubles: the minimum
+    // and maximum bounding box points and the position.
+    const size_t record_size = sizeof(unsigned long long) + sizeof(double) * 9;
+    std::vector<char> buffer(indices.size() * record_size);
+    size_t offset = 0;
+    for (std::vector<int>::iterator it = indices.begin(); it != indices.end(); ++it) {
+        const MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(snapshot.m_bodies[*it]));
+        double values[9];
+        for (int j = 0; j < 3; ++j) {
+            values[j] = static_cast<double>(snapshot.m_min[j][*it]);
+            values[j + 3] = static_cast<double>(snapshot.m_max[j][*it]);
+            values[j + 6] = static_cast<double>(snapshot.m_position[j][*it]);
+        }
+        memcpy(&buffer[offset], &body_data->m_handle, sizeof(unsigned long long));
+        memcpy(&buffer[offset + sizeof(unsigned long long)], values, sizeof(values));
+        offset += record_size;
+    }
+    return rb_str_new(buffer.empty() ? nullptr : &buffer[0], static_cast<long>(buffer.size()));
 }
 
 VALUE MSP::World::rbf_get_first_body(VALUE self, VALUE v_world) {
@@ -707,45 +1581,67 @@ VALUE MSP::World::rbf_ray_cast(VALUE self, VALUE v_world, VALUE v_point1, VALUE
     const NewtonWorld* world = c_value_to_world(v_world);
     dVector point1(Util::value_to_point(v_point1));
     dVector point2(Util::value_to_point(v_point2));
-    HitData* hit = new HitData(nullptr, dVector(0.0f), dVector(0.0f));
-    NewtonWorldRayCast(world, &point1[0], &point2[0], ray_filter_callback, reinterpret_cast<void*>(hit), NULL, 0);
-    VALUE v_res;
-    if (hit->m_body != nullptr) {
-        MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(hit->m_body));
-        v_res = rb_ary_new3(4, MSP::Body::c_body_to_value(hit->m_body), body_data->m_user_data, Util::point_to_value(hit->m_point), Util::vector_to_value(hit->m_normal));
-    }
-    else
-        v_res = Qnil;
-    delete hit;
-    return v_res;
+    HitData hit(nullptr, dVector(0.0f), dVector(0.0f));
+    NewtonWorldRayCast(world, &point1[0], &point2[0], ray_filter_callback, reinterpret_cast<void*>(&hit), NULL, 0);
+    if (hit.m_body == nullptr)
+        return Qnil;
+    MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(hit.m_body));
+    return rb_ary_new3(4, MSP::Body::c_body_to_value(hit.m_body), body_data->m_cold->m_user_data, Util::point_to_value(hit.m_point), Util::vector_to_value(hit.m_normal));
 }
 
 VALUE MSP::World::rbf_continuous_ray_cast(VALUE self, VALUE v_world, VALUE v_point1, VALUE v_point2) {
     const NewtonWorld* world = c_value_to_world(v_world);
     dVector point1(Util::value_to_point(v_point1));
     dVector point2(Util::value_to_point(v_point2));
-    RayData* ray_data = new RayData();
+    RayData ray_data;
     bool proc_given = (rb_block_given_p() != 0);
-    NewtonWorldRayCast(world, &point1[0], &point2[0], continuous_ray_filter_callback, reinterpret_cast<void*>(ray_data), NULL, 0);
-    VALUE v_hits = rb_ary_new();
-    for (std::vector<HitData*>::iterator it = ray_data->m_hits.begin(); it != ray_data->m_hits.end(); ++it) {
-        HitData* hit = *it;
-        MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(hit->m_body));
-        VALUE v_address = MSP::Body::c_body_to_value(hit->m_body);
-        VALUE v_point = Util::point_to_value(hit->m_point);
-        VALUE v_normal = Util::vector_to_value(hit->m_normal);
+    NewtonWorldRayCast(world, &point1[0], &point2[0], continuous_ray_filter_callback, reinterpret_cast<void*>(&ray_data), NULL, 0);
+    VALUE v_hits = rb_ary_new2(static_cast<long>(ray_data.m_hits.size()));
+    for (std::vector<HitData>::iterator it = ray_data.m_hits.begin(); it != ray_data.m_hits.end(); ++it) {
+        MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(it->m_body));
+        VALUE v_address = MSP::Body::c_body_to_value(it->m_body);
+        VALUE v_point = Util::point_to_value(it->m_point);
+        VALUE v_normal = Util::vector_to_value(it->m_normal);
         if (proc_given) {
-            VALUE v_result = rb_yield_values(4, v_address, body_data->m_user_data, v_point, v_normal);
+            VALUE v_result = rb_yield_values(4, v_address, body_data->m_cold->m_user_data, v_point, v_normal);
             if (v_result != Qnil) rb_ary_push(v_hits, v_result);
         }
         else
-            rb_ary_push(v_hits, rb_ary_new3(4, v_address, body_data->m_user_data, v_point, v_normal));
-        delete hit;
+            rb_ary_push(v_hits, rb_ary_new3(4, v_address, body_data->m_cold->m_user_data, v_point, v_normal));
     }
-    delete ray_data;
     return v_hits;
 }
 
+VALUE MSP::World::rbf_ray_cast_batch(VALUE self, VALUE v_world, VALUE v_origins, VALUE v_targets, VALUE v_flags) {
+    const NewtonWorld* world = c_value_to_world(v_world);
+    // Rays must not see the world mid-update and the workers must be idle.
+    c_wait_for_update(world);
+    StringValue(v_origins);
+    StringValue(v_targets);
+    const long point_size = static_cast<long>(sizeof(double) * 3);
+    long length = RSTRING_LEN(v_origins);
+    if (length % point_size != 0)
+        rb_raise(rb_eArgError, "Size of packed origins must be a multiple of 3 doubles!");
+    if (RSTRING_LEN(v_targets) != length)
+        rb_raise(rb_eArgError, "Number of targets doesn't match the number of origins!");
+    int flags = Util::value_to_int(v_flags);
+    int count = static_cast<int>(length / point_size);
+    const long record_size = static_cast<long>(sizeof(unsigned long long) + sizeof(double) * 7);
+    // Results are written by the worker threads directly into the string.
+    VALUE v_output = rb_str_new(nullptr, count * record_size);
+    RayBatch batch(RSTRING_PTR(v_origins), RSTRING_PTR(v_targets), RSTRING_PTR(v_output), count, flags);
+    int num_chunks = (count + RAY_BATCH_CHUNK_SIZE - 1) / RAY_BATCH_CHUNK_SIZE;
+    int num_jobs = dMin(NewtonGetThreadsCount(world), num_chunks);
+    if (num_jobs > 1) {
+        for (int i = 0; i < num_jobs; ++i)
+            NewtonDispachThreadJob(world, ray_batch_job, &batch, "ray_batch_job");
+        NewtonSyncThreadJobs(world);
+    }
+    else
+        c_cast_ray_batch(world, batch, 0);
+    return v_output;
+}
+
 VALUE MSP::World::rbf_convex_ray_cast(VALUE self, VALUE v_world, VALUE v_collision, VALUE v_matrix, VALUE v_target) {
     const NewtonWorld* world = c_value_to_world(v_world);
     const NewtonCollision* collision = MSP::Collision::c_value_to_collision(v_collision);
@@ -759,7 +1655,7 @@ VALUE MSP::World::rbf_convex_ray_cast(VALUE self, VALUE v_world, VALUE v_collisi
         return rb_ary_new3(
             5,
             MSP::Body::c_body_to_value(info[0].m_hitBody),
-            body_data->m_user_data,
+            body_data->m_cold->m_user_data,
             Util::point_to_value(dVector(info[0].m_point)),
             Util::vector_to_value(dVector(info[0].m_normal)),
             Util::to_value(info[0].m_penetration));
@@ -787,12 +1683,12 @@ VALUE MSP::World::rbf_continuous_convex_ray_cast(VALUE self, VALUE v_world, VALU
         VALUE v_normal = Util::vector_to_value(hit.m_normal);
         VALUE v_penetration = Util::to_value(hit.m_penetration);
         if (proc_given) {
-            VALUE v_result = rb_yield_values(5, v_address, body_data->m_user_data, v_point, v_normal, v_penetration);
+            VALUE v_result = rb_yield_values(5, v_address, body_data->m_cold->m_user_data, v_point, v_normal, v_penetration);
             if (v_result != Qnil)
                 rb_ary_push(v_hits, v_result);
         }
         else
-            rb_ary_push(v_hits, rb_ary_new3(5, v_address, body_data->m_user_data, v_point, v_normal, v_penetration));
+            rb_ary_push(v_hits, rb_ary_new3(5, v_address, body_data->m_cold->m_user_data, v_point, v_normal, v_penetration));
     }
     return v_hits;
 }
@@ -803,62 +1699,108 @@ VALUE MSP::World::rbf_add_explosion(VALUE self, VALUE v_world, VALUE v_center, V
     dFloat blast_radius = Util::value_to_dFloat(v_blast_radius) * M_METER_TO_INCH;
     dFloat blast_force = Util::value_to_dFloat(v_blast_force) * M_METER_TO_INCH;
     if (blast_radius > M_EPSILON && dAbs(blast_force) > M_EPSILON) {
-        HitData* hit = new HitData(nullptr, dVector(0.0f), dVector(0.0f));
-        dFloat inv_blast_radius = 1.0f / blast_radius;
-        for (const NewtonBody* body = NewtonWorldGetFirstBody(world); body; body = NewtonWorldGetNextBody(world, body)) {
-            MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body));
-            if (body_data->m_dynamic && !body_data->m_bstatic && body_data->m_mass > MSP::Body::MIN_MASS) {
-                dMatrix matrix;
-                dVector centre;
-                NewtonBodyGetMatrix(body, &matrix[0][0]);
-                NewtonBodyGetCentreOfMass(body, &centre[0]);
-                centre = matrix.TransformVector(centre);
-                if (Util::get_vector_magnitude(centre - blast_point) <= blast_radius) {
-                    hit->m_body = nullptr;
-                    NewtonWorldRayCast(world, &blast_point[0], &centre[0], ray_filter_callback, reinterpret_cast<void*>(hit), NULL, 0);
-                    if (hit->m_body == body) {
-                        dVector force(hit->m_point - blast_point);
-                        dFloat dist = Util::get_vector_magnitude(force);
-                        if (dist > M_EPSILON) {
-                            Util::scale_vector(force, (blast_radius - dist) * blast_force * inv_blast_radius / dist);
-                            MSP::Body::c_body_add_force(body_data, force);
-                            dFloat moment = force.DotProduct3(hit->m_normal);
-                            dVector torque((hit->m_point - centre).CrossProduct(hit->m_normal.Scale(-moment)));
-                            MSP::Body::c_body_add_torque(body_data, torque);
-                        }
-                    }
-                }
-            }
-        }
-        delete hit;
+        c_apply_explosion(world, blast_point, blast_radius, blast_force, -1.0f, blast_radius);
+        return Qtrue;
+    }
+    else
+        return Qfalse;
+}
+
+VALUE MSP::World::rbf_add_shockwave(VALUE self, VALUE v_world, VALUE v_center, VALUE v_blast_radius, VALUE v_blast_force, VALUE v_speed) {
+    const NewtonWorld* world = c_value_to_world(v_world);
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    dVector blast_point(Util::value_to_point(v_center));
+    dFloat blast_radius = Util::value_to_dFloat(v_blast_radius) * M_METER_TO_INCH;
+    dFloat blast_force = Util::value_to_dFloat(v_blast_force) * M_METER_TO_INCH;
+    dFloat speed = Util::value_to_dFloat(v_speed) * M_METER_TO_INCH;
+    if (blast_radius > M_EPSILON && dAbs(blast_force) > M_EPSILON && speed > M_EPSILON) {
+        world_data->m_shockwaves.push_back(Shockwave(blast_point, blast_radius, blast_force, speed));
         return Qtrue;
     }
     else
         return Qfalse;
 }
 
+VALUE MSP::World::rbf_get_shockwave_count(VALUE self, VALUE v_world) {
+    const NewtonWorld* world = c_value_to_world(v_world);
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    return Util::to_value(static_cast<int>(world_data->m_shockwaves.size()));
+}
+
+VALUE MSP::World::rbf_add_fluid_volume(VALUE self, VALUE v_world, VALUE v_matrix, VALUE v_bounds, VALUE v_density, VALUE v_linear_viscosity, VALUE v_angular_viscosity, VALUE v_linear_current, VALUE v_angular_current) {
+    const NewtonWorld* world = c_value_to_world(v_world);
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    FluidVolume volume;
+    volume.m_matrix = Util::value_to_matrix(v_matrix);
+    volume.m_bounded = (v_bounds != Qnil);
+    if (volume.m_bounded) {
+        Check_Type(v_bounds, T_ARRAY);
+        if (RARRAY_LEN(v_bounds) != 2)
+            rb_raise(rb_eArgError, "Expected bounds as an array of two points!");
+        dVector a(Util::value_to_point(rb_ary_entry(v_bounds, 0)));
+        dVector b(Util::value_to_point(rb_ary_entry(v_bounds, 1)));
+        volume.m_min = dVector(dMin(a.m_x, b.m_x), dMin(a.m_y, b.m_y), dMin(a.m_z, b.m_z));
+        volume.m_max = dVector(dMax(a.m_x, b.m_x), dMax(a.m_y, b.m_y), dMax(a.m_z, b.m_z));
+    }
+    volume.m_density = Util::max_float(Util::value_to_dFloat(v_density), MSP::Body::MIN_DENSITY);
+    volume.m_linear_viscosity = Util::clamp_float(Util::value_to_dFloat(v_linear_viscosity), 0.0f, 1.0f);
+    volume.m_angular_viscosity = Util::clamp_float(Util::value_to_dFloat(v_angular_viscosity), 0.0f, 1.0f);
+    volume.m_local_linear_current = Util::value_to_vector(v_linear_current);
+    volume.m_local_angular_current = Util::value_to_vector(v_angular_current);
+    c_update_fluid_volume(volume);
+    // Volumes are read by the force callbacks of a pending update.
+    c_wait_for_update(world);
+    volume.m_id = world_data->m_next_fluid_volume_id++;
+    world_data->m_fluid_volumes.push_back(volume);
+    return Util::to_value(volume.m_id);
+}
+
+VALUE MSP::World::rbf_set_fluid_volume_matrix(VALUE self, VALUE v_world, VALUE v_id, VALUE v_matrix) {
+    const NewtonWorld* world = c_value_to_world(v_world);
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    int id = Util::value_to_int(v_id);
+    dMatrix matrix(Util::value_to_matrix(v_matrix));
+    c_wait_for_update(world);
+    std::vector<FluidVolume>::iterator it = c_find_fluid_volume(world_data, id);
+    if (it == world_data->m_fluid_volumes.end())
+        return Qfalse;
+    it->m_matrix = matrix;
+    c_update_fluid_volume(*it);
+    return Qtrue;
+}
+
+VALUE MSP::World::rbf_remove_fluid_volume(VALUE self, VALUE v_world, VALUE v_id) {
+    const NewtonWorld* world = c_value_to_world(v_world);
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    int id = Util::value_to_int(v_id);
+    c_wait_for_update(world);
+    std::vector<FluidVolume>::iterator it = c_find_fluid_volume(world_data, id);
+    if (it == world_data->m_fluid_volumes.end())
+        return Qfalse;
+    world_data->m_fluid_volumes.erase(it);
+    return Qtrue;
+}
+
+VALUE MSP::World::rbf_clear_fluid_volumes(VALUE self, VALUE v_world) {
+    const NewtonWorld* world = c_value_to_world(v_world);
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    c_wait_for_update(world);
+    world_data->m_fluid_volumes.clear();
+    return Qnil;
+}
+
+VALUE MSP::World::rbf_get_fluid_volume_count(VALUE self, VALUE v_world) {
+    const NewtonWorld* world = c_value_to_world(v_world);
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    return Util::to_value(static_cast<int>(world_data->m_fluid_volumes.size()));
+}
+
 VALUE MSP::World::rbf_get_aabb(VALUE self, VALUE v_world) {
     const NewtonWorld* world = c_value_to_world(v_world);
     if (NewtonWorldGetBodyCount(world) == 0)
         return Qnil;
-    dVector world_min;
-    dVector world_max;
-    bool first_time = true;
-    for (const NewtonBody* body = NewtonWorldGetFirstBody(world); body; body = NewtonWorldGetNextBody(world, body)) {
-        if(first_time) {
-            NewtonBodyGetAABB(body, &world_min[0], &world_max[0]);
-            first_time = false;
-            continue;
-        }
-        dVector min;
-        dVector max;
-        NewtonBodyGetAABB(body, &min[0], &max[0]);
-        for (int i = 0; i < 3; ++i) {
-            if (min[i] < world_min[i]) world_min[i] = min[i];
-            if (max[i] > world_max[i]) world_max[i] = max[i];
-        }
-    }
-    return rb_ary_new3(2, Util::point_to_value(world_min), Util::point_to_value(world_max));
+    const BodySnapshot& snapshot = c_get_body_snapshot(world);
+    return rb_ary_new3(2, Util::point_to_value(snapshot.m_min_pt), Util::point_to_value(snapshot.m_max_pt));
 }
 
 VALUE MSP::World::rbf_get_destructor_proc(VALUE self, VALUE v_world) {
@@ -896,10 +1838,10 @@ VALUE MSP::World::rbf_get_touch_data_at(VALUE self, VALUE v_world, VALUE v_index
     unsigned int index = Util::value_to_uint(v_index);
     if (index >= world_data->m_touch_data.size())
         return Qnil;
-    const BodyTouchData* touch_data = world_data->m_touch_data[index];
+    const BodyTouchData* touch_data = &world_data->m_touch_data[index];
     VALUE v_touch_data = rb_ary_new2(6);
-    rb_ary_store(v_touch_data, 0, MSP::Body::c_body_to_value(touch_data->m_body0));
-    rb_ary_store(v_touch_data, 1, MSP::Body::c_body_to_value(touch_data->m_body1));
+    rb_ary_store(v_touch_data, 0, rb_ull2inum(touch_data->m_body0));
+    rb_ary_store(v_touch_data, 1, rb_ull2inum(touch_data->m_body1));
     rb_ary_store(v_touch_data, 2, Util::point_to_value(touch_data->m_point));
     rb_ary_store(v_touch_data, 3, Util::vector_to_value(touch_data->m_normal));
     rb_ary_store(v_touch_data, 4, Util::vector_to_value(touch_data->m_force.Scale(M_INCH_TO_METER)));
@@ -919,10 +1861,10 @@ VALUE MSP::World::rbf_get_touching_data_at(VALUE self, VALUE v_world, VALUE v_in
     unsigned int index = Util::value_to_uint(v_index);
     if (index >= world_data->m_touching_data.size())
         return Qnil;
-    const BodyTouchingData* touching_data = world_data->m_touching_data[index];
+    const BodyTouchingData* touching_data = &world_data->m_touching_data[index];
     VALUE v_touching_data = rb_ary_new2(2);
-    rb_ary_store(v_touching_data, 0, MSP::Body::c_body_to_value(touching_data->m_body0));
-    rb_ary_store(v_touching_data, 1, MSP::Body::c_body_to_value(touching_data->m_body1));
+    rb_ary_store(v_touching_data, 0, rb_ull2inum(touching_data->m_body0));
+    rb_ary_store(v_touching_data, 1, rb_ull2inum(touching_data->m_body1));
     return v_touching_data;
 }
 
@@ -937,10 +1879,10 @@ VALUE MSP::World::rbf_get_untouch_data_at(VALUE self, VALUE v_world, VALUE v_ind
     WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
     unsigned int index = Util::value_to_uint(v_index);
     if (index >= world_data->m_untouch_data.size()) return Qnil;
-    const BodyUntouchData* untouch_data = world_data->m_untouch_data[index];
+    const BodyUntouchData* untouch_data = &world_data->m_untouch_data[index];
     VALUE v_untouch_data = rb_ary_new2(2);
-    rb_ary_store(v_untouch_data, 0, MSP::Body::c_body_to_value(untouch_data->m_body0));
-    rb_ary_store(v_untouch_data, 1, MSP::Body::c_body_to_value(untouch_data->m_body1));
+    rb_ary_store(v_untouch_data, 0, rb_ull2inum(untouch_data->m_body0));
+    rb_ary_store(v_untouch_data, 1, rb_ull2inum(untouch_data->m_body1));
     return v_untouch_data;
 }
 
@@ -950,6 +1892,46 @@ VALUE MSP::World::rbf_get_untouch_data_count(VALUE self, VALUE v_world) {
     return Util::to_value( (unsigned int)world_data->m_untouch_data.size() );
 }
 
+VALUE MSP::World::rbf_get_touch_events(VALUE self, VALUE v_world) {
+    const NewtonWorld* world = c_value_to_world(v_world);
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    // Events are packed into flat arrays of body user datas to avoid creating
+    // an array per event. Events involving destroyed bodies are skipped.
+    VALUE v_touch_data = rb_ary_new2(world_data->m_touch_data.size() * 6);
+    for (std::vector<BodyTouchData>::const_iterator it = world_data->m_touch_data.begin(); it != world_data->m_touch_data.end(); ++it) {
+        const NewtonBody* body0 = MSP::Body::s_valid_bodies.find(it->m_body0);
+        const NewtonBody* body1 = MSP::Body::s_valid_bodies.find(it->m_body1);
+        if (body0 == nullptr || body1 == nullptr) continue;
+        rb_ary_push(v_touch_data, reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body0))->m_cold->m_user_data);
+        rb_ary_push(v_touch_data, reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body1))->m_cold->m_user_data);
+        rb_ary_push(v_touch_data, Util::point_to_value(it->m_point));
+        rb_ary_push(v_touch_data, Util::vector_to_value(it->m_normal));
+        rb_ary_push(v_touch_data, Util::vector_to_value(it->m_force.Scale(M_INCH_TO_METER)));
+        rb_ary_push(v_touch_data, Util::to_value(it->m_speed * M_INCH_TO_METER));
+    }
+    VALUE v_touching_data = rb_ary_new2(world_data->m_touching_data.size() * 2);
+    for (std::vector<BodyTouchingData>::const_iterator it = world_data->m_touching_data.begin(); it != world_data->m_touching_data.end(); ++it) {
+        const NewtonBody* body0 = MSP::Body::s_valid_bodies.find(it->m_body0);
+        const NewtonBody* body1 = MSP::Body::s_valid_bodies.find(it->m_body1);
+        if (body0 == nullptr || body1 == nullptr) continue;
+        rb_ary_push(v_touching_data, reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body0))->m_cold->m_user_data);
+        rb_ary_push(v_touching_data, reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body1))->m_cold->m_user_data);
+    }
+    VALUE v_untouch_data = rb_ary_new2(world_data->m_untouch_data.size() * 2);
+    for (std::vector<BodyUntouchData>::const_iterator it = world_data->m_untouch_data.begin(); it != world_data->m_untouch_data.end(); ++it) {
+        const NewtonBody* body0 = MSP::Body::s_valid_bodies.find(it->m_body0);
+        const NewtonBody* body1 = MSP::Body::s_valid_bodies.find(it->m_body1);
+        if (body0 == nullptr || body1 == nullptr) continue;
+        rb_ary_push(v_untouch_data, reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body0))->m_cold->m_user_data);
+        rb_ary_push(v_untouch_data, reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body1))->m_cold->m_user_data);
+    }
+    VALUE v_events = rb_ary_new2(3);
+    rb_ary_store(v_events, 0, v_touch_data);
+    rb_ary_store(v_events, 1, v_touching_data);
+    rb_ary_store(v_events, 2, v_untouch_data);
+    return v_events;
+}
+
 VALUE MSP::World::rbf_get_time(VALUE self, VALUE v_world) {
     const NewtonWorld* world = c_value_to_world(v_world);
     WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
@@ -1007,6 +1989,115 @@ VALUE MSP::World::rbf_clear_matrix_change_record(VALUE self, VALUE v_world) {
     return Qnil;
 }
 
+VALUE MSP::World::rbf_get_changed_body_matrices(VALUE self, VALUE v_world) {
+    const NewtonWorld* world = c_value_to_world(v_world);
+    bool proc_given = (rb_block_given_p() != 0);
+    dMatrix matrix;
+    if (proc_given) {
+        // The block may destroy bodies, which would break the body iteration,
+        // so changed bodies are collected by handle before yielding. They are
+        // kept in a Ruby array, as breaking out of the block skips C++
+        // destructors.
+        VALUE v_changes = rb_ary_new();
+        for (const NewtonBody* body = NewtonWorldGetFirstBody(world); body; body = NewtonWorldGetNextBody(world, body)) {
+            MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body));
+            if (!body_data->m_matrix_changed) continue;
+            body_data->m_matrix_changed = false;
+            MSP::Body::c_body_get_matrix(body, matrix);
+            rb_ary_push(v_changes, MSP::Body::c_body_to_value(body));
+            rb_ary_push(v_changes, Util::matrix_to_value(matrix));
+        }
+        long count = RARRAY_LEN(v_changes);
+        for (long i = 0; i < count; i += 2) {
+            const NewtonBody* body = MSP::Body::s_valid_bodies.find(Util::value_to_ull(rb_ary_entry(v_changes, i)));
+            if (body == nullptr) continue;
+            MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body));
+            rb_yield_values(2, body_data->m_cold->m_user_data, rb_ary_entry(v_changes, i + 1));
+        }
+        return Qnil;
+    }
+    // Each record is a 64-bit body handle followed by 16 doubles of the matrix.
+    const long record_size = static_cast<long>(sizeof(unsigned long long) + sizeof(double) * 16);
+    std::vector<char> buffer;
+    for (const NewtonBody* body = NewtonWorldGetFirstBody(world); body; body = NewtonWorldGetNextBody(world, body)) {
+        MSP::Body::BodyData* body_data = reinterpret_cast<MSP::Body::BodyData*>(NewtonBodyGetUserData(body));
+        if (!body_data->m_matrix_changed) continue;
+        body_data->m_matrix_changed = false;
+        MSP::Body::c_body_get_matrix(body, matrix);
+        size_t offset = buffer.size();
+        buffer.resize(offset + record_size);
+        memcpy(&buffer[offset], &body_data->m_handle, sizeof(unsigned long long));
+        double values[16];
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                values[i * 4 + j] = static_cast<double>(matrix[i][j]);
+        memcpy(&buffer[offset + sizeof(unsigned long long)], values, sizeof(values));
+    }
+    return rb_str_new(buffer.empty() ? nullptr : &buffer[0], static_cast<long>(buffer.size()));
+}
+
+VALUE MSP::World::rbf_get_magnet_theta(VALUE self, VALUE v_world) {
+    const NewtonWorld* world = c_value_to_world(v_world);
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    return Util::to_value(world_data->m_magnet_theta);
+}
+
+VALUE MSP::World::rbf_set_magnet_theta(VALUE self, VALUE v_world, VALUE v_theta) {
+    const NewtonWorld* world = c_value_to_world(v_world);
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    world_data->m_magnet_theta = Util::clamp_float(Util::value_to_dFloat(v_theta), 0.0f, 2.0f);
+    return Qnil;
+}
+
+VALUE MSP::World::rbf_get_controller_inputs(VALUE self, VALUE v_world) {
+    const NewtonWorld* world = c_value_to_world(v_world);
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    if (world_data->m_controller_inputs_dirty)
+        MSP::Joint::c_prune_controller_inputs(world);
+    VALUE v_inputs = rb_ary_new2(static_cast<long>(world_data->m_controller_inputs.size()));
+    for (std::vector<std::string>::const_iterator it = world_data->m_controller_inputs.begin(); it != world_data->m_controller_inputs.end(); ++it)
+        rb_ary_push(v_inputs, Util::to_value(it->c_str(), static_cast<unsigned int>(it->length())));
+    return v_inputs;
+}
+
+VALUE MSP::World::rbf_update_controllers(VALUE self, VALUE v_world, VALUE v_values) {
+    const NewtonWorld* world = c_value_to_world(v_world);
+    WorldData* world_data = reinterpret_cast<WorldData*>(NewtonWorldGetUserData(world));
+    Check_Type(v_values, T_ARRAY);
+    c_wait_for_update(world);
+    unsigned int count = static_cast<unsigned int>(RARRAY_LEN(v_values));
+    if (count > world_data->m_controller_inputs.size())
+        count = static_cast<unsigned int>(world_data->m_controller_inputs.size());
+    world_data->m_controller_values.resize(world_data->m_controller_inputs.size());
+    for (unsigned int i = 0; i < world_data->m_controller_values.size(); ++i) {
+        MSP::Joint::ControllerValue& value = world_data->m_controller_values[i];
+        VALUE v_value = i < count ? rb_ary_entry(v_values, i) : Qnil;
+        value.m_number = 0.0;
+        if (FIXNUM_P(v_value) || TYPE(v_value) == T_BIGNUM) {
+            value.m_number = rb_num2dbl(v_value);
+            value.m_type = MSP::Joint::CONTROLLER_INT;
+        }
+        else if (TYPE(v_value) == T_FLOAT) {
+            value.m_number = rb_num2dbl(v_value);
+            value.m_type = MSP::Joint::CONTROLLER_FLOAT;
+        }
+#ifndef RUBY_VERSION18
+        else if (TYPE(v_value) == T_RATIONAL) {
+            value.m_number = rb_num2dbl(v_value);
+            value.m_type = MSP::Joint::CONTROLLER_RATIONAL;
+        }
+#endif
+        else if (v_value == Qtrue || v_value == Qfalse) {
+            value.m_number = v_value == Qtrue ? 1.0 : 0.0;
+            value.m_type = MSP::Joint::CONTROLLER_BOOL;
+        }
+        else
+            value.m_type = MSP::Joint::CONTROLLER_NIL;
+    }
+    MSP::Joint::c_update_controllers(world);
+    return Qnil;
+}
+
 
 /*
  ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1017,6 +2108,9 @@ VALUE MSP::World::rbf_clear_matrix_change_record(VALUE self, VALUE v_world) {
 void MSP::World::init_ruby(VALUE mNewton) {
     VALUE mWorld = rb_define_module_under(mNewton, "World");
 
+    rb_define_const(mWorld, "QUERY_AWAKE", Util::to_value(QUERY_AWAKE));
+    rb_define_const(mWorld, "QUERY_DYNAMIC", Util::to_value(QUERY_DYNAMIC));
+
     rb_define_module_function(mWorld, "is_valid?", VALUEFUNC(MSP::World::rbf_is_valid), 1);
     rb_define_module_function(mWorld, "create", VALUEFUNC(MSP::World::rbf_create), 0);
     rb_define_module_function(mWorld, "destroy", VALUEFUNC(MSP::World::rbf_destroy), 1);
@@ -1029,12 +2123,18 @@ void MSP::World::init_ruby(VALUE mNewton) {
     rb_define_module_function(mWorld, "get_constraint_count", VALUEFUNC(MSP::World::rbf_get_constraint_count), 1);
     rb_define_module_function(mWorld, "update", VALUEFUNC(MSP::World::rbf_update), 2);
     rb_define_module_function(mWorld, "update_async", VALUEFUNC(MSP::World::rbf_update_async), 2);
+    rb_define_module_function(mWorld, "wait_for_update", VALUEFUNC(MSP::World::rbf_wait_for_update), 1);
+    rb_define_module_function(mWorld, "is_update_pending?", VALUEFUNC(MSP::World::rbf_is_update_pending), 1);
     rb_define_module_function(mWorld, "get_gravity", VALUEFUNC(MSP::World::rbf_get_gravity), 1);
     rb_define_module_function(mWorld, "set_gravity", VALUEFUNC(MSP::World::rbf_set_gravity), 2);
     rb_define_module_function(mWorld, "get_bodies", VALUEFUNC(MSP::World::rbf_get_bodies), 1);
     rb_define_module_function(mWorld, "get_joints", VALUEFUNC(MSP::World::rbf_get_joints), 1);
     rb_define_module_function(mWorld, "get_gears", VALUEFUNC(MSP::World::rbf_get_gears), 1);
     rb_define_module_function(mWorld, "get_bodies_in_aabb", VALUEFUNC(MSP::World::rbf_get_bodies_in_aabb), 3);
+    rb_define_module_function(mWorld, "get_bodies_in_sphere", VALUEFUNC(MSP::World::rbf_get_bodies_in_sphere), 4);
+    rb_define_module_function(mWorld, "get_bodies_in_frustum", VALUEFUNC(MSP::World::rbf_get_bodies_in_frustum), 3);
+    rb_define_module_function(mWorld, "select_bodies", VALUEFUNC(MSP::World::rbf_select_bodies), 2);
+    rb_define_module_function(mWorld, "get_body_states", VALUEFUNC(MSP::World::rbf_get_body_states), 2);
     rb_define_module_function(mWorld, "get_first_body", VALUEFUNC(MSP::World::rbf_get_first_body), 1);
     rb_define_module_function(mWorld, "get_next_body", VALUEFUNC(MSP::World::rbf_get_next_body), 2);
     rb_define_module_function(mWorld, "get_solver_model", VALUEFUNC(MSP::World::rbf_get_solver_model), 1);
@@ -1043,9 +2143,17 @@ void MSP::World::init_ruby(VALUE mNewton) {
     rb_define_module_function(mWorld, "set_material_thickness", VALUEFUNC(MSP::World::rbf_set_material_thickness), 2);
     rb_define_module_function(mWorld, "ray_cast", VALUEFUNC(MSP::World::rbf_ray_cast), 3);
     rb_define_module_function(mWorld, "continuous_ray_cast", VALUEFUNC(MSP::World::rbf_continuous_ray_cast), 3);
+    rb_define_module_function(mWorld, "ray_cast_batch", VALUEFUNC(MSP::World::rbf_ray_cast_batch), 4);
     rb_define_module_function(mWorld, "convex_ray_cast", VALUEFUNC(MSP::World::rbf_convex_ray_cast), 4);
     rb_define_module_function(mWorld, "continuous_convex_ray_cast", VALUEFUNC(MSP::World::rbf_continuous_convex_ray_cast), 5);
     rb_define_module_function(mWorld, "add_explosion", VALUEFUNC(MSP::World::rbf_add_explosion), 4);
+    rb_define_module_function(mWorld, "add_shockwave", VALUEFUNC(MSP::World::rbf_add_shockwave), 5);
+    rb_define_module_function(mWorld, "get_shockwave_count", VALUEFUNC(MSP::World::rbf_get_shockwave_count), 1);
+    rb_define_module_function(mWorld, "add_fluid_volume", VALUEFUNC(MSP::World::rbf_add_fluid_volume), 8);
+    rb_define_module_function(mWorld, "set_fluid_volume_matrix", VALUEFUNC(MSP::World::rbf_set_fluid_volume_matrix), 3);
+    rb_define_module_function(mWorld, "remove_fluid_volume", VALUEFUNC(MSP::World::rbf_remove_fluid_volume), 2);
+    rb_define_module_function(mWorld, "clear_fluid_volumes", VALUEFUNC(MSP::World::rbf_clear_fluid_volumes), 1);
+    rb_define_module_function(mWorld, "get_fluid_volume_count", VALUEFUNC(MSP::World::rbf_get_fluid_volume_count), 1);
     rb_define_module_function(mWorld, "get_aabb", VALUEFUNC(MSP::World::rbf_get_aabb), 1);
     rb_define_module_function(mWorld, "get_destructor_proc", VALUEFUNC(MSP::World::rbf_get_destructor_proc), 1);
     rb_define_module_function(mWorld, "set_destructor_proc", VALUEFUNC(MSP::World::rbf_set_destructor_proc), 2);
@@ -1057,6 +2165,7 @@ void MSP::World::init_ruby(VALUE mNewton) {
     rb_define_module_function(mWorld, "get_touching_data_count", VALUEFUNC(MSP::World::rbf_get_touching_data_count), 1);
     rb_define_module_function(mWorld, "get_untouch_data_at", VALUEFUNC(MSP::World::rbf_get_untouch_data_at), 2);
     rb_define_module_function(mWorld, "get_untouch_data_count", VALUEFUNC(MSP::World::rbf_get_untouch_data_count), 1);
+    rb_define_module_function(mWorld, "get_touch_events", VALUEFUNC(MSP::World::rbf_get_touch_events), 1);
     rb_define_module_function(mWorld, "get_time", VALUEFUNC(MSP::World::rbf_get_time), 1);
     rb_define_module_function(mWorld, "serialize_to_file", VALUEFUNC(MSP::World::rbf_serialize_to_file), 2);
     rb_define_module_function(mWorld, "get_contact_merge_tolerance", VALUEFUNC(MSP::World::rbf_get_contact_merge_tolerance), 1);
@@ -1064,4 +2173,9 @@ void MSP::World::init_ruby(VALUE mNewton) {
     rb_define_module_function(mWorld, "get_default_material_id", VALUEFUNC(MSP::World::rbf_get_default_material_id), 1);
     rb_define_module_function(mWorld, "draw_collision_wireframe", VALUEFUNC(MSP::World::rbf_draw_collision_wireframe), 7);
     rb_define_module_function(mWorld, "clear_matrix_change_record", VALUEFUNC(MSP::World::rbf_clear_matrix_change_record), 1);
+    rb_define_module_function(mWorld, "get_changed_body_matrices", VALUEFUNC(MSP::World::rbf_get_changed_body_matrices), 1);
+    rb_define_module_function(mWorld, "get_magnet_theta", VALUEFUNC(MSP::World::rbf_get_magnet_theta), 1);
+    rb_define_module_function(mWorld, "set_magnet_theta", VALUEFUNC(MSP::World::rbf_set_magnet_theta), 2);
+    rb_define_module_function(mWorld, "get_controller_inputs", VALUEFUNC(MSP::World::rbf_get_controller_inputs), 1);
+    rb_define_module_function(mWorld, "update_controllers", VALUEFUNC(MSP::World::rbf_update_controllers), 2);
 }
@@ -10,6 +10,9 @@
 #define MSP_WORLD_H
 
 #include "msp.h"
+#include "msp_body.h"
+#include "msp_joint.h"
+#include "msp_gear.h"
 
 class MSP::World {
 public:
@@ -22,16 +25,27 @@ public:
     static const dFloat MIN_TOUCH_DISTANCE;
     static const dFloat MIN_TIMESTEP;
     static const dFloat MAX_TIMESTEP;
+    static const dFloat DEFAULT_MAGNET_THETA;
+    static const int MAGNET_LEAF_SIZE;
+    static const int MAGNET_MAX_DEPTH;
+    static const int MIN_SENSOR_PAIRS_PER_JOB;
+    static const int SNAPSHOT_CHUNK_SIZE;
+    static const int QUERY_AWAKE;
+    static const int QUERY_DYNAMIC;
+    static const int RAY_BATCH_CHUNK_SIZE;
+    static const int EXPLOSION_SAMPLE_COUNT;
 
     // Structures
+    // Touch events refer to bodies by handle, as bodies may be destroyed
+    // before the events are read.
     struct BodyTouchData {
-        const NewtonBody* m_body0;
-        const NewtonBody* m_body1;
+        unsigned long long m_body0;
+        unsigned long long m_body1;
         dVector m_point;
         dVector m_normal;
         dVector m_force;
         dFloat m_speed;
-        BodyTouchData(const NewtonBody* body0, const NewtonBody* body1, const dVector& point, const dVector& normal, const dVector& force, dFloat speed) :
+        BodyTouchData(unsigned long long body0, unsigned long long body1, const dVector& point, const dVector& normal, const dVector& force, dFloat speed) :
             m_body0(body0),
             m_body1(body1),
             m_point(point),
@@ -43,9 +57,9 @@ public:
     };
 
     struct BodyTouchingData {
-        const NewtonBody* m_body0;
-        const NewtonBody* m_body1;
-        BodyTouchingData(const NewtonBody* body0, const NewtonBody* body1) :
+        unsigned long long m_body0;
+        unsigned long long m_body1;
+        BodyTouchingData(unsigned long long body0, unsigned long long body1) :
             m_body0(body0),
             m_body1(body1)
         {
@@ -53,15 +67,22 @@ public:
     };
 
     struct BodyUntouchData {
-        const NewtonBody* m_body0;
-        const NewtonBody* m_body1;
-        BodyUntouchData(const NewtonBody* body0, const NewtonBody* body1) :
+        unsigned long long m_body0;
+        unsigned long long m_body1;
+        BodyUntouchData(unsigned long long body0, unsigned long long body1) :
             m_body0(body0),
             m_body1(body1)
         {
         }
     };
 
+    struct ThreadBuffer {
+        std::vector<BodyTouchData> m_touch_data;
+        std::vector<BodyTouchingData> m_touching_data;
+        std::vector<const NewtonJoint*> m_joints_to_disconnect;
+        std::vector<const NewtonBody*> m_cccd_bodies;
+    };
+
     struct DrawData {
         VALUE m_view;
         VALUE m_bb;
@@ -84,8 +105,215 @@ public:
         }
     };
 
+    struct MagnetBody {
+        const NewtonBody* m_body;
+        dVector m_com;
+        dVector m_force;
+        bool m_force_state;
+        MagnetBody(const NewtonBody* body, const dVector& com) :
+            m_body(body),
+            m_com(com),
+            m_force(0.0f),
+            m_force_state(false)
+        {
+        }
+    };
+
+    struct MagnetNode {
+        dVector m_center;
+        dFloat m_half_size;
+        int m_begin;
+        int m_end;
+        int m_children[8];
+        dFloat m_strength;
+        dVector m_strength_center;
+        bool m_uniform;
+        dVector m_force;
+        bool m_force_state;
+        MagnetNode(const dVector& center, dFloat half_size, int begin, int end) :
+            m_center(center),
+            m_half_size(half_size),
+            m_begin(begin),
+            m_end(end),
+            m_strength(0.0f),
+            m_strength_center(0.0f),
+            m_uniform(true),
+            m_force(0.0f),
+            m_force_state(false)
+        {
+            for (int i = 0; i < 8; ++i)
+                m_children[i] = -1;
+        }
+    };
+
+    struct SensorPair {
+        const NewtonBody* m_body0;
+        const NewtonBody* m_body1;
+        dVector m_point;
+        dVector m_normal;
+        bool m_touching;
+        SensorPair(const NewtonBody* body0, const NewtonBody* body1) :
+            m_body0(body0),
+            m_body1(body1),
+            m_point(0.0f),
+            m_normal(0.0f),
+            m_touching(false)
+        {
+        }
+    };
+
+    struct SensorQuery {
+        const NewtonBody* m_body;
+        std::vector<SensorPair>* m_pairs;
+        SensorQuery(const NewtonBody* body, std::vector<SensorPair>* pairs) :
+            m_body(body),
+            m_pairs(pairs)
+        {
+        }
+    };
+
+    // Bounds, positions and states of all bodies, captured once per step and
+    // stored as separate arrays, so that body queries can scan them in bulk.
+    // The snapshot is invalidated by updates and by creating, destroying or
+    // moving bodies between updates.
+    struct BodySnapshot {
+        std::vector<const NewtonBody*> m_bodies;
+        std::vector<dFloat> m_min[3];
+        std::vector<dFloat> m_max[3];
+        std::vector<dFloat> m_position[3];
+        std::vector<char> m_awake;
+        std::vector<char> m_dynamic;
+        std::vector<dVector> m_chunk_min;
+        std::vector<dVector> m_chunk_max;
+        dVector m_min_pt;
+        dVector m_max_pt;
+        int m_chunk_index;
+        bool m_valid;
+        BodySnapshot() :
+            m_min_pt(0.0f),
+            m_max_pt(0.0f),
+            m_chunk_index(0),
+            m_valid(false)
+        {
+        }
+    };
+
     struct RayData {
-        std::vector<HitData*> m_hits;
+        std::vector<HitData> m_hits;
+    };
+
+    // Rays cast by ray_cast_batch. Origins and targets are packed doubles,
+    // three per point, and each ray writes one record to the output buffer.
+    struct RayBatch {
+        const char* m_origins;
+        const char* m_targets;
+        char* m_output;
+        int m_count;
+        int m_flags;
+        int m_chunk_index;
+        RayBatch(const char* origins, const char* targets, char* output, int count, int flags) :
+            m_origins(origins),
+            m_targets(targets),
+            m_output(output),
+            m_count(count),
+            m_flags(flags),
+            m_chunk_index(0)
+        {
+        }
+    };
+
+    struct RayBatchHit {
+        const NewtonBody* m_body;
+        dFloat m_param;
+        dVector m_point;
+        dVector m_normal;
+        int m_flags;
+        RayBatchHit(int flags) :
+            m_body(nullptr),
+            m_param(1.0f),
+            m_point(0.0f),
+            m_normal(0.0f),
+            m_flags(flags)
+        {
+        }
+    };
+
+    // A blast whose front expands from the center by a given speed, affecting
+    // bodies as it passes them. Instant explosions are applied right away.
+    struct Shockwave {
+        dVector m_center;
+        dFloat m_radius;
+        dFloat m_force;
+        dFloat m_speed;
+        dFloat m_front;
+        Shockwave(const dVector& center, dFloat radius, dFloat force, dFloat speed) :
+            m_center(center),
+            m_radius(radius),
+            m_force(force),
+            m_speed(speed),
+            // Below zero, so that bodies at the center are reached too.
+            m_front(-1.0f)
+        {
+        }
+    };
+
+    // A region of fluid that floats bodies. An unbounded volume fills the
+    // half-space below the XY plane of its matrix. A bounded volume fills a
+    // box in the local space of its matrix, whose top is the surface.
+    // Currents are given in the local space of the matrix, so that they turn
+    // with the volume, and are kept in global space for the force callbacks.
+    struct FluidVolume {
+        int m_id;
+        dMatrix m_matrix;
+        dVector m_min;
+        dVector m_max;
+        bool m_bounded;
+        dVector m_plane;
+        dVector m_aabb_min;
+        dVector m_aabb_max;
+        dFloat m_density;
+        dFloat m_linear_viscosity;
+        dFloat m_angular_viscosity;
+        dVector m_local_linear_current;
+        dVector m_local_angular_current;
+        dVector m_linear_current;
+        dVector m_angular_current;
+    };
+
+    struct ExplosionRay {
+        int m_body_index;
+        dVector m_target;
+        RayBatchHit m_hit;
+        ExplosionRay(int body_index, const dVector& target) :
+            m_body_index(body_index),
+            m_target(target),
+            m_hit(0)
+        {
+        }
+    };
+
+    struct ExplosionCast {
+        dVector m_center;
+        std::vector<ExplosionRay>* m_rays;
+        int m_ray_index;
+        ExplosionCast(const dVector& center, std::vector<ExplosionRay>* rays) :
+            m_center(center),
+            m_rays(rays),
+            m_ray_index(0)
+        {
+        }
+    };
+
+    // A collision built once and shared by instancing. The key holds all
+    // inputs of the shape, so that hash collisions are told apart.
+    struct CachedShape {
+        std::vector<char> m_key;
+        const NewtonCollision* m_collision;
+        CachedShape(const std::vector<char>& key, const NewtonCollision* collision) :
+            m_key(key),
+            m_collision(collision)
+        {
+        }
     };
 
     struct WorldData {
@@ -100,14 +328,46 @@ public:
         VALUE m_joint_user_datas;
         VALUE m_gear_user_datas;
         std::map<VALUE, const NewtonBody*> m_group_to_body_map;
-        std::vector<BodyTouchData*> m_touch_data;
-        std::vector<BodyTouchingData*> m_touching_data;
-        std::vector<BodyUntouchData*> m_untouch_data;
+        std::vector<BodyTouchData> m_touch_data;
+        std::vector<BodyTouchingData> m_touching_data;
+        std::vector<BodyUntouchData> m_untouch_data;
         std::vector<const NewtonJoint*> m_joints_to_disconnect;
         double m_time;
         int m_material_id;
         std::vector<const NewtonBody*> m_temp_cccd_bodies;
+        std::vector<ThreadBuffer> m_thread_buffers;
         NewtonWorldConvexCastReturnInfo m_hit_buffer[MSP_MAX_RAY_HITS];
+        bool m_update_pending;
+        dFloat m_pending_timestep;
+        dFloat m_magnet_theta;
+        std::vector<MagnetBody> m_magnet_bodies;
+        std::vector<int> m_magnetic_indices;
+        std::vector<int> m_range_magnet_indices;
+        std::vector<int> m_field_magnet_indices;
+        std::vector<std::pair<long long, int>> m_magnet_grid;
+        std::vector<MagnetNode> m_magnet_nodes;
+        std::vector<int> m_magnet_temp;
+        std::vector<int> m_magnet_stack;
+        std::vector<SensorPair> m_sensor_pairs;
+        std::vector<const NewtonBody*> m_touchers_to_erase;
+        int m_sensor_pair_index;
+        BodySnapshot m_snapshot;
+        std::vector<Shockwave> m_shockwaves;
+        std::vector<const NewtonBody*> m_explosion_bodies;
+        std::vector<ExplosionRay> m_explosion_rays;
+        std::multimap<unsigned long long, CachedShape> m_shape_cache;
+        std::vector<FluidVolume> m_fluid_volumes;
+        int m_next_fluid_volume_id;
+        ObjectPool<MSP::Body::BodyData> m_body_pool;
+        std::vector<std::string> m_controller_inputs;
+        std::vector<MSP::Joint::ControllerValue> m_controller_values;
+        std::vector<MSP::Joint::ControllerValue> m_controller_stack;
+        // Set when a program is released, so that inputs no longer referenced
+        // are pruned before Ruby samples them again.
+        bool m_controller_inputs_dirty;
+        MSP::Joint::WorldJointList m_joints;
+        MSP::Gear::WorldGearList m_gears;
+        unsigned long long m_handle;
         WorldData(int material_id) :
             m_max_threads(1),
             m_solver_model(DEFAULT_SOLVER_MODEL),
@@ -120,7 +380,14 @@ public:
             m_joint_user_datas(rb_hash_new()),
             m_gear_user_datas(rb_hash_new()),
             m_time(0.0),
-            m_material_id(material_id)
+            m_material_id(material_id),
+            m_update_pending(false),
+            m_pending_timestep(0.0f),
+            m_magnet_theta(DEFAULT_MAGNET_THETA),
+            m_sensor_pair_index(0),
+            m_next_fluid_volume_id(1),
+            m_controller_inputs_dirty(false),
+            m_handle(0)
         {
             rb_gc_register_address(&m_user_info);
             rb_ary_store(m_user_info, 0, Qnil); // world destructor proc
@@ -146,7 +413,7 @@ public:
     };
 
     // Variables
-    static std::map<const NewtonWorld*, WorldData*> valid_worlds;
+    static HandleTable<const NewtonWorld*> valid_worlds;
 
     // Callback Functions
     static void destructor_callback(const NewtonWorld* const world);
@@ -156,21 +423,56 @@ public:
     static unsigned ray_prefilter_callback_continuous(const NewtonBody* const body, const NewtonCollision* const collision, void* const user_data);
     static dFloat ray_filter_callback(const NewtonBody* const body, const NewtonCollision* const shape_hit, const dFloat* const hit_contact, const dFloat* const hit_normal, dLong collision_id, void* const user_data, dFloat intersect_param);
     static dFloat continuous_ray_filter_callback(const NewtonBody* const body, const NewtonCollision* const shape_hit, const dFloat* const hit_contact, const dFloat* const hit_normal, dLong collision_id, void* const user_data, dFloat intersect_param);
+    static unsigned ray_batch_prefilter_callback(const NewtonBody* const body, const NewtonCollision* const collision, void* const user_data);
+    static dFloat ray_batch_filter_callback(const NewtonBody* const body, const NewtonCollision* const shape_hit, const dFloat* const hit_contact, const dFloat* const hit_normal, dLong collision_id, void* const user_data, dFloat intersect_param);
+    static void ray_batch_job(NewtonWorld* const world, void* const user_data, int thread_index);
     static int body_iterator(const NewtonBody* const body, void* const user_data);
+    static int explosion_iterator(const NewtonBody* const body, void* const user_data);
+    static void explosion_job(NewtonWorld* const world, void* const user_data, int thread_index);
+    static int sensor_iterator(const NewtonBody* const body, void* const user_data);
+    static void sensor_collide_job(NewtonWorld* const world, void* const user_data, int thread_index);
+    static void snapshot_job(NewtonWorld* const world, void* const user_data, int thread_index);
     static void collision_copy_constructor_callback(const NewtonWorld* const world, NewtonCollision* const collision, const NewtonCollision* const source_collision);
     static void collision_destructor_callback(const NewtonWorld* const world, const NewtonCollision* const collision);
     static void draw_collision_iterator(void* const user_data, int vertex_count, const dFloat* const face_array, int face_id);
 
     // Helper Functions
-    static bool c_is_world_valid(const NewtonWorld* address);
+    static bool c_is_world_valid(unsigned long long handle);
     static VALUE c_world_to_value(const NewtonWorld* world);
     static const NewtonWorld* c_value_to_world(VALUE v_world);
+    static const NewtonWorld* c_value_to_world2(VALUE v_world);
     static void c_update_magnets(const NewtonWorld* world, dFloat timestep);
+    static void c_apply_range_magnets(WorldData* world_data);
+    static int c_build_magnet_node(WorldData* world_data, int begin, int end, const dVector& center, dFloat half_size, int depth);
+    static void c_apply_field_magnets(WorldData* world_data);
     static void c_process_touch_events(const NewtonWorld* world);
+    static void c_collide_sensor_pairs(const NewtonWorld* world, int thread_index);
     static void c_clear_touch_events(const NewtonWorld* world);
     static void c_clear_matrix_change_record(const NewtonWorld* world);
+    static void c_merge_thread_buffers(const NewtonWorld* world);
     static void c_disconnect_flagged_joints(const NewtonWorld* world);
     static void c_enable_cccd_bodies(const NewtonWorld* world);
+    static void c_begin_update(const NewtonWorld* world, dFloat timestep);
+    static void c_finish_update(const NewtonWorld* world, dFloat timestep);
+    static bool c_wait_for_update(const NewtonWorld* world);
+    static void c_invalidate_body_snapshot(const NewtonWorld* world);
+    static const BodySnapshot& c_get_body_snapshot(const NewtonWorld* world);
+    static void c_fill_snapshot_chunks(BodySnapshot& snapshot);
+    static dFloat c_reduce_min(const dFloat* values, int count);
+    static dFloat c_reduce_max(const dFloat* values, int count);
+    static bool c_snapshot_body_passes(const BodySnapshot& snapshot, int index, int flags);
+    static void c_select_bodies(const BodySnapshot& snapshot, int flags, std::vector<int>& indices_out);
+    static void c_select_bodies_in_aabb(const BodySnapshot& snapshot, int flags, const dVector& min_pt, const dVector& max_pt, std::vector<int>& indices_out);
+    static void c_select_bodies_in_sphere(const BodySnapshot& snapshot, int flags, const dVector& center, dFloat radius, std::vector<int>& indices_out);
+    static void c_select_bodies_in_frustum(const BodySnapshot& snapshot, int flags, const std::vector<dVector>& planes, std::vector<int>& indices_out);
+    static VALUE c_selection_to_value(const BodySnapshot& snapshot, const std::vector<int>& indices);
+    static VALUE c_yield_bodies(VALUE v_bodies);
+    static void c_cast_ray_batch(const NewtonWorld* world, RayBatch& batch, int thread_index);
+    static void c_apply_explosion(const NewtonWorld* world, const dVector& center, dFloat blast_radius, dFloat blast_force, dFloat inner_radius, dFloat outer_radius);
+    static void c_cast_explosion_rays(const NewtonWorld* world, ExplosionCast& cast, int thread_index);
+    static void c_update_shockwaves(const NewtonWorld* world, dFloat timestep);
+    static void c_update_fluid_volume(FluidVolume& volume);
+    static std::vector<FluidVolume>::iterator c_find_fluid_volume(WorldData* world_data, int id);
 
     // Ruby Functions
     static VALUE rbf_is_valid(VALUE self, VALUE v_world);
@@ -185,12 +487,18 @@ public:
     static VALUE rbf_get_constraint_count(VALUE self, VALUE v_world);
     static VALUE rbf_update(VALUE self, VALUE v_world, VALUE v_timestep);
     static VALUE rbf_update_async(VALUE self, VALUE v_world, VALUE v_timestep);
+    static VALUE rbf_wait_for_update(VALUE self, VALUE v_world);
+    static VALUE rbf_is_update_pending(VALUE self, VALUE v_world);
     static VALUE rbf_get_gravity(VALUE self, VALUE v_world);
     static VALUE rbf_set_gravity(VALUE self, VALUE v_world, VALUE v_gravity);
     static VALUE rbf_get_bodies(VALUE self, VALUE v_world);
     static VALUE rbf_get_joints(VALUE self, VALUE v_world);
     static VALUE rbf_get_gears(VALUE self, VALUE v_world);
     static VALUE rbf_get_bodies_in_aabb(VALUE self, VALUE v_world, VALUE v_min_pt, VALUE v_max_pt);
+    static VALUE rbf_get_bodies_in_sphere(VALUE self, VALUE v_world, VALUE v_center, VALUE v_radius, VALUE v_flags);
+    static VALUE rbf_get_bodies_in_frustum(VALUE self, VALUE v_world, VALUE v_planes, VALUE v_flags);
+    static VALUE rbf_select_bodies(VALUE self, VALUE v_world, VALUE v_flags);
+    static VALUE rbf_get_body_states(VALUE self, VALUE v_world, VALUE v_flags);
     static VALUE rbf_get_first_body(VALUE self, VALUE v_world);
     static VALUE rbf_get_next_body(VALUE self, VALUE v_world, VALUE v_body);
     static VALUE rbf_get_solver_model(VALUE self, VALUE v_world);
@@ -199,9 +507,17 @@ public:
     static VALUE rbf_set_material_thickness(VALUE self, VALUE v_world, VALUE v_material_thinkness);
     static VALUE rbf_ray_cast(VALUE self, VALUE v_world, VALUE v_point1, VALUE v_point2);
     static VALUE rbf_continuous_ray_cast(VALUE self, VALUE v_world, VALUE v_point1, VALUE v_point2);
+    static VALUE rbf_ray_cast_batch(VALUE self, VALUE v_world, VALUE v_origins, VALUE v_targets, VALUE v_flags);
     static VALUE rbf_convex_ray_cast(VALUE self, VALUE v_world, VALUE v_collision, VALUE v_matrix, VALUE v_target);
     static VALUE rbf_continuous_convex_ray_cast(VALUE self, VALUE v_world, VALUE v_collision, VALUE v_matrix, VALUE v_target, VALUE v_max_hits);
     static VALUE rbf_add_explosion(VALUE self, VALUE v_world, VALUE v_center, VALUE v_blast_radius, VALUE v_blast_force);
+    static VALUE rbf_add_shockwave(VALUE self, VALUE v_world, VALUE v_center, VALUE v_blast_radius, VALUE v_blast_force, VALUE v_speed);
+    static VALUE rbf_get_shockwave_count(VALUE self, VALUE v_world);
+    static VALUE rbf_add_fluid_volume(VALUE self, VALUE v_world, VALUE v_matrix, VALUE v_bounds, VALUE v_density, VALUE v_linear_viscosity, VALUE v_angular_viscosity, VALUE v_linear_current, VALUE v_angular_current);
+    static VALUE rbf_set_fluid_volume_matrix(VALUE self, VALUE v_world, VALUE v_id, VALUE v_matrix);
+    static VALUE rbf_remove_fluid_volume(VALUE self, VALUE v_world, VALUE v_id);
+    static VALUE rbf_clear_fluid_volumes(VALUE self, VALUE v_world);
+    static VALUE rbf_get_fluid_volume_count(VALUE self, VALUE v_world);
     static VALUE rbf_get_aabb(VALUE self, VALUE v_world);
     static VALUE rbf_get_destructor_proc(VALUE self, VALUE v_world);
     static VALUE rbf_set_destructor_proc(VALUE self, VALUE v_world, VALUE v_proc);
@@ -213,6 +529,7 @@ public:
     static VALUE rbf_get_touching_data_count(VALUE self, VALUE v_world);
     static VALUE rbf_get_untouch_data_at(VALUE self, VALUE v_world, VALUE v_index);
     static VALUE rbf_get_untouch_data_count(VALUE self, VALUE v_world);
+    static VALUE rbf_get_touch_events(VALUE self, VALUE v_world);
     static VALUE rbf_get_time(VALUE self, VALUE v_world);
     static VALUE rbf_serialize_to_file(VALUE self, VALUE v_world, VALUE v_full_path);
     static VALUE rbf_get_contact_merge_tolerance(VALUE self, VALUE v_world);
@@ -220,6 +537,11 @@ public:
     static VALUE rbf_get_default_material_id(VALUE self, VALUE v_world);
     static VALUE rbf_draw_collision_wireframe(VALUE self, VALUE v_world, VALUE v_view, VALUE v_bb, VALUE v_sleep_color, VALUE v_active_color, VALUE v_line_width, VALUE v_line_stipple);
     static VALUE rbf_clear_matrix_change_record(VALUE self, VALUE v_world);
+    static VALUE rbf_get_changed_body_matrices(VALUE self, VALUE v_world);
+    static VALUE rbf_get_magnet_theta(VALUE self, VALUE v_world);
+    static VALUE rbf_set_magnet_theta(VALUE self, VALUE v_world, VALUE v_theta);
+    static VALUE rbf_get_controller_inputs(VALUE self, VALUE v_world);
+    static VALUE rbf_update_controllers(VALUE self, VALUE v_world, VALUE v_values);
 
     // Main
     static void init_ruby(VALUE mNewton);
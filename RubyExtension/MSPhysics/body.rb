@@ -120,6 +120,63 @@ module MSPhysics
         MSPhysics::Newton.get_all_bodies() { |ptr, data| data.is_a?(MSPhysics::Body) ? data : nil }
       end
 
+      # Create many bodies that share one collision shape. This is much faster
+      # than creating each body separately, as the collision, its volume, and
+      # the body mass are computed only once.
+      # @note All entities are expected to be instances of the same definition.
+      #   The collision shape is generated from the first entity and is then
+      #   placed at the transformation of each entity.
+      # @param [World] world
+      # @param [Array<Sketchup::Group, Sketchup::ComponentInstance>] entities
+      # @param [Integer] shape_id Shape ID. See {MSPhysics::SHAPE_NAMES}
+      # @param [Geom::Transformation, nil] offset_tra A local transform to apply
+      #   to the collision.
+      # @param [Integer] type_id Body type: 0 -> dynamic; 1 -> kinematic.
+      # @return [Array<Body>] The created bodies, in the order of entities.
+      # @raise [TypeError] if the specified world is invalid.
+      # @raise [TypeError] if at least one of the entities is invalid.
+      # @raise [TypeError] if the specified collision shape is invalid.
+      def create_many(world, entities, shape_id, offset_tra = nil, type_id = 0)
+        MSPhysics::World.validate(world)
+        entities.each { |entity| MSPhysics::Collision.validate_entity(entity) }
+        return [] if entities.empty?
+        collision = MSPhysics::Collision.create(world, entities[0], shape_id, offset_tra)
+        begin
+          matrices = entities.map { |entity| entity.transformation }
+          addresses = MSPhysics::Newton::Body.create_many(world.address, collision, matrices, type_id, world.default_material_id, entities)
+        ensure
+          MSPhysics::Newton::Collision.destroy(collision)
+        end
+        bodies = []
+        addresses.each_with_index { |address, i|
+          adjust_null_body(address, entities[i]) if shape_id == 0
+          bodies << self.new(address, entities[i])
+        }
+        bodies
+      end
+
+      # Set centre of mass and volume of a body with a null collision from the
+      # bounding box of its entity.
+      # @api private
+      # @param [Integer] address
+      # @param [Sketchup::Group, Sketchup::ComponentInstance] entity
+      # @return [void]
+      def adjust_null_body(address, entity)
+        bb = AMS::Group.get_bounding_box_from_faces(entity, true, nil, &MSPhysics::Collision::ENTITY_VALIDATION_PROC)
+        scale = AMS::Geometry.get_matrix_scale(entity.transformation)
+        c = bb.center
+        c.x *= scale.x
+        c.y *= scale.y
+        c.z *= scale.z
+        MSPhysics::Newton::Body.set_centre_of_mass(address, c)
+        if bb.width.to_f < MSPhysics::EPSILON || bb.height.to_f < MSPhysics::EPSILON || bb.depth.to_f < MSPhysics::EPSILON
+          MSPhysics::Newton::Body.set_volume(address, 1.0)
+        else
+          v = bb.width * bb.height * bb.depth * 0.0254**3
+          MSPhysics::Newton::Body.set_volume(address, v)
+        end
+      end
+
     end # class << self
 
     # @overload initialize(world, entity, shape_id, offset_tra, type_id)
@@ -147,6 +204,12 @@ module MSPhysics
     #   @param [Integer] type_id Body type: 0 -> dynamic; 1 -> kinematic.
     #   @raise [TypeError] if the specified body is invalid.
     #   @raise [TypeError] if the specified transformation matrix is not acceptable.
+    # @overload initialize(address, entity)
+    #   Wrap a body created by {Body.create_many}.
+    #   @api private
+    #   @param [Integer] address A body address.
+    #   @param [Sketchup::Group, Sketchup::ComponentInstance] entity The
+    #     entity associated with the body.
     def initialize(*args)
       if args.size == 5
         MSPhysics::World.validate(args[0])
@@ -154,21 +217,7 @@ module MSPhysics
         @group = args[1]
         collision = MSPhysics::Collision.create(args[0], @group, args[2], args[3])
         @address = MSPhysics::Newton::Body.create(args[0].address, collision, @group.transformation, args[4], args[0].default_material_id, @group)
-        if args[2] == 0
-          bb = AMS::Group.get_bounding_box_from_faces(@group, true, nil, &MSPhysics::Collision::ENTITY_VALIDATION_PROC)
-          scale = AMS::Geometry.get_matrix_scale(@group.transformation)
-          c = bb.center
-          c.x *= scale.x
-          c.y *= scale.y
-          c.z *= scale.z
-          MSPhysics::Newton::Body.set_centre_of_mass(@address, c)
-          if bb.width.to_f < MSPhysics::EPSILON || bb.height.to_f < MSPhysics::EPSILON || bb.depth.to_f < MSPhysics::EPSILON
-            MSPhysics::Newton::Body.set_volume(@address, 1.0)
-          else
-            v = bb.width * bb.height * bb.depth * 0.0254**3
-            MSPhysics::Newton::Body.set_volume(@address, v)
-          end
-        end
+        Body.adjust_null_body(@address, @group) if args[2] == 0
         MSPhysics::Newton::Collision.destroy(collision)
       elsif args.size == 4
         # Create a clone of an existing body.
@@ -188,8 +237,12 @@ module MSPhysics
         if MSPhysics::Replay.record_enabled? && @group.is_a?(Sketchup::Group)
           MSPhysics::Replay.preset_definition(@group, definition)
         end
+      elsif args.size == 2
+        # Wrap a body created by Body.create_many.
+        @address = args[0]
+        @group = args[1]
       else
-        raise(ArgumentError, "Wrong number of arguments! Expected 4..5 arguments but got #{args.size}.", caller)
+        raise(ArgumentError, "Wrong number of arguments! Expected 2, 4, or 5 arguments but got #{args.size}.", caller)
       end
       MSPhysics::Newton::Body.set_user_data(@address, self)
       @context = MSPhysics::BodyContext.new(self)
@@ -1084,18 +1137,23 @@ module MSPhysics
     # Get all contact points on the body.
     # @param [Boolean] inc_non_collidable Whether to included contacts from
     #   non-collidable bodies.
-    # @return [Array<Geom::Point3d>]
-    def contact_points(inc_non_collidable)
-      MSPhysics::Newton::Body.get_contact_points(@address, inc_non_collidable)
+    # @param [Boolean] packed Whether to return the points as a binary String
+    #   of native doubles, three per point, to be unpacked with 'D*'.
+    # @return [Array<Geom::Point3d>, String]
+    def contact_points(inc_non_collidable, packed = false)
+      MSPhysics::Newton::Body.get_contact_points(@address, inc_non_collidable, packed)
     end
 
     # @!endgroup
 
     # Get collision faces of the body.
-    # @return [Array<Array<Geom::Point3d>>] An array of faces. Each face
-    #   represents an array of points. Points are coordinated in global space.
-    def collision_faces
-      MSPhysics::Newton::Body.get_collision_faces(@address)
+    # @param [Boolean] packed Whether to return each face as a binary String of
+    #   native doubles, three per point, to be unpacked with 'D*'.
+    # @return [Array<Array<Geom::Point3d>>, Array<String>] An array of faces.
+    #   Each face represents an array of points. Points are coordinated in
+    #   global space.
+    def collision_faces(packed = false)
+      MSPhysics::Newton::Body.get_collision_faces(@address, packed)
     end
 
     # Get collision faces of the body.
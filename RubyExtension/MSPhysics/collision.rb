@@ -24,6 +24,23 @@ module MSPhysics::Collision
       @mesh_cache.clear
     end
 
+    # Get the directory in which built convex hulls and static meshes are
+    # saved between simulations.
+    # @return [String, nil] A directory path or nil if disk cache is disabled.
+    def disk_cache_path
+      MSPhysics::Newton::Collision.get_disk_cache_path
+    end
+
+    # Set the directory in which built convex hulls and static meshes are
+    # saved between simulations. Shapes are keyed on their geometry, so
+    # restarting a simulation loads them instead of rebuilding them.
+    # @param [String, nil] path An existing, writable directory or nil to
+    #   disable disk cache.
+    # @return [void]
+    def disk_cache_path=(path)
+      MSPhysics::Newton::Collision.set_disk_cache_path(path ? path.to_s : nil)
+    end
+
     # Verify that entity is valid for collision generation.
     # @api private
     # @param [Sketchup::Group, Sketchup::ComponentInstance] entity
@@ -405,6 +422,37 @@ module MSPhysics::Collision
       collision
     end
 
+    # Create a compound collision from an approximate convex decomposition of
+    # the entity's faces. Unlike {create_compound2}, a concave mesh doesn't
+    # have to be split into convex groups by hand.
+    # @param [World] world
+    # @param [Sketchup::Group, Sketchup::ComponentInstance] entity
+    # @param [Numeric] max_concavity Maximum concavity of a cluster, relative
+    #   to the size of the mesh.
+    # @param [Integer] max_hull_count Maximum number of convex hulls.
+    # @yield A block, called with the progress of the decomposition.
+    # @yieldparam [Numeric] progress A value from 0.0 to 1.0.
+    # @yieldreturn [Boolean] false to cancel the decomposition.
+    # @return [Integer, nil] Collision address or nil if decomposition was
+    #   cancelled.
+    # @raise [TypeError] if entity has no faces.
+    def create_convex_decomposition(world, entity, max_concavity = 0.01, max_hull_count = 256, &progress)
+      MSPhysics::World.validate(world)
+      validate_entity(entity)
+      tra = entity.transformation
+      s = AMS::Geometry.get_matrix_scale(tra)
+      flipped = AMS::Geometry.is_matrix_flipped?(tra)
+      s.x *= -1 if flipped
+      stra = Geom::Transformation.new([s.x,0,0,0, 0,s.y,0,0, 0,0,s.z,0, 0,0,0,1])
+      mesh = AMS::Group.get_triangular_mesh(entity, true, stra, &ENTITY_VALIDATION_PROC)
+      if mesh.count_polygons == 0
+        raise(TypeError, "Entity #{entity} doesn't have any faces. At least one face is required for an entity to be decomposed!", caller)
+      end
+      points = mesh.points
+      polygons = mesh.polygons.map { |polygon| polygon.map { |i| points[i.abs - 1] } }
+      MSPhysics::Newton::Collision.create_compound_from_cd(world.address, polygons, max_concavity.to_f, 0.2, max_hull_count.to_i, 100, 1.0e-4, 0, progress)
+    end
+
     # Create a static tree/scene collision.
     # @param [World] world
     # @param [Sketchup::Group, Sketchup::ComponentInstance] entity
@@ -454,11 +502,11 @@ module MSPhysics::Collision
       if mesh.count_polygons == 0
         raise(TypeError, "Entity #{entity} doesn't have any faces. At least one face is required for an entity to be a valid tree collision!", caller)
       end
-      triplets = Array.new(mesh.count_polygons)
-      for i in 0...mesh.count_polygons
-        triplets[i] = mesh.polygon_points_at(i+1)
-      end
-      c = MSPhysics::Newton::Collision.create_static_mesh(world.address, triplets, false, 0)
+      vertices = mesh.points.map { |pt| pt.to_a }.flatten.pack('D*')
+      polygons = mesh.polygons
+      indices = polygons.flatten.map { |i| i.abs - 1 }.pack('l*')
+      counts = polygons.map { |polygon| polygon.size }.pack('l*')
+      MSPhysics::Newton::Collision.create_static_mesh_indexed(world.address, vertices, indices, counts, false, 0)
     end
 
   end # class << self
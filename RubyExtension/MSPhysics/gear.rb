@@ -97,6 +97,10 @@ module MSPhysics
     end
 
     # Get gear ratio.
+    # @note The gear keeps <tt>ratio * rate1 + rate2</tt> at zero, where the
+    #   rates are the angular (rad/s) or linear (m/s) velocities of the first
+    #   and second joint. The coupling applies while both joints are
+    #   connected.
     # @return [Numeric]
     def ratio
       MSPhysics::Newton::Gear.get_ratio(@address)
@@ -189,6 +189,7 @@ class MSPhysics::Simulation < MSPhysics::Entity
     @emitters = {}
     @buoyancy_planes = {}
     @controlled_joints = {}
+    @native_controllers = false
     @scene_info = { :active => false, :data1 => nil, :data2 => nil, :transition_time => 0, :elasted_time => 0, :timer => nil }
     @scene_anim_info = { :state => 0, :data => {}, :transition_time => 0, :elasted_time => 0, :ref_time => 0, :tabs_size => nil, :active_tab => nil, :tab_dir => 1 }
     @cc_bodies = []
@@ -2281,7 +2282,8 @@ class MSPhysics::Simulation < MSPhysics::Entity
     return false unless self.class.active?
     # Update world update_rate times
     world_address = @world.address
-    @update_rate.times {
+    controller_values = nil
+    @update_rate.times { |update_index|
       # Get world time
       world_time = @world.time
       # Call onPreUpdate event
@@ -2363,21 +2365,33 @@ class MSPhysics::Simulation < MSPhysics::Entity
         end
         false
       }
-      # Process buoyancy planes
-      MSPhysics::Newton.enable_object_validation(false)
-      @buoyancy_planes.reject! { |entity, data|
-        next true unless entity.valid?
-        tra = entity.transformation
-        body_address = MSPhysics::Newton::World.get_first_body(world_address)
-        while body_address
-          unless MSPhysics::Newton::Body.is_static?(body_address)
-            MSPhysics::Newton::Body.apply_buoyancy(body_address, tra.origin, tra.zaxis, data[:density], data[:linear_viscosity], data[:angular_viscosity], data[:linear_current].transform(tra), data[:angular_current].transform(tra), @update_timestep)
-          end
-          body_address = MSPhysics::Newton::World.get_next_body(world_address, body_address)
+      # Move buoyancy planes; their forces are applied by the world
+      @buoyancy_planes.reject! { |entity, id|
+        unless entity.valid?
+          MSPhysics::Newton::World.remove_fluid_volume(world_address, id)
+          next true
         end
+        MSPhysics::Newton::World.set_fluid_volume_matrix(world_address, id, entity.transformation)
         false
       }
-      MSPhysics::Newton.enable_object_validation(true)
+      # Update joints with compiled controllers, sampling each input once per
+      # frame and evaluating the controllers themselves on every update
+      if @native_controllers
+        if update_index == 0
+          controller_values = MSPhysics::Newton::World.get_controller_inputs(world_address).map { |source|
+            begin
+              @controller_context.eval_script(source, CONTROLLER_NAME, 0)
+            rescue Exception => err
+              err_message = err.message
+              err_message.force_encoding('UTF-8') unless AMS::IS_RUBY_VERSION_18
+              puts "An exception occurred while evaluating joint controller input!\nInput:\n#{source}\n#{err.class}:\n#{err_message}"
+              nil
+            end
+          }
+          return false unless self.class.active?
+        end
+        MSPhysics::Newton::World.update_controllers(world_address, controller_values)
+      end
       # Update controlled joints
       @controlled_joints.reject! { |joint, data|
         next true if !joint.valid?
@@ -2458,46 +2472,50 @@ class MSPhysics::Simulation < MSPhysics::Entity
         end
       end
       # Update newton world
-      @world.update(@update_timestep)
+      if update_index == @update_rate - 1
+        # Move groups to the transformations of the preceding updates while the
+        # last update of this frame is being solved.
+        transitions = []
+        MSPhysics::Newton::World.get_changed_body_matrices(world_address) { |data, tra|
+          transitions << [data.group, tra] if data.is_a?(MSPhysics::Body)
+        }
+        @world.update_async(@update_timestep)
+        begin
+          transitions.each { |group, tra| group.move!(tra) if group.valid? }
+        ensure
+          @world.wait_for_update
+        end
+      else
+        @world.update(@update_timestep)
+      end
       # Call onUpdate event
       call_event(:onUpdate)
       return false unless self.class.active?
+      # Fetch touch events of this update
+      touch_data, touching_data, untouch_data = MSPhysics::Newton::World.get_touch_events(world_address)
       # Call onTouch event
-      count = MSPhysics::Newton::World.get_touch_data_count(world_address)
-      for i in 0...count
-        MSPhysics::Newton.enable_object_validation(false)
-        data = MSPhysics::Newton::World.get_touch_data_at(world_address, i)
-        if MSPhysics::Newton::Body.is_valid?(data[0]) && MSPhysics::Newton::Body.is_valid?(data[1])
-          body1 = MSPhysics::Newton::Body.get_user_data(data[0])
-          body2 = MSPhysics::Newton::Body.get_user_data(data[1])
-        else
-          MSPhysics::Newton.enable_object_validation(true)
-          next
-        end
-        MSPhysics::Newton.enable_object_validation(true)
-        if body1.is_a?(MSPhysics::Body) && body2.is_a?(MSPhysics::Body)
+      i = 0
+      count = touch_data.size
+      while i < count
+        body1 = touch_data[i]
+        body2 = touch_data[i + 1]
+        if body1.is_a?(MSPhysics::Body) && body2.is_a?(MSPhysics::Body) && body1.valid? && body2.valid?
           begin
-            body1.context.call_event(:onTouch, body2, data[2], data[3], data[4], data[5])
+            body1.context.call_event(:onTouch, body2, touch_data[i + 2], touch_data[i + 3], touch_data[i + 4], touch_data[i + 5])
           rescue Exception => err
             abort(err)
           end
           return false unless self.class.active?
         end
+        i += 6
       end
       # Call onTouching event
-      count = MSPhysics::Newton::World.get_touching_data_count(world_address)
-      for i in 0...count
-        MSPhysics::Newton.enable_object_validation(false)
-        data = MSPhysics::Newton::World.get_touching_data_at(world_address, i)
-        if MSPhysics::Newton::Body.is_valid?(data[0]) && MSPhysics::Newton::Body.is_valid?(data[1])
-          body1 = MSPhysics::Newton::Body.get_user_data(data[0])
-          body2 = MSPhysics::Newton::Body.get_user_data(data[1])
-        else
-          MSPhysics::Newton.enable_object_validation(true)
-          next
-        end
-        MSPhysics::Newton.enable_object_validation(true)
-        if body1.is_a?(MSPhysics::Body) && body2.is_a?(MSPhysics::Body)
+      i = 0
+      count = touching_data.size
+      while i < count
+        body1 = touching_data[i]
+        body2 = touching_data[i + 1]
+        if body1.is_a?(MSPhysics::Body) && body2.is_a?(MSPhysics::Body) && body1.valid? && body2.valid?
           begin
             body1.context.call_event(:onTouching, body2)
           rescue Exception => err
@@ -2505,21 +2523,15 @@ class MSPhysics::Simulation < MSPhysics::Entity
           end
           return false unless self.class.active?
         end
+        i += 2
       end
       # Call onUntouch event
-      count = MSPhysics::Newton::World.get_untouch_data_count(world_address)
-      for i in 0...count
-        MSPhysics::Newton.enable_object_validation(false)
-        data = MSPhysics::Newton::World.get_untouch_data_at(world_address, i)
-        if MSPhysics::Newton::Body.is_valid?(data[0]) && MSPhysics::Newton::Body.is_valid?(data[1])
-          body1 = MSPhysics::Newton::Body.get_user_data(data[0])
-          body2 = MSPhysics::Newton::Body.get_user_data(data[1])
-        else
-          MSPhysics::Newton.enable_object_validation(true)
-          next
-        end
-        MSPhysics::Newton.enable_object_validation(true)
-        if body1.is_a?(MSPhysics::Body) && body2.is_a?(MSPhysics::Body)
+      i = 0
+      count = untouch_data.size
+      while i < count
+        body1 = untouch_data[i]
+        body2 = untouch_data[i + 1]
+        if body1.is_a?(MSPhysics::Body) && body2.is_a?(MSPhysics::Body) && body1.valid? && body2.valid?
           begin
             body1.context.call_event(:onUntouch, body2)
           rescue Exception => err
@@ -2527,6 +2539,7 @@ class MSPhysics::Simulation < MSPhysics::Entity
           end
           return false unless self.class.active?
         end
+        i += 2
       end
       # Call onPostUpdate event
       call_event(:onPostUpdate)
@@ -2544,20 +2557,8 @@ class MSPhysics::Simulation < MSPhysics::Entity
         end
       }
     }
-    # Update group transformations
-    MSPhysics::Newton.enable_object_validation(false)
-    body_address = MSPhysics::Newton::World.get_first_body(world_address)
-    while body_address
-      if MSPhysics::Newton::Body.matrix_changed?(body_address)
-        data = MSPhysics::Newton::Body.get_user_data(body_address)
-        if data.is_a?(MSPhysics::Body) && data.group.valid?
-          data.group.move!(data.get_matrix)
-        end
-      end
-      body_address = MSPhysics::Newton::World.get_next_body(world_address, body_address)
-    end
-    MSPhysics::Newton::World.clear_matrix_change_record(world_address)
-    MSPhysics::Newton.enable_object_validation(true)
+    # Group transformations are updated during the last world update; the
+    # changes it made are displayed at the next frame.
     # Update particles
     update_particles
     # Call onTick event
@@ -2598,7 +2599,7 @@ class MSPhysics::Simulation < MSPhysics::Entity
     MSPhysics::Newton.enable_object_validation(false)
     body_address = MSPhysics::Newton::World.get_first_body(world_address)
     while body_address
-      points = MSPhysics::Newton::Body.get_contact_points(body_address, true)
+      points = MSPhysics::Newton::Body.get_contact_points(body_address, true, false)
       if points.size > 0
         view.draw_points(points, @contact_points[:point_size], @contact_points[:point_style], @contact_points[:point_color])
       end
@@ -3121,6 +3122,13 @@ class MSPhysics::Simulation < MSPhysics::Entity
         puts "An exception occurred while creating a joint from #{jinfo[0]}!\n#{err.class}:\n#{err_message}\nTrace:\n#{err_backtrace.join("\n")}"
       end
     }
+    # Compile what controllers we can; the rest are evaluated in Ruby
+    @controlled_joints.reject! { |joint, data|
+      controller, ratio = data.is_a?(Array) ? data : [data, 1]
+      next false unless MSPhysics::Newton::Joint.set_controller_program(joint.address, controller, ratio)
+      @native_controllers = true
+      true
+    }
   end
 
   public
@@ -3233,13 +3241,9 @@ class MSPhysics::Simulation < MSPhysics::Entity
           current_y = default_buoyancy[:current_y] unless current_y.is_a?(Numeric)
           current_z = entity.get_attribute(dict, 'Current Z')
           current_z = default_buoyancy[:current_z] unless current_z.is_a?(Numeric)
-          @buoyancy_planes[entity] = {
-            :density => AMS.clamp(density, 0.001, nil),
-            :linear_viscosity => AMS.clamp(viscosity, 0.0, 1.0),
-            :angular_viscosity => AMS.clamp(viscosity, 0.0, 1.0),
-            :linear_current => Geom::Vector3d.new(current_x, current_y, current_z),
-            :angular_current => Geom::Vector3d.new(0, 0, 0)
-          }
+          viscosity = AMS.clamp(viscosity, 0.0, 1.0)
+          linear_current = Geom::Vector3d.new(current_x, current_y, current_z)
+          @buoyancy_planes[entity] = @world.add_fluid_volume(entity.transformation, nil, AMS.clamp(density, 0.001, nil), viscosity, viscosity, linear_current, [0, 0, 0])
         end
       end
       return unless @world
@@ -3453,6 +3457,7 @@ class MSPhysics::Simulation < MSPhysics::Entity
     @thrusters.clear
     @buoyancy_planes.clear
     @controlled_joints.clear
+    @native_controllers = false
     @cc_bodies.clear
     @particles.clear
     @particle_def2d.clear
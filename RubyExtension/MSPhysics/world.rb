@@ -96,6 +96,31 @@ module MSPhysics
       MSPhysics::Newton::World.update(@address, timestep)
     end
 
+    # Start updating world by a time step in seconds without waiting for the
+    # solver to finish.
+    # @note Accessing the world or any of its bodies, joints, or gears
+    #   finishes the update first, as {#wait_for_update} does.
+    # @param [Numeric] timestep This value is clamped between 1/30.0 and 1/1200.0.
+    # @return [Numeric] The update time step.
+    def update_async(timestep)
+      MSPhysics::Newton::World.update_async(@address, timestep)
+    end
+
+    # Wait for the update started by {#update_async} to finish and process the
+    # post-update events.
+    # @return [Numeric, nil] The update time step or nil if no update was
+    #   pending.
+    def wait_for_update
+      MSPhysics::Newton::World.wait_for_update(@address)
+    end
+
+    # Determine whether an update started by {#update_async} has yet to be
+    # waited for.
+    # @return [Boolean]
+    def update_pending?
+      MSPhysics::Newton::World.is_update_pending?(@address)
+    end
+
     # Get all bodies in the world.
     # @note Bodies that do not have a {Body} instance are not included in the
     #   array.
@@ -128,6 +153,65 @@ module MSPhysics
       MSPhysics::Newton::World.get_bodies_in_aabb(@address, min, max) { |ptr, data| data.is_a?(MSPhysics::Body) ? data : nil }
     end
 
+    # Get all bodies with bounding boxes intersecting a sphere.
+    # @param [Geom::Point3d, Array<Numeric>] center Sphere center.
+    # @param [Numeric] radius Sphere radius in inches.
+    # @param [Boolean] awake_only Whether to skip sleeping bodies.
+    # @param [Boolean] dynamic_only Whether to skip static bodies.
+    # @return [Array<Body>]
+    def bodies_in_sphere(center, radius, awake_only = false, dynamic_only = false)
+      flags = query_flags(awake_only, dynamic_only)
+      MSPhysics::Newton::World.get_bodies_in_sphere(@address, center, radius, flags) { |ptr, data| data.is_a?(MSPhysics::Body) ? data : nil }
+    end
+
+    # Get all bodies with bounding boxes inside or intersecting a convex
+    # volume, such as a camera frustum.
+    # @param [Array<Array<Numeric>>] planes An array of planes in the form of
+    #   [a, b, c, d], with normals pointing into the volume.
+    # @param [Boolean] awake_only Whether to skip sleeping bodies.
+    # @param [Boolean] dynamic_only Whether to skip static bodies.
+    # @return [Array<Body>]
+    def bodies_in_frustum(planes, awake_only = false, dynamic_only = false)
+      flags = query_flags(awake_only, dynamic_only)
+      MSPhysics::Newton::World.get_bodies_in_frustum(@address, planes, flags) { |ptr, data| data.is_a?(MSPhysics::Body) ? data : nil }
+    end
+
+    # Get all awake bodies.
+    # @param [Boolean] dynamic_only Whether to skip static bodies.
+    # @return [Array<Body>]
+    def awake_bodies(dynamic_only = false)
+      flags = query_flags(true, dynamic_only)
+      MSPhysics::Newton::World.select_bodies(@address, flags) { |ptr, data| data.is_a?(MSPhysics::Body) ? data : nil }
+    end
+
+    # Get bounds and positions of bodies in one call.
+    # @param [Boolean] awake_only Whether to skip sleeping bodies.
+    # @param [Boolean] dynamic_only Whether to skip static bodies.
+    # @return [String] A binary string of records, each a 64-bit body handle
+    #   followed by 9 doubles: minimum and maximum bounding box points and the
+    #   position of the body in inches. Unpack with 'QD9'.
+    def body_states(awake_only = false, dynamic_only = false)
+      MSPhysics::Newton::World.get_body_states(@address, query_flags(awake_only, dynamic_only))
+    end
+
+    # Get transformations of bodies that moved since the last call and reset
+    # their change flags.
+    # @overload changed_body_matrices
+    #   @return [String] A binary string of records, each a 64-bit body handle
+    #     followed by 16 doubles of the transformation matrix in inches.
+    #     Unpack with 'QD16'.
+    # @overload changed_body_matrices { |body, tra| ... }
+    #   @yieldparam [Body] body
+    #   @yieldparam [Geom::Transformation] tra
+    #   @note Bodies that do not have a {Body} instance are skipped.
+    #   @return [nil]
+    def changed_body_matrices(&block)
+      return MSPhysics::Newton::World.get_changed_body_matrices(@address) unless block
+      MSPhysics::Newton::World.get_changed_body_matrices(@address) { |data, tra|
+        block.call(data, tra) if data.is_a?(MSPhysics::Body)
+      }
+    end
+
     # Get the number of bodies in the world.
     # @return [Integer]
     def body_count
@@ -200,6 +284,22 @@ module MSPhysics
       MSPhysics::Newton::World.set_material_thickness(@address, thickness.to_f)
     end
 
+    # Get the opening angle used when approximating groups of distant magnets,
+    # whose magnet mode is 2, as a single magnet.
+    # @return [Numeric] A value between 0.0 and 2.0.
+    def magnet_theta
+      MSPhysics::Newton::World.get_magnet_theta(@address)
+    end
+
+    # Set the opening angle used when approximating groups of distant magnets,
+    # whose magnet mode is 2, as a single magnet. A group is approximated if its
+    # size divided by its distance from a magnetic body is less than theta.
+    # @param [Numeric] theta This value is clamped between 0.0 and 2.0. Pass
+    #   0.0 to compute all magnet forces exactly.
+    def magnet_theta=(theta)
+      MSPhysics::Newton::World.set_magnet_theta(@address, theta.to_f)
+    end
+
     # Shoot a ray from point1 to point2 and get the closest intersection.
     # @param [Geom::Point3d, Array<Numeric>] point1 Ray starting point.
     # @param [Geom::Point3d, Array<Numeric>] point2 Ray destination point.
@@ -219,6 +319,27 @@ module MSPhysics
       }
     end
 
+    # Shoot many rays at once and get the closest intersection of each.
+    # @note Rays are distributed among the world threads.
+    # @param [Array<Geom::Point3d>, String] origins Ray starting points or a
+    #   string of packed doubles, three per point.
+    # @param [Array<Geom::Point3d>, String] targets Ray destination points or a
+    #   string of packed doubles, three per point.
+    # @param [Boolean] awake_only Whether to ignore sleeping bodies.
+    # @param [Boolean] dynamic_only Whether to ignore static bodies.
+    # @return [Array<Hit, nil>] A Hit object or nil for each ray.
+    def ray_cast_batch(origins, targets, awake_only = false, dynamic_only = false)
+      origins = origins.map { |pt| pt.to_a }.flatten.pack('D*') unless origins.is_a?(String)
+      targets = targets.map { |pt| pt.to_a }.flatten.pack('D*') unless targets.is_a?(String)
+      data = MSPhysics::Newton::World.ray_cast_batch(@address, origins, targets, query_flags(awake_only, dynamic_only))
+      hits = []
+      data.unpack('QD7' * (data.bytesize / 64)).each_slice(8) { |address, distance, px, py, pz, nx, ny, nz|
+        body = address != 0 ? MSPhysics::Body.body_by_address(address) : nil
+        hits << (body ? Hit.new(body, [px, py, pz], [nx, ny, nz]) : nil)
+      }
+      hits
+    end
+
     # Shoot a convex body from point1 to point2 and get the closest
     # intersection.
     # @note If given body does not have a convex collision, the function will
@@ -272,6 +393,88 @@ module MSPhysics
       MSPhysics::Newton::World.add_explosion(@address, center_point, blast_radius.to_f, blast_force.to_f)
     end
 
+    # Add a shockwave, an explosion whose front expands from the center point
+    # at a particular speed and pushes bodies as it passes them.
+    # @param [Geom::Point3d, Array<Numeric>] center_point A point of impulse.
+    # @param [Numeric] blast_radius A blast radius in meters. The shockwave
+    #   fades out once its front reaches the blast radius.
+    # @param [Numeric] blast_force Maximum blast force in Newtons. The force is
+    #   distributed linearly along the blast radius.
+    # @param [Numeric] speed Speed of the front in meters per second.
+    # @return [Boolean] success
+    def add_shockwave(center_point, blast_radius, blast_force, speed)
+      MSPhysics::Newton::World.add_shockwave(@address, center_point, blast_radius.to_f, blast_force.to_f, speed.to_f)
+    end
+
+    # Get the number of shockwaves still expanding.
+    # @return [Integer]
+    def shockwave_count
+      MSPhysics::Newton::World.get_shockwave_count(@address)
+    end
+
+    # Add a region of fluid that floats all bodies overlapping it. Buoyancy and
+    # viscosity are applied while the world updates, so scripts don't need to
+    # call {Body#apply_buoyancy} on each body.
+    # @param [Geom::Transformation, Array<Numeric>] transformation Fluid
+    #   transformation. Without bounds, the fluid fills the space below the XY
+    #   plane of the transformation.
+    # @param [Array<Geom::Point3d>, nil] bounds Minimum and maximum corners of a
+    #   fluid box in the local space of the transformation, whose top is the
+    #   surface of the fluid. Pass nil for an unbounded fluid.
+    # @param [Numeric] density Fluid density in kilograms per cubic meter
+    #   (kg/m^3).
+    # @param [Numeric] linear_viscosity A value between 0.0 and 1.0.
+    # @param [Numeric] angular_viscosity A value between 0.0 and 1.0.
+    # @param [Geom::Vector3d, Array<Numeric>] linear_current Velocity of the
+    #   fluid in the local space of the transformation. The current follows the
+    #   fluid as it is moved.
+    # @param [Geom::Vector3d, Array<Numeric>] angular_current Omega of the
+    #   fluid in the local space of the transformation.
+    # @return [Integer] Fluid volume ID.
+    def add_fluid_volume(transformation, bounds, density, linear_viscosity, angular_viscosity, linear_current, angular_current)
+      MSPhysics::Newton::World.add_fluid_volume(@address, transformation, bounds, density, linear_viscosity, angular_viscosity, linear_current, angular_current)
+    end
+    # Move a fluid volume. Its currents turn along with it.
+    # Move a fluid volume.
+    # @param [Integer] id
+    # @param [Geom::Transformation, Array<Numeric>] transformation
+    # @return [Boolean] success
+    def set_fluid_volume_transformation(id, transformation)
+      MSPhysics::Newton::World.set_fluid_volume_matrix(@address, id, transformation)
+    end
+
+    # Remove a fluid volume.
+    # @param [Integer] id
+    # @return [Boolean] success
+    def remove_fluid_volume(id)
+      MSPhysics::Newton::World.remove_fluid_volume(@address, id)
+    end
+
+    # Remove all fluid volumes.
+    # @return [nil]
+    def clear_fluid_volumes
+      MSPhysics::Newton::World.clear_fluid_volumes(@address)
+    end
+
+    # Get the number of fluid volumes.
+    # @return [Integer]
+    def fluid_volume_count
+      MSPhysics::Newton::World.get_fluid_volume_count(@address)
+    end
+
+    # Release all collision shapes cached by this world. Shapes created with
+    # identical input are instanced from the cache until it is cleared.
+    # @return [nil]
+    def clear_collision_cache
+      MSPhysics::Newton::Collision.clear_cache(@address)
+    end
+
+    # Get the number of collision shapes cached by this world.
+    # @return [Integer]
+    def collision_cache_size
+      MSPhysics::Newton::Collision.get_cache_size(@address)
+    end
+
     # Get world axes aligned bounding box, a bounding box in which all the
     # bodies are included.
     # @return [Geom::BoundingBox, nil] A bounding box object, containing the
@@ -310,5 +513,14 @@ module MSPhysics
       MSPhysics::Newton::World.set_contact_merge_tolerance(@address, tolerance)
     end
 
+    private
+
+    def query_flags(awake_only, dynamic_only)
+      flags = 0
+      flags |= MSPhysics::Newton::World::QUERY_AWAKE if awake_only
+      flags |= MSPhysics::Newton::World::QUERY_DYNAMIC if dynamic_only
+      flags
+    end
+
   end # class World
 end # module MSPhysics